@@ -0,0 +1,71 @@
+#version 330 core
+in vec3 FragPos;
+in vec3 Velocity;
+in float Temperature;
+in float Density;
+in float DistFromCenter;
+out vec4 FragColor;
+
+uniform float time;
+uniform float blackHoleMass;
+
+vec3 blackbodyColor(float temp) {
+    //Simplified blackbody radiation color
+    temp = clamp(temp, 0.0, 1.0);
+
+    if (temp < 0.25) {
+        return mix(vec3(0.1, 0.0, 0.0), vec3(0.8, 0.1, 0.0), temp * 4.0);
+    } else if (temp < 0.5) {
+        return mix(vec3(0.8, 0.1, 0.0), vec3(1.0, 0.4, 0.0), (temp - 0.25) * 4.0);
+    } else if (temp < 0.75) {
+        return mix(vec3(1.0, 0.4, 0.0), vec3(1.0, 0.8, 0.2), (temp - 0.5) * 4.0);
+    } else {
+        return mix(vec3(1.0, 0.8, 0.2), vec3(0.8, 0.9, 1.0), (temp - 0.75) * 4.0);
+    }
+}
+
+void main() {
+    //Calculate physical properties
+    float radius = DistFromCenter;
+    float eventHorizon = blackHoleMass * 0.5;
+
+    //Temperature decreases with distance (T ∝ r^-3/4 for accretion disk)
+    float physicalTemp = pow(max(radius / eventHorizon, 1.0), -0.75);
+    float combinedTemp = Temperature * physicalTemp;
+
+    //Doppler shift effect based on velocity
+    float velocityMagnitude = length(Velocity);
+    float dopplerShift = 1.0 + velocityMagnitude * 0.1;
+
+    //Get base color from blackbody radiation
+    vec3 baseColor = blackbodyColor(combinedTemp * dopplerShift);
+
+    //Add relativistic beaming effect
+    float beamingFactor = 1.0 + velocityMagnitude * 0.3;
+    baseColor *= beamingFactor;
+
+    //Density affects opacity and brightness
+    float opacity = Density * smoothstep(eventHorizon * 3.0, eventHorizon, radius);
+    opacity *= smoothstep(blackHoleMass * 8.0, blackHoleMass * 2.0, radius);
+
+    //Add turbulence-based flickering
+    float flicker = 0.8 + 0.2 * sin(time * 15.0 + FragPos.x * 50.0 + FragPos.z * 30.0);
+    baseColor *= flicker;
+
+    //Add magnetic field reconnection flares
+    float reconnectionFlare = 0.0;
+    if (sin(time * 2.0 + radius * 5.0) > 0.95) {
+        reconnectionFlare = 0.5 * exp(-(time - floor(time * 2.0) / 2.0) * 10.0);
+    }
+    baseColor += vec3(reconnectionFlare * 2.0, reconnectionFlare, reconnectionFlare * 0.5);
+
+    //Gravitational redshift near black hole
+    float redshift = 1.0 / sqrt(1.0 - eventHorizon / max(radius, eventHorizon * 1.1));
+    baseColor.r *= redshift;
+    baseColor.gb /= sqrt(redshift);
+
+    //Final alpha with atmospheric perspective
+    float finalAlpha = opacity * 0.6 * clamp(combinedTemp * 2.0, 0.1, 1.0);
+
+    FragColor = vec4(baseColor, finalAlpha);
+}
@@ -0,0 +1,82 @@
+#version 330 core
+//PackedParticle: half4 position + speed, snorm16 octahedral direction, unorm8 temperature, density
+//and importance
+layout (location = 0) in vec4 aPosSpeed;
+layout (location = 1) in vec2 aDirection;
+layout (location = 2) in vec3 aTemperatureDensityImportance;
+
+out vec3 FragPos;
+out vec3 Velocity;
+out float Temperature;
+out float Density;
+out float DistFromCenter;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float time;
+uniform float blackHoleMass;
+uniform float lodDistance;  //Unit-mass distance drawn at full density, 0 = no level of detail
+
+//PackedParticle::TEMPERATURE_RANGE and DENSITY_RANGE
+const float TEMPERATURE_RANGE = 2.0;
+const float DENSITY_RANGE = 2.0;
+//ParticleChunks::MIN_FRACTION
+const float MIN_FRACTION = 1.0 / 256.0;
+
+//ParticleChunks::lodFraction
+float lodFraction(float distance) {
+    if (lodDistance <= 0.0 || distance <= lodDistance) {
+        return 1.0;
+    }
+    float ratio = lodDistance / distance;
+    return max(ratio * ratio, MIN_FRACTION);
+}
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    vec3 aPos = aPosSpeed.xyz;
+    vec3 aVelocity = octDecode(aDirection) * aPosSpeed.w;
+    float aTemperature = aTemperatureDensityImportance.x * TEMPERATURE_RANGE;
+    float aDensity = aTemperatureDensityImportance.y * DENSITY_RANGE;
+    float aImportance = floor(aTemperatureDensityImportance.z * 255.0 + 0.5);
+
+    //Particles are stored for unit mass. Orbital motion and inflow are
+    //advanced on the CPU (AccretionDisk::advance), so aPos is already current.
+    vec3 pos = aPos * blackHoleMass;
+    float radius = length(pos.xz);
+
+    //Add turbulence
+    float turbulence = sin(time * 3.0 + radius * 10.0) * 0.02;
+    pos.y += turbulence * aTemperature;
+
+    vec4 viewPos = view * model * vec4(pos, 1.0);
+    gl_Position = projection * viewPos;
+
+    //Dynamic point size based on density and distance
+    float screenDistance = gl_Position.w;
+    float baseSize = 2.0 + aDensity * 3.0 + aTemperature * 2.0;
+    gl_PointSize = baseSize * (50.0 / screenDistance);
+    gl_PointSize = clamp(gl_PointSize, 1.0, 8.0);
+
+    //Level of detail: far away only the lowest importances are drawn, each covering the area
+    //of the particles dropped around it. ParticleChunks has already left out most of the rest.
+    float fraction = lodFraction(length(viewPos.xyz) / blackHoleMass);
+    if (aImportance >= fraction * 256.0) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0); //Outside the clip volume
+    }
+    gl_PointSize = min(gl_PointSize / sqrt(fraction), 64.0);
+
+    FragPos = pos;
+    Velocity = aVelocity;
+    Temperature = aTemperature;
+    Density = aDensity;
+    DistFromCenter = radius;
+}
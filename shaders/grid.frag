@@ -1,5 +1,6 @@
 #version 330 core
 out vec4 FragColor;
+
 void main() {
-    FragColor = vec4(0.5, 0.5, 0.5, 0.7); // translucent blue lines
+    FragColor = vec4(0.3, 0.7, 1.0, 0.8); //Blue grid lines
 }
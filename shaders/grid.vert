@@ -1,6 +1,9 @@
 #version 330 core
-layout(location = 0) in vec3 aPos;
+layout(location = 0) in vec2 aPos; // (x, z) on the flat grid
 uniform mat4 viewProj;
+uniform float mass;
 void main() {
-    gl_Position = viewProj * vec4(aPos, 1.0);
+    // SpacetimeGrid::height: the well deepens and widens with mass
+    float y = -2.0 * mass * exp(-0.3 * dot(aPos, aPos) / mass);
+    gl_Position = viewProj * vec4(aPos.x, y, aPos.y, 1.0);
 }
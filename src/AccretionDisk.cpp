@@ -1,271 +1,240 @@
 #include "AccretionDisk.h"
+#include "PackedParticle.h"
+#include "Profiler.h"
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstddef>
+#include <cstring>
 #include <cmath>
-#include <cstdlib>
-#include <algorithm>
 
-AccretionDisk::AccretionDisk() : VAO(0), VBO(0), EBO(0), totalParticles(0) {
+//Slots of getUniformNames()
+enum DiskUniform {
+    UNIFORM_MODEL,
+    UNIFORM_VIEW,
+    UNIFORM_PROJECTION,
+    UNIFORM_TIME,
+    UNIFORM_MASS,
+    UNIFORM_LOD_DISTANCE
+};
+
+AccretionDisk::AccretionDisk(const DiskLayout& layout, bool persistentMapping)
+    : VAO(0), depthSorting(true), chunking(true), lodDistance(0.0f), generator(layout), totalParticles(0),
+      persistentMapping(persistentMapping), uploadedMass(1.0f) {
 }
 
 AccretionDisk::~AccretionDisk() {
     cleanup();
 }
 
-void AccretionDisk::initialize(float blackHoleMass) {
-    //Clear existing data
-    vertices.clear();
-    indices.clear();
-    
-    //Set random seed for consistent results
-    srand(42);
-    
-    //Generate all disk components
-    generateMainDisk(blackHoleMass);
-    generateSpiralArms(blackHoleMass);
-    generateJets(blackHoleMass);
-    generateTorus(blackHoleMass);
+void AccretionDisk::initialize(float blackHoleMass, TaskScheduler* scheduler) {
+    //Generate all disk components at unit mass. Every length scales linearly with
+    //mass, so the vertex shader scales positions by the blackHoleMass uniform instead.
+    generator.generate(1.0f, scheduler);
+    particles.loadInterleaved(generator.getVertices());
     
     //Calculate total particles
-    totalParticles = DISK_PARTICLES + SPIRAL_ARMS * ARM_PARTICLES + 2 * JET_PARTICLES + TORUS_PARTICLES;
+    totalParticles = generator.getParticleCount();
     
-    //Generate indices for point rendering
-    for (int i = 0; i < totalParticles; ++i) {
-        indices.push_back(i);
+    //Chunks reorder the particles within each component, which keep their ranges
+    if (chunking) {
+        PROFILE_SCOPE("disk chunk build");
+        chunks.build(particles, generator.getLayout(), scheduler);
+        lodDistance = ParticleChunks::lodDistanceFor(totalParticles);
+    } else {
+        chunks.clear();
+        lodDistance = 0.0f;
     }
     
     //Setup OpenGL buffers
     setupBuffers();
+    upload(blackHoleMass, scheduler);
 }
 
-void AccretionDisk::update(float blackHoleMass) {
-    //For now, reinitialize with new mass
-    //Could be optimized to only update affected particles
-    initialize(blackHoleMass);
-}
-
-void AccretionDisk::generateMainDisk(float blackHoleMass) {
-    const float innerRadius = blackHoleMass * 0.6f; //Just outside event horizon
-    const float outerRadius = blackHoleMass * 12.0f; //Extended disk
-    const float diskThickness = blackHoleMass * 0.8f; //Vertical extent
+void AccretionDisk::initialize(const ParticleSnapshot& snapshot, size_t frame, TaskScheduler* scheduler) {
+    //Nothing is generated; the frame's arrays are copied in as they are
+    generator.setLayout(snapshot.getLayout());
+    generator.setSeed(snapshot.getSeed());
+    snapshot.read(frame, particles, scheduler);
+    totalParticles = (int)particles.size();
     
-    //Generate particle-based disk structure
-    for (int i = 0; i < DISK_PARTICLES; ++i) {
-        //Logarithmic radial distribution (more particles closer to center)
-        float randomRadius = ((float)rand() / RAND_MAX);
-        float radius = innerRadius * pow(outerRadius / innerRadius, randomRadius);
-        
-        //Random angle
-        float angle = ((float)rand() / RAND_MAX) * 2.0f * 3.14159f;
-        
-        //Vertical distribution with Gaussian-like profile
-        float verticalRandom = ((float)rand() / RAND_MAX) - 0.5f;
-        float scaleHeight = diskThickness * pow(radius / innerRadius, 0.125f); //Flared disk
-        float y = verticalRandom * scaleHeight * exp(-verticalRandom * verticalRandom * 2.0f);
-        
-        //Position
-        float x = radius * cos(angle);
-        float z = radius * sin(angle);
-        
-        //Add small random perturbations for turbulence
-        x += (((float)rand() / RAND_MAX) - 0.5f) * radius * 0.02f;
-        y += (((float)rand() / RAND_MAX) - 0.5f) * scaleHeight * 0.1f;
-        z += (((float)rand() / RAND_MAX) - 0.5f) * radius * 0.02f;
-        
-        vertices.push_back(x);
-        vertices.push_back(y);
-        vertices.push_back(z);
-        
-        //Velocity (Keplerian + perturbations)
-        float keplerianSpeed = sqrt(blackHoleMass / radius);
-        float vx = -keplerianSpeed * sin(angle);
-        float vy = (((float)rand() / RAND_MAX) - 0.5f) * keplerianSpeed * 0.1f; //Vertical turbulence
-        float vz = keplerianSpeed * cos(angle);
-        
-        //Add radial inflow velocity
-        float inflowSpeed = keplerianSpeed * 0.01f * (innerRadius / radius);
-        vx += inflowSpeed * cos(angle);
-        vz += inflowSpeed * sin(angle);
-        
-        vertices.push_back(vx);
-        vertices.push_back(vy);
-        vertices.push_back(vz);
-        
-        //Temperature (decreases with radius, T ∝ r^-3/4)
-        float temperature = pow(innerRadius / radius, 0.75f);
-        temperature *= (0.8f + 0.4f * ((float)rand() / RAND_MAX)); //Add variability
-        vertices.push_back(temperature);
-        
-        //Density (decreases with radius and height)
-        float density = pow(innerRadius / radius, 1.5f) * exp(-abs(y) / scaleHeight);
-        density *= (0.5f + 1.0f * ((float)rand() / RAND_MAX)); //Add variability
-        vertices.push_back(density);
+    const std::vector<ParticleChunk> saved = snapshot.chunks(frame);
+    if (chunking && !saved.empty()) {
+        chunks.restore(snapshot.getLayout(), saved, snapshot.frame(frame).builtRadius);
+        lodDistance = ParticleChunks::lodDistanceFor(totalParticles);
+    } else if (chunking) {
+        PROFILE_SCOPE("disk chunk build");
+        chunks.build(particles, snapshot.getLayout(), scheduler);
+        lodDistance = ParticleChunks::lodDistanceFor(totalParticles);
+    } else {
+        chunks.clear();
+        lodDistance = 0.0f;
     }
+    
+    setupBuffers();
+    upload(snapshot.frame(frame).blackHoleMass, scheduler);
 }
 
-void AccretionDisk::generateSpiralArms(float blackHoleMass) {
-    const float innerRadius = blackHoleMass * 0.6f;
-    const float outerRadius = blackHoleMass * 12.0f;
-    const float diskThickness = blackHoleMass * 0.8f;
-    
-    for (int arm = 0; arm < SPIRAL_ARMS; ++arm) {
-        float armPhase = (float)arm / (float)SPIRAL_ARMS * 2.0f * 3.14159f;
-        
-        for (int i = 0; i < ARM_PARTICLES; ++i) {
-            float t = (float)i / (float)ARM_PARTICLES;
-            float radius = innerRadius + t * (outerRadius - innerRadius);
-            
-            //Logarithmic spiral pattern
-            float spiralTightness = 0.3f;
-            float angle = armPhase + log(radius / innerRadius) / spiralTightness;
-            
-            //Enhanced density along spiral arms
-            float spiralWidth = radius * 0.1f;
-            float offsetAngle = angle + (((float)rand() / RAND_MAX) - 0.5f) * spiralWidth / radius;
-            
-            float x = radius * cos(offsetAngle);
-            float z = radius * sin(offsetAngle);
-            float y = (((float)rand() / RAND_MAX) - 0.5f) * diskThickness * 0.3f;
-            
-            vertices.push_back(x);
-            vertices.push_back(y);
-            vertices.push_back(z);
-            
-            //Enhanced velocity in spiral arms
-            float keplerianSpeed = sqrt(blackHoleMass / radius) * 1.1f;
-            float vx = -keplerianSpeed * sin(offsetAngle);
-            float vy = (((float)rand() / RAND_MAX) - 0.5f) * keplerianSpeed * 0.15f;
-            float vz = keplerianSpeed * cos(offsetAngle);
-            
-            vertices.push_back(vx);
-            vertices.push_back(vy);
-            vertices.push_back(vz);
-            
-            //Higher temperature in spiral arms
-            float temperature = pow(innerRadius / radius, 0.75f) * 1.3f;
-            vertices.push_back(temperature);
-            
-            //Higher density in spiral arms
-            float density = pow(innerRadius / radius, 1.5f) * 2.0f;
-            vertices.push_back(density);
-        }
+void AccretionDisk::update(float blackHoleMass) {
+    if (VAO == 0) {
+        initialize(blackHoleMass);
     }
+    
+    //Keplerian speeds sqrt(M / r) do not change when r scales with M, but jet speeds go as
+    //sqrt(M). advance() packs every frame for the mass it is given, so the next frame picks the
+    //new mass up; packing here too would cost a second pack and stream segment in that frame.
 }
 
-void AccretionDisk::generateJets(float blackHoleMass) {
-    const float jetHeight = blackHoleMass * 15.0f;
-    const float jetRadius = blackHoleMass * 0.3f;
+void AccretionDisk::advance(float dt, float blackHoleMass, TaskScheduler* scheduler) {
+    if (VAO == 0) {
+        return;
+    }
+    if (dt <= 0.0f) {
+        //Nothing moved, but a new mass still needs its jet speeds written
+        if (blackHoleMass != uploadedMass) {
+            upload(blackHoleMass, scheduler);
+        }
+        return;
+    }
     
-    for (int jet = 0; jet < 2; ++jet) { //Top and bottom jets
-        float jetDirection = (jet == 0) ? 1.0f : -1.0f;
-        
-        for (int i = 0; i < JET_PARTICLES; ++i) {
-            float t = (float)i / (float)JET_PARTICLES;
-            float y = jetDirection * t * jetHeight;
-            
-            //Conical expansion of jet
-            float jetRadiusAtHeight = jetRadius * (1.0f + t * 2.0f);
-            float angle = ((float)rand() / RAND_MAX) * 2.0f * 3.14159f;
-            float radialPos = ((float)rand() / RAND_MAX) * jetRadiusAtHeight;
-            
-            float x = radialPos * cos(angle);
-            float z = radialPos * sin(angle);
-            
-            vertices.push_back(x);
-            vertices.push_back(y);
-            vertices.push_back(z);
-            
-            //High-velocity jet material
-            float jetSpeed = sqrt(blackHoleMass) * 3.0f * (1.0f - t * 0.5f);
-            float vx = (((float)rand() / RAND_MAX) - 0.5f) * jetSpeed * 0.2f;
-            float vy = jetDirection * jetSpeed;
-            float vz = (((float)rand() / RAND_MAX) - 0.5f) * jetSpeed * 0.2f;
-            
-            vertices.push_back(vx);
-            vertices.push_back(vy);
-            vertices.push_back(vz);
-            
-            //Extremely hot jet material
-            float temperature = 2.0f * (1.0f - t * 0.7f);
-            vertices.push_back(temperature);
-            
-            //Lower density in jets
-            float density = 0.1f * (1.0f - t);
-            vertices.push_back(density);
+    //The disk and spiral arms drift inwards and are recycled at the outer edge;
+    //the jets and torus only rotate, as they did in the old vertex shader
+    PROFILE_SCOPE("disk advect");
+    const DiskLayout& layout = generator.getLayout();
+    AdvectParams params;
+    params.dt = dt;
+    params.blackHoleMass = blackHoleMass;
+    params.inflow = 0.01f;
+    particles.advect(params, 0, layout.jetOffset(), scheduler);
+    params.inflow = 0.0f;
+    particles.advect(params, layout.jetOffset(), totalParticles, scheduler);
+    
+    //Shear and recycling stretch the chunks; once too loose, sort the particles into new ones.
+    //Their indices change, so the previous depth order means nothing any more.
+    if (!chunks.empty()) {
+        PROFILE_SCOPE("disk chunk bounds");
+        if (chunks.updateBounds(particles, scheduler)) {
+            PROFILE_SCOPE("disk chunk rebuild");
+            chunks.rebuild(particles, scheduler);
+            sorter.reset();
         }
     }
+    
+    upload(blackHoleMass, scheduler);
 }
 
-void AccretionDisk::generateTorus(float blackHoleMass) {
-    const float torusRadius = blackHoleMass * 3.0f;
-    const float torusThickness = blackHoleMass * 0.8f;
+void AccretionDisk::upload(float blackHoleMass, TaskScheduler* scheduler) {
+    const DiskLayout& layout = generator.getLayout();
+    const size_t jetBegin = layout.jetOffset();
+    const size_t jetEnd = layout.jetOffset() + 2 * layout.jetParticles;
     
-    for (int i = 0; i < TORUS_PARTICLES; ++i) {
-        float torusAngle = ((float)rand() / RAND_MAX) * 2.0f * 3.14159f;
-        float poloidalAngle = ((float)rand() / RAND_MAX) * 2.0f * 3.14159f;
-        
-        float majorR = torusRadius + torusThickness * cos(poloidalAngle);
-        float x = majorR * cos(torusAngle);
-        float z = majorR * sin(torusAngle);
-        float y = torusThickness * sin(poloidalAngle);
-        
-        vertices.push_back(x);
-        vertices.push_back(y);
-        vertices.push_back(z);
-        
-        //Slower motion in thick torus
-        float speed = sqrt(blackHoleMass / majorR) * 0.8f;
-        float vx = -speed * sin(torusAngle);
-        float vy = (((float)rand() / RAND_MAX) - 0.5f) * speed * 0.3f;
-        float vz = speed * cos(torusAngle);
-        
-        vertices.push_back(vx);
-        vertices.push_back(vy);
-        vertices.push_back(vz);
-        
-        //Moderate temperature in torus
-        float temperature = 0.6f * (0.7f + 0.6f * ((float)rand() / RAND_MAX));
-        vertices.push_back(temperature);
-        
-        //High density in torus
-        float density = 1.5f * (0.8f + 0.4f * ((float)rand() / RAND_MAX));
-        vertices.push_back(density);
+    //Pack straight into the mapped segment, no staging copy
+    PROFILE_SCOPE("disk pack");
+    PackedParticle* out = static_cast<PackedParticle*>(stream.beginWrite());
+    if (out == nullptr) {
+        return;
     }
+    
+    //Jet velocities are the only stored values that depend on mass
+    particles.pack(out, 0, jetBegin, 1.0f, scheduler);
+    particles.pack(out + jetBegin, jetBegin, jetEnd, sqrt(blackHoleMass), scheduler);
+    particles.pack(out + jetEnd, jetEnd, totalParticles, 1.0f, scheduler);
+    stream.endWrite();
+    uploadedMass = blackHoleMass;
 }
 
 void AccretionDisk::setupBuffers() {
-    //Generate OpenGL objects
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    //Generate OpenGL objects once, later calls reuse them
+    if (VAO == 0) {
+        glGenVertexArrays(1, &VAO);
+    }
 
+    //Contents are rewritten by upload() every frame; render() picks the segment as its first vertex
     glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    stream.create((size_t)totalParticles * sizeof(PackedParticle), persistentMapping);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
     
-    //Position attribute (x, y, z)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    //Position (x, y, z) and speed as half4
+    glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedParticle),
+                          (void*)offsetof(PackedParticle, position));
     glEnableVertexAttribArray(0);
-    //Velocity attribute (vx, vy, vz)
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    //Octahedral velocity direction as normalized short2
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedParticle),
+                          (void*)offsetof(PackedParticle, direction));
     glEnableVertexAttribArray(1);
-    //Temperature attribute
-    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    //Temperature, density and importance as normalized ubyte3
+    glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedParticle),
+                          (void*)offsetof(PackedParticle, temperature));
     glEnableVertexAttribArray(2);
-    //Density attribute
-    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(7 * sizeof(float)));
-    glEnableVertexAttribArray(3);
+    
+    //Indices go through their own stream, bound as the VAO's element buffer
+    indexStream.create((size_t)totalParticles * sizeof(uint32_t), persistentMapping);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexStream.getBuffer());
+    sorter.reset();
+}
+
+void AccretionDisk::selectVisible(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection,
+                                  float blackHoleMass) {
+    visibleRanges.clear();
+    if (chunks.empty()) {
+        ParticleRange all;
+        all.count = (uint32_t)totalParticles;
+        visibleRanges.push_back(all);
+        return;
+    }
+    
+    //Culled in the particles' unit-mass model space, like the sort
+    PROFILE_SCOPE("disk cull");
+    ChunkCamera camera;
+    camera.clipFromUnit = projection * view * model * glm::scale(glm::mat4(1.0f), glm::vec3(blackHoleMass));
+    camera.eye = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)) / blackHoleMass;
+    camera.blackHoleMass = blackHoleMass;
+    camera.lodDistance = lodDistance;
+    chunks.select(particles, camera, visibleRanges);
+}
+
+void AccretionDisk::uploadOrder(const glm::mat4& model, const glm::mat4& view, float blackHoleMass,
+                                TaskScheduler* scheduler) {
+    //Camera in the particles' unit-mass model space; the vertex shader scales positions by the mass
+    PROFILE_SCOPE("disk sort");
+    const glm::mat4 cameraToModel = glm::inverse(view * model);
+    const glm::vec3 eye = glm::vec3(cameraToModel * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)) / blackHoleMass;
+    const glm::vec3 viewDir = glm::normalize(glm::vec3(cameraToModel * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+    sorter.sort(particles, visibleRanges, eye, viewDir, scheduler);
+    
+    uint32_t* out = static_cast<uint32_t*>(indexStream.beginWrite());
+    if (out == nullptr) {
+        return;
+    }
+    const std::vector<uint32_t>& order = sorter.getOrder();
+    if (!order.empty()) {
+        std::memcpy(out, order.data(), order.size() * sizeof(uint32_t));
+    }
+    indexStream.endWrite();
 }
 
-void AccretionDisk::render(GLuint shaderProgram, const glm::mat4& model, const glm::mat4& view, 
-                          const glm::mat4& projection, float time, float blackHoleMass) {
-    glUseProgram(shaderProgram);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glUniform1f(glGetUniformLocation(shaderProgram, "time"), time);
-    glUniform1f(glGetUniformLocation(shaderProgram, "blackHoleMass"), blackHoleMass);
+const std::vector<std::string>& AccretionDisk::getUniformNames() {
+    static const std::vector<std::string> names = {"model", "view", "projection", "time", "blackHoleMass",
+                                                     "lodDistance"};
+    return names;
+}
+
+void AccretionDisk::render(const ShaderProgram& program, const glm::mat4& model, const glm::mat4& view, 
+                          const glm::mat4& projection, float time, float blackHoleMass, TaskScheduler* scheduler) {
+    if (VAO == 0) {
+        return;
+    }
+    selectVisible(model, view, projection, blackHoleMass);
+    if (depthSorting) {
+        uploadOrder(model, view, blackHoleMass, scheduler);
+    }
+    
+    program.use();
+    glUniformMatrix4fv(program.uniform(UNIFORM_MODEL), 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(program.uniform(UNIFORM_VIEW), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(program.uniform(UNIFORM_PROJECTION), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(program.uniform(UNIFORM_TIME), time);
+    glUniform1f(program.uniform(UNIFORM_MASS), blackHoleMass);
+    glUniform1f(program.uniform(UNIFORM_LOD_DISTANCE), chunks.empty() ? 0.0f : lodDistance);
     
     //Enable point size modification in vertex shader
     glEnable(GL_PROGRAM_POINT_SIZE);
@@ -273,8 +242,24 @@ void AccretionDisk::render(GLuint shaderProgram, const glm::mat4& model, const g
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glDepthMask(GL_FALSE); //Disable depth writing for transparent particles
     
+    //Fence this frame's segment once the draw is queued, so upload() does not overwrite it early
+    const GLint first = (GLint)(stream.drawOffset() / sizeof(PackedParticle));
     glBindVertexArray(VAO);
-    glDrawElements(GL_POINTS, indices.size(), GL_UNSIGNED_INT, 0);
+    if (depthSorting) {
+        //Indices count from the start of this frame's vertex segment
+        glDrawElementsBaseVertex(GL_POINTS, (GLsizei)sorter.getOrder().size(), GL_UNSIGNED_INT,
+                                 (void*)indexStream.drawOffset(), first);
+        indexStream.endFrame();
+    } else {
+        drawFirsts.clear();
+        drawCounts.clear();
+        for (const ParticleRange& range : visibleRanges) {
+            drawFirsts.push_back(first + (GLint)range.first);
+            drawCounts.push_back((GLsizei)range.count);
+        }
+        glMultiDrawArrays(GL_POINTS, drawFirsts.data(), drawCounts.data(), (GLsizei)drawFirsts.size());
+    }
+    stream.endFrame();
     
     glDepthMask(GL_TRUE); //Re-enable depth writing
     glDisable(GL_BLEND);
@@ -286,144 +271,6 @@ void AccretionDisk::cleanup() {
         glDeleteVertexArrays(1, &VAO);
         VAO = 0;
     }
-    if (VBO != 0) {
-        glDeleteBuffers(1, &VBO);
-        VBO = 0;
-    }
-    if (EBO != 0) {
-        glDeleteBuffers(1, &EBO);
-        EBO = 0;
-    }
-}
-
-const char* AccretionDisk::getVertexShaderSource() {
-    return R"(
-    #version 330 core
-    layout (location = 0) in vec3 aPos;
-    layout (location = 1) in vec3 aVelocity;
-    layout (location = 2) in float aTemperature;
-    layout (location = 3) in float aDensity;
-
-    out vec3 FragPos;
-    out vec3 Velocity;
-    out float Temperature;
-    out float Density;
-    out float DistFromCenter;
-
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
-    uniform float time;
-
-    void main() {
-        vec3 pos = aPos;
-        
-        //Add orbital motion based on distance from center
-        float radius = length(pos.xz);
-        float orbitalSpeed = 1.0 / sqrt(max(radius, 0.1)); //Keplerian velocity
-        float angle = atan(pos.z, pos.x) + time * orbitalSpeed;
-        
-        //Apply orbital motion
-        pos.x = radius * cos(angle);
-        pos.z = radius * sin(angle);
-        
-        //Add turbulence and accretion flow
-        float turbulence = sin(time * 3.0 + radius * 10.0) * 0.02;
-        pos.y += turbulence * aTemperature;
-        
-        //Spiral inward motion
-        float spiralFactor = 0.98 + 0.02 * sin(time * 0.5);
-        pos.xz *= spiralFactor;
-        
-        gl_Position = projection * view * model * vec4(pos, 1.0);
-        
-        //Dynamic point size based on density and distance
-        float screenDistance = gl_Position.w;
-        float baseSize = 2.0 + aDensity * 3.0 + aTemperature * 2.0;
-        gl_PointSize = baseSize * (50.0 / screenDistance);
-        gl_PointSize = clamp(gl_PointSize, 1.0, 8.0);
-        
-        FragPos = pos;
-        Velocity = aVelocity;
-        Temperature = aTemperature;
-        Density = aDensity;
-        DistFromCenter = radius;
-    }
-    )";
-}
-
-const char* AccretionDisk::getFragmentShaderSource() {
-    return R"(
-    #version 330 core
-    in vec3 FragPos;
-    in vec3 Velocity;
-    in float Temperature;
-    in float Density;
-    in float DistFromCenter;
-    out vec4 FragColor;
-
-    uniform float time;
-    uniform float blackHoleMass;
-
-    vec3 blackbodyColor(float temp) {
-        //Simplified blackbody radiation color
-        temp = clamp(temp, 0.0, 1.0);
-        
-        if (temp < 0.25) {
-            return mix(vec3(0.1, 0.0, 0.0), vec3(0.8, 0.1, 0.0), temp * 4.0);
-        } else if (temp < 0.5) {
-            return mix(vec3(0.8, 0.1, 0.0), vec3(1.0, 0.4, 0.0), (temp - 0.25) * 4.0);
-        } else if (temp < 0.75) {
-            return mix(vec3(1.0, 0.4, 0.0), vec3(1.0, 0.8, 0.2), (temp - 0.5) * 4.0);
-        } else {
-            return mix(vec3(1.0, 0.8, 0.2), vec3(0.8, 0.9, 1.0), (temp - 0.75) * 4.0);
-        }
-    }
-
-    void main() {
-        //Calculate physical properties
-        float radius = DistFromCenter;
-        float eventHorizon = blackHoleMass * 0.5;
-        
-        //Temperature decreases with distance (T ∝ r^-3/4 for accretion disk)
-        float physicalTemp = pow(max(radius / eventHorizon, 1.0), -0.75);
-        float combinedTemp = Temperature * physicalTemp;
-        
-        //Doppler shift effect based on velocity
-        float velocityMagnitude = length(Velocity);
-        float dopplerShift = 1.0 + velocityMagnitude * 0.1;
-        
-        //Get base color from blackbody radiation
-        vec3 baseColor = blackbodyColor(combinedTemp * dopplerShift);
-        
-        //Add relativistic beaming effect
-        float beamingFactor = 1.0 + velocityMagnitude * 0.3;
-        baseColor *= beamingFactor;
-        
-        //Density affects opacity and brightness
-        float opacity = Density * smoothstep(eventHorizon * 3.0, eventHorizon, radius);
-        opacity *= smoothstep(blackHoleMass * 8.0, blackHoleMass * 2.0, radius);
-        
-        //Add turbulence-based flickering
-        float flicker = 0.8 + 0.2 * sin(time * 15.0 + FragPos.x * 50.0 + FragPos.z * 30.0);
-        baseColor *= flicker;
-        
-        //Add magnetic field reconnection flares
-        float reconnectionFlare = 0.0;
-        if (sin(time * 2.0 + radius * 5.0) > 0.95) {
-            reconnectionFlare = 0.5 * exp(-(time - floor(time * 2.0) / 2.0) * 10.0);
-        }
-        baseColor += vec3(reconnectionFlare * 2.0, reconnectionFlare, reconnectionFlare * 0.5);
-        
-        //Gravitational redshift near black hole
-        float redshift = 1.0 / sqrt(1.0 - eventHorizon / max(radius, eventHorizon * 1.1));
-        baseColor.r *= redshift;
-        baseColor.gb /= sqrt(redshift);
-        
-        //Final alpha with atmospheric perspective
-        float finalAlpha = opacity * 0.6 * clamp(combinedTemp * 2.0, 0.1, 1.0);
-        
-        FragColor = vec4(baseColor, finalAlpha);
-    } 
-    )";
+    stream.cleanup();
+    indexStream.cleanup();
 }
@@ -4,49 +4,86 @@
 #include <glm/glm.hpp>
 #include <vector>
 
+#include "DepthSorter.h"
+#include "DiskGenerator.h"
+#include "ParticleChunks.h"
+#include "ParticleSnapshot.h"
+#include "ParticleStore.h"
+#include "ShaderManager.h"
+#include "StreamBuffer.h"
+
 class AccretionDisk {
 public:
-    AccretionDisk();
+    //persistentMapping = false forces the GL 3.3 orphaning upload path
+    explicit AccretionDisk(const DiskLayout& layout = DiskLayout(), bool persistentMapping = true);
     ~AccretionDisk();
 
-    //Initialize the accretion disk with given black hole mass
-    void initialize(float blackHoleMass);
+    //Initialize the accretion disk with given black hole mass.
+    //Particles are generated and uploaded once, at unit mass, in parallel if given a scheduler.
+    void initialize(float blackHoleMass, TaskScheduler* scheduler = nullptr);
+    //Initialize from a saved frame instead, taking its layout, seed and particles; the chunks
+    //saved with it are reused when chunking is on. Uploads for the frame's black hole mass.
+    void initialize(const ParticleSnapshot& snapshot, size_t frame, TaskScheduler* scheduler = nullptr);
     
-    //Update the disk (can be used for dynamic changes)
+    //Apply a new black hole mass without regenerating the disk; the next advance() packs the
+    //particles for it
     void update(float blackHoleMass);
     
-    //Render the accretion disk
-    void render(GLuint shaderProgram, const glm::mat4& model, const glm::mat4& view, 
-                const glm::mat4& projection, float time, float blackHoleMass);
+    //Advance orbital motion and inflow by dt seconds on the CPU and upload the result
+    void advance(float dt, float blackHoleMass, TaskScheduler* scheduler = nullptr);
+    
+    //Draw back to front through a per-frame sorted index stream; off, in generation order
+    void setDepthSorting(bool enabled) { depthSorting = enabled; }
+    bool isDepthSorting() const { return depthSorting; }
+    const DepthSorter& getSorter() const { return sorter; }
+    
+    //Cull chunks of particles to the view and thin out distant ones; off, every particle is
+    //drawn. Takes effect at initialize().
+    void setChunking(bool enabled) { chunking = enabled; }
+    bool isChunking() const { return chunking; }
+    const ParticleChunks& getChunks() const { return chunks; }
+    
+    const DiskGenerator& getGenerator() const { return generator; }
+    const ParticleStore& getParticles() const { return particles; }
+    const StreamStats& getStreamStats() const { return stream.getStats(); }
+    bool isPersistentMapped() const { return stream.isPersistent(); }
+    
+    //Render the accretion disk with shaders/disk.vert and disk.frag, sorting first (in parallel
+    //if given a scheduler) when depth sorting is on
+    void render(const ShaderProgram& program, const glm::mat4& model, const glm::mat4& view, 
+                const glm::mat4& projection, float time, float blackHoleMass, TaskScheduler* scheduler = nullptr);
     
-    //Get shader source code
-    static const char* getVertexShaderSource();
-    static const char* getFragmentShaderSource();
+    //Uniforms render() sets, to load the disk program with
+    static const std::vector<std::string>& getUniformNames();
     
     //Cleanup OpenGL resources
     void cleanup();
 
 private:
     //OpenGL objects
-    GLuint VAO, VBO, EBO;
+    GLuint VAO;
+    StreamBuffer stream;            //Vertex data, rewritten every frame
+    StreamBuffer indexStream;       //Draw order, rewritten every frame when depth sorting
+    DepthSorter sorter;
+    bool depthSorting;
+    ParticleChunks chunks;
+    bool chunking;
+    float lodDistance;              //For the layout's particle count
+    std::vector<ParticleRange> visibleRanges;
+    std::vector<GLint> drawFirsts;  //Of visibleRanges in this frame's vertex segment
+    std::vector<GLsizei> drawCounts;
     
     //Disk data
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
+    DiskGenerator generator;
+    ParticleStore particles;        //Current state, at unit mass
     int totalParticles;
+    bool persistentMapping;
+    float uploadedMass;             //Mass the jet velocities in the stream were scaled for
     
-    //Generation parameters
-    static constexpr int DISK_PARTICLES = 8192;
-    static constexpr int DISK_LAYERS = 32;
-    static constexpr int SPIRAL_ARMS = 2;
-    static constexpr int ARM_PARTICLES = 1024;
-    static constexpr int JET_PARTICLES = 512;
-    static constexpr int TORUS_PARTICLES = 2048;
-    
-    //Private methods for disk generation
-    void generateMainDisk(float blackHoleMass);
-    void generateSpiralArms(float blackHoleMass);
-    void generateJets(float blackHoleMass);
-    void generateTorus(float blackHoleMass);
     void setupBuffers();
+    void upload(float blackHoleMass, TaskScheduler* scheduler = nullptr);
+    //Picks the particles to draw for this camera into visibleRanges
+    void selectVisible(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float blackHoleMass);
+    //Sorts visibleRanges for the camera of view * model and writes the order to indexStream
+    void uploadOrder(const glm::mat4& model, const glm::mat4& view, float blackHoleMass, TaskScheduler* scheduler);
 };
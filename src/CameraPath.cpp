@@ -0,0 +1,104 @@
+#include "CameraPath.h"
+#include <fstream>
+#include <sstream>
+
+//Cubic Hermite through p1 and p2 with tangents m1, m2 already scaled to the segment
+static double hermite(double p1, double p2, double m1, double m2, double u) {
+    double u2 = u * u, u3 = u2 * u;
+    return (2.0 * u3 - 3.0 * u2 + 1.0) * p1 + (u3 - 2.0 * u2 + u) * m1
+         + (-2.0 * u3 + 3.0 * u2) * p2 + (u3 - u2) * m2;
+}
+
+bool CameraPath::load(const std::string& path, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    keyframes.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        CameraKeyframe keyframe;
+        std::string extra;
+        if (!(fields >> keyframe.time >> keyframe.radius >> keyframe.yaw >> keyframe.pitch >> keyframe.mass)
+            || (fields >> extra)) {
+            error = path + ":" + std::to_string(lineNumber) + ": expected \"time radius yaw pitch mass\"";
+            return false;
+        }
+        if (!keyframes.empty() && keyframe.time <= keyframes.back().time) {
+            error = path + ":" + std::to_string(lineNumber) + ": keyframe times must increase";
+            return false;
+        }
+        if (keyframe.radius <= 0.0 || keyframe.mass <= 0.0) {
+            error = path + ":" + std::to_string(lineNumber) + ": radius and mass must be positive";
+            return false;
+        }
+        keyframes.push_back(keyframe);
+    }
+
+    if (keyframes.empty()) {
+        error = path + ": no keyframes";
+        return false;
+    }
+    return true;
+}
+
+void CameraPath::addKeyframe(const CameraKeyframe& keyframe) {
+    keyframes.push_back(keyframe);
+}
+
+double CameraPath::duration() const {
+    return keyframes.empty() ? 0.0 : keyframes.back().time - keyframes.front().time;
+}
+
+CameraKeyframe CameraPath::sample(double time) const {
+    if (keyframes.empty()) {
+        return CameraKeyframe{time, 5.0, -90.0, 0.0, 1.0};
+    }
+    if (time <= keyframes.front().time) {
+        CameraKeyframe keyframe = keyframes.front();
+        keyframe.time = time;
+        return keyframe;
+    }
+    if (time >= keyframes.back().time) {
+        CameraKeyframe keyframe = keyframes.back();
+        keyframe.time = time;
+        return keyframe;
+    }
+
+    size_t i = 1;
+    while (keyframes[i].time < time) {
+        ++i;
+    }
+    //Segment k1 -> k2, with neighbours k0 and k3 repeated at the ends of the path
+    const CameraKeyframe& k1 = keyframes[i - 1];
+    const CameraKeyframe& k2 = keyframes[i];
+    const CameraKeyframe& k0 = i >= 2 ? keyframes[i - 2] : k1;
+    const CameraKeyframe& k3 = i + 1 < keyframes.size() ? keyframes[i + 1] : k2;
+
+    const double span = k2.time - k1.time;
+    const double u = (time - k1.time) / span;
+    //Finite-difference tangents over uneven key spacing, scaled to this segment's length
+    auto interpolate = [&](double CameraKeyframe::*field) {
+        double m1 = (k2.*field - k0.*field) / (k2.time - k0.time) * span;
+        double m2 = (k3.*field - k1.*field) / (k3.time - k1.time) * span;
+        return hermite(k1.*field, k2.*field, m1, m2, u);
+    };
+
+    CameraKeyframe keyframe;
+    keyframe.time = time;
+    keyframe.radius = interpolate(&CameraKeyframe::radius);
+    keyframe.yaw = interpolate(&CameraKeyframe::yaw);
+    keyframe.pitch = interpolate(&CameraKeyframe::pitch);
+    keyframe.mass = k1.mass + (k2.mass - k1.mass) * u;
+    return keyframe;
+}
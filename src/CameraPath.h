@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+//One camera state on a scripted path. radius/yaw/pitch follow the Camera struct in main.cpp
+//(radius in Schwarzschild radii of the unit-mass hole), mass is relative as in blackHoleMass.
+struct CameraKeyframe {
+    double time;        //Seconds
+    double radius;
+    double yaw;         //Degrees
+    double pitch;       //Degrees
+    double mass;
+};
+
+//Keyframed camera orbit and mass ramp for offline rendering.
+//The file is plain text, one keyframe per line: "time radius yaw pitch mass", with blank
+//lines and lines starting with '#' ignored. Times must increase. Radius, yaw and pitch are
+//interpolated with a Catmull-Rom spline so the orbit has no corners at keyframes; mass is
+//interpolated linearly so a ramp never overshoots.
+class CameraPath {
+public:
+    //Returns false and sets error (with the line number) if the file is missing or malformed
+    bool load(const std::string& path, std::string& error);
+
+    void addKeyframe(const CameraKeyframe& keyframe);
+    const std::vector<CameraKeyframe>& getKeyframes() const { return keyframes; }
+
+    double duration() const;
+    //Clamped to the first and last keyframe outside the path
+    CameraKeyframe sample(double time) const;
+
+private:
+    std::vector<CameraKeyframe> keyframes;
+};
@@ -0,0 +1,186 @@
+#include "DeflectionTable.h"
+#include "GeodesicTracer.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+
+//Integration state saved at every accepted step while building an orbit
+struct OrbitPoint {
+    double psi, u, du;
+};
+
+static double binetAccel(double u) {
+    return 1.5 * u * u - u;
+}
+
+//Cubic Hermite interpolation of u and du/dpsi between two saved points
+static void hermite(const OrbitPoint& a, const OrbitPoint& b, double t, double& u, double& du) {
+    const double h = b.psi - a.psi;
+    const double t2 = t * t, t3 = t2 * t;
+    u = (2.0 * t3 - 3.0 * t2 + 1.0) * a.u + (t3 - 2.0 * t2 + t) * h * a.du
+      + (-2.0 * t3 + 3.0 * t2) * b.u + (t3 - t2) * h * b.du;
+    du = (2.0 * t3 - 3.0 * t2 + 1.0) * a.du + (t3 - 2.0 * t2 + t) * h * binetAccel(a.u)
+       + (-2.0 * t3 + 3.0 * t2) * b.du + (t3 - t2) * h * binetAccel(b.u);
+}
+
+double DeflectionTable::criticalImpact() {
+    return 1.5 * sqrt(3.0);
+}
+
+DeflectionTable::DeflectionTable() : built(false) {
+    const double bc = criticalImpact();
+    //Log spacing in |b - b_crit| resolves the logarithmic winding near the photon sphere
+    xMin[0] = log(1e-6);
+    xMax[0] = log(B_MAX - bc);
+    xMin[1] = log(1e-6);
+    xMax[1] = log(bc - 1e-3);
+}
+
+double DeflectionTable::impactFor(int family, int index) const {
+    const double x = xMin[family] + (xMax[family] - xMin[family]) * index / (IMPACT_SAMPLES - 1);
+    return family == 0 ? criticalImpact() + exp(x) : criticalImpact() - exp(x);
+}
+
+void DeflectionTable::build() {
+    for (int family = 0; family < 2; ++family) {
+        psiEnds[family].assign(IMPACT_SAMPLES, 0.0);
+        samples[family].assign((size_t)IMPACT_SAMPLES * ANGLE_SAMPLES, Sample{0.0f, 0.0f});
+        for (int i = 0; i < IMPACT_SAMPLES; ++i) {
+            buildOrbit(family, i);
+        }
+    }
+    built = true;
+}
+
+void DeflectionTable::buildOrbit(int family, int index) {
+    const double b = impactFor(family, index);
+
+    //Arriving from infinity: u = 0 and du/dpsi = 1/b exactly
+    std::vector<OrbitPoint> points;
+    points.push_back({0.0, 0.0, 1.0 / b});
+    glm::dvec2 state(0.0, 1.0 / b);
+    double psi = 0.0;
+    double h = 0.01;
+
+    //Escaping orbits end at periapsis (du = 0), captured ones at the horizon (u = 1)
+    auto finished = [family](const glm::dvec2& s) { return family == 0 ? s.y <= 0.0 : s.x >= 1.0; };
+
+    while (!finished(state) && points.size() < 1000000) {
+        h = std::min(h, 0.05);
+        const double hTried = h;
+        if (binetStep(state, h, 1e-11, 1e-13)) {
+            psi += hTried;
+            points.push_back({psi, state.x, state.y});
+        }
+    }
+
+    //Locate the end point inside the last step
+    OrbitPoint& a = points[points.size() - 2];
+    OrbitPoint& last = points.back();
+    double lo = 0.0, hi = 1.0, u, du;
+    for (int i = 0; i < 60; ++i) {
+        const double t = 0.5 * (lo + hi);
+        hermite(a, last, t, u, du);
+        const bool past = family == 0 ? du <= 0.0 : u >= 1.0;
+        (past ? hi : lo) = t;
+    }
+    const double tEnd = 0.5 * (lo + hi);
+    hermite(a, last, tEnd, u, du);
+    const double psiEnd = a.psi + tEnd * (last.psi - a.psi);
+    last = {psiEnd, u, family == 0 ? 0.0 : du};
+
+    //Resample onto a uniform grid in psi
+    psiEnds[family][index] = psiEnd;
+    Sample* out = &samples[family][(size_t)index * ANGLE_SAMPLES];
+    size_t segment = 0;
+    for (int k = 0; k < ANGLE_SAMPLES; ++k) {
+        const double target = psiEnd * k / (ANGLE_SAMPLES - 1);
+        while (segment + 2 < points.size() && points[segment + 1].psi < target) {
+            ++segment;
+        }
+        const OrbitPoint& p0 = points[segment];
+        const OrbitPoint& p1 = points[segment + 1];
+        const double t = glm::clamp((target - p0.psi) / (p1.psi - p0.psi), 0.0, 1.0);
+        hermite(p0, p1, t, u, du);
+        out[k] = Sample{(float)u, (float)du};
+    }
+}
+
+bool DeflectionTable::locate(double b, OrbitRef& orbit) const {
+    const double bc = criticalImpact();
+    const int family = b > bc ? 0 : 1;
+    const double x = log(fabs(b - bc));
+    if (!(x >= xMin[family] && x <= xMax[family])) {
+        return false;
+    }
+
+    const double pos = (x - xMin[family]) / (xMax[family] - xMin[family]) * (IMPACT_SAMPLES - 1);
+    orbit.index = std::min((int)pos, IMPACT_SAMPLES - 2);
+    orbit.weight = pos - orbit.index;
+    orbit.captured = family == 1;
+    orbit.psiEnd = glm::mix(psiEnds[family][orbit.index], psiEnds[family][orbit.index + 1], orbit.weight);
+    return true;
+}
+
+double DeflectionTable::sampleU(int family, int index, double fraction, double& du) const {
+    const double pos = glm::clamp(fraction, 0.0, 1.0) * (ANGLE_SAMPLES - 1);
+    const int k = std::min((int)pos, ANGLE_SAMPLES - 2);
+    const double t = pos - k;
+    const double h = psiEnds[family][index] / (ANGLE_SAMPLES - 1);
+    const Sample* s = &samples[family][(size_t)index * ANGLE_SAMPLES + k];
+
+    const double t2 = t * t, t3 = t2 * t;
+    du = ((6.0 * t2 - 6.0 * t) * (s[0].u - s[1].u)) / h
+       + (3.0 * t2 - 4.0 * t + 1.0) * s[0].du + (3.0 * t2 - 2.0 * t) * s[1].du;
+    return (2.0 * t3 - 3.0 * t2 + 1.0) * s[0].u + (t3 - 2.0 * t2 + t) * h * s[0].du
+         + (-2.0 * t3 + 3.0 * t2) * s[1].u + (t3 - t2) * h * s[1].du;
+}
+
+double DeflectionTable::uAt(const OrbitRef& orbit, double psi, double& du) const {
+    //Neighbouring orbits are blended at the same fraction of their inbound half
+    const int family = orbit.captured ? 1 : 0;
+    const double fraction = psi / orbit.psiEnd;
+    double du0, du1;
+    const double u0 = sampleU(family, orbit.index, fraction, du0);
+    const double u1 = sampleU(family, orbit.index + 1, fraction, du1);
+    //Each orbit's derivative is per radian of its own psi, rescale to the blended psiEnd
+    du0 *= psiEnds[family][orbit.index] / orbit.psiEnd;
+    du1 *= psiEnds[family][orbit.index + 1] / orbit.psiEnd;
+    du = glm::mix(du0, du1, orbit.weight);
+    return glm::mix(u0, u1, orbit.weight);
+}
+
+double DeflectionTable::uAt(const OrbitRef& orbit, double psi) const {
+    double du;
+    return uAt(orbit, psi, du);
+}
+
+double DeflectionTable::psiAt(const OrbitRef& orbit, double b, double u) const {
+    //u grows monotonically along the inbound half. Newton from the straight-line guess
+    //u = sin(psi) / b, falling back to bisection whenever a step leaves the bracket.
+    double lo = 0.0, hi = orbit.psiEnd;
+    double psi = std::min(asin(std::min(u * b, 1.0)), hi);
+    for (int i = 0; i < 40; ++i) {
+        double du;
+        const double error = uAt(orbit, psi, du) - u;
+        if (fabs(error) < 1e-12) {
+            break;
+        }
+        (error < 0.0 ? lo : hi) = psi;
+        const double next = du > 0.0 ? psi - error / du : -1.0;
+        psi = next > lo && next < hi ? next : 0.5 * (lo + hi);
+        if (hi - lo < 1e-12) {
+            break;
+        }
+    }
+    return psi;
+}
+
+double DeflectionTable::deflection(const OrbitRef& orbit) const {
+    return 2.0 * orbit.psiEnd - glm::pi<double>();
+}
+
+size_t DeflectionTable::memoryBytes() const {
+    return (samples[0].size() + samples[1].size()) * sizeof(Sample)
+         + (psiEnds[0].size() + psiEnds[1].size()) * sizeof(double);
+}
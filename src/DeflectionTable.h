@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+//Precomputed Schwarzschild photon orbits keyed by impact parameter.
+//
+//Every null geodesic lies in a plane and is fixed by its impact parameter b, so the
+//orbit u(psi) = rs / r of a photon arriving from infinity is tabulated once for a dense
+//set of b. A camera ray is then a window onto one of these orbits: its start angle comes
+//from inverting u at the camera radius, and disk crossings and the final deflection are
+//lookups rather than integration. Everything is stored in units of rs, so the table does
+//not depend on the black hole mass or the disk radii and never needs rebuilding for them.
+class DeflectionTable {
+public:
+    static constexpr int IMPACT_SAMPLES = 2048;   //Orbits per family (escaping, captured)
+    static constexpr int ANGLE_SAMPLES = 256;     //Samples along each orbit's inbound half
+    static constexpr double B_MAX = 1000.0;       //Largest tabulated impact parameter, in rs
+
+    //Critical impact parameter 3*sqrt(3)/2 rs, in rs
+    static double criticalImpact();
+
+    //A position between two tabulated orbits
+    struct OrbitRef {
+        int index;          //Lower orbit
+        double weight;      //Blend towards index + 1
+        bool captured;      //b below critical: the orbit ends on the horizon
+        double psiEnd;      //Angle from the asymptote to periapsis, or to the horizon if captured
+    };
+
+    DeflectionTable();
+
+    void build();
+    bool isBuilt() const { return built; }
+
+    //Finds the orbit for impact parameter b (rs units); false if b is outside the table
+    bool locate(double b, OrbitRef& orbit) const;
+
+    //u at angle psi in [0, psiEnd] after the asymptote, on the inbound half
+    double uAt(const OrbitRef& orbit, double psi) const;
+    double uAt(const OrbitRef& orbit, double psi, double& du) const;
+
+    //Inverse of uAt on the inbound half, for u between 0 and the periapsis/horizon value.
+    //b is the impact parameter passed to locate, used for the starting guess.
+    double psiAt(const OrbitRef& orbit, double b, double u) const;
+
+    //Total bending of an escaping ray, 2 psiEnd - pi
+    double deflection(const OrbitRef& orbit) const;
+
+    size_t memoryBytes() const;
+
+private:
+    struct Sample {
+        float u;
+        float du;   //du/dpsi
+    };
+
+    void buildOrbit(int family, int index);
+    double impactFor(int family, int index) const;
+    double sampleU(int family, int index, double fraction, double& du) const;
+
+    bool built;
+    double xMin[2], xMax[2];                //Grid in log|b - b_crit| per family
+    std::vector<double> psiEnds[2];
+    std::vector<Sample> samples[2];         //IMPACT_SAMPLES * ANGLE_SAMPLES per family
+};
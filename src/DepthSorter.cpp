@@ -0,0 +1,382 @@
+#include "DepthSorter.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SORTER_X86 1
+#include <immintrin.h>
+#endif
+
+//Same convention as ParticleStore.cpp: GCC and Clang need the AVX2 kernels marked
+#if defined(SORTER_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+static constexpr size_t RADIX = (size_t)1 << DepthSorter::DIGIT_BITS;
+static constexpr int LOW_BITS = DepthSorter::KEY_BITS - DepthSorter::DIGIT_BITS;
+static constexpr float MAX_KEY = (float)((1 << DepthSorter::KEY_BITS) - 1);
+
+static_assert(DepthSorter::KEY_BITS == 2 * DepthSorter::DIGIT_BITS, "Key must be a top and a low digit");
+
+//Runs fn(block, first, last) over [0, count) in blocks of BLOCK_PARTICLES, on the scheduler when there is one
+template <typename Fn>
+static void forEachBlock(size_t count, TaskScheduler* scheduler, const Fn& fn) {
+    const size_t blocks = (count + DepthSorter::BLOCK_PARTICLES - 1) / DepthSorter::BLOCK_PARTICLES;
+    auto runBlock = [&](size_t block, unsigned) {
+        const size_t first = block * DepthSorter::BLOCK_PARTICLES;
+        fn(block, first, std::min(first + DepthSorter::BLOCK_PARTICLES, count));
+    };
+    if (scheduler != nullptr && blocks > 1) {
+        scheduler->parallelFor(blocks, runBlock);
+    } else {
+        for (size_t block = 0; block < blocks; ++block) {
+            runBlock(block, 0);
+        }
+    }
+}
+
+//Runs fn(piece, first, last) over the particle indices of each piece, likewise
+template <typename Piece, typename Fn>
+static void forEachPiece(const std::vector<Piece>& pieces, TaskScheduler* scheduler, const Fn& fn) {
+    auto runPiece = [&](size_t piece, unsigned) {
+        fn(piece, (size_t)pieces[piece].first, (size_t)pieces[piece].last);
+    };
+    if (scheduler != nullptr && pieces.size() > 1) {
+        scheduler->parallelFor(pieces.size(), runPiece);
+    } else {
+        for (size_t piece = 0; piece < pieces.size(); ++piece) {
+            runPiece(piece, 0);
+        }
+    }
+}
+
+//Every level evaluates dot(p, dir) - offset in this order, without FMA, so they give the same keys
+static inline float depthOf(float x, float y, float z, const glm::vec3& dir, float offset) {
+    float d = x * dir.x;
+    d = d + y * dir.y;
+    d = d + z * dir.z;
+    return d - offset;
+}
+
+static inline uint16_t quantise(float depth, float farthest, float scale) {
+    const float key = std::min(std::max((farthest - depth) * scale, 0.0f), MAX_KEY);
+    return (uint16_t)(int)key;
+}
+
+#ifdef SORTER_X86
+//SSE2 is part of every x86-64 target
+static inline __m128 depthSSE(const float* x, const float* y, const float* z, size_t i,
+                              __m128 fx, __m128 fy, __m128 fz, __m128 offset) {
+    __m128 d = _mm_mul_ps(_mm_loadu_ps(x + i), fx);
+    d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(y + i), fy));
+    d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(z + i), fz));
+    return _mm_sub_ps(d, offset);
+}
+
+static size_t rangeSSE(const ParticleStore& store, size_t first, size_t last, const glm::vec3& dir, float offset,
+                       float& nearest, float& farthest) {
+    const __m128 fx = _mm_set1_ps(dir.x), fy = _mm_set1_ps(dir.y), fz = _mm_set1_ps(dir.z);
+    const __m128 off = _mm_set1_ps(offset);
+    __m128 lo = _mm_set1_ps(nearest), hi = _mm_set1_ps(farthest);
+    size_t i = first;
+    for (; i + 4 <= last; i += 4) {
+        const __m128 d = depthSSE(store.x.data(), store.y.data(), store.z.data(), i, fx, fy, fz, off);
+        lo = _mm_min_ps(lo, d);
+        hi = _mm_max_ps(hi, d);
+    }
+    alignas(16) float los[4], his[4];
+    _mm_store_ps(los, lo);
+    _mm_store_ps(his, hi);
+    for (int k = 0; k < 4; ++k) {
+        nearest = std::min(nearest, los[k]);
+        farthest = std::max(farthest, his[k]);
+    }
+    return i;
+}
+
+static size_t keysSSE(const ParticleStore& store, size_t first, size_t last, const glm::vec3& dir, float offset,
+                      float farthest, float scale, uint16_t* keys) {
+    const __m128 fx = _mm_set1_ps(dir.x), fy = _mm_set1_ps(dir.y), fz = _mm_set1_ps(dir.z);
+    const __m128 off = _mm_set1_ps(offset), far4 = _mm_set1_ps(farthest), scale4 = _mm_set1_ps(scale);
+    const __m128 zero = _mm_setzero_ps(), maxKey = _mm_set1_ps(MAX_KEY);
+    //SSE2 only packs signed: shift keys into int16 range and back
+    const __m128i bias = _mm_set1_epi32(32768), flip = _mm_set1_epi16((short)0x8000);
+    size_t i = first;
+    for (; i + 8 <= last; i += 8) {
+        __m128i k[2];
+        for (int half = 0; half < 2; ++half) {
+            const __m128 d = depthSSE(store.x.data(), store.y.data(), store.z.data(), i + 4 * half, fx, fy, fz, off);
+            const __m128 key = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(far4, d), scale4), zero), maxKey);
+            k[half] = _mm_sub_epi32(_mm_cvttps_epi32(key), bias);
+        }
+        _mm_storeu_si128((__m128i*)(keys + i), _mm_xor_si128(_mm_packs_epi32(k[0], k[1]), flip));
+    }
+    return i;
+}
+
+TARGET_AVX2
+static inline __m256 depthAVX2(const float* x, const float* y, const float* z, size_t i,
+                               __m256 fx, __m256 fy, __m256 fz, __m256 offset) {
+    __m256 d = _mm256_mul_ps(_mm256_loadu_ps(x + i), fx);
+    d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(y + i), fy));
+    d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(z + i), fz));
+    return _mm256_sub_ps(d, offset);
+}
+
+TARGET_AVX2
+static size_t rangeAVX2(const ParticleStore& store, size_t first, size_t last, const glm::vec3& dir, float offset,
+                        float& nearest, float& farthest) {
+    const __m256 fx = _mm256_set1_ps(dir.x), fy = _mm256_set1_ps(dir.y), fz = _mm256_set1_ps(dir.z);
+    const __m256 off = _mm256_set1_ps(offset);
+    __m256 lo = _mm256_set1_ps(nearest), hi = _mm256_set1_ps(farthest);
+    size_t i = first;
+    for (; i + 8 <= last; i += 8) {
+        const __m256 d = depthAVX2(store.x.data(), store.y.data(), store.z.data(), i, fx, fy, fz, off);
+        lo = _mm256_min_ps(lo, d);
+        hi = _mm256_max_ps(hi, d);
+    }
+    alignas(32) float los[8], his[8];
+    _mm256_store_ps(los, lo);
+    _mm256_store_ps(his, hi);
+    for (int k = 0; k < 8; ++k) {
+        nearest = std::min(nearest, los[k]);
+        farthest = std::max(farthest, his[k]);
+    }
+    return i;
+}
+
+TARGET_AVX2
+static size_t keysAVX2(const ParticleStore& store, size_t first, size_t last, const glm::vec3& dir, float offset,
+                       float farthest, float scale, uint16_t* keys) {
+    const __m256 fx = _mm256_set1_ps(dir.x), fy = _mm256_set1_ps(dir.y), fz = _mm256_set1_ps(dir.z);
+    const __m256 off = _mm256_set1_ps(offset), far8 = _mm256_set1_ps(farthest), scale8 = _mm256_set1_ps(scale);
+    const __m256 zero = _mm256_setzero_ps(), maxKey = _mm256_set1_ps(MAX_KEY);
+    size_t i = first;
+    for (; i + 8 <= last; i += 8) {
+        const __m256 d = depthAVX2(store.x.data(), store.y.data(), store.z.data(), i, fx, fy, fz, off);
+        const __m256 key = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(far8, d), scale8), zero), maxKey);
+        const __m256i k = _mm256_cvttps_epi32(key);
+        _mm_storeu_si128((__m128i*)(keys + i),
+                         _mm_packus_epi32(_mm256_castsi256_si128(k), _mm256_extracti128_si256(k, 1)));
+    }
+    return i;
+}
+#endif
+
+DepthSorter::DepthSorter()
+    : temporalReuse(true), reused(false), framesSinceSort(0), sortedEye(0.0f), sortedViewDir(0.0f) {
+}
+
+void DepthSorter::reset() {
+    order.clear();
+    keys.clear();
+    sortedRanges.clear();
+    reused = false;
+    framesSinceSort = 0;
+}
+
+void DepthSorter::sort(const ParticleStore& store, const glm::vec3& eye, const glm::vec3& viewDir,
+                       TaskScheduler* scheduler, SimdLevel level) {
+    ParticleRange all;
+    all.count = (uint32_t)store.size();
+    sort(store, std::vector<ParticleRange>(1, all), eye, viewDir, scheduler, level);
+}
+
+void DepthSorter::sort(const ParticleStore& store, const std::vector<ParticleRange>& ranges, const glm::vec3& eye,
+                       const glm::vec3& viewDir, TaskScheduler* scheduler, SimdLevel level) {
+    const size_t count = buildPieces(ranges, store.size());
+    const bool fresh = order.size() != count || ranges != sortedRanges;
+    reused = false;
+    if (count == 0) {
+        reset();
+        return;
+    }
+    if (!ParticleStore::isSupported(level)) {
+        level = SimdLevel::Scalar;
+    }
+
+    //How far any depth can have moved with the camera since the last full sort
+    const float range = computeKeys(store, eye, viewDir, scheduler, level);
+    const float drift = glm::length(eye - sortedEye) + range * glm::length(viewDir - sortedViewDir);
+    if (temporalReuse && !fresh && framesSinceSort < REUSE_FRAMES && drift <= REUSE_DRIFT * range) {
+        resort(scheduler);
+        reused = true;
+        framesSinceSort++;
+        return;
+    }
+    radixSort(scheduler);
+    framesSinceSort = 0;
+    sortedEye = eye;
+    sortedViewDir = viewDir;
+    sortedRanges = ranges;
+}
+
+size_t DepthSorter::buildPieces(const std::vector<ParticleRange>& ranges, size_t storeSize) {
+    pieces.clear();
+    uint32_t position = 0;
+    for (const ParticleRange& range : ranges) {
+        const uint32_t end = (uint32_t)std::min((size_t)range.first + range.count, storeSize);
+        for (uint32_t first = range.first; first < end; first += (uint32_t)BLOCK_PARTICLES) {
+            Piece piece;
+            piece.first = first;
+            piece.last = std::min(first + (uint32_t)BLOCK_PARTICLES, end);
+            piece.position = position;
+            position += piece.last - piece.first;
+            pieces.push_back(piece);
+        }
+    }
+    return position;
+}
+
+float DepthSorter::computeKeys(const ParticleStore& store, const glm::vec3& eye, const glm::vec3& viewDir,
+                               TaskScheduler* scheduler, SimdLevel level) {
+    const float offset = glm::dot(eye, viewDir);
+
+    //The depth range first, then the keys over it; recomputing depth beats storing it
+    blockLow.resize(pieces.size());
+    blockHigh.resize(pieces.size());
+    forEachPiece(pieces, scheduler, [&](size_t block, size_t first, size_t last) {
+        float lo = std::numeric_limits<float>::max();
+        float hi = -std::numeric_limits<float>::max();
+        size_t done = first;
+#ifdef SORTER_X86
+        if (level == SimdLevel::AVX2) {
+            done = rangeAVX2(store, first, last, viewDir, offset, lo, hi);
+        } else if (level == SimdLevel::SSE) {
+            done = rangeSSE(store, first, last, viewDir, offset, lo, hi);
+        }
+#endif
+        for (size_t i = done; i < last; ++i) {
+            const float d = depthOf(store.x[i], store.y[i], store.z[i], viewDir, offset);
+            lo = std::min(lo, d);
+            hi = std::max(hi, d);
+        }
+        blockLow[block] = lo;
+        blockHigh[block] = hi;
+    });
+    const float nearest = *std::min_element(blockLow.begin(), blockLow.end());
+    const float farthest = *std::max_element(blockHigh.begin(), blockHigh.end());
+    const float scale = farthest > nearest ? MAX_KEY / (farthest - nearest) : 0.0f;
+
+    indexKeys.resize(store.size());
+    forEachPiece(pieces, scheduler, [&](size_t, size_t first, size_t last) {
+        size_t done = first;
+#ifdef SORTER_X86
+        if (level == SimdLevel::AVX2) {
+            done = keysAVX2(store, first, last, viewDir, offset, farthest, scale, indexKeys.data());
+        } else if (level == SimdLevel::SSE) {
+            done = keysSSE(store, first, last, viewDir, offset, farthest, scale, indexKeys.data());
+        }
+#endif
+        for (size_t i = done; i < last; ++i) {
+            indexKeys[i] = quantise(depthOf(store.x[i], store.y[i], store.z[i], viewDir, offset), farthest, scale);
+        }
+    });
+    return farthest - nearest;
+}
+
+void DepthSorter::topPass(const uint16_t* inKeys, const uint32_t* inOrder, uint16_t* outKeys, uint32_t* outOrder,
+                          TaskScheduler* scheduler) {
+    const size_t count = order.size();
+    const size_t blocks = (count + BLOCK_PARTICLES - 1) / BLOCK_PARTICLES;
+    histograms.resize(blocks * RADIX);
+    bucketStarts.resize(RADIX + 1);
+
+    forEachBlock(count, scheduler, [&](size_t block, size_t first, size_t last) {
+        uint32_t* counts = histograms.data() + block * RADIX;
+        std::fill(counts, counts + RADIX, 0u);
+        for (size_t i = first; i < last; ++i) {
+            counts[inKeys[i] >> LOW_BITS]++;
+        }
+    });
+
+    //Counts become each block's first output slot per digit, digit-major so the pass is stable
+    uint32_t next = 0;
+    for (size_t digit = 0; digit < RADIX; ++digit) {
+        bucketStarts[digit] = next;
+        for (size_t block = 0; block < blocks; ++block) {
+            uint32_t& slot = histograms[block * RADIX + digit];
+            const uint32_t n = slot;
+            slot = next;
+            next += n;
+        }
+    }
+    bucketStarts[RADIX] = next;
+
+    forEachBlock(count, scheduler, [&](size_t block, size_t first, size_t last) {
+        uint32_t* slots = histograms.data() + block * RADIX;
+        for (size_t i = first; i < last; ++i) {
+            const uint32_t slot = slots[inKeys[i] >> LOW_BITS]++;
+            outKeys[slot] = inKeys[i];
+            outOrder[slot] = inOrder != nullptr ? inOrder[i] : (uint32_t)i;
+        }
+    });
+}
+
+void DepthSorter::radixSort(TaskScheduler* scheduler) {
+    const size_t count = pieces.back().position + (pieces.back().last - pieces.back().first);
+    order.resize(count);
+    keys.resize(count);
+    scratchOrder.resize(count);
+    scratchKeys.resize(count);
+
+    //Top digit from range order into scratch, then each bucket by the low digit back into the
+    //result. A bucket is a small slice that stays in cache, where a second pass over the whole
+    //array would scatter to RADIX places at once. The whole store is read in place; a subset is
+    //first gathered into the result arrays, which the buckets overwrite afterwards.
+    if (pieces.front().first == 0 && count == indexKeys.size()) {
+        topPass(indexKeys.data(), nullptr, scratchKeys.data(), scratchOrder.data(), scheduler);
+    } else {
+        forEachPiece(pieces, scheduler, [&](size_t piece, size_t first, size_t last) {
+            const size_t position = pieces[piece].position;
+            std::copy(indexKeys.begin() + first, indexKeys.begin() + last, keys.begin() + position);
+            std::iota(order.begin() + position, order.begin() + position + (last - first), (uint32_t)first);
+        });
+        topPass(keys.data(), order.data(), scratchKeys.data(), scratchOrder.data(), scheduler);
+    }
+    auto sortBucket = [&](size_t bucket, unsigned) {
+        const uint32_t first = bucketStarts[bucket], last = bucketStarts[bucket + 1];
+        uint32_t slots[RADIX] = {};
+        for (uint32_t i = first; i < last; ++i) {
+            slots[scratchKeys[i] & (RADIX - 1)]++;
+        }
+        uint32_t next = first;
+        for (size_t digit = 0; digit < RADIX; ++digit) {
+            const uint32_t n = slots[digit];
+            slots[digit] = next;
+            next += n;
+        }
+        for (uint32_t i = first; i < last; ++i) {
+            const uint32_t slot = slots[scratchKeys[i] & (RADIX - 1)]++;
+            keys[slot] = scratchKeys[i];
+            order[slot] = scratchOrder[i];
+        }
+    };
+    if (scheduler != nullptr && count > BLOCK_PARTICLES) {
+        scheduler->parallelFor(RADIX, sortBucket);
+    } else {
+        for (size_t bucket = 0; bucket < RADIX; ++bucket) {
+            sortBucket(bucket, 0);
+        }
+    }
+}
+
+void DepthSorter::resort(TaskScheduler* scheduler) {
+    const size_t count = order.size();
+    keys.resize(count);
+    scratchOrder.resize(count);
+    scratchKeys.resize(count);
+
+    forEachBlock(count, scheduler, [&](size_t, size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            keys[i] = indexKeys[order[i]];
+        }
+    });
+    topPass(keys.data(), order.data(), scratchKeys.data(), scratchOrder.data(), scheduler);
+    keys.swap(scratchKeys);
+    order.swap(scratchOrder);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ParticleStore.h"
+
+class TaskScheduler;
+
+//Back-to-front order of a ParticleStore for alpha blending, recomputed every frame.
+//
+//Each particle's depth along the view direction is quantised to KEY_BITS over the frame's depth
+//range, farthest first, with the store's SIMD level. A two-digit radix sort then orders the keys:
+//the top digit across the whole array (per-block histograms, a digit-major prefix sum and a
+//stable scatter, blocks in parallel), then each top-digit bucket by the low digit, in cache,
+//buckets in parallel.
+//
+//With temporal reuse, while the camera stays close to where it was at the last full sort, the
+//previous frame's order is the starting point instead: its keys are gathered and only the top
+//digit is sorted, one stable pass. Particles come out exactly ordered to within 1 / RADIX of the
+//depth range, and inside that keep the previous frame's order, which a full sort at most
+//REUSE_FRAMES frames ago made exact and small motion since has barely disturbed.
+class DepthSorter {
+public:
+    static constexpr int KEY_BITS = 16;
+    static constexpr int DIGIT_BITS = 8;
+    static constexpr size_t BLOCK_PARTICLES = 65536;        //Keys per scheduler item in every pass
+    static constexpr int REUSE_FRAMES = 8;                  //Top-digit sorts between full sorts
+    static constexpr double REUSE_DRIFT = 1.0 / 128.0;      //Camera movement allowed, of the depth range
+
+    DepthSorter();
+
+    //Start from the previous order while the camera moves slightly; off, every sort is a full one
+    void setTemporalReuse(bool enabled) { temporalReuse = enabled; }
+    //Forgets the previous order, e.g. after the particle count changed
+    void reset();
+
+    //Orders particles [0, store.size()) by depth along viewDir from eye (in the store's
+    //coordinates), farthest first
+    void sort(const ParticleStore& store, const glm::vec3& eye, const glm::vec3& viewDir,
+              TaskScheduler* scheduler = nullptr, SimdLevel level = ParticleStore::bestSimdLevel());
+    //Orders only the particles in ranges, which must not overlap. The previous order is reused
+    //only if the ranges are the same as last time.
+    void sort(const ParticleStore& store, const std::vector<ParticleRange>& ranges, const glm::vec3& eye,
+              const glm::vec3& viewDir, TaskScheduler* scheduler = nullptr,
+              SimdLevel level = ParticleStore::bestSimdLevel());
+
+    //Particle indices, back to front
+    const std::vector<uint32_t>& getOrder() const { return order; }
+    //Quantised depth of getOrder()[i]; non-decreasing after a full sort, in the top digit after reuse
+    const std::vector<uint16_t>& getKeys() const { return keys; }
+
+    //Whether the last sort started from the previous order
+    bool reusedOrder() const { return reused; }
+
+private:
+    //Up to BLOCK_PARTICLES of one range, and where they start in the sequence of all ranges
+    struct Piece {
+        uint32_t first, last, position;
+    };
+
+    //Splits ranges into pieces; returns the number of particles in them
+    size_t buildPieces(const std::vector<ParticleRange>& ranges, size_t storeSize);
+    //Key of every particle in the pieces by index, quantised over the frame's depth range; returns the range
+    float computeKeys(const ParticleStore& store, const glm::vec3& eye, const glm::vec3& viewDir,
+                      TaskScheduler* scheduler, SimdLevel level);
+    //Both digits, from the particles in range order
+    void radixSort(TaskScheduler* scheduler);
+    //The top digit only, from the previous order
+    void resort(TaskScheduler* scheduler);
+    //Stable counting pass on the top digit from inOrder (nullptr for particle order) to out;
+    //records where each digit's bucket starts
+    void topPass(const uint16_t* inKeys, const uint32_t* inOrder, uint16_t* outKeys, uint32_t* outOrder,
+                 TaskScheduler* scheduler);
+
+    bool temporalReuse;
+    bool reused;
+    int framesSinceSort;
+    glm::vec3 sortedEye, sortedViewDir;     //Camera of the last full sort
+
+    std::vector<ParticleRange> sortedRanges;    //Of the previous sort
+    std::vector<Piece> pieces;
+    std::vector<uint32_t> order;
+    std::vector<uint16_t> keys;
+    std::vector<uint16_t> indexKeys;    //Per particle index, valid inside the ranges
+    std::vector<uint32_t> scratchOrder; //Between the two digits
+    std::vector<uint16_t> scratchKeys;
+    std::vector<uint32_t> histograms;   //Per block, (1 << DIGIT_BITS) counters each
+    std::vector<uint32_t> bucketStarts; //Of each top digit after topPass, and the end
+    std::vector<float> blockLow, blockHigh;
+};
@@ -0,0 +1,264 @@
+#include "DiskGenerator.h"
+#include "Philox.h"
+#include "TaskScheduler.h"
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+//Philox key for each component, so the same particle id in two components draws different values
+static constexpr uint32_t COMPONENT_MAIN_DISK = 0;
+static constexpr uint32_t COMPONENT_SPIRAL_ARMS = 1;
+static constexpr uint32_t COMPONENT_JETS = 2;
+static constexpr uint32_t COMPONENT_TORUS = 3;
+
+//Particles per scheduler item
+static constexpr int CHUNK_PARTICLES = 4096;
+
+//Runs fn(begin, end) over [0, count) in chunks, on the scheduler when there is one
+static void forEachChunk(int count, TaskScheduler* scheduler, const std::function<void(int, int)>& fn) {
+    const int chunks = (count + CHUNK_PARTICLES - 1) / CHUNK_PARTICLES;
+    auto runChunk = [&](size_t chunk, unsigned) {
+        const int begin = (int)chunk * CHUNK_PARTICLES;
+        fn(begin, std::min(begin + CHUNK_PARTICLES, count));
+    };
+    if (scheduler != nullptr && chunks > 1) {
+        scheduler->parallelFor((size_t)chunks, runChunk);
+    } else {
+        for (int chunk = 0; chunk < chunks; ++chunk) {
+            runChunk((size_t)chunk, 0);
+        }
+    }
+}
+
+static void writeParticle(float* out, float x, float y, float z, float vx, float vy, float vz,
+                          float temperature, float density) {
+    out[0] = x;
+    out[1] = y;
+    out[2] = z;
+    out[3] = vx;
+    out[4] = vy;
+    out[5] = vz;
+    out[6] = temperature;
+    out[7] = density;
+}
+
+DiskLayout DiskLayout::scaled(double factor) {
+    DiskLayout layout;
+    layout.diskParticles = std::max(1, (int)(layout.diskParticles * factor));
+    layout.armParticles = std::max(1, (int)(layout.armParticles * factor));
+    layout.jetParticles = std::max(1, (int)(layout.jetParticles * factor));
+    layout.torusParticles = std::max(1, (int)(layout.torusParticles * factor));
+    return layout;
+}
+
+DiskGenerator::DiskGenerator(const DiskLayout& layout, uint32_t seed) : layout(layout), seed(seed) {
+}
+
+void DiskGenerator::setLayout(const DiskLayout& newLayout) {
+    layout = newLayout;
+}
+
+void DiskGenerator::setSeed(uint32_t newSeed) {
+    seed = newSeed;
+}
+
+void DiskGenerator::clear() {
+    vertices.clear();
+}
+
+void DiskGenerator::allocate() {
+    vertices.resize((size_t)layout.totalParticles() * FLOATS_PER_PARTICLE);
+}
+
+float* DiskGenerator::particle(int index) {
+    return &vertices[(size_t)index * FLOATS_PER_PARTICLE];
+}
+
+void DiskGenerator::generate(float blackHoleMass, TaskScheduler* scheduler) {
+    //Generate all disk components; each phase sizes the vertices itself, as it can run alone. Every value depends only on the seed and the particle's
+    //(component, id, attribute), so the result is the same for any thread count.
+    generateMainDisk(blackHoleMass, scheduler);
+    generateSpiralArms(blackHoleMass, scheduler);
+    generateJets(blackHoleMass, scheduler);
+    generateTorus(blackHoleMass, scheduler);
+}
+
+void DiskGenerator::generateMainDisk(float blackHoleMass, TaskScheduler* scheduler) {
+    const float innerRadius = blackHoleMass * 0.6f; //Just outside event horizon
+    const float outerRadius = blackHoleMass * 12.0f; //Extended disk
+    const float diskThickness = blackHoleMass * 0.8f; //Vertical extent
+    allocate();
+
+    //Generate particle-based disk structure
+    forEachChunk(layout.diskParticles, scheduler, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            ParticleRandom random(seed, COMPONENT_MAIN_DISK, (uint32_t)i);
+
+            //Logarithmic radial distribution (more particles closer to center)
+            float randomRadius = random.uniform(0);
+            float radius = innerRadius * pow(outerRadius / innerRadius, randomRadius);
+
+            //Random angle
+            float angle = random.uniform(1) * 2.0f * 3.14159f;
+
+            //Vertical distribution with Gaussian-like profile
+            float verticalRandom = random.uniform(2) - 0.5f;
+            float scaleHeight = diskThickness * pow(radius / innerRadius, 0.125f); //Flared disk
+            float y = verticalRandom * scaleHeight * exp(-verticalRandom * verticalRandom * 2.0f);
+
+            //Position
+            float x = radius * cos(angle);
+            float z = radius * sin(angle);
+
+            //Add small random perturbations for turbulence
+            x += (random.uniform(3) - 0.5f) * radius * 0.02f;
+            y += (random.uniform(4) - 0.5f) * scaleHeight * 0.1f;
+            z += (random.uniform(5) - 0.5f) * radius * 0.02f;
+
+            //Velocity (Keplerian + perturbations)
+            float keplerianSpeed = sqrt(blackHoleMass / radius);
+            float vx = -keplerianSpeed * sin(angle);
+            float vy = (random.uniform(6) - 0.5f) * keplerianSpeed * 0.1f; //Vertical turbulence
+            float vz = keplerianSpeed * cos(angle);
+
+            //Add radial inflow velocity
+            float inflowSpeed = keplerianSpeed * 0.01f * (innerRadius / radius);
+            vx += inflowSpeed * cos(angle);
+            vz += inflowSpeed * sin(angle);
+
+            //Temperature (decreases with radius, T ∝ r^-3/4)
+            float temperature = pow(innerRadius / radius, 0.75f);
+            temperature *= (0.8f + 0.4f * random.uniform(7)); //Add variability
+
+            //Density (decreases with radius and height)
+            float density = pow(innerRadius / radius, 1.5f) * exp(-fabs(y) / scaleHeight);
+            density *= (0.5f + 1.0f * random.uniform(8)); //Add variability
+
+            writeParticle(particle(i), x, y, z, vx, vy, vz, temperature, density);
+        }
+    });
+}
+
+void DiskGenerator::generateSpiralArms(float blackHoleMass, TaskScheduler* scheduler) {
+    const float innerRadius = blackHoleMass * 0.6f;
+    const float outerRadius = blackHoleMass * 12.0f;
+    const float diskThickness = blackHoleMass * 0.8f;
+    const int offset = layout.diskParticles;
+    allocate();
+
+    //Particle id runs over all arms, arm = id / armParticles
+    forEachChunk(layout.spiralArms * layout.armParticles, scheduler, [&](int begin, int end) {
+        for (int id = begin; id < end; ++id) {
+            const int arm = id / layout.armParticles;
+            const int i = id % layout.armParticles;
+            ParticleRandom random(seed, COMPONENT_SPIRAL_ARMS, (uint32_t)id);
+
+            float armPhase = (float)arm / (float)layout.spiralArms * 2.0f * 3.14159f;
+            float t = (float)i / (float)layout.armParticles;
+            float radius = innerRadius + t * (outerRadius - innerRadius);
+
+            //Logarithmic spiral pattern
+            float spiralTightness = 0.3f;
+            float angle = armPhase + log(radius / innerRadius) / spiralTightness;
+
+            //Enhanced density along spiral arms
+            float spiralWidth = radius * 0.1f;
+            float offsetAngle = angle + (random.uniform(0) - 0.5f) * spiralWidth / radius;
+
+            float x = radius * cos(offsetAngle);
+            float z = radius * sin(offsetAngle);
+            float y = (random.uniform(1) - 0.5f) * diskThickness * 0.3f;
+
+            //Enhanced velocity in spiral arms
+            float keplerianSpeed = sqrt(blackHoleMass / radius) * 1.1f;
+            float vx = -keplerianSpeed * sin(offsetAngle);
+            float vy = (random.uniform(2) - 0.5f) * keplerianSpeed * 0.15f;
+            float vz = keplerianSpeed * cos(offsetAngle);
+
+            //Higher temperature in spiral arms
+            float temperature = pow(innerRadius / radius, 0.75f) * 1.3f;
+
+            //Higher density in spiral arms
+            float density = pow(innerRadius / radius, 1.5f) * 2.0f;
+
+            writeParticle(particle(offset + id), x, y, z, vx, vy, vz, temperature, density);
+        }
+    });
+}
+
+void DiskGenerator::generateJets(float blackHoleMass, TaskScheduler* scheduler) {
+    const float jetHeight = blackHoleMass * 15.0f;
+    const float jetRadius = blackHoleMass * 0.3f;
+    const int offset = layout.jetOffset();
+    allocate();
+
+    //Top jet first, then bottom
+    forEachChunk(2 * layout.jetParticles, scheduler, [&](int begin, int end) {
+        for (int id = begin; id < end; ++id) {
+            const int jet = id / layout.jetParticles;
+            const int i = id % layout.jetParticles;
+            ParticleRandom random(seed, COMPONENT_JETS, (uint32_t)id);
+
+            float jetDirection = (jet == 0) ? 1.0f : -1.0f;
+            float t = (float)i / (float)layout.jetParticles;
+            float y = jetDirection * t * jetHeight;
+
+            //Conical expansion of jet
+            float jetRadiusAtHeight = jetRadius * (1.0f + t * 2.0f);
+            float angle = random.uniform(0) * 2.0f * 3.14159f;
+            float radialPos = random.uniform(1) * jetRadiusAtHeight;
+
+            float x = radialPos * cos(angle);
+            float z = radialPos * sin(angle);
+
+            //High-velocity jet material
+            float jetSpeed = sqrt(blackHoleMass) * 3.0f * (1.0f - t * 0.5f);
+            float vx = (random.uniform(2) - 0.5f) * jetSpeed * 0.2f;
+            float vy = jetDirection * jetSpeed;
+            float vz = (random.uniform(3) - 0.5f) * jetSpeed * 0.2f;
+
+            //Extremely hot jet material
+            float temperature = 2.0f * (1.0f - t * 0.7f);
+
+            //Lower density in jets
+            float density = 0.1f * (1.0f - t);
+
+            writeParticle(particle(offset + id), x, y, z, vx, vy, vz, temperature, density);
+        }
+    });
+}
+
+void DiskGenerator::generateTorus(float blackHoleMass, TaskScheduler* scheduler) {
+    const float torusRadius = blackHoleMass * 3.0f;
+    const float torusThickness = blackHoleMass * 0.8f;
+    const int offset = layout.jetOffset() + 2 * layout.jetParticles;
+    allocate();
+
+    forEachChunk(layout.torusParticles, scheduler, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            ParticleRandom random(seed, COMPONENT_TORUS, (uint32_t)i);
+
+            float torusAngle = random.uniform(0) * 2.0f * 3.14159f;
+            float poloidalAngle = random.uniform(1) * 2.0f * 3.14159f;
+
+            float majorR = torusRadius + torusThickness * cos(poloidalAngle);
+            float x = majorR * cos(torusAngle);
+            float z = majorR * sin(torusAngle);
+            float y = torusThickness * sin(poloidalAngle);
+
+            //Slower motion in thick torus
+            float speed = sqrt(blackHoleMass / majorR) * 0.8f;
+            float vx = -speed * sin(torusAngle);
+            float vy = (random.uniform(2) - 0.5f) * speed * 0.3f;
+            float vz = speed * cos(torusAngle);
+
+            //Moderate temperature in torus
+            float temperature = 0.6f * (0.7f + 0.6f * random.uniform(3));
+
+            //High density in torus
+            float density = 1.5f * (0.8f + 0.4f * random.uniform(4));
+
+            writeParticle(particle(offset + i), x, y, z, vx, vy, vz, temperature, density);
+        }
+    });
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class TaskScheduler;
+
+//Particle counts of each accretion disk component
+struct DiskLayout {
+    int diskParticles = 8192;
+    int spiralArms = 2;
+    int armParticles = 1024;
+    int jetParticles = 512;     //Per jet, there are two
+    int torusParticles = 2048;
+
+    int totalParticles() const {
+        return diskParticles + spiralArms * armParticles + 2 * jetParticles + torusParticles;
+    }
+
+    //Index of the first jet particle; both jets follow contiguously
+    int jetOffset() const { return diskParticles + spiralArms * armParticles; }
+
+    //Default layout with every component scaled by factor
+    static DiskLayout scaled(double factor);
+};
+
+//Builds the accretion disk particles on the CPU, without touching OpenGL.
+//Each particle is 8 floats: position (3), velocity (3), temperature, density.
+//Random values come from a counter-based generator keyed by (seed, component, particle id,
+//attribute), so generation parallelises freely and gives bit-identical output for any
+//thread count.
+class DiskGenerator {
+public:
+    static constexpr int FLOATS_PER_PARTICLE = 8;
+
+    explicit DiskGenerator(const DiskLayout& layout = DiskLayout(), uint32_t seed = 42);
+
+    void setLayout(const DiskLayout& layout);
+    const DiskLayout& getLayout() const { return layout; }
+    void setSeed(uint32_t seed);
+    uint32_t getSeed() const { return seed; }
+
+    //Generate every component for the given black hole mass, replacing the previous particles.
+    //Chunks of particles are spread over the scheduler when one is given.
+    void generate(float blackHoleMass, TaskScheduler* scheduler = nullptr);
+
+    //Individual phases, each filling its own range of the vertices in this order
+    void generateMainDisk(float blackHoleMass, TaskScheduler* scheduler = nullptr);
+    void generateSpiralArms(float blackHoleMass, TaskScheduler* scheduler = nullptr);
+    void generateJets(float blackHoleMass, TaskScheduler* scheduler = nullptr);
+    void generateTorus(float blackHoleMass, TaskScheduler* scheduler = nullptr);
+
+    void clear();
+
+    const std::vector<float>& getVertices() const { return vertices; }
+    int getParticleCount() const { return (int)(vertices.size() / FLOATS_PER_PARTICLE); }
+
+private:
+    void allocate();
+    float* particle(int index);
+
+    DiskLayout layout;
+    uint32_t seed;
+    std::vector<float> vertices;
+};
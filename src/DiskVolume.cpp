@@ -0,0 +1,350 @@
+#include "DiskVolume.h"
+#include "DiskGenerator.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+//CPU copy of blackbodyColor in shaders/disk.frag
+static glm::vec3 blackbodyColor(float temp) {
+    temp = glm::clamp(temp, 0.0f, 1.0f);
+    if (temp < 0.25f) {
+        return glm::mix(glm::vec3(0.1f, 0.0f, 0.0f), glm::vec3(0.8f, 0.1f, 0.0f), temp * 4.0f);
+    } else if (temp < 0.5f) {
+        return glm::mix(glm::vec3(0.8f, 0.1f, 0.0f), glm::vec3(1.0f, 0.4f, 0.0f), (temp - 0.25f) * 4.0f);
+    } else if (temp < 0.75f) {
+        return glm::mix(glm::vec3(1.0f, 0.4f, 0.0f), glm::vec3(1.0f, 0.8f, 0.2f), (temp - 0.5f) * 4.0f);
+    }
+    return glm::mix(glm::vec3(1.0f, 0.8f, 0.2f), glm::vec3(0.8f, 0.9f, 1.0f), (temp - 0.75f) * 4.0f);
+}
+
+//Distances along the unit vector dir from p to where the line enters and leaves the infinite
+//cylinder of the given radius around the y axis; false if it stays outside
+static bool cylinderSpan(const glm::dvec3& p, const glm::dvec3& dir, double radius, double& enter, double& leave) {
+    const double a = dir.x * dir.x + dir.z * dir.z;
+    const double b = p.x * dir.x + p.z * dir.z;
+    const double c = p.x * p.x + p.z * p.z - radius * radius;
+    if (a <= 0.0) {
+        enter = -std::numeric_limits<double>::infinity();
+        leave = std::numeric_limits<double>::infinity();
+        return c < 0.0;
+    }
+    const double discriminant = b * b - a * c;
+    if (discriminant < 0.0) {
+        return false;
+    }
+    const double root = sqrt(discriminant);
+    enter = (-b - root) / a;
+    leave = (-b + root) / a;
+    return true;
+}
+
+//Distance along dir from p, on the side of a plane through the origin that normal points to,
+//to the plane; infinity if dir does not head towards it
+static double planeExit(const glm::dvec3& p, const glm::dvec3& dir, const glm::dvec3& normal) {
+    const double rate = glm::dot(dir, normal);
+    return rate < 0.0 ? -glm::dot(p, normal) / rate : std::numeric_limits<double>::infinity();
+}
+
+static int roundUpToBrick(int count) {
+    const int b = DiskVolume::BRICK;
+    return std::max(b, (count + b - 1) / b * b);
+}
+
+//Shared by every volume, so a volume built at the address of a destroyed one still looks new
+static std::atomic<uint64_t> nextGeneration(1);
+
+DiskVolume::DiskVolume()
+    : radial(0), azimuthal(0), vertical(0), bricksR(0), bricksPhi(0), bricksY(0), opacity(0.5),
+      emptySkipping(true), maxR(0.0), minY(0.0), voxelR(1.0), voxelPhi(1.0), voxelY(1.0), sampleSpacing(0.5),
+      innerRadius(0.0), outerRadius(0.0), generation(nextGeneration++) {
+    setResolution(64, 128, 128);
+}
+
+void DiskVolume::setResolution(int newRadial, int newAzimuthal, int newVertical) {
+    radial = roundUpToBrick(newRadial);
+    azimuthal = roundUpToBrick(newAzimuthal);
+    vertical = roundUpToBrick(newVertical);
+    bricksR = radial / BRICK;
+    bricksPhi = azimuthal / BRICK;
+    bricksY = vertical / BRICK;
+}
+
+void DiskVolume::setOpacity(double newOpacity) {
+    opacity = newOpacity;
+}
+
+void DiskVolume::clear() {
+    brickSlots.clear();
+    voxels.clear();
+    innerRadius = outerRadius = 0.0;
+    generation = nextGeneration++;
+}
+
+int32_t DiskVolume::slotOf(int ir, int ip, int iy) const {
+    return brickSlots[((size_t)(iy / BRICK) * bricksPhi + ip / BRICK) * bricksR + ir / BRICK];
+}
+
+size_t DiskVolume::voxelIndex(int32_t slot, int ir, int ip, int iy) const {
+    return (size_t)slot * (BRICK * BRICK * BRICK) + ((iy % BRICK) * BRICK + ip % BRICK) * BRICK + ir % BRICK;
+}
+
+bool DiskVolume::locate(const glm::dvec3& p, int& ir, int& ip, int& iy, double& R, double& phi) const {
+    R = sqrt(p.x * p.x + p.z * p.z);
+    phi = atan2(p.z, p.x);
+    if (phi < 0.0) phi += glm::two_pi<double>();
+    const double fy = (p.y - minY) / voxelY;
+    if (R >= maxR || fy < 0.0 || fy >= vertical) {
+        return false;
+    }
+    ir = (int)(R / voxelR);
+    ip = std::min((int)(phi / voxelPhi), azimuthal - 1);
+    iy = std::min((int)fy, vertical - 1);
+    return true;
+}
+
+void DiskVolume::build(const std::vector<float>& particles) {
+    const size_t stride = DiskGenerator::FLOATS_PER_PARTICLE;
+    ParticleArrays arrays;
+    arrays.count = particles.size() / stride;
+    if (arrays.count > 0) {
+        arrays.x = &particles[0];
+        arrays.y = &particles[1];
+        arrays.z = &particles[2];
+        arrays.temperature = &particles[6];
+        arrays.density = &particles[7];
+    }
+    arrays.stride = stride;
+    build(arrays);
+}
+
+void DiskVolume::build(const ParticleArrays& particles) {
+    clear();
+    const size_t count = particles.count, stride = particles.stride;
+    if (count == 0) {
+        return;
+    }
+
+    //Grid extent from the particles, with room for the cloud-in-cell spread of the outermost
+    double extentR = 0.0, extentY = 0.0;
+    for (size_t i = 0, at = 0; i < count; ++i, at += stride) {
+        extentR = std::max(extentR, (double)std::hypot(particles.x[at], particles.z[at]) / PARTICLE_UNITS_PER_RS);
+        extentY = std::max(extentY, (double)std::fabs(particles.y[at]) / PARTICLE_UNITS_PER_RS);
+    }
+    extentR = std::max(extentR, 1e-3);
+    extentY = std::max(extentY, 1e-3);
+    voxelR = extentR / (radial - 1);
+    voxelPhi = glm::two_pi<double>() / azimuthal;
+    voxelY = 2.0 * extentY / (vertical - 2);
+    maxR = radial * voxelR;
+    minY = -extentY - voxelY;
+    sampleSpacing = std::min(voxelR, voxelY) / SAMPLES_PER_VOXEL;
+
+    //Cloud-in-cell: the 8 voxel centres around a particle share it by trilinear weights
+    auto splat = [&](size_t at, auto&& deposit) {
+        const double x = particles.x[at] / PARTICLE_UNITS_PER_RS, z = particles.z[at] / PARTICLE_UNITS_PER_RS;
+        double phi = atan2(z, x);
+        if (phi < 0.0) phi += glm::two_pi<double>();
+        const double fr = sqrt(x * x + z * z) / voxelR - 0.5;
+        const double fp = phi / voxelPhi - 0.5;
+        const double fy = (particles.y[at] / PARTICLE_UNITS_PER_RS - minY) / voxelY - 0.5;
+        const int r0 = (int)std::floor(fr), p0 = (int)std::floor(fp), y0 = (int)std::floor(fy);
+        const double wr = fr - r0, wp = fp - p0, wy = fy - y0;
+        for (int k = 0; k < 8; ++k) {
+            const int dr = k & 1, dp = (k >> 1) & 1, dy = k >> 2;
+            //Inside the innermost voxel centre the axis folds the weight back onto the first ring
+            const int ir = std::max(r0 + dr, 0);
+            const int ip = ((p0 + dp) % azimuthal + azimuthal) % azimuthal;
+            const int iy = y0 + dy;
+            const double w = (dr ? wr : 1.0 - wr) * (dp ? wp : 1.0 - wp) * (dy ? wy : 1.0 - wy);
+            if (w > 0.0) {
+                deposit(ir, ip, iy, w);
+            }
+        }
+    };
+
+    //First pass marks the bricks any particle touches, then they get slots in table order
+    brickSlots.assign((size_t)getBrickCount(), -1);
+    for (size_t i = 0; i < count; ++i) {
+        splat(i * stride, [&](int ir, int ip, int iy, double) {
+            brickSlots[((size_t)(iy / BRICK) * bricksPhi + ip / BRICK) * bricksR + ir / BRICK] = 0;
+        });
+    }
+    int32_t stored = 0;
+    for (int32_t& slot : brickSlots) {
+        if (slot == 0) slot = stored++;
+    }
+
+    //Second pass sums density into alpha and density x temperature alongside
+    voxels.assign((size_t)stored * BRICK * BRICK * BRICK, glm::vec4(0.0f));
+    std::vector<float> heat(voxels.size(), 0.0f);
+    for (size_t i = 0; i < count; ++i) {
+        const size_t at = i * stride;
+        const float temperature = particles.temperature[at], density = particles.density[at];
+        splat(at, [&](int ir, int ip, int iy, double w) {
+            const size_t index = voxelIndex(slotOf(ir, ip, iy), ir, ip, iy);
+            voxels[index].a += (float)(w * density);
+            heat[index] += (float)(w * density * temperature);
+        });
+    }
+
+    //Density per unit volume, scaled to the default layout's particle count
+    const double scale = opacity * DiskLayout().totalParticles() / (double)count;
+    for (int by = 0; by < bricksY; ++by) {
+        for (int bp = 0; bp < bricksPhi; ++bp) {
+            for (int br = 0; br < bricksR; ++br) {
+                const int32_t slot = brickSlots[((size_t)by * bricksPhi + bp) * bricksR + br];
+                if (slot < 0) continue;
+
+                for (int v = 0; v < BRICK * BRICK * BRICK; ++v) {
+                    const int ir = br * BRICK + v % BRICK;
+                    const size_t index = (size_t)slot * (BRICK * BRICK * BRICK) + v;
+                    glm::vec4& voxel = voxels[index];
+                    if (voxel.a <= 0.0f) continue;
+                    const double volume = (ir + 0.5) * voxelR * voxelR * voxelPhi * voxelY;
+                    const float absorption = (float)(scale * voxel.a / volume);
+                    const glm::vec3 source = blackbodyColor(heat[index] / voxel.a);
+                    voxel = glm::vec4(absorption * source, absorption);
+                }
+
+                //Nearest and farthest points of the brick from the hole
+                const double r0 = br * BRICK * voxelR, r1 = r0 + BRICK * voxelR;
+                const double y0 = minY + by * BRICK * voxelY, y1 = y0 + BRICK * voxelY;
+                const double nearY = y0 > 0.0 ? y0 : y1 < 0.0 ? -y1 : 0.0;
+                const double nearest = sqrt(r0 * r0 + nearY * nearY);
+                const double farthest = sqrt(r1 * r1 + std::max(y0 * y0, y1 * y1));
+                innerRadius = outerRadius == 0.0 ? nearest : std::min(innerRadius, nearest);
+                outerRadius = std::max(outerRadius, farthest);
+            }
+        }
+    }
+}
+
+glm::vec4 DiskVolume::sample(const glm::dvec3& p) const {
+    int ir, ip, iy;
+    double R, phi;
+    if (voxels.empty() || !locate(p, ir, ip, iy, R, phi)) {
+        return glm::vec4(0.0f);
+    }
+    const int32_t slot = slotOf(ir, ip, iy);
+    return slot < 0 ? glm::vec4(0.0f) : voxels[voxelIndex(slot, ir, ip, iy)];
+}
+
+void DiskVolume::march(const glm::dvec3& a, const glm::dvec3& b, VolumeAccumulator& acc) const {
+    if (voxels.empty() || acc.opaque()) {
+        return;
+    }
+    const glm::dvec3 d = b - a;
+    const double length = glm::length(d);
+    if (length <= 0.0) {
+        return;
+    }
+
+    //Segments wholly outside the shell of stored bricks, or wholly inside it, sample nothing;
+    //the next segment starts afresh
+    const double closest = glm::length(a + glm::clamp(-glm::dot(a, d) / (length * length), 0.0, 1.0) * d);
+    if (closest >= outerRadius || std::max(glm::length(a), glm::length(b)) < innerRadius) {
+        acc.carry = 0.0;
+        return;
+    }
+
+    //Samples sit at carry + k spacing; counting in whole samples keeps skipped and plain marches
+    //on the same positions. A skip over an empty stretch of length gap goes to the first sample
+    //past it, or past the segment's end.
+    const glm::dvec3 dir = d / length;
+    const double brickR = BRICK * voxelR, brickPhi = BRICK * voxelPhi, brickY = BRICK * voxelY;
+    long k = 0;
+    double s = acc.carry;
+    auto skip = [&](double gap) {
+        const double clear = std::min(gap, length - s) / sampleSpacing;
+        k += std::max(1L, (long)std::floor(clear - 1e-6) + 1);
+        s = acc.carry + k * sampleSpacing;
+    };
+    while (s < length) {
+        const glm::dvec3 p = a + s * dir;
+        int ir, ip, iy;
+        double R, phi;
+        if (!locate(p, ir, ip, iy, R, phi)) {
+            if (!emptySkipping) {
+                skip(0.0);
+                continue;
+            }
+            //Nothing until the ray enters both the grid's slab and its cylinder
+            double enter = 0.0, leave = std::numeric_limits<double>::infinity();
+            if (dir.y != 0.0) {
+                const double t0 = (minY - p.y) / dir.y, t1 = (-minY - p.y) / dir.y;
+                enter = std::max(enter, std::min(t0, t1));
+                leave = std::min(leave, std::max(t0, t1));
+            } else if (p.y < minY || p.y >= -minY) {
+                leave = 0.0;
+            }
+            double near, far;
+            if (cylinderSpan(p, dir, maxR, near, far)) {
+                enter = std::max(enter, near);
+                leave = std::min(leave, far);
+            } else {
+                leave = 0.0;
+            }
+            skip(enter < leave ? enter : length);
+            continue;
+        }
+
+        const int32_t slot = slotOf(ir, ip, iy);
+        if (slot < 0) {
+            if (!emptySkipping) {
+                skip(0.0);
+                continue;
+            }
+            //Where the ray leaves the brick: its outer cylinder, its inner one (the innermost
+            //bricks meet at the axis instead), its y faces, or its phi faces. A brick spans at
+            //most pi in phi, so it lies on the inner side of both phi faces' planes.
+            const int br = ir / BRICK, bp = ip / BRICK, by = iy / BRICK;
+            const double r0 = br * brickR, y0 = minY + by * brickY;
+            double near, far;
+            double gap = cylinderSpan(p, dir, r0 + brickR, near, far) ? far : 0.0;
+            if (br > 0 && cylinderSpan(p, dir, r0, near, far) && near >= 0.0) {
+                gap = std::min(gap, near);
+            }
+            if (dir.y > 0.0) {
+                gap = std::min(gap, (y0 + brickY - p.y) / dir.y);
+            } else if (dir.y < 0.0) {
+                gap = std::min(gap, (y0 - p.y) / dir.y);
+            }
+            if (bricksPhi > 1) {
+                const double p0 = bp * brickPhi, p1 = p0 + brickPhi;
+                gap = std::min(gap, planeExit(p, dir, glm::dvec3(-sin(p0), 0.0, cos(p0))));
+                gap = std::min(gap, planeExit(p, dir, glm::dvec3(sin(p1), 0.0, -cos(p1))));
+            }
+            skip(gap);
+            continue;
+        }
+
+        const glm::vec4& voxel = voxels[voxelIndex(slot, ir, ip, iy)];
+        ++acc.samples;
+        if (voxel.a > 0.0f) {
+            //Constant over the sample's length: the source term emission / absorption fills in
+            //by the fraction the sample absorbs
+            const float alpha = 1.0f - std::exp(-voxel.a * (float)sampleSpacing);
+            acc.color += acc.transmittance * alpha * glm::vec3(voxel) / voxel.a;
+            acc.transmittance *= 1.0f - alpha;
+            if (acc.opaque()) {
+                return;
+            }
+        }
+        s = acc.carry + ++k * sampleSpacing;
+    }
+    acc.carry = s - length;
+}
+
+void DiskVolume::packGpuBuffers(GpuVolumeParams& params, std::vector<int32_t>& slots,
+                                std::vector<glm::vec4>& data) const {
+    params = GpuVolumeParams{empty() ? 0 : 1, bricksR, bricksPhi, bricksY,
+                             (float)maxR, (float)minY, (float)voxelR, (float)voxelPhi,
+                             (float)voxelY, (float)sampleSpacing, (float)innerRadius, (float)outerRadius};
+    slots = brickSlots;
+    data = voxels;
+    //Empty storage buffers cannot be bound, so an empty volume still gets one entry of each
+    if (slots.empty()) slots.push_back(-1);
+    if (data.empty()) data.push_back(glm::vec4(0.0f));
+}
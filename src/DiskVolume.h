@@ -0,0 +1,130 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Emission and absorption gathered along one ray, carried from segment to segment
+struct VolumeAccumulator {
+    glm::vec3 color = glm::vec3(0.0f);  //Light reaching the camera so far
+    float transmittance = 1.0f;         //Fraction of whatever lies further along that still shows
+    double carry = 0.0;                 //Path length from the start of the next segment to its first sample
+    int samples = 0;                    //Voxel fetches
+
+    //Whatever lies behind is hidden
+    bool opaque() const { return transmittance < 1.0f / 256.0f; }
+    //The accumulated volume over a background of colour behind, alpha as coverage
+    glm::vec4 over(const glm::vec4& behind) const {
+        return glm::vec4(color + transmittance * glm::vec3(behind),
+                         1.0f - transmittance * (1.0f - behind.a));
+    }
+};
+
+//Mirrors the Volume uniform block of shaders/geodesic.comp (std140, 48 bytes)
+struct GpuVolumeParams {
+    int32_t enabled;
+    int32_t bricksR, bricksPhi, bricksY;
+    float maxR, minY, voxelR, voxelPhi;
+    float voxelY, sampleSpacing, innerRadius, outerRadius;
+};
+
+//Particle attributes build() reads, each array stride floats from one particle to the next:
+//DiskGenerator's interleaved vertices, or a ParticleStore's or ParticleSnapshot's arrays (stride 1)
+struct ParticleArrays {
+    const float* x = nullptr;
+    const float* y = nullptr;
+    const float* z = nullptr;
+    const float* temperature = nullptr;
+    const float* density = nullptr;
+    size_t stride = 1;
+    size_t count = 0;
+};
+
+static_assert(sizeof(GpuVolumeParams) == 48, "GpuVolumeParams must match the Volume block in shaders/geodesic.comp");
+
+//The accretion flow as a participating medium, for the tracer's volumetric mode.
+//
+//build() bins DiskGenerator particles once into a grid in cylindrical coordinates (R, phi, y)
+//around the black hole's spin axis y, with cloud-in-cell weights so each particle spreads over
+//the 8 voxels around it. Voxels are grouped into bricks of BRICK^3; only bricks some particle
+//touches are stored, contiguously, and a brick table holds each brick's slot or -1. Each voxel
+//keeps an absorption coefficient and the emission it produces, from the particles' density and
+//their density-weighted temperature through the blackbody ramp of shaders/disk.frag.
+//
+//march() integrates the emission-absorption equation along a straight segment with point
+//samples a fixed path length apart, the phase carried between segments so a curved ray split
+//into chords samples as evenly as a straight one. From inside an empty brick, or outside the
+//grid, it jumps to the first sample past where the segment leaves the brick (or enters the
+//grid), so skipping lands on exactly the samples a plain march would take and changes nothing
+//but the cost.
+class DiskVolume {
+public:
+    static constexpr int BRICK = 8;                     //Voxels along each edge of a brick
+    static constexpr double PARTICLE_UNITS_PER_RS = 0.5;    //DiskGenerator's unit-mass horizon radius
+    static constexpr double SAMPLES_PER_VOXEL = 2.0;    //Along the shorter of the R and y voxel sides
+    static constexpr double SAMPLES_PER_SEGMENT = 8.0;  //Longest chord inside the volume, in samples
+
+    DiskVolume();
+
+    //Voxel counts along R, phi and y, each rounded up to whole bricks
+    void setResolution(int radial, int azimuthal, int vertical);
+    //Absorption per rs of particles at unit density, packed as tightly as in the default
+    //DiskLayout; denser sampling of the same flow gives the same volume
+    void setOpacity(double opacity);
+    //Segment-to-segment skipping of empty bricks; off, every sample is fetched
+    void setEmptySkipping(bool enabled) { emptySkipping = enabled; }
+
+    //Bins particles (DiskGenerator::FLOATS_PER_PARTICLE floats each, generated for unit mass)
+    //into the grid, replacing what was there
+    void build(const std::vector<float>& particles);
+    //Bins particles generated for unit mass, read in place
+    void build(const ParticleArrays& particles);
+    void clear();
+    bool empty() const { return voxels.empty(); }
+    //Changes with every build() or clear(), unique across volumes, so a renderer holding results
+    //of this volume can tell they are stale
+    uint64_t getGeneration() const { return generation; }
+
+    //Integrates the segment from a to b (rs units) into acc; returns early once acc is opaque
+    void march(const glm::dvec3& a, const glm::dvec3& b, VolumeAccumulator& acc) const;
+    //Emission (rgb) and absorption (a) of the voxel holding p, zero outside any stored brick
+    glm::vec4 sample(const glm::dvec3& p) const;
+
+    //Radii (rs) of the sphere shell holding every stored brick
+    double getInnerRadius() const { return innerRadius; }
+    double getOuterRadius() const { return outerRadius; }
+    //Path length (rs) between samples
+    double getSampleSpacing() const { return sampleSpacing; }
+    //Longest chord (rs) the kernels use inside the volume, so the straight segments marched
+    //stay close to the curved path
+    double getMaxSegment() const { return SAMPLES_PER_SEGMENT * sampleSpacing; }
+
+    int getBrickCount() const { return bricksR * bricksPhi * bricksY; }
+    int getStoredBricks() const { return (int)(voxels.size() / (BRICK * BRICK * BRICK)); }
+    size_t getBytes() const { return brickSlots.size() * sizeof(int32_t) + voxels.size() * sizeof(glm::vec4); }
+
+    //Contents of the shader's Volume block and its brick table and voxel buffers
+    void packGpuBuffers(GpuVolumeParams& params, std::vector<int32_t>& slots, std::vector<glm::vec4>& data) const;
+
+private:
+    //Voxel holding p and its distance R from the axis; false outside the grid
+    bool locate(const glm::dvec3& p, int& ir, int& ip, int& iy, double& R, double& phi) const;
+    //Slot of the brick holding voxel (ir, ip, iy), or -1; indices must be in range
+    int32_t slotOf(int ir, int ip, int iy) const;
+    size_t voxelIndex(int32_t slot, int ir, int ip, int iy) const;
+
+    int radial, azimuthal, vertical;
+    int bricksR, bricksPhi, bricksY;
+    double opacity;
+    bool emptySkipping;
+
+    double maxR, minY;                  //Grid covers R in [0, maxR), y in [minY, -minY)
+    double voxelR, voxelPhi, voxelY;
+    double sampleSpacing;
+    double innerRadius, outerRadius;
+    uint64_t generation;
+
+    std::vector<int32_t> brickSlots;    //R fastest, then phi, then y
+    std::vector<glm::vec4> voxels;      //BRICK^3 per stored brick, same order within it
+};
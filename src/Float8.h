@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+//The lane width is fixed when compiling: AVX2 builds (-mavx2, /arch:AVX2) use one 256-bit
+//register, other x86 builds a pair of SSE2 registers, which every x86-64 CPU has, and
+//anything else plain arrays the compiler may vectorise itself.
+#if defined(__AVX2__)
+#define FLOAT8_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLOAT8_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//Per-lane result of comparing two Float8s
+struct Mask8 {
+#if defined(FLOAT8_AVX2)
+    __m256 v;
+#elif defined(FLOAT8_SSE2)
+    __m128 lo, hi;
+#else
+    bool lane[8];
+#endif
+};
+
+//Eight floats operated on together, one lane per ray of a packet. Arithmetic is IEEE single
+//precision in every lane, the same as float, so a packet gives what eight float rays would.
+struct Float8 {
+#if defined(FLOAT8_AVX2)
+    __m256 v;
+    Float8() = default;
+    Float8(float x) : v(_mm256_set1_ps(x)) {}
+    explicit Float8(__m256 x) : v(x) {}
+    static Float8 load(const float* p) { return Float8(_mm256_loadu_ps(p)); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+#elif defined(FLOAT8_SSE2)
+    __m128 lo, hi;
+    Float8() = default;
+    Float8(float x) : lo(_mm_set1_ps(x)), hi(_mm_set1_ps(x)) {}
+    Float8(__m128 l, __m128 h) : lo(l), hi(h) {}
+    static Float8 load(const float* p) { return Float8(_mm_loadu_ps(p), _mm_loadu_ps(p + 4)); }
+    void store(float* p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+#else
+    float lane[8];
+    Float8() = default;
+    Float8(float x) { for (int i = 0; i < 8; ++i) lane[i] = x; }
+    static Float8 load(const float* p) { Float8 r; memcpy(r.lane, p, sizeof(r.lane)); return r; }
+    void store(float* p) const { memcpy(p, lane, sizeof(lane)); }
+#endif
+};
+
+#if defined(FLOAT8_AVX2)
+
+inline Float8 operator+(Float8 a, Float8 b) { return Float8(_mm256_add_ps(a.v, b.v)); }
+inline Float8 operator-(Float8 a, Float8 b) { return Float8(_mm256_sub_ps(a.v, b.v)); }
+inline Float8 operator*(Float8 a, Float8 b) { return Float8(_mm256_mul_ps(a.v, b.v)); }
+inline Float8 operator/(Float8 a, Float8 b) { return Float8(_mm256_div_ps(a.v, b.v)); }
+inline Float8 operator-(Float8 a) { return Float8(_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f))); }
+inline Float8 sqrt(Float8 a) { return Float8(_mm256_sqrt_ps(a.v)); }
+inline Float8 abs(Float8 a) { return Float8(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)); }
+inline Float8 min(Float8 a, Float8 b) { return Float8(_mm256_min_ps(a.v, b.v)); }
+inline Float8 max(Float8 a, Float8 b) { return Float8(_mm256_max_ps(a.v, b.v)); }
+
+//Ordered comparisons: false in any lane holding a NaN
+inline Mask8 operator<(Float8 a, Float8 b) { return Mask8{_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline Mask8 operator<=(Float8 a, Float8 b) { return Mask8{_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+inline Mask8 operator>(Float8 a, Float8 b) { return Mask8{_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+inline Mask8 operator>=(Float8 a, Float8 b) { return Mask8{_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+
+inline Mask8 operator&(Mask8 a, Mask8 b) { return Mask8{_mm256_and_ps(a.v, b.v)}; }
+inline Mask8 operator|(Mask8 a, Mask8 b) { return Mask8{_mm256_or_ps(a.v, b.v)}; }
+inline Mask8 operator!(Mask8 a) { return Mask8{_mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))}; }
+//Bit i set where lane i is true
+inline int laneBits(Mask8 m) { return _mm256_movemask_ps(m.v); }
+inline Float8 select(Mask8 m, Float8 a, Float8 b) { return Float8(_mm256_blendv_ps(b.v, a.v, m.v)); }
+
+//Exponent and mantissa of positive normal floats: x = 2^e m with m in [1, 2)
+inline void splitFloat(Float8 x, Float8& e, Float8& m) {
+    const __m256i bits = _mm256_castps_si256(x.v);
+    e = Float8(_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127))));
+    m = Float8(_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x7fffff)),
+                                                   _mm256_set1_epi32(0x3f800000))));
+}
+//2^n for whole n in [-126, 127], and floor
+inline Float8 exp2Whole(Float8 n) {
+    const __m256i e = _mm256_add_epi32(_mm256_cvttps_epi32(n.v), _mm256_set1_epi32(127));
+    return Float8(_mm256_castsi256_ps(_mm256_slli_epi32(e, 23)));
+}
+inline Float8 floor(Float8 a) { return Float8(_mm256_floor_ps(a.v)); }
+
+#elif defined(FLOAT8_SSE2)
+
+inline Float8 operator+(Float8 a, Float8 b) { return Float8(_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)); }
+inline Float8 operator-(Float8 a, Float8 b) { return Float8(_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)); }
+inline Float8 operator*(Float8 a, Float8 b) { return Float8(_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)); }
+inline Float8 operator/(Float8 a, Float8 b) { return Float8(_mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi)); }
+inline Float8 operator-(Float8 a) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    return Float8(_mm_xor_ps(a.lo, sign), _mm_xor_ps(a.hi, sign));
+}
+inline Float8 sqrt(Float8 a) { return Float8(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+inline Float8 abs(Float8 a) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    return Float8(_mm_andnot_ps(sign, a.lo), _mm_andnot_ps(sign, a.hi));
+}
+inline Float8 min(Float8 a, Float8 b) { return Float8(_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)); }
+inline Float8 max(Float8 a, Float8 b) { return Float8(_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)); }
+
+//Ordered comparisons: false in any lane holding a NaN
+inline Mask8 operator<(Float8 a, Float8 b) { return Mask8{_mm_cmplt_ps(a.lo, b.lo), _mm_cmplt_ps(a.hi, b.hi)}; }
+inline Mask8 operator<=(Float8 a, Float8 b) { return Mask8{_mm_cmple_ps(a.lo, b.lo), _mm_cmple_ps(a.hi, b.hi)}; }
+inline Mask8 operator>(Float8 a, Float8 b) { return Mask8{_mm_cmpgt_ps(a.lo, b.lo), _mm_cmpgt_ps(a.hi, b.hi)}; }
+inline Mask8 operator>=(Float8 a, Float8 b) { return Mask8{_mm_cmpge_ps(a.lo, b.lo), _mm_cmpge_ps(a.hi, b.hi)}; }
+
+inline Mask8 operator&(Mask8 a, Mask8 b) { return Mask8{_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)}; }
+inline Mask8 operator|(Mask8 a, Mask8 b) { return Mask8{_mm_or_ps(a.lo, b.lo), _mm_or_ps(a.hi, b.hi)}; }
+inline Mask8 operator!(Mask8 a) {
+    const __m128 ones = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    return Mask8{_mm_xor_ps(a.lo, ones), _mm_xor_ps(a.hi, ones)};
+}
+//Bit i set where lane i is true
+inline int laneBits(Mask8 m) { return _mm_movemask_ps(m.lo) | (_mm_movemask_ps(m.hi) << 4); }
+inline Float8 select(Mask8 m, Float8 a, Float8 b) {
+    return Float8(_mm_or_ps(_mm_and_ps(m.lo, a.lo), _mm_andnot_ps(m.lo, b.lo)),
+                  _mm_or_ps(_mm_and_ps(m.hi, a.hi), _mm_andnot_ps(m.hi, b.hi)));
+}
+
+//Exponent and mantissa of positive normal floats: x = 2^e m with m in [1, 2)
+inline void splitFloat(Float8 x, Float8& e, Float8& m) {
+    const __m128i bias = _mm_set1_epi32(127), mantissa = _mm_set1_epi32(0x7fffff), one = _mm_set1_epi32(0x3f800000);
+    const __m128i lo = _mm_castps_si128(x.lo), hi = _mm_castps_si128(x.hi);
+    e = Float8(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(lo, 23), bias)),
+               _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(hi, 23), bias)));
+    m = Float8(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(lo, mantissa), one)),
+               _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(hi, mantissa), one)));
+}
+//2^n for whole n in [-126, 127], and floor
+inline Float8 exp2Whole(Float8 n) {
+    const __m128i bias = _mm_set1_epi32(127);
+    return Float8(_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n.lo), bias), 23)),
+                  _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n.hi), bias), 23)));
+}
+inline Float8 floor(Float8 a) {
+    //SSE2 only truncates, so step down where that rounded up
+    const __m128 tlo = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.lo)), thi = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.hi));
+    const __m128 one = _mm_set1_ps(1.0f);
+    return Float8(_mm_sub_ps(tlo, _mm_and_ps(_mm_cmpgt_ps(tlo, a.lo), one)),
+                  _mm_sub_ps(thi, _mm_and_ps(_mm_cmpgt_ps(thi, a.hi), one)));
+}
+
+#else
+
+#define FLOAT8_LANEWISE(expression) Float8 r; for (int i = 0; i < 8; ++i) r.lane[i] = (expression); return r
+#define MASK8_LANEWISE(expression) Mask8 r; for (int i = 0; i < 8; ++i) r.lane[i] = (expression); return r
+
+inline Float8 operator+(Float8 a, Float8 b) { FLOAT8_LANEWISE(a.lane[i] + b.lane[i]); }
+inline Float8 operator-(Float8 a, Float8 b) { FLOAT8_LANEWISE(a.lane[i] - b.lane[i]); }
+inline Float8 operator*(Float8 a, Float8 b) { FLOAT8_LANEWISE(a.lane[i] * b.lane[i]); }
+inline Float8 operator/(Float8 a, Float8 b) { FLOAT8_LANEWISE(a.lane[i] / b.lane[i]); }
+inline Float8 operator-(Float8 a) { FLOAT8_LANEWISE(-a.lane[i]); }
+inline Float8 sqrt(Float8 a) { FLOAT8_LANEWISE(std::sqrt(a.lane[i])); }
+inline Float8 abs(Float8 a) { FLOAT8_LANEWISE(std::fabs(a.lane[i])); }
+inline Float8 min(Float8 a, Float8 b) { FLOAT8_LANEWISE(a.lane[i] < b.lane[i] ? a.lane[i] : b.lane[i]); }
+inline Float8 max(Float8 a, Float8 b) { FLOAT8_LANEWISE(a.lane[i] > b.lane[i] ? a.lane[i] : b.lane[i]); }
+
+inline Mask8 operator<(Float8 a, Float8 b) { MASK8_LANEWISE(a.lane[i] < b.lane[i]); }
+inline Mask8 operator<=(Float8 a, Float8 b) { MASK8_LANEWISE(a.lane[i] <= b.lane[i]); }
+inline Mask8 operator>(Float8 a, Float8 b) { MASK8_LANEWISE(a.lane[i] > b.lane[i]); }
+inline Mask8 operator>=(Float8 a, Float8 b) { MASK8_LANEWISE(a.lane[i] >= b.lane[i]); }
+
+inline Mask8 operator&(Mask8 a, Mask8 b) { MASK8_LANEWISE(a.lane[i] && b.lane[i]); }
+inline Mask8 operator|(Mask8 a, Mask8 b) { MASK8_LANEWISE(a.lane[i] || b.lane[i]); }
+inline Mask8 operator!(Mask8 a) { MASK8_LANEWISE(!a.lane[i]); }
+inline int laneBits(Mask8 m) {
+    int bits = 0;
+    for (int i = 0; i < 8; ++i) bits |= m.lane[i] ? 1 << i : 0;
+    return bits;
+}
+inline Float8 select(Mask8 m, Float8 a, Float8 b) { FLOAT8_LANEWISE(m.lane[i] ? a.lane[i] : b.lane[i]); }
+
+inline void splitFloat(Float8 x, Float8& e, Float8& m) {
+    for (int i = 0; i < 8; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &x.lane[i], sizeof(bits));
+        e.lane[i] = (float)((int)(bits >> 23) - 127);
+        bits = (bits & 0x7fffffu) | 0x3f800000u;
+        memcpy(&m.lane[i], &bits, sizeof(bits));
+    }
+}
+inline Float8 exp2Whole(Float8 n) { FLOAT8_LANEWISE(std::ldexp(1.0f, (int)n.lane[i])); }
+inline Float8 floor(Float8 a) { FLOAT8_LANEWISE(std::floor(a.lane[i])); }
+
+#undef FLOAT8_LANEWISE
+#undef MASK8_LANEWISE
+
+#endif
+
+inline bool any(Mask8 m) { return laneBits(m) != 0; }
+
+//x^y for positive finite x, to about 1e-4 relative: log2 and exp2 by short polynomials on the
+//mantissa and fraction. Meant for step-size control, where a few digits are plenty.
+inline Float8 fastPow(Float8 x, float y) {
+    Float8 e, m;
+    splitFloat(x, e, m);
+    const Float8 t = m - 1.0f;
+    const Float8 log2x = e + ((((t * -0.0800109f + 0.3154676f) * t - 0.6729342f) * t + 1.4373022f) * t + 0.0001002f);
+    const Float8 p = max(min(log2x * y, 127.0f), -126.0f);
+    const Float8 n = floor(p);
+    const Float8 f = p - n;
+    return exp2Whole(n) * (((f * 0.0790857f + 0.2245163f) * f + 0.6963905f) * f + 0.9998967f);
+}
@@ -0,0 +1,216 @@
+#include "FrameWriter.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static unsigned char toByte(float value) {
+    return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+FrameWriter::FrameWriter()
+    : stream(nullptr), width(0), height(0), encodedBytes(0), stopping(false), failed(false) {
+}
+
+FrameWriter::~FrameWriter() {
+    std::string error;
+    finish(error);
+}
+
+bool FrameWriter::open(const std::string& output, int frameWidth, int frameHeight, int fps, std::string& error) {
+    width = frameWidth;
+    height = frameHeight;
+    stats = FrameWriterStats();
+
+    const std::string extension = ".y4m";
+    if (output.size() >= extension.size() &&
+        output.compare(output.size() - extension.size(), extension.size(), extension) == 0) {
+        stream = fopen(output.c_str(), "wb");
+        if (!stream) {
+            error = "cannot open " + output;
+            return false;
+        }
+        fprintf(stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+    } else if (output.find('%') != std::string::npos) {
+        pattern = output;
+    } else {
+        size_t dot = output.find_last_of('.');
+        size_t slash = output.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            dot = output.size();
+        }
+        pattern = output.substr(0, dot) + "%05d" + output.substr(dot);
+    }
+
+    pool.clear();
+    freeFrames.clear();
+    for (int i = 0; i < POOL_SIZE; ++i) {
+        pool.emplace_back(new Image());
+        freeFrames.push_back(pool.back().get());
+    }
+    poolBytes.assign(POOL_SIZE, 0);
+    encodedBytes = 0;
+    stopping = false;
+    failed = false;
+    writer = std::thread(&FrameWriter::writerLoop, this);
+    return true;
+}
+
+std::string FrameWriter::framePath(int frame) const {
+    std::vector<char> path(pattern.size() + 32);
+    snprintf(path.data(), path.size(), pattern.c_str(), frame);
+    return std::string(path.data());
+}
+
+Image* FrameWriter::acquire() {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    frameFree.wait(lock, [this] { return !freeFrames.empty(); });
+    Image* frame = freeFrames.back();
+    freeFrames.pop_back();
+    stats.stallSeconds += secondsSince(start);
+    return frame;
+}
+
+bool FrameWriter::submit(Image* frame) {
+    std::lock_guard<std::mutex> lock(mutex);
+    queued.push_back(frame);
+    poolBytes[poolIndex(frame)] = frame->getPixels().capacity() * sizeof(glm::vec4);
+    notePeak();
+    frameQueued.notify_one();
+    return !failed;
+}
+
+bool FrameWriter::finish(std::string& error) {
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        frameQueued.notify_one();
+        writer.join();
+    }
+    if (stream) {
+        if (fclose(stream) != 0 && !failed) {
+            failed = true;
+            failure = "error closing the output stream";
+        }
+        stream = nullptr;
+    }
+    error = failure;
+    return !failed;
+}
+
+size_t FrameWriter::poolIndex(const Image* frame) const {
+    size_t index = 0;
+    while (pool[index].get() != frame) {
+        ++index;
+    }
+    return index;
+}
+
+void FrameWriter::notePeak() {
+    size_t bytes = encodedBytes;
+    for (size_t frameBytes : poolBytes) {
+        bytes += frameBytes;
+    }
+    stats.peakBytes = std::max(stats.peakBytes, bytes);
+}
+
+void FrameWriter::writerLoop() {
+    int index = 0;
+    for (;;) {
+        Image* frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameQueued.wait(lock, [this] { return stopping || !queued.empty(); });
+            if (queued.empty()) {
+                return;
+            }
+            frame = queued.front();
+            queued.pop_front();
+        }
+
+        //After a failure frames are still recycled so the renderer never blocks forever
+        bool ok = failed || writeFrame(*frame, index++);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ok) {
+            failed = true;
+        }
+        encodedBytes = encoded.capacity();
+        notePeak();
+        freeFrames.push_back(frame);
+        frameFree.notify_one();
+    }
+}
+
+bool FrameWriter::writeFrame(const Image& frame, int index) {
+    PROFILE_SCOPE("frame write");
+    if (frame.getWidth() != width || frame.getHeight() != height) {
+        failure = "frame " + std::to_string(index) + " has the wrong size";
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (stream) {
+        encodeY4M(frame);
+        stats.encodeSeconds += secondsSince(start);
+        start = std::chrono::steady_clock::now();
+        if (fputs("FRAME\n", stream) < 0 || fwrite(encoded.data(), 1, encoded.size(), stream) != encoded.size()) {
+            failure = "error writing frame " + std::to_string(index);
+            return false;
+        }
+        stats.writeSeconds += secondsSince(start);
+        stats.bytesWritten += encoded.size() + 6;
+    } else {
+        //Image::writePPM converts row by row, so there is no separate encode step
+        const std::string path = framePath(index);
+        if (!frame.writePPM(path)) {
+            failure = "cannot write " + path;
+            return false;
+        }
+        stats.writeSeconds += secondsSince(start);
+        stats.bytesWritten += (size_t)width * height * 3;
+    }
+    stats.frames++;
+    return true;
+}
+
+void FrameWriter::encodeY4M(const Image& frame) {
+    //JFIF full-range BT.601. Chroma is taken from the mean colour of each 2x2 block, edge
+    //pixels are repeated when a dimension is odd.
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    const size_t lumaSize = (size_t)width * height;
+    const size_t chromaSize = (size_t)chromaWidth * chromaHeight;
+    encoded.resize(lumaSize + 2 * chromaSize);
+    unsigned char* luma = encoded.data();
+    unsigned char* cb = luma + lumaSize;
+    unsigned char* cr = cb + chromaSize;
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const glm::vec4& c = frame.at(x, y);
+            glm::vec3 rgb = glm::clamp(glm::vec3(c), 0.0f, 1.0f);
+            luma[(size_t)y * width + x] = toByte(0.299f * rgb.r + 0.587f * rgb.g + 0.114f * rgb.b);
+        }
+    }
+
+    for (int cy = 0; cy < chromaHeight; ++cy) {
+        const int y0 = 2 * cy, y1 = std::min(y0 + 1, height - 1);
+        for (int cx = 0; cx < chromaWidth; ++cx) {
+            const int x0 = 2 * cx, x1 = std::min(x0 + 1, width - 1);
+            glm::vec3 rgb = (glm::clamp(glm::vec3(frame.at(x0, y0)), 0.0f, 1.0f) +
+                             glm::clamp(glm::vec3(frame.at(x1, y0)), 0.0f, 1.0f) +
+                             glm::clamp(glm::vec3(frame.at(x0, y1)), 0.0f, 1.0f) +
+                             glm::clamp(glm::vec3(frame.at(x1, y1)), 0.0f, 1.0f)) * 0.25f;
+            const size_t i = (size_t)cy * chromaWidth + cx;
+            cb[i] = toByte(0.5f - 0.168736f * rgb.r - 0.331264f * rgb.g + 0.5f * rgb.b);
+            cr[i] = toByte(0.5f + 0.5f * rgb.r - 0.418688f * rgb.g - 0.081312f * rgb.b);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Image.h"
+
+struct FrameWriterStats {
+    int frames = 0;
+    size_t bytesWritten = 0;
+    double encodeSeconds = 0.0;     //Float to 8-bit conversion, on the writer thread
+    double writeSeconds = 0.0;      //File I/O, on the writer thread
+    double stallSeconds = 0.0;      //Time acquire() blocked the renderer waiting for a free frame
+    size_t peakBytes = 0;           //Frame pool plus encode buffer at their largest
+};
+
+//Background encoder and writer for frame sequences.
+//The renderer takes a frame from a small pool with acquire(), traces into it and hands it
+//back with submit(); a writer thread converts it to 8-bit and writes it while the next frame
+//is being traced, then returns it to the pool. The pool bounds memory: with POOL_SIZE frames
+//at most one is being traced while the others wait for or go through the writer.
+//
+//Outputs ending in ".y4m" are one YUV4MPEG2 stream (4:2:0, full-range BT.601, what ffmpeg
+//reads as yuvj420p). Anything else is a numbered PPM sequence: the path is a printf pattern
+//such as "frames/%05d.ppm", and a path without '%' gets the frame number before its extension.
+class FrameWriter {
+public:
+    static constexpr int POOL_SIZE = 2;
+
+    FrameWriter();
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    bool open(const std::string& output, int width, int height, int fps, std::string& error);
+
+    //Blocks until a pooled frame is free. Its contents are whatever it last held.
+    Image* acquire();
+    //Queues a frame from acquire() for writing, in submission order. Returns false once
+    //any write has failed; the error is reported by finish().
+    bool submit(Image* frame);
+    //Writes everything queued, stops the writer thread and closes the output
+    bool finish(std::string& error);
+
+    bool isStream() const { return stream != nullptr; }
+    //File name of a frame in an image sequence
+    std::string framePath(int frame) const;
+
+    const FrameWriterStats& getStats() const { return stats; }
+
+private:
+    void writerLoop();
+    bool writeFrame(const Image& frame, int index);
+    void encodeY4M(const Image& frame);
+    void notePeak();
+    size_t poolIndex(const Image* frame) const;
+
+    std::string pattern;                //Image sequence pattern, empty for a stream
+    FILE* stream;
+    int width;
+    int height;
+
+    std::vector<std::unique_ptr<Image>> pool;
+    std::vector<unsigned char> encoded; //Y4M planes of the frame being written
+
+    //Memory held by each pooled frame and the encode buffer, updated under the mutex by
+    //whichever thread owns them at the time
+    std::vector<size_t> poolBytes;
+    size_t encodedBytes;
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable frameFree;
+    std::condition_variable frameQueued;
+    std::vector<Image*> freeFrames;
+    std::deque<Image*> queued;
+    bool stopping;
+    bool failed;
+    std::string failure;
+
+    FrameWriterStats stats;
+};
@@ -0,0 +1,965 @@
+#include "GeodesicTracer.h"
+#include "DiskVolume.h"
+#include "PlanarKernel.h"
+#include "Profiler.h"
+#include "StarCatalog.h"
+#include "TaskScheduler.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+TraceCamera TraceCamera::orbit(double radius, double yawDegrees, double pitchDegrees,
+                               double fovDegrees, double aspect) {
+    const double yaw = glm::radians(yawDegrees);
+    const double pitch = glm::radians(pitchDegrees);
+
+    TraceCamera camera;
+    camera.position.x = radius * cos(pitch) * cos(yaw);
+    camera.position.y = radius * sin(pitch);
+    camera.position.z = radius * cos(pitch) * sin(yaw);
+
+    //Look at the origin with +y up
+    camera.forward = glm::normalize(-camera.position);
+    camera.right = glm::normalize(glm::cross(camera.forward, glm::dvec3(0.0, 1.0, 0.0)));
+    camera.up = glm::cross(camera.right, camera.forward);
+    camera.tanHalfFov = tan(glm::radians(fovDegrees) * 0.5);
+    camera.aspect = aspect;
+    camera.moving = false;
+    return camera;
+}
+
+RenderStats& RenderStats::operator+=(const WorkerStats& worker) {
+    rays += worker.rays;
+    steps += worker.steps;
+    for (int i = 0; i < 4; ++i) {
+        hits[i] += worker.hits[i];
+    }
+    for (int i = 0; i < 5; ++i) {
+        culled[i] += worker.culled[i];
+    }
+    return *this;
+}
+
+RenderStats& RenderStats::operator+=(const RenderStats& other) {
+    rays += other.rays;
+    steps += other.steps;
+    for (int i = 0; i < 4; ++i) {
+        hits[i] += other.hits[i];
+    }
+    for (int i = 0; i < 5; ++i) {
+        culled[i] += other.culled[i];
+    }
+    seconds += other.seconds;
+    threads = std::max(threads, other.threads);
+    steals += other.steals;
+    return *this;
+}
+
+Ray initRay(const glm::dvec3& pos, const glm::dvec3& dir, double rs) {
+    Ray ray;
+    ray.x = pos.x; ray.y = pos.y; ray.z = pos.z;
+    ray.r = glm::length(pos);
+    ray.theta = acos(pos.z / ray.r);
+    ray.phi = atan2(pos.y, pos.x);
+
+    const double sinTheta = sin(ray.theta), cosTheta = cos(ray.theta);
+    const double sinPhi = sin(ray.phi), cosPhi = cos(ray.phi);
+    const double dx = dir.x, dy = dir.y, dz = dir.z;
+    ray.dr     = sinTheta * cosPhi * dx + sinTheta * sinPhi * dy + cosTheta * dz;
+    ray.dtheta = (cosTheta * cosPhi * dx + cosTheta * sinPhi * dy - sinTheta * dz) / ray.r;
+    ray.dphi   = (-sinPhi * dx + cosPhi * dy) / (ray.r * sinTheta);
+
+    ray.L = ray.r * ray.r * sinTheta * ray.dphi;
+    const double f = 1.0 - rs / ray.r;
+    //Null condition: f dt^2 = dr^2 / f + r^2 (dtheta^2 + sin^2 dphi^2)
+    const double dt_dL = sqrt((ray.dr * ray.dr) / (f * f)
+                            + ray.r * ray.r * (ray.dtheta * ray.dtheta + sinTheta * sinTheta * ray.dphi * ray.dphi) / f);
+    ray.E = f * dt_dL;
+
+    return ray;
+}
+
+void geodesicRHS(const glm::dvec3& q, const glm::dvec3& p, double E, double rs, glm::dvec3& dq, glm::dvec3& dp) {
+    const double r = q.x, theta = q.y;
+    const double dr = p.x, dtheta = p.y, dphi = p.z;
+    const double f = 1.0 - rs / r;
+    const double dt_dL = E / f;
+    const double sinTheta = sin(theta), cosTheta = cos(theta);
+
+    dq = p;
+    dp.x = -(rs / (2.0 * r * r)) * f * dt_dL * dt_dL
+         + (rs / (2.0 * r * r * f)) * dr * dr
+         + r * f * (dtheta * dtheta + sinTheta * sinTheta * dphi * dphi);
+    dp.y = -2.0 * dr * dtheta / r + sinTheta * cosTheta * dphi * dphi;
+    dp.z = -2.0 * dr * dphi / r - 2.0 * cosTheta / sinTheta * dtheta * dphi;
+}
+
+void geodesicRHS(const Ray& ray, double rs, glm::dvec3& d1, glm::dvec3& d2) {
+    geodesicRHS(glm::dvec3(ray.r, ray.theta, ray.phi), glm::dvec3(ray.dr, ray.dtheta, ray.dphi),
+                ray.E, rs, d1, d2);
+}
+
+void eulerStep(Ray& ray, double dL, double rs) {
+    glm::dvec3 k1a, k1b;
+    geodesicRHS(ray, rs, k1a, k1b);
+
+    ray.r      += dL * k1a.x;
+    ray.theta  += dL * k1a.y;
+    ray.phi    += dL * k1a.z;
+    ray.dr     += dL * k1b.x;
+    ray.dtheta += dL * k1b.y;
+    ray.dphi   += dL * k1b.z;
+
+    ray.x = ray.r * sin(ray.theta) * cos(ray.phi);
+    ray.y = ray.r * sin(ray.theta) * sin(ray.phi);
+    ray.z = ray.r * cos(ray.theta);
+}
+
+bool dormandPrinceStep(Ray& ray, double& h, double rs, double relTol, double absTol) {
+    //Dormand-Prince 5(4) tableau
+    static const double a21 = 1.0 / 5.0;
+    static const double a31 = 3.0 / 40.0, a32 = 9.0 / 40.0;
+    static const double a41 = 44.0 / 45.0, a42 = -56.0 / 15.0, a43 = 32.0 / 9.0;
+    static const double a51 = 19372.0 / 6561.0, a52 = -25360.0 / 2187.0, a53 = 64448.0 / 6561.0, a54 = -212.0 / 729.0;
+    static const double a61 = 9017.0 / 3168.0, a62 = -355.0 / 33.0, a63 = 46732.0 / 5247.0, a64 = 49.0 / 176.0,
+                        a65 = -5103.0 / 18656.0;
+    static const double b1 = 35.0 / 384.0, b3 = 500.0 / 1113.0, b4 = 125.0 / 192.0, b5 = -2187.0 / 6784.0,
+                        b6 = 11.0 / 84.0;
+    //Difference between the 5th and embedded 4th order weights
+    static const double e1 = 71.0 / 57600.0, e3 = -71.0 / 16695.0, e4 = 71.0 / 1920.0, e5 = -17253.0 / 339200.0,
+                        e6 = 22.0 / 525.0, e7 = -1.0 / 40.0;
+
+    const glm::dvec3 q(ray.r, ray.theta, ray.phi);
+    const glm::dvec3 p(ray.dr, ray.dtheta, ray.dphi);
+    const double E = ray.E;
+
+    glm::dvec3 kq1, kp1, kq2, kp2, kq3, kp3, kq4, kp4, kq5, kp5, kq6, kp6, kq7, kp7;
+    geodesicRHS(q, p, E, rs, kq1, kp1);
+    geodesicRHS(q + h * (a21 * kq1), p + h * (a21 * kp1), E, rs, kq2, kp2);
+    geodesicRHS(q + h * (a31 * kq1 + a32 * kq2), p + h * (a31 * kp1 + a32 * kp2), E, rs, kq3, kp3);
+    geodesicRHS(q + h * (a41 * kq1 + a42 * kq2 + a43 * kq3),
+                p + h * (a41 * kp1 + a42 * kp2 + a43 * kp3), E, rs, kq4, kp4);
+    geodesicRHS(q + h * (a51 * kq1 + a52 * kq2 + a53 * kq3 + a54 * kq4),
+                p + h * (a51 * kp1 + a52 * kp2 + a53 * kp3 + a54 * kp4), E, rs, kq5, kp5);
+    geodesicRHS(q + h * (a61 * kq1 + a62 * kq2 + a63 * kq3 + a64 * kq4 + a65 * kq5),
+                p + h * (a61 * kp1 + a62 * kp2 + a63 * kp3 + a64 * kp4 + a65 * kp5), E, rs, kq6, kp6);
+
+    const glm::dvec3 qNew = q + h * (b1 * kq1 + b3 * kq3 + b4 * kq4 + b5 * kq5 + b6 * kq6);
+    const glm::dvec3 pNew = p + h * (b1 * kp1 + b3 * kp3 + b4 * kp4 + b5 * kp5 + b6 * kp6);
+    geodesicRHS(qNew, pNew, E, rs, kq7, kp7);
+
+    const glm::dvec3 errQ = h * (e1 * kq1 + e3 * kq3 + e4 * kq4 + e5 * kq5 + e6 * kq6 + e7 * kq7);
+    const glm::dvec3 errP = h * (e1 * kp1 + e3 * kp3 + e4 * kp4 + e5 * kp5 + e6 * kp6 + e7 * kp7);
+
+    //Per-component scales: absTol is given in units where rs = 1
+    const glm::dvec3 scaleQ = glm::dvec3(absTol * rs, absTol, absTol)
+                            + relTol * glm::max(glm::abs(q), glm::abs(qNew));
+    const glm::dvec3 scaleP = glm::dvec3(absTol, absTol / q.x, absTol / q.x)
+                            + relTol * glm::max(glm::abs(p), glm::abs(pNew));
+    const glm::dvec3 ratioQ = glm::abs(errQ) / scaleQ;
+    const glm::dvec3 ratioP = glm::abs(errP) / scaleP;
+    const double err = std::max(std::max(std::max(ratioQ.x, ratioQ.y), std::max(ratioQ.z, ratioP.x)),
+                                std::max(ratioP.y, ratioP.z));
+
+    //NaN (a stage fell inside the horizon) fails this test and shrinks the step
+    if (!(err <= 1.0)) {
+        h *= std::isfinite(err) ? std::max(0.2, 0.9 * pow(err, -0.25)) : 0.2;
+        return false;
+    }
+
+    ray.r = qNew.x; ray.theta = qNew.y; ray.phi = qNew.z;
+    ray.dr = pNew.x; ray.dtheta = pNew.y; ray.dphi = pNew.z;
+    ray.x = ray.r * sin(ray.theta) * cos(ray.phi);
+    ray.y = ray.r * sin(ray.theta) * sin(ray.phi);
+    ray.z = ray.r * cos(ray.theta);
+
+    h *= err > 0.0 ? glm::clamp(0.9 * pow(err, -0.2), 0.2, 5.0) : 5.0;
+    return true;
+}
+
+bool binetStep(glm::dvec2& state, double& h, double relTol, double absTol) {
+    //The double instance of the templated step, so every precision shares one tableau
+    return binetStepLanes<double>(state.x, state.y, h, relTol, absTol);
+}
+
+glm::dvec3 rayDirection(const Ray& ray) {
+    const double sinTheta = sin(ray.theta), cosTheta = cos(ray.theta);
+    const double sinPhi = sin(ray.phi), cosPhi = cos(ray.phi);
+    const double r = ray.r;
+    return glm::dvec3(
+        sinTheta * cosPhi * ray.dr + r * cosTheta * cosPhi * ray.dtheta - r * sinTheta * sinPhi * ray.dphi,
+        sinTheta * sinPhi * ray.dr + r * cosTheta * sinPhi * ray.dtheta + r * sinTheta * cosPhi * ray.dphi,
+        cosTheta * ray.dr - r * sinTheta * ray.dtheta);
+}
+
+//Gauss-Legendre nodes and weights on [0, 1]
+static const double GAUSS_NODES[8] = {
+    0.0198550717512319, 0.1016667612931866, 0.2372337950418355, 0.4082826787521751,
+    0.5917173212478249, 0.7627662049581645, 0.8983332387068134, 0.9801449282487681};
+static const double GAUSS_WEIGHTS[8] = {
+    0.0506142681451881, 0.1111905172266872, 0.1568533229389436, 0.1813418916891810,
+    0.1813418916891810, 0.1568533229389436, 0.1111905172266872, 0.0506142681451881};
+
+//psi swept between uStart and uEnd, the integral of du / sqrt(1/b^2 - u^2 + u^3). Substituting
+//u = uEnd - (uEnd - uStart) t^2 removes the square-root singularity when uEnd is a turning point.
+static double deflectionIntegral(double uStart, double uEnd, double inverseImpact2) {
+    const double span = uEnd - uStart;
+    double sum = 0.0;
+    for (int i = 0; i < 8; ++i) {
+        const double t = GAUSS_NODES[i];
+        const double u = uEnd - span * t * t;
+        const double f = inverseImpact2 - u * u + u * u * u;
+        sum += GAUSS_WEIGHTS[i] * 2.0 * span * t / sqrt(std::max(f, 1e-300));
+    }
+    return sum;
+}
+
+double remainingDeflection(double u, double du) {
+    const double inverseImpact2 = du * du + u * u - u * u * u;
+    if (inverseImpact2 >= 4.0 / 27.0 || u >= 2.0 / 3.0) {
+        //No periapsis to go round: outbound rays leave directly, inbound ones fall in
+        return du <= 0.0 ? deflectionIntegral(0.0, u, inverseImpact2) : 0.0;
+    }
+    //Periapsis is the smallest positive root of u^3 - u^2 + 1/b^2, polished by one Newton step.
+    //Both pieces end there, so neither integrand is steep when u is close to it.
+    double periapsis = 1.0 / 3.0 + 2.0 / 3.0 * cos(acos(1.0 - 13.5 * inverseImpact2) / 3.0 - 2.0 * glm::pi<double>() / 3.0);
+    periapsis -= (periapsis * periapsis * (1.0 - periapsis) - inverseImpact2) / (periapsis * (2.0 - 3.0 * periapsis));
+    u = std::min(u, periapsis);
+    const double fromPeriapsis = deflectionIntegral(0.0, periapsis, inverseImpact2);
+    const double toPeriapsis = deflectionIntegral(u, periapsis, inverseImpact2);
+    return du <= 0.0 ? fromPeriapsis - toPeriapsis : fromPeriapsis + toPeriapsis;
+}
+
+glm::dvec3 escapeDirection(const glm::dvec3& pos, const glm::dvec3& dir, double rs) {
+    const double r = glm::length(pos);
+    const glm::dvec3 e1 = pos / r;
+    const glm::dvec3 d = glm::normalize(dir);
+    const double cosAlpha = glm::dot(d, e1);
+    const glm::dvec3 tangential = d - cosAlpha * e1;
+    const double sinAlpha = glm::length(tangential);
+    if (sinAlpha < 1e-12) {
+        return d;
+    }
+    //Far away the ray moves radially, so it leaves along the position it reaches at infinity
+    const double u = rs / r;
+    const double psi = remainingDeflection(u, -u * cosAlpha / sinAlpha);
+    return cos(psi) * e1 + sin(psi) * (tangential / sinAlpha);
+}
+
+bool crossesEquatorialPlane(const glm::dvec3& oldPos, const glm::dvec3& newPos, double diskR1, double diskR2) {
+    const bool crossed = oldPos.y * newPos.y < 0.0;
+    const double r = glm::length(glm::dvec2(newPos.x, newPos.z));
+    return crossed && r >= diskR1 && r <= diskR2;
+}
+
+static HitType culledHit(CullType cull) {
+    return cull == CullType::CapturedAtStart || cull == CullType::Captured ? HitType::BlackHole : HitType::None;
+}
+
+GeodesicTracer::GeodesicTracer() {
+    setScene(scene);
+}
+
+void GeodesicTracer::setScene(const TraceScene& newScene) {
+    scene = newScene;
+
+    if (scene.volume && !scene.volume->empty()) {
+        cullInnerR = scene.volume->getInnerRadius() * scene.rs;
+        cullOuterR = std::max(scene.volume->getOuterRadius() * scene.rs, 1.5 * scene.rs);
+    } else {
+        scene.volume = nullptr;
+        cullInnerR = scene.diskR1;
+        cullOuterR = std::max(scene.diskR2, 1.5 * scene.rs);
+    }
+    for (const TraceObject& object : scene.objects) {
+        const double distance = glm::length(object.center);
+        cullInnerR = std::min(cullInnerR, distance - object.radius);
+        cullOuterR = std::max(cullOuterR, distance + object.radius);
+    }
+    std::vector<BoundingSphere> spheres;
+    spheres.reserve(scene.objects.size());
+    for (const TraceObject& object : scene.objects) {
+        spheres.push_back(BoundingSphere{object.center, object.radius});
+    }
+    objectBVH.build(spheres);
+
+    const double uOuter = scene.rs / cullOuterR;
+    cullOuterBarrier = uOuter * uOuter * (1.0 - uOuter);
+}
+
+void GeodesicTracer::setSettings(const TraceSettings& newSettings) {
+    settings = newSettings;
+}
+
+const DeflectionTable& GeodesicTracer::getDeflectionTable() const {
+    std::call_once(deflectionTableBuilt, [this] { deflectionTable.build(); });
+    return deflectionTable;
+}
+
+double GeodesicTracer::inverseImpactSquared(const glm::dvec3& pos, const glm::dvec3& dir) const {
+    //u' = -u cot(alpha) at the start, as in tracePlanar, so 1/b^2 = u^2 / sin^2(alpha) - u^3
+    const double r0 = glm::length(pos);
+    const double u0 = scene.rs / r0;
+    const double cosAlpha = glm::dot(glm::normalize(dir), pos / r0);
+    const double sin2Alpha = 1.0 - cosAlpha * cosAlpha;
+    if (sin2Alpha <= 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return u0 * u0 / sin2Alpha - u0 * u0 * u0;
+}
+
+CullType GeodesicTracer::cullRay(double r, double dr, double inverseImpact2, int steps) const {
+    const bool start = steps == 0;
+    if (dr >= 0.0) {
+        if (r > cullOuterR) {
+            return start ? CullType::EscapedAtStart : CullType::Escaped;
+        }
+        return CullType::None;
+    }
+
+    //Inbound: captured below the critical impact parameter (1/b^2 > 4/27) or inside the
+    //photon sphere, turned back before reaching cullOuterR when 1/b^2 is under the barrier there
+    if (r < cullInnerR && (inverseImpact2 > 4.0 / 27.0 || r < 1.5 * scene.rs)) {
+        return start ? CullType::CapturedAtStart : CullType::Captured;
+    }
+    if (r > cullOuterR && inverseImpact2 < cullOuterBarrier) {
+        return start ? CullType::EscapedAtStart : CullType::Escaped;
+    }
+    return CullType::None;
+}
+
+bool GeodesicTracer::interceptObject(const glm::dvec3& a, const glm::dvec3& b, glm::dvec3& hitPos,
+                                     int& objectIndex) const {
+    //Whole segments rather than end points, so long adaptive steps cannot jump over a body
+    double t;
+    if (!objectBVH.intersectSegment(a, b, t, objectIndex)) {
+        return false;
+    }
+    hitPos = a + t * (b - a);
+    return true;
+}
+
+void GeodesicTracer::packObjectBuffers(std::vector<GpuSceneObject>& objects, std::vector<GpuBVHNode>& nodes) const {
+    const std::vector<int>& order = objectBVH.getOrder();
+    objects.resize(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const TraceObject& object = scene.objects[order[i]];
+        objects[i] = GpuSceneObject{{(float)object.center.x, (float)object.center.y, (float)object.center.z,
+                                     (float)object.radius},
+                                    {object.color.r, object.color.g, object.color.b, object.color.a}};
+    }
+    nodes = objectBVH.gpuNodes();
+}
+
+glm::vec4 GeodesicTracer::shade(const glm::dvec3& P, HitType hit, int objectIndex, const glm::dvec3& cameraPos) const {
+    if (hit == HitType::Disk) {
+        float r = (float)(glm::length(P) / scene.diskR2);
+        return glm::vec4(1.0f, r, 0.2f, r);
+    }
+    if (hit == HitType::BlackHole) {
+        return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    if (hit == HitType::Object) {
+        const TraceObject& object = scene.objects[objectIndex];
+        const glm::dvec3 N = glm::normalize(P - object.center);
+        const glm::dvec3 V = glm::normalize(cameraPos - P);
+        const float ambient = 0.1f;
+        const float diff = (float)std::max(glm::dot(N, V), 0.0);
+        const float intensity = ambient + (1.0f - ambient) * diff;
+        return glm::vec4(glm::vec3(object.color) * intensity, object.color.a);
+    }
+    return glm::vec4(0.0f);
+}
+
+glm::vec4 GeodesicTracer::composite(const VolumeAccumulator& volume, const glm::dvec3& P, HitType hit,
+                                    int objectIndex, const glm::dvec3& cameraPos) const {
+    //A ray the volume made opaque ends in it, and there is no thin disk behind to shade
+    if (hit == HitType::Disk) {
+        return volume.over(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+    return volume.over(shade(P, hit, objectIndex, cameraPos));
+}
+
+glm::vec3 GeodesicTracer::skyColor(const glm::dvec3& direction, double footprint, const TraceCamera& camera) const {
+    if (!scene.stars) {
+        return glm::vec3(0.0f);
+    }
+    //Lensing conserves surface brightness, so a pixel gets the sky's radiance over its own
+    //solid angle. Scaled so a starMagnitude star in an unlensed pixel peaks at 1.
+    const double pixelAngle = 2.0 * camera.tanHalfFov / settings.height;
+    const double sigma = SKY_FILTER_WIDTH * footprint;
+    const double scale = 2.0 * glm::pi<double>() * SKY_FILTER_WIDTH * SKY_FILTER_WIDTH * pixelAngle * pixelAngle
+                       * pow(10.0, 0.4 * scene.starMagnitude);
+    return scene.stars->radiance(direction, sigma) * (float)scale;
+}
+
+double GeodesicTracer::skyFootprint(const glm::dvec3& direction, const glm::dvec3& xNeighbour,
+                                    const glm::dvec3& yNeighbour, double fallback) {
+    auto angle = [&](const glm::dvec3& neighbour) {
+        return 2.0 * asin(std::min(0.5 * glm::length(neighbour - direction), 1.0));
+    };
+    const bool hasX = xNeighbour != glm::dvec3(0.0);
+    const bool hasY = yNeighbour != glm::dvec3(0.0);
+    if (!hasX && !hasY) {
+        return fallback;
+    }
+    return std::max(hasX ? angle(xNeighbour) : 0.0, hasY ? angle(yNeighbour) : 0.0);
+}
+
+TraceResult GeodesicTracer::traceRay(const glm::dvec3& pos, const glm::dvec3& dir) const {
+    if (settings.kernel == TraceKernel::Planar) {
+        return tracePlanar(pos, dir);
+    }
+    if (settings.kernel == TraceKernel::Lookup) {
+        return traceLookup(pos, dir);
+    }
+    if (settings.integrator == Integrator::DormandPrince) {
+        return traceAdaptive(pos, dir);
+    }
+    return traceFixed(pos, dir);
+}
+
+TraceResult GeodesicTracer::traceFixed(const glm::dvec3& pos, const glm::dvec3& dir) const {
+    Ray ray = initRay(pos, dir, scene.rs);
+    glm::dvec3 prevPos(ray.x, ray.y, ray.z);
+
+    TraceResult result;
+    result.hit = HitType::None;
+    result.steps = 0;
+    int objectIndex = -1;
+    glm::dvec3 objectHit;
+
+    const double inverseImpact2 = inverseImpactSquared(pos, dir);
+    const DiskVolume* volume = scene.volume;
+    VolumeAccumulator acc;
+    for (int i = 0; i < settings.maxSteps; ++i) {
+        if (ray.r <= scene.rs) { result.hit = HitType::BlackHole; break; }
+        if (settings.analyticCulling) {
+            result.cull = cullRay(ray.r, ray.dr, inverseImpact2, result.steps);
+            if (result.cull != CullType::None) { result.hit = culledHit(result.cull); break; }
+        }
+        eulerStep(ray, settings.stepSize, scene.rs);
+        ++result.steps;
+
+        glm::dvec3 newPos(ray.x, ray.y, ray.z);
+        if (!volume && crossesEquatorialPlane(prevPos, newPos, scene.diskR1, scene.diskR2)) {
+            result.hit = HitType::Disk;
+            break;
+        }
+        if (interceptObject(prevPos, newPos, objectHit, objectIndex)) { result.hit = HitType::Object; break; }
+        if (volume) {
+            volume->march(prevPos / scene.rs, newPos / scene.rs, acc);
+            if (acc.opaque()) { result.hit = HitType::Disk; break; }
+        }
+        prevPos = newPos;
+        if (ray.r > ESCAPE_R) break;
+    }
+
+    const glm::dvec3 end = result.hit == HitType::Object ? objectHit : glm::dvec3(ray.x, ray.y, ray.z);
+    if (result.hit == HitType::None) {
+        result.escape = escapeDirection(glm::dvec3(ray.x, ray.y, ray.z), rayDirection(ray), scene.rs);
+    }
+    result.color = volume ? composite(acc, end, result.hit, objectIndex, pos)
+                          : shade(end, result.hit, objectIndex, pos);
+    return result;
+}
+
+TraceResult GeodesicTracer::traceAdaptive(const glm::dvec3& pos, const glm::dvec3& dir) const {
+    Ray ray = initRay(pos, dir, scene.rs);
+    glm::dvec3 prevPos(ray.x, ray.y, ray.z);
+    glm::dvec3 hitPos = prevPos;
+
+    TraceResult result;
+    result.hit = HitType::None;
+    result.steps = 0;
+    int objectIndex = -1;
+
+    //dt/dlambda diverges at r = rs, so stop a hair outside; nothing inside 1.5 rs moving inward escapes
+    const double horizonR = scene.rs * 1.001;
+    const double minStep = scene.rs * 1e-9;
+    double h = settings.stepSize;
+    const double inverseImpact2 = inverseImpactSquared(pos, dir);
+    const DiskVolume* volume = scene.volume;
+    const double volumeOuterR = volume ? volume->getOuterRadius() * scene.rs : 0.0;
+    VolumeAccumulator acc;
+
+    while (result.steps < settings.maxSteps) {
+        if (ray.r <= horizonR) { result.hit = HitType::BlackHole; break; }
+        if (settings.analyticCulling) {
+            result.cull = cullRay(ray.r, ray.dr, inverseImpact2, result.steps);
+            if (result.cull != CullType::None) { result.hit = culledHit(result.cull); break; }
+        }
+
+        h = std::min(h, settings.maxStepFraction * ray.r);
+        //Chords through the volume stay short enough to follow the curve
+        if (volume && ray.r < volumeOuterR) h = std::min(h, volume->getMaxSegment() * scene.rs);
+        ++result.steps;
+        if (!dormandPrinceStep(ray, h, scene.rs, settings.relTolerance, settings.absTolerance)) {
+            if (h < minStep) {
+                if (ray.r < 1.5 * scene.rs && ray.dr < 0.0) result.hit = HitType::BlackHole;
+                break;
+            }
+            continue;
+        }
+
+        //Long steps would overshoot the disk edge, so test the radius where the segment meets y = 0
+        glm::dvec3 newPos(ray.x, ray.y, ray.z);
+        if (!volume && prevPos.y * newPos.y < 0.0) {
+            double t = prevPos.y / (prevPos.y - newPos.y);
+            glm::dvec3 crossing = prevPos + t * (newPos - prevPos);
+            double r = glm::length(glm::dvec2(crossing.x, crossing.z));
+            if (r >= scene.diskR1 && r <= scene.diskR2) {
+                result.hit = HitType::Disk;
+                hitPos = crossing;
+                break;
+            }
+        }
+        if (interceptObject(prevPos, newPos, hitPos, objectIndex)) { result.hit = HitType::Object; break; }
+        if (volume) {
+            volume->march(prevPos / scene.rs, newPos / scene.rs, acc);
+            if (acc.opaque()) { result.hit = HitType::Disk; hitPos = newPos; break; }
+        }
+        hitPos = newPos;
+        prevPos = newPos;
+        if (ray.r > ESCAPE_R) break;
+    }
+
+    if (result.hit == HitType::None) {
+        result.escape = escapeDirection(glm::dvec3(ray.x, ray.y, ray.z), rayDirection(ray), scene.rs);
+    }
+    result.color = volume ? composite(acc, hitPos, result.hit, objectIndex, pos)
+                          : shade(hitPos, result.hit, objectIndex, pos);
+    return result;
+}
+
+TraceResult GeodesicTracer::tracePlanar(const glm::dvec3& pos, const glm::dvec3& dir) const {
+    if (settings.precision != Precision::Double) {
+        TraceResult result;
+        if (settings.precision == Precision::Simd8) {
+            tracePlanarLanes<Float8>(pos, &dir, 1, &result);
+        } else {
+            tracePlanarLanes<float>(pos, &dir, 1, &result);
+        }
+        return result;
+    }
+
+    TraceResult result;
+    result.hit = HitType::None;
+    result.steps = 0;
+    int objectIndex = -1;
+
+    //In-plane basis: e1 towards the camera position, e2 along the tangential part of dir
+    const double r0 = glm::length(pos);
+    const glm::dvec3 e1 = pos / r0;
+    const glm::dvec3 d = glm::normalize(dir);
+    const double cosAlpha = glm::dot(d, e1);
+    const glm::dvec3 tangential = d - cosAlpha * e1;
+    const double sinAlpha = glm::length(tangential);
+
+    if (sinAlpha < 1e-12) {
+        //Radial ray: straight into the hole or straight out
+        result.hit = cosAlpha < 0.0 ? HitType::BlackHole : HitType::None;
+        if (result.hit == HitType::None) {
+            result.escape = d;
+        }
+        result.color = shade(pos, result.hit, objectIndex, pos);
+        return result;
+    }
+    const glm::dvec3 e2 = tangential / sinAlpha;
+
+    //u = rs / r, u' = du/dpsi = -u cot(alpha) at the start
+    glm::dvec2 state(scene.rs / r0, -(scene.rs / r0) * cosAlpha / sinAlpha);
+    double psi = 0.0;
+
+    //The orbit meets y = 0 where e1.y cos(psi) + e2.y sin(psi) = 0, i.e. psi = psi0 + pi/2 + k pi
+    const DiskVolume* volume = scene.volume;
+    const double nodeA = e1.y, nodeB = e2.y;
+    const bool hasNodes = !volume && nodeA * nodeA + nodeB * nodeB > 1e-24;
+    double nextNode = 0.0;
+    if (hasNodes) {
+        nextNode = atan2(nodeB, nodeA) + 0.5 * glm::pi<double>();
+        while (nextNode <= 0.0) nextNode += glm::pi<double>();
+        while (nextNode > glm::pi<double>()) nextNode -= glm::pi<double>();
+    }
+
+    const double uEscape = scene.rs / ESCAPE_R;
+    double h = std::min(settings.maxStepFraction, 0.01);
+    glm::dvec3 hitPos = pos;
+    const double inverseImpact2 = inverseImpactSquared(pos, dir);
+    const double volumeOuterU = volume ? 1.0 / volume->getOuterRadius() : 0.0;
+    VolumeAccumulator acc;
+
+    while (result.steps < settings.maxSteps) {
+        if (state.x >= 1.0) { result.hit = HitType::BlackHole; break; }
+        //u' < 0 is outbound
+        if (settings.analyticCulling && state.x > 0.0) {
+            result.cull = cullRay(scene.rs / state.x, -state.y, inverseImpact2, result.steps);
+            if (result.cull != CullType::None) { result.hit = culledHit(result.cull); break; }
+        }
+
+        h = std::min(h, settings.maxStepFraction);
+        //A step of h is a chord about h / u long
+        if (volume && state.x > volumeOuterU) h = std::min(h, volume->getMaxSegment() * state.x);
+        ++result.steps;
+        const glm::dvec2 prev = state;
+        const double hTried = h;
+        if (!binetStep(state, h, settings.relTolerance, settings.absTolerance)) {
+            continue;
+        }
+        const double psiPrev = psi;
+        psi += hTried;
+
+        //Disk crossing: cubic Hermite interpolation of u at the node angle
+        if (hasNodes && nextNode <= psi) {
+            const double t = (nextNode - psiPrev) / hTried;
+            const double t2 = t * t, t3 = t2 * t;
+            const double u = (2.0 * t3 - 3.0 * t2 + 1.0) * prev.x + (t3 - 2.0 * t2 + t) * hTried * prev.y
+                           + (-2.0 * t3 + 3.0 * t2) * state.x + (t3 - t2) * hTried * state.y;
+            if (u > 0.0) {
+                const double r = scene.rs / u;
+                if (r >= scene.diskR1 && r <= scene.diskR2) {
+                    result.hit = HitType::Disk;
+                    hitPos = r * (cos(nextNode) * e1 + sin(nextNode) * e2);
+                    break;
+                }
+            }
+            nextNode += glm::pi<double>();
+        }
+
+        if (state.x <= uEscape) break;
+
+        //Objects are tested along the chord of each step
+        const glm::dvec3 newPos = (scene.rs / state.x) * (cos(psi) * e1 + sin(psi) * e2);
+        glm::dvec3 objectHit;
+        if (interceptObject(hitPos, newPos, objectHit, objectIndex)) {
+            result.hit = HitType::Object;
+            hitPos = objectHit;
+            break;
+        }
+        if (volume) {
+            volume->march(hitPos / scene.rs, newPos / scene.rs, acc);
+            if (acc.opaque()) { result.hit = HitType::Disk; hitPos = newPos; break; }
+        }
+        hitPos = newPos;
+    }
+
+    if (result.hit == HitType::None) {
+        const double psiEscape = psi + remainingDeflection(state.x, state.y);
+        result.escape = cos(psiEscape) * e1 + sin(psiEscape) * e2;
+    }
+    result.color = volume ? composite(acc, hitPos, result.hit, objectIndex, pos)
+                          : shade(hitPos, result.hit, objectIndex, pos);
+    return result;
+}
+
+template <typename Real>
+void GeodesicTracer::tracePlanarLanes(const glm::dvec3& pos, const glm::dvec3* dirs, int count,
+                                      TraceResult* results) const {
+    const int W = Lanes<Real>::WIDTH;
+    const double inf = std::numeric_limits<double>::infinity();
+    const double r0 = glm::length(pos);
+    const glm::dvec3 e1 = pos / r0;
+    const double u0 = scene.rs / r0;
+
+    //Same per-ray setup as tracePlanar; radial rays and padding lanes do not integrate
+    PlanarStart starts[W];
+    PlanarEnd ends[W];
+    glm::dvec3 e2[W];
+    glm::dvec3 chordStart[W];
+    glm::dvec3 hitPos[W];
+    int objectIndex[W];
+    VolumeAccumulator acc[W];
+    const DiskVolume* volume = scene.volume;
+    for (int i = 0; i < W; ++i) {
+        starts[i] = PlanarStart{false, 0.0, 0.0, inf, 0.0};
+        chordStart[i] = hitPos[i] = pos;
+        objectIndex[i] = -1;
+        if (i >= count) continue;
+
+        TraceResult& result = results[i];
+        result = TraceResult();
+        result.hit = HitType::None;
+        result.steps = 0;
+        const glm::dvec3 d = glm::normalize(dirs[i]);
+        const double cosAlpha = glm::dot(d, e1);
+        const glm::dvec3 tangential = d - cosAlpha * e1;
+        const double sinAlpha = glm::length(tangential);
+        if (sinAlpha < 1e-12) {
+            result.hit = cosAlpha < 0.0 ? HitType::BlackHole : HitType::None;
+            if (result.hit == HitType::None) {
+                result.escape = d;
+            }
+            result.color = shade(pos, result.hit, -1, pos);
+            continue;
+        }
+        e2[i] = tangential / sinAlpha;
+
+        PlanarStart& start = starts[i];
+        start.active = true;
+        start.u = u0;
+        start.du = -u0 * cosAlpha / sinAlpha;
+        start.inverseImpact2 = inverseImpactSquared(pos, dirs[i]);
+        const double nodeA = e1.y, nodeB = e2[i].y;
+        if (!volume && nodeA * nodeA + nodeB * nodeB > 1e-24) {
+            double node = atan2(nodeB, nodeA) + 0.5 * glm::pi<double>();
+            while (node <= 0.0) node += glm::pi<double>();
+            while (node > glm::pi<double>()) node -= glm::pi<double>();
+            start.firstNode = node;
+        }
+    }
+
+    PlanarLimits limits;
+    limits.maxSteps = settings.maxSteps;
+    limits.relTolerance = settings.relTolerance;
+    limits.absTolerance = settings.absTolerance;
+    limits.maxStepFraction = settings.maxStepFraction;
+    limits.escapeU = scene.rs / ESCAPE_R;
+    limits.diskInnerU = scene.rs / scene.diskR1;
+    limits.diskOuterU = scene.rs / scene.diskR2;
+    limits.cull = settings.analyticCulling;
+    limits.cullInnerU = cullInnerR > 0.0 ? scene.rs / cullInnerR : inf;
+    limits.cullOuterU = scene.rs / cullOuterR;
+    limits.cullOuterBarrier = cullOuterBarrier;
+    limits.objects = !scene.objects.empty() || volume;
+    limits.volumeOuterU = volume ? 1.0 / volume->getOuterRadius() : 0.0;
+    limits.volumeSegment = volume ? volume->getMaxSegment() : 0.0;
+
+    //Objects and the volume are tested along the chord of each step, in double. A ray the
+    //volume makes opaque retires as an object hit with no object, and becomes a disk hit below.
+    auto objectHit = [&](int lane, double psi, double u) {
+        const glm::dvec3 newPos = (scene.rs / u) * (cos(psi) * e1 + sin(psi) * e2[lane]);
+        glm::dvec3 entry;
+        if (interceptObject(chordStart[lane], newPos, entry, objectIndex[lane])) {
+            hitPos[lane] = entry;
+            return true;
+        }
+        if (volume) {
+            volume->march(chordStart[lane] / scene.rs, newPos / scene.rs, acc[lane]);
+            if (acc[lane].opaque()) {
+                hitPos[lane] = newPos;
+                objectIndex[lane] = -1;
+                return true;
+            }
+        }
+        chordStart[lane] = newPos;
+        return false;
+    };
+    integratePlanar<Real>(starts, ends, limits, objectHit);
+
+    for (int i = 0; i < count; ++i) {
+        if (!starts[i].active) continue;
+        TraceResult& result = results[i];
+        const PlanarEnd& end = ends[i];
+        result.hit = end.hit == HitType::Object && objectIndex[i] < 0 ? HitType::Disk : end.hit;
+        result.cull = end.cull;
+        result.steps = end.steps;
+        if (end.hit == HitType::Disk) {
+            hitPos[i] = (scene.rs / end.u) * (cos(end.psi) * e1 + sin(end.psi) * e2[i]);
+        } else if (end.hit == HitType::None) {
+            const double psiEscape = end.psi + remainingDeflection(end.u, end.du);
+            result.escape = cos(psiEscape) * e1 + sin(psiEscape) * e2[i];
+        }
+        result.color = volume ? composite(acc[i], hitPos[i], result.hit, objectIndex[i], pos)
+                              : shade(hitPos[i], result.hit, objectIndex[i], pos);
+    }
+}
+
+TraceResult GeodesicTracer::traceLookup(const glm::dvec3& pos, const glm::dvec3& dir) const {
+    const double r0 = glm::length(pos);
+    const double u0 = scene.rs / r0;
+    const glm::dvec3 e1 = pos / r0;
+    const glm::dvec3 d = glm::normalize(dir);
+    const double cosAlpha = glm::dot(d, e1);
+    const glm::dvec3 tangential = d - cosAlpha * e1;
+    const double sinAlpha = glm::length(tangential);
+
+    //Objects and the volume need the path itself, and orbits starting inside the photon sphere
+    //are not tabulated
+    if (!scene.objects.empty() || scene.volume || u0 >= 2.0 / 3.0 || sinAlpha < 1e-9) {
+        return tracePlanar(pos, dir);
+    }
+
+    //Impact parameter from the Binet first integral 1/b^2 = u'^2 + u^2 - u^3, with u' = -u cot(alpha)
+    const double b = 1.0 / sqrt(u0 * u0 / (sinAlpha * sinAlpha) - u0 * u0 * u0);
+    const DeflectionTable& table = getDeflectionTable();
+    DeflectionTable::OrbitRef orbit;
+    if (!table.locate(b, orbit)) {
+        return tracePlanar(pos, dir);
+    }
+
+    //Place the camera on the tabulated orbit; sigma is the angle travelled from the camera.
+    //Escaping orbits are symmetric about periapsis, so the outbound half mirrors the inbound one.
+    const bool inbound = cosAlpha < 0.0;
+    const double psiCamera = std::min(table.psiAt(orbit, b, u0), orbit.psiEnd);
+    double psiStart, sigmaEnd;
+    double direction = 1.0;
+    HitType fate = HitType::None;
+    if (orbit.captured) {
+        if (inbound) {
+            psiStart = psiCamera;
+            sigmaEnd = orbit.psiEnd - psiCamera;
+            fate = HitType::BlackHole;
+        } else {
+            //Walk the captured orbit backwards out to infinity
+            psiStart = psiCamera;
+            sigmaEnd = psiCamera;
+            direction = -1.0;
+        }
+    } else {
+        psiStart = inbound ? psiCamera : 2.0 * orbit.psiEnd - psiCamera;
+        sigmaEnd = 2.0 * orbit.psiEnd - psiStart;
+    }
+
+    auto uAlong = [&](double sigma) {
+        const double psi = psiStart + direction * sigma;
+        return table.uAt(orbit, psi <= orbit.psiEnd ? psi : 2.0 * orbit.psiEnd - psi);
+    };
+
+    TraceResult result;
+    result.hit = fate;
+    result.steps = 0;
+    glm::dvec3 hitPos = pos;
+
+    //Same line-of-nodes test as tracePlanar
+    const glm::dvec3 e2 = tangential / sinAlpha;
+    const double nodeA = e1.y, nodeB = e2.y;
+    if (nodeA * nodeA + nodeB * nodeB > 1e-24) {
+        double node = atan2(nodeB, nodeA) + 0.5 * glm::pi<double>();
+        while (node <= 0.0) node += glm::pi<double>();
+        while (node > glm::pi<double>()) node -= glm::pi<double>();
+
+        for (; node <= sigmaEnd; node += glm::pi<double>()) {
+            const double u = uAlong(node);
+            if (u <= 0.0) continue;
+            const double r = scene.rs / u;
+            if (r >= scene.diskR1 && r <= scene.diskR2) {
+                result.hit = HitType::Disk;
+                hitPos = r * (cos(node) * e1 + sin(node) * e2);
+                break;
+            }
+        }
+    }
+
+    //sigmaEnd runs to u = 0, so the orbit's end is already the direction at infinity
+    if (result.hit == HitType::None) {
+        result.escape = cos(sigmaEnd) * e1 + sin(sigmaEnd) * e2;
+    }
+    result.color = shade(hitPos, result.hit, -1, pos);
+    return result;
+}
+
+static glm::dvec3 pixelDirection(const TraceCamera& camera, const TraceSettings& settings, double px, double py) {
+    const double u = (2.0 * px / settings.width - 1.0) * camera.aspect * camera.tanHalfFov;
+    const double v = (1.0 - 2.0 * py / settings.height) * camera.tanHalfFov;
+    return glm::normalize(u * camera.right + v * camera.up + camera.forward);
+}
+
+TraceResult GeodesicTracer::tracePixel(const TraceCamera& camera, double px, double py) const {
+    return traceRay(camera.position, pixelDirection(camera, settings, px, py));
+}
+
+void GeodesicTracer::tracePixels(const TraceCamera& camera, const glm::dvec2* pixels, int count,
+                                 TraceResult* results) const {
+    if (settings.kernel != TraceKernel::Planar || settings.precision != Precision::Simd8) {
+        for (int i = 0; i < count; ++i) {
+            results[i] = tracePixel(camera, pixels[i].x, pixels[i].y);
+        }
+        return;
+    }
+
+    glm::dvec3 dirs[Lanes<Float8>::WIDTH];
+    for (int first = 0; first < count; first += Lanes<Float8>::WIDTH) {
+        const int packet = std::min(count - first, Lanes<Float8>::WIDTH);
+        for (int i = 0; i < packet; ++i) {
+            dirs[i] = pixelDirection(camera, settings, pixels[first + i].x, pixels[first + i].y);
+        }
+        tracePlanarLanes<Float8>(camera.position, dirs, packet, results + first);
+    }
+}
+
+RenderStats GeodesicTracer::render(const TraceCamera& camera, Image& image, TaskScheduler& scheduler) const {
+    PROFILE_SCOPE("render");
+    if (image.getWidth() != settings.width || image.getHeight() != settings.height) {
+        image.resize(settings.width, settings.height);
+    }
+
+    const int tileSize = std::max(1, settings.tileSize);
+    const int tilesX = (settings.width + tileSize - 1) / tileSize;
+    const int tilesY = (settings.height + tileSize - 1) / tileSize;
+
+    std::vector<WorkerStats> workerStats(scheduler.threadCount());
+
+    if (settings.kernel == TraceKernel::Lookup) {
+        getDeflectionTable();
+    }
+    const bool sky = scene.stars != nullptr;
+    const double pixelAngle = 2.0 * camera.tanHalfFov / settings.height;
+
+    auto start = std::chrono::steady_clock::now();
+
+    scheduler.parallelFor((size_t)tilesX * tilesY, [&](size_t tile, unsigned worker) {
+        PROFILE_SCOPE("tile");
+        const int x0 = (int)(tile % tilesX) * tileSize;
+        const int y0 = (int)(tile / tilesX) * tileSize;
+        const int x1 = std::min(x0 + tileSize, settings.width);
+        const int y1 = std::min(y0 + tileSize, settings.height);
+        WorkerStats& stats = workerStats[worker];
+        std::vector<glm::dvec3> escapes;
+        if (sky) {
+            escapes.assign((size_t)(x1 - x0) * (y1 - y0), glm::dvec3(0.0));
+        }
+
+        //A tile row at a time, so packet kernels see neighbouring rays
+        std::vector<glm::dvec2> pixels(x1 - x0);
+        std::vector<TraceResult> results(x1 - x0);
+        for (int y = y0; y < y1; ++y) {
+            for (int x = x0; x < x1; ++x) {
+                pixels[x - x0] = glm::dvec2(x + 0.5, y + 0.5);
+            }
+            tracePixels(camera, pixels.data(), x1 - x0, results.data());
+            for (int x = x0; x < x1; ++x) {
+                const TraceResult& result = results[x - x0];
+                image.at(x, y) = result.color;
+                if (sky) {
+                    escapes[(size_t)(y - y0) * (x1 - x0) + (x - x0)] = result.escape;
+                }
+                PROFILE_HISTOGRAM("ray steps", result.steps);
+                stats.count(result);
+            }
+        }
+        if (!sky) {
+            return;
+        }
+
+        //Footprints come from neighbours inside the tile, the next pixel along or else the previous
+        auto escapeAt = [&](int x, int y) {
+            if (x < x0 || x >= x1 || y < y0 || y >= y1) return glm::dvec3(0.0);
+            return escapes[(size_t)(y - y0) * (x1 - x0) + (x - x0)];
+        };
+        for (int y = y0; y < y1; ++y) {
+            for (int x = x0; x < x1; ++x) {
+                const glm::dvec3 escape = escapeAt(x, y);
+                if (escape == glm::dvec3(0.0)) continue;
+                glm::dvec3 xNeighbour = escapeAt(x + 1, y);
+                if (xNeighbour == glm::dvec3(0.0)) xNeighbour = escapeAt(x - 1, y);
+                glm::dvec3 yNeighbour = escapeAt(x, y + 1);
+                if (yNeighbour == glm::dvec3(0.0)) yNeighbour = escapeAt(x, y - 1);
+                const double footprint = skyFootprint(escape, xNeighbour, yNeighbour, pixelAngle);
+                //Whatever cover the volume gave the ray dims the sky behind it
+                glm::vec4& pixel = image.at(x, y);
+                pixel += glm::vec4(skyColor(escape, footprint, camera) * (1.0f - pixel.a), 0.0f);
+            }
+        }
+    });
+
+    RenderStats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.threads = scheduler.threadCount();
+    stats.steals = scheduler.lastStealCount();
+    for (const WorkerStats& worker : workerStats) {
+        stats += worker;
+    }
+    return stats;
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "DeflectionTable.h"
+#include "Image.h"
+#include "ObjectBVH.h"
+
+class DiskVolume;
+struct VolumeAccumulator;
+class StarCatalog;
+class TaskScheduler;
+
+//CPU port of shaders/geodesic.comp. Units are SI metres, as in the shader.
+constexpr double SAGA_RS = 1.269e10;    //Schwarzschild radius of Sagittarius A*
+constexpr double D_LAMBDA = 1e7;        //Affine step of the fixed-step loop
+constexpr double ESCAPE_R = 1e30;
+constexpr double SKY_FILTER_WIDTH = 0.5;    //Star filter standard deviation in pixel footprints
+
+//Mirrors the Camera uniform block
+struct TraceCamera {
+    glm::dvec3 position;
+    glm::dvec3 right;
+    glm::dvec3 up;
+    glm::dvec3 forward;
+    double tanHalfFov;
+    double aspect;
+    bool moving;
+
+    //Orbit camera looking at the origin, using the same radius/yaw/pitch convention as main.cpp
+    static TraceCamera orbit(double radius, double yawDegrees, double pitchDegrees,
+                             double fovDegrees, double aspect);
+};
+
+//Mirrors one entry of the Objects uniform block
+struct TraceObject {
+    glm::dvec3 center;
+    double radius;
+    glm::vec4 color;
+    double mass;
+};
+
+//One entry of the shader's Objects buffer (std430, 32 bytes), in ObjectBVH leaf order
+struct GpuSceneObject {
+    float posRadius[4];
+    float color[4];
+};
+
+//Mirrors the Disk uniform block and the Objects buffer
+struct TraceScene {
+    double rs = SAGA_RS;
+    double diskR1 = SAGA_RS * 2.2;
+    double diskR2 = SAGA_RS * 5.2;
+    std::vector<TraceObject> objects;
+    const StarCatalog* stars = nullptr;     //Sky behind escaped rays, black when null; not owned
+    const DiskVolume* volume = nullptr;     //Volumetric accretion flow in place of the thin disk; not owned
+    double starMagnitude = 6.0;             //A star this bright peaks at 1.0 in an unlensed pixel
+};
+
+enum class Integrator {
+    FixedEuler,     //Constant D_LAMBDA steps, as in the shader's original loop
+    DormandPrince   //Embedded Runge-Kutta 5(4) with error control
+};
+
+enum class TraceKernel {
+    Spherical,      //Six-component (r, theta, phi) state, as in the shader
+    Planar,         //Binet equation in each ray's own orbital plane, always adaptive
+    Lookup          //Precomputed DeflectionTable, falls back to Planar where it does not apply
+};
+
+//Scalar type the planar kernel integrates in (see PlanarKernel.h); the other kernels are double
+enum class Precision {
+    Double,         //Reference
+    Float,          //Single precision, one ray at a time
+    Simd8           //Single precision, eight rays per Float8 packet
+};
+
+struct TraceSettings {
+    int width = 200;
+    int height = 150;
+    int maxSteps = 60000;
+    double stepSize = D_LAMBDA;     //Fixed step, or the first trial step of the adaptive integrator
+    int tileSize = 16;
+
+    TraceKernel kernel = TraceKernel::Spherical;
+    Integrator integrator = Integrator::FixedEuler;
+    double relTolerance = 1e-7;
+    double absTolerance = 1e-10;    //In units where rs = 1
+    double maxStepFraction = 0.5;   //Adaptive steps never exceed this fraction of r
+    bool analyticCulling = true;    //Retire rays whose fate is already known, see CullType
+    Precision precision = Precision::Double;
+};
+
+//Ray state in Schwarzschild coordinates, z is the polar axis
+struct Ray {
+    double x, y, z, r, theta, phi;
+    double dr, dtheta, dphi;
+    double E, L;
+};
+
+enum class HitType {
+    None,
+    BlackHole,
+    Disk,
+    Object
+};
+
+//Early exits from the analytic Schwarzschild tests. With 1/b^2 = u'^2 + u^2 - u^3 (rs = 1):
+//an inbound ray with b < 3 sqrt(3) / 2, or any inbound ray inside the photon sphere, falls in;
+//an outbound ray outside the photon sphere never turns back; an inbound ray whose 1/b^2 is
+//below u^2 - u^3 at some radius outside the photon sphere turns back before reaching it.
+//Rays are retired once the rest of their path cannot reach the disk or an object: inside the
+//innermost geometry for captures, outside the outermost for escapes.
+enum class CullType {
+    None,               //Integrated until it hit something or ran out of steps
+    CapturedAtStart,    //Classified before the first step
+    EscapedAtStart,
+    Captured,           //Retired part way
+    Escaped
+};
+
+struct TraceResult {
+    glm::vec4 color;    //With a volume, the alpha of an escaped ray is the cover the volume gave it
+    HitType hit;        //Disk for a ray the volume made opaque
+    int steps;          //Attempted integration steps, including rejected adaptive steps
+    CullType cull = CullType::None;
+    glm::dvec3 escape = glm::dvec3(0.0);   //Direction at infinity of an escaped ray (HitType::None), else zero
+};
+
+//Per-worker counters of a parallel render, padded so workers do not share cache lines
+struct alignas(64) WorkerStats {
+    uint64_t rays = 0;
+    uint64_t steps = 0;
+    uint64_t hits[4] = {0, 0, 0, 0}; //Indexed by HitType
+    uint64_t culled[5] = {0, 0, 0, 0, 0}; //Indexed by CullType
+
+    void count(const TraceResult& result) {
+        ++rays;
+        steps += result.steps;
+        ++hits[(int)result.hit];
+        ++culled[(int)result.cull];
+    }
+};
+
+struct RenderStats {
+    uint64_t rays = 0;
+    uint64_t steps = 0;
+    uint64_t hits[4] = {0, 0, 0, 0}; //Indexed by HitType
+    uint64_t culled[5] = {0, 0, 0, 0, 0}; //Indexed by CullType
+    double seconds = 0.0;
+    unsigned threads = 0;
+    size_t steals = 0;
+
+    //Adds one worker's counters
+    RenderStats& operator+=(const WorkerStats& worker);
+    //Adds another pass or frame: counters, time and steals, keeping the larger thread count
+    RenderStats& operator+=(const RenderStats& other);
+
+    double raysPerSecond() const { return seconds > 0.0 ? rays / seconds : 0.0; }
+    double raysPerSecondPerCore() const { return threads > 0 ? raysPerSecond() / threads : 0.0; }
+};
+
+//Same maths as the shader functions of the same name
+Ray initRay(const glm::dvec3& pos, const glm::dvec3& dir, double rs);
+void geodesicRHS(const Ray& ray, double rs, glm::dvec3& d1, glm::dvec3& d2);
+//Same right-hand side on a split state: q = (r, theta, phi), p = (dr, dtheta, dphi)
+void geodesicRHS(const glm::dvec3& q, const glm::dvec3& p, double E, double rs, glm::dvec3& dq, glm::dvec3& dp);
+//The shader calls this rk4Step, but it is a single forward-Euler update
+void eulerStep(Ray& ray, double dL, double rs);
+//Attempts one Dormand-Prince 5(4) step of size h. Advances the ray and returns true if the
+//error estimate is within tolerance; either way h is replaced by the suggested next step.
+bool dormandPrinceStep(Ray& ray, double& h, double rs, double relTol, double absTol);
+//One Dormand-Prince 5(4) step of the Binet equation u'' + u = 3/2 u^2 with u = rs / r,
+//state = (u, du/dpsi). Same contract as dormandPrinceStep.
+bool binetStep(glm::dvec2& state, double& h, double relTol, double absTol);
+//Cartesian direction of travel d(x, y, z)/dlambda
+glm::dvec3 rayDirection(const Ray& ray);
+//Angle an escaping orbit still turns through on its way to infinity, from u = rs / r and
+//u' = du/dpsi (negative outbound). Inbound orbits go round periapsis first; orbits that
+//would fall in return 0.
+double remainingDeflection(double u, double du);
+//Direction an escaping ray at pos moving along dir approaches at infinity
+glm::dvec3 escapeDirection(const glm::dvec3& pos, const glm::dvec3& dir, double rs);
+bool crossesEquatorialPlane(const glm::dvec3& oldPos, const glm::dvec3& newPos, double diskR1, double diskR2);
+
+class GeodesicTracer {
+public:
+    GeodesicTracer();
+
+    void setScene(const TraceScene& scene);
+    void setSettings(const TraceSettings& settings);
+    const TraceScene& getScene() const { return scene; }
+    const TraceSettings& getSettings() const { return settings; }
+
+    //Built on first use; in rs units, so mass and disk changes reuse it
+    const DeflectionTable& getDeflectionTable() const;
+
+    //Trace a single ray from the camera through pixel (px, py), row 0 at the top. The colour
+    //leaves out the sky, which needs neighbouring rays; see skyColor.
+    TraceResult tracePixel(const TraceCamera& camera, double px, double py) const;
+    //Same as tracePixel for each of count pixel positions. The planar kernel at Precision::Simd8
+    //traces them eight at a time, so callers should pass runs of neighbouring pixels.
+    void tracePixels(const TraceCamera& camera, const glm::dvec2* pixels, int count, TraceResult* results) const;
+
+    //Trace a single ray from pos along dir
+    TraceResult traceRay(const glm::dvec3& pos, const glm::dvec3& dir) const;
+
+    //Render a full frame at settings.width x settings.height, tiles spread over the scheduler.
+    //Escaped rays show the star catalog, filtered by how far apart neighbouring pixels land.
+    RenderStats render(const TraceCamera& camera, Image& image, TaskScheduler& scheduler) const;
+
+    //Colour the sky adds to a pixel whose escaped ray leaves along direction, when neighbouring
+    //pixels escape footprint radians apart. Black without a star catalog.
+    glm::vec3 skyColor(const glm::dvec3& direction, double footprint, const TraceCamera& camera) const;
+    //Sky angle one pixel spans, from the escape directions of a neighbour along each image
+    //axis (zero for a neighbour that did not escape). The larger axis wins, so stretched
+    //regions are filtered along their long side; with neither neighbour escaping, fallback.
+    static double skyFootprint(const glm::dvec3& direction, const glm::dvec3& xNeighbour,
+                               const glm::dvec3& yNeighbour, double fallback);
+
+    //Built by setScene; objects are tested per integration segment through it
+    const ObjectBVH& getObjectBVH() const { return objectBVH; }
+    //Contents of the shader's Objects and BVH buffers for the current scene
+    void packObjectBuffers(std::vector<GpuSceneObject>& objects, std::vector<GpuBVHNode>& nodes) const;
+
+private:
+    TraceResult traceFixed(const glm::dvec3& pos, const glm::dvec3& dir) const;
+    TraceResult traceAdaptive(const glm::dvec3& pos, const glm::dvec3& dir) const;
+    TraceResult tracePlanar(const glm::dvec3& pos, const glm::dvec3& dir) const;
+    TraceResult traceLookup(const glm::dvec3& pos, const glm::dvec3& dir) const;
+    //Planar kernel in Real (float or Float8) for up to Lanes<Real>::WIDTH rays from pos
+    template <typename Real>
+    void tracePlanarLanes(const glm::dvec3& pos, const glm::dvec3* dirs, int count, TraceResult* results) const;
+
+    //Analytic early exit for a ray at radius r moving with dr (sign only) and 1/b^2 in rs
+    //units. Returns CullType::None while the ray still needs integrating.
+    CullType cullRay(double r, double dr, double inverseImpact2, int steps) const;
+    double inverseImpactSquared(const glm::dvec3& pos, const glm::dvec3& dir) const;
+
+    //First object on the segment from a to b; hitPos is where the segment enters it
+    bool interceptObject(const glm::dvec3& a, const glm::dvec3& b, glm::dvec3& hitPos, int& objectIndex) const;
+    glm::vec4 shade(const glm::dvec3& P, HitType hit, int objectIndex, const glm::dvec3& cameraPos) const;
+    //shade() seen through what the volume gathered in front of it
+    glm::vec4 composite(const VolumeAccumulator& volume, const glm::dvec3& P, HitType hit, int objectIndex,
+                        const glm::dvec3& cameraPos) const;
+
+    TraceScene scene;
+    TraceSettings settings;
+    ObjectBVH objectBVH;
+    double cullInnerR;      //No disk or object inside this radius
+    double cullOuterR;      //No disk or object outside this radius, and at least the photon sphere
+    double cullOuterBarrier;    //u^2 - u^3 at cullOuterR: rays with a smaller 1/b^2 never get inside it
+
+    mutable std::once_flag deflectionTableBuilt;
+    mutable DeflectionTable deflectionTable;
+};
@@ -0,0 +1,94 @@
+#include "GpuProfiler.h"
+
+#ifdef BLACKHOLE_PROFILE
+
+GpuProfiler& GpuProfiler::instance() {
+    static GpuProfiler profiler;
+    return profiler;
+}
+
+GpuProfiler::GpuProfiler() : gpuToProfilerNs(0), calibrated(false) {
+}
+
+void GpuProfiler::calibrate() {
+    //GL_TIMESTAMP is the GPU clock once all earlier commands have reached the GPU, close
+    //enough to line the GPU track up with the CPU spans that issued the commands
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    gpuToProfilerNs = (int64_t)Profiler::instance().now() - (int64_t)gpuNow;
+    calibrated = true;
+}
+
+GLuint GpuProfiler::acquireQuery() {
+    if (freeQueries.empty()) {
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        return query;
+    }
+    GLuint query = freeQueries.back();
+    freeQueries.pop_back();
+    return query;
+}
+
+void GpuProfiler::begin(const char* name) {
+    if (!calibrated) {
+        calibrate();
+    }
+    Pass pass;
+    pass.name = name;
+    pass.queries[0] = acquireQuery();
+    pass.queries[1] = acquireQuery();
+    glQueryCounter(pass.queries[0], GL_TIMESTAMP);
+    open.push_back(pass);
+}
+
+void GpuProfiler::end() {
+    if (open.empty()) {
+        return;
+    }
+    Pass pass = open.back();
+    open.pop_back();
+    glQueryCounter(pass.queries[1], GL_TIMESTAMP);
+    pending.push_back(pass);
+}
+
+void GpuProfiler::collect() {
+    //Queries complete in submission order, so stop at the first one still in flight
+    while (!pending.empty()) {
+        Pass& pass = pending.front();
+        GLint available = 0;
+        glGetQueryObjectiv(pass.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(pass.queries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(pass.queries[1], GL_QUERY_RESULT, &end);
+        Profiler::instance().complete(pass.name, (uint64_t)((int64_t)start + gpuToProfilerNs),
+                                      end > start ? end - start : 0, Profiler::GPU_THREAD);
+        freeQueries.push_back(pass.queries[0]);
+        freeQueries.push_back(pass.queries[1]);
+        pending.pop_front();
+    }
+}
+
+void GpuProfiler::cleanup() {
+    for (const Pass& pass : pending) {
+        freeQueries.push_back(pass.queries[0]);
+        freeQueries.push_back(pass.queries[1]);
+    }
+    for (const Pass& pass : open) {
+        freeQueries.push_back(pass.queries[0]);
+        freeQueries.push_back(pass.queries[1]);
+    }
+    if (!freeQueries.empty()) {
+        glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+    }
+    pending.clear();
+    open.clear();
+    freeQueries.clear();
+    calibrated = false;
+}
+
+#endif
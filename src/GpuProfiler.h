@@ -0,0 +1,66 @@
+#pragma once
+
+//GL timer queries around render passes, reported on the profiler's GPU track.
+//Like Profiler.h this compiles to nothing without BLACKHOLE_PROFILE.
+
+#include "Profiler.h"
+
+#ifdef BLACKHOLE_PROFILE
+
+#include <GL/glew.h>
+#include <deque>
+#include <vector>
+
+//Each pass brackets its commands with two GL_TIMESTAMP queries. Results are read a few
+//frames later, once available, so measuring never stalls the pipeline.
+class GpuProfiler {
+public:
+    static GpuProfiler& instance();
+
+    void begin(const char* name);
+    void end();
+
+    //Moves finished queries into the profiler; call once per frame
+    void collect();
+    //Deletes every query, call while the context is current
+    void cleanup();
+
+private:
+    GpuProfiler();
+
+    struct Pass {
+        const char* name;
+        GLuint queries[2];  //Start and end timestamps
+    };
+
+    GLuint acquireQuery();
+    void calibrate();
+
+    std::deque<Pass> pending;           //Ended, waiting for results, oldest first
+    std::vector<Pass> open;             //Begun, not ended yet
+    std::vector<GLuint> freeQueries;
+    int64_t gpuToProfilerNs;            //Added to GPU timestamps to put them on the CPU timeline
+    bool calibrated;
+};
+
+//Times the GL commands issued in the enclosing scope
+class GpuProfileScope {
+public:
+    explicit GpuProfileScope(const char* name) { GpuProfiler::instance().begin(name); }
+    ~GpuProfileScope() { GpuProfiler::instance().end(); }
+
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+};
+
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_JOIN(gpuProfileScope, __LINE__)(name)
+#define PROFILE_GPU_COLLECT() GpuProfiler::instance().collect()
+#define PROFILE_GPU_CLEANUP() GpuProfiler::instance().cleanup()
+
+#else
+
+#define PROFILE_GPU_SCOPE(name) ((void)0)
+#define PROFILE_GPU_COLLECT() ((void)0)
+#define PROFILE_GPU_CLEANUP() ((void)0)
+
+#endif
@@ -0,0 +1,67 @@
+#include "Image.h"
+#include <algorithm>
+#include <cstdio>
+
+Image::Image() : width(0), height(0) {
+}
+
+Image::Image(int width, int height) : width(0), height(0) {
+    resize(width, height);
+}
+
+void Image::resize(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    pixels.assign((size_t)width * height, glm::vec4(0.0f));
+}
+
+void Image::fill(const glm::vec4& color) {
+    std::fill(pixels.begin(), pixels.end(), color);
+}
+
+void Image::resampleFrom(const Image& source) {
+    if (source.width <= 0 || source.height <= 0) {
+        return;
+    }
+    const float scaleX = (float)source.width / width;
+    const float scaleY = (float)source.height / height;
+    for (int y = 0; y < height; ++y) {
+        const float sy = glm::clamp((y + 0.5f) * scaleY - 0.5f, 0.0f, (float)(source.height - 1));
+        const int y0 = std::min((int)sy, source.height - 1);
+        const int y1 = std::min(y0 + 1, source.height - 1);
+        const float fy = sy - y0;
+        for (int x = 0; x < width; ++x) {
+            const float sx = glm::clamp((x + 0.5f) * scaleX - 0.5f, 0.0f, (float)(source.width - 1));
+            const int x0 = std::min((int)sx, source.width - 1);
+            const int x1 = std::min(x0 + 1, source.width - 1);
+            const float fx = sx - x0;
+            const glm::vec4 top = glm::mix(source.at(x0, y0), source.at(x1, y0), fx);
+            const glm::vec4 bottom = glm::mix(source.at(x0, y1), source.at(x1, y1), fx);
+            at(x, y) = glm::mix(top, bottom, fy);
+        }
+    }
+}
+
+bool Image::writePPM(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+    std::vector<unsigned char> row((size_t)width * 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const glm::vec4& c = at(x, y);
+            row[x * 3 + 0] = (unsigned char)(glm::clamp(c.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+            row[x * 3 + 1] = (unsigned char)(glm::clamp(c.g, 0.0f, 1.0f) * 255.0f + 0.5f);
+            row[x * 3 + 2] = (unsigned char)(glm::clamp(c.b, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
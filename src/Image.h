@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+//Floating point RGBA image, rows stored top-down
+class Image {
+public:
+    Image();
+    Image(int width, int height);
+
+    void resize(int width, int height);
+    void fill(const glm::vec4& color);
+    //Bilinear resample of source to this image's size, pixel centres aligned
+    void resampleFrom(const Image& source);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    glm::vec4& at(int x, int y) { return pixels[(size_t)y * width + x]; }
+    const glm::vec4& at(int x, int y) const { return pixels[(size_t)y * width + x]; }
+
+    const std::vector<glm::vec4>& getPixels() const { return pixels; }
+
+    //Write as binary PPM (P6), alpha is dropped and colors clamped to [0, 1]
+    bool writePPM(const std::string& path) const;
+
+private:
+    int width;
+    int height;
+    std::vector<glm::vec4> pixels;
+};
@@ -0,0 +1,113 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : view(nullptr), length(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {
+}
+
+bool MappedFile::open(const std::string& path, std::string& error) {
+    close();
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "cannot open " + path;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        error = "cannot read the size of " + path;
+        close();
+        return false;
+    }
+    length = (size_t)fileSize.QuadPart;
+    if (length == 0) {
+        return true;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+        view = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!view) {
+        error = "cannot map " + path;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (view) {
+        UnmapViewOfFile(view);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    view = nullptr;
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+    length = 0;
+}
+
+#else
+
+MappedFile::MappedFile() : view(nullptr), length(0), descriptor(-1) {
+}
+
+bool MappedFile::open(const std::string& path, std::string& error) {
+    close();
+    descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        error = "cannot open " + path;
+        return false;
+    }
+    struct stat info;
+    if (fstat(descriptor, &info) != 0) {
+        error = "cannot read the size of " + path;
+        close();
+        return false;
+    }
+    length = (size_t)info.st_size;
+    if (length == 0) {
+        return true;
+    }
+    void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (address == MAP_FAILED) {
+        error = "cannot map " + path;
+        close();
+        return false;
+    }
+    view = (const unsigned char*)address;
+    return true;
+}
+
+void MappedFile::close() {
+    if (view) {
+        munmap((void*)view, length);
+    }
+    if (descriptor >= 0) {
+        ::close(descriptor);
+    }
+    view = nullptr;
+    descriptor = -1;
+    length = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//Read-only view of a whole file through the OS page cache (MapViewOfFile on Windows, mmap
+//elsewhere). Pages are read on first touch and shared with every other process mapping the
+//same file, so opening a large data file costs nothing until it is used.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    //Null for an empty or closed file
+    const unsigned char* data() const { return view; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char* view;
+    size_t length;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int descriptor;
+#endif
+};
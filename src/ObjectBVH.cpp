@@ -0,0 +1,168 @@
+#include "ObjectBVH.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+//Slab test of the segment a + t d, t in [0, tMax], against a box; returns the entry t
+static bool segmentBox(const glm::dvec3& boundsMin, const glm::dvec3& boundsMax, const glm::dvec3& a,
+                       const glm::dvec3& d, double tMax, double& tEntry) {
+    double t0 = 0.0, t1 = tMax;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (d[axis] == 0.0) {
+            if (a[axis] < boundsMin[axis] || a[axis] > boundsMax[axis]) return false;
+            continue;
+        }
+        const double inv = 1.0 / d[axis];
+        double tNear = (boundsMin[axis] - a[axis]) * inv;
+        double tFar = (boundsMax[axis] - a[axis]) * inv;
+        if (tNear > tFar) std::swap(tNear, tFar);
+        t0 = std::max(t0, tNear);
+        t1 = std::min(t1, tFar);
+        if (t0 > t1) return false;
+    }
+    tEntry = t0;
+    return true;
+}
+
+bool ObjectBVH::segmentSphere(const glm::dvec3& a, const glm::dvec3& d, const glm::dvec3& center,
+                              double radius, double& t) {
+    const glm::dvec3 m = a - center;
+    const double c = glm::dot(m, m) - radius * radius;
+    if (c <= 0.0) {
+        t = 0.0;
+        return true;
+    }
+    const double b = glm::dot(m, d);
+    if (b >= 0.0) {
+        return false;   //Outside and moving away
+    }
+    const double dd = glm::dot(d, d);
+    const double discriminant = b * b - dd * c;
+    if (discriminant < 0.0) {
+        return false;
+    }
+    t = (-b - sqrt(discriminant)) / dd;
+    return t <= 1.0;
+}
+
+void ObjectBVH::build(const std::vector<BoundingSphere>& newSpheres) {
+    spheres = newSpheres;
+    nodes.clear();
+    order.resize(spheres.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (spheres.empty()) {
+        return;
+    }
+
+    nodes.reserve(2 * spheres.size());
+    nodes.push_back(Node());
+    buildNode(0, 0, (int)spheres.size(), 0);
+}
+
+void ObjectBVH::buildNode(int nodeIndex, int first, int count, int depth) {
+    glm::dvec3 boundsMin(std::numeric_limits<double>::max());
+    glm::dvec3 boundsMax(-std::numeric_limits<double>::max());
+    glm::dvec3 centroidMin = boundsMin, centroidMax = boundsMax;
+    for (int i = first; i < first + count; ++i) {
+        const BoundingSphere& sphere = spheres[order[i]];
+        boundsMin = glm::min(boundsMin, sphere.center - sphere.radius);
+        boundsMax = glm::max(boundsMax, sphere.center + sphere.radius);
+        centroidMin = glm::min(centroidMin, sphere.center);
+        centroidMax = glm::max(centroidMax, sphere.center);
+    }
+    nodes[nodeIndex].boundsMin = boundsMin;
+    nodes[nodeIndex].boundsMax = boundsMax;
+
+    const glm::dvec3 extent = centroidMax - centroidMin;
+    int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    //Coincident centres cannot be split, so they share one leaf
+    if (count <= MAX_LEAF_SIZE || depth >= MAX_DEPTH - 1 || extent[axis] <= 0.0) {
+        nodes[nodeIndex].leftFirst = first;
+        nodes[nodeIndex].count = count;
+        return;
+    }
+
+    const int half = count / 2;
+    std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+                     [&](int a, int b) { return spheres[a].center[axis] < spheres[b].center[axis]; });
+
+    const int left = (int)nodes.size();
+    nodes.push_back(Node());
+    nodes.push_back(Node());
+    nodes[nodeIndex].leftFirst = left;
+    nodes[nodeIndex].count = 0;
+    buildNode(left, first, half, depth + 1);
+    buildNode(left + 1, first + half, count - half, depth + 1);
+}
+
+bool ObjectBVH::intersectSegment(const glm::dvec3& a, const glm::dvec3& b, double& t, int& objectIndex) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    const glm::dvec3 d = b - a;
+    double best = 1.0;
+    int bestIndex = -1;
+
+    int stack[MAX_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        double entry;
+        if (!segmentBox(node.boundsMin, node.boundsMax, a, d, best, entry)) {
+            continue;
+        }
+
+        if (node.count > 0) {
+            for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                const BoundingSphere& sphere = spheres[order[i]];
+                double tSphere;
+                if (segmentSphere(a, d, sphere.center, sphere.radius, tSphere) && tSphere <= best) {
+                    best = tSphere;
+                    bestIndex = order[i];
+                }
+            }
+            continue;
+        }
+
+        //Visit the child the segment enters first, so later boxes are pruned by its hit
+        const Node& left = nodes[node.leftFirst];
+        const Node& right = nodes[node.leftFirst + 1];
+        double leftEntry, rightEntry;
+        const bool hitLeft = segmentBox(left.boundsMin, left.boundsMax, a, d, best, leftEntry);
+        const bool hitRight = segmentBox(right.boundsMin, right.boundsMax, a, d, best, rightEntry);
+        if (hitLeft && hitRight) {
+            const bool leftFirst = leftEntry <= rightEntry;
+            stack[top++] = node.leftFirst + (leftFirst ? 1 : 0);
+            stack[top++] = node.leftFirst + (leftFirst ? 0 : 1);
+        } else if (hitLeft) {
+            stack[top++] = node.leftFirst;
+        } else if (hitRight) {
+            stack[top++] = node.leftFirst + 1;
+        }
+    }
+
+    if (bestIndex < 0) {
+        return false;
+    }
+    t = best;
+    objectIndex = bestIndex;
+    return true;
+}
+
+std::vector<GpuBVHNode> ObjectBVH::gpuNodes() const {
+    std::vector<GpuBVHNode> packed(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const Node& node = nodes[i];
+        for (int axis = 0; axis < 3; ++axis) {
+            //Round outwards so float bounds still contain every sphere
+            packed[i].boundsMin[axis] = std::nextafter((float)node.boundsMin[axis], -std::numeric_limits<float>::infinity());
+            packed[i].boundsMax[axis] = std::nextafter((float)node.boundsMax[axis], std::numeric_limits<float>::infinity());
+        }
+        packed[i].leftFirst = node.leftFirst;
+        packed[i].count = node.count;
+    }
+    return packed;
+}
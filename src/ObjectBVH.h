@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+struct BoundingSphere {
+    glm::dvec3 center;
+    double radius;
+};
+
+//One node of the flattened tree as the shader reads it (std430, 32 bytes)
+struct GpuBVHNode {
+    float boundsMin[3];
+    int32_t leftFirst;      //First child for an inner node, first object for a leaf
+    float boundsMax[3];
+    int32_t count;          //Objects in a leaf, 0 for an inner node
+};
+static_assert(sizeof(GpuBVHNode) == 32, "GpuBVHNode must match BVHNode in shaders/geodesic.comp");
+
+//Bounding volume hierarchy over the scene's spheres, so a ray segment is tested against
+//the few objects near it instead of every object after every step.
+//
+//Built top-down by splitting at the median centroid along the longest axis, which is
+//quick enough to rebuild whenever the scene changes and keeps the tree balanced for
+//the clustered layouts (star clusters, rings of bodies) the tracer sees. Children of a
+//node are stored next to each other, and leaves refer to a contiguous range of the
+//object order, so the same arrays upload to the shader unchanged.
+class ObjectBVH {
+public:
+    static constexpr int MAX_LEAF_SIZE = 2;
+    static constexpr int MAX_DEPTH = 32;    //Traversal stack size; must match BVH_STACK in shaders/geodesic.comp
+
+    void build(const std::vector<BoundingSphere>& spheres);
+
+    //First sphere hit by the segment from a to b. t is the fraction along the segment of the
+    //entry point (0 if a is already inside), objectIndex the index passed to build.
+    bool intersectSegment(const glm::dvec3& a, const glm::dvec3& b, double& t, int& objectIndex) const;
+
+    //Entry fraction of the segment a + t d, t in [0, 1], into a sphere
+    static bool segmentSphere(const glm::dvec3& a, const glm::dvec3& d, const glm::dvec3& center,
+                              double radius, double& t);
+
+    bool empty() const { return nodes.empty(); }
+    size_t nodeCount() const { return nodes.size(); }
+    //Object indices in leaf order; leaf ranges index into this
+    const std::vector<int>& getOrder() const { return order; }
+
+    //Nodes converted for the shader's BVH buffer
+    std::vector<GpuBVHNode> gpuNodes() const;
+
+private:
+    struct Node {
+        glm::dvec3 boundsMin;
+        glm::dvec3 boundsMax;
+        int leftFirst;
+        int count;
+    };
+
+    void buildNode(int nodeIndex, int first, int count, int depth);
+
+    std::vector<Node> nodes;
+    std::vector<int> order;
+    std::vector<BoundingSphere> spheres;    //Copy in the order passed to build
+};
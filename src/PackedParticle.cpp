@@ -0,0 +1,128 @@
+#include "PackedParticle.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static constexpr uint16_t HALF_MAX = 0x7bff;   //65504, largest finite half
+
+static uint8_t toUnorm8(float value, float range) {
+    //Truncating after adding 0.5 rounds to nearest without a libm call
+    return (uint8_t)(std::min(std::max(value * (1.0f / range), 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static int16_t toSnorm16(float value) {
+    const float scaled = std::min(std::max(value, -1.0f), 1.0f) * 32767.0f;
+    return (int16_t)(scaled + (scaled >= 0.0f ? 0.5f : -0.5f));
+}
+
+static float fromSnorm16(int16_t value) {
+    return std::max(value / 32767.0f, -1.0f);
+}
+
+static float signNotZero(float value) {
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+uint16_t PackedParticle::toHalf(float value) {
+    //Branch-light conversion after F. Giesen's float_to_half_fast3_rtne: subnormals are rounded
+    //by the FPU through a magic addend, normals by adding the rounding bias to the bits
+    const uint32_t F16_OVERFLOW = (127 + 16) << 23;     //2^16, first float that is not a finite half
+    const uint32_t F16_MIN_NORMAL = 113 << 23;          //2^-14
+    const uint32_t DENORM_MAGIC_BITS = ((127 - 15) + (23 - 10) + 1) << 23;
+
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    uint32_t half;
+    if (bits >= F16_OVERFLOW) {
+        half = bits > 0x7f800000 ? 0x7e00 : HALF_MAX;
+    } else if (bits < F16_MIN_NORMAL) {
+        float magnitude;
+        float denormMagic;
+        std::memcpy(&magnitude, &bits, sizeof(bits));
+        std::memcpy(&denormMagic, &DENORM_MAGIC_BITS, sizeof(bits));
+        magnitude += denormMagic;
+        std::memcpy(&half, &magnitude, sizeof(half));
+        half -= DENORM_MAGIC_BITS;
+    } else {
+        const uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += ((uint32_t)(15 - 127) << 23) + 0xfff + mantissaOdd;
+        half = std::min(bits >> 13, (uint32_t)HALF_MAX);
+    }
+    return (uint16_t)(sign | half);
+}
+
+float PackedParticle::fromHalf(uint16_t half) {
+    const uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1f;
+    const uint32_t mantissa = half & 0x3ff;
+
+    if (exponent == 0) {
+        const float value = std::ldexp((float)mantissa, -24);
+        return sign != 0 ? -value : value;
+    }
+
+    uint32_t bits;
+    if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+//ParticleStore's SSE and AVX2 packers reproduce this byte for byte, provided the build keeps
+//multiplies and adds unfused (-ffp-contract=off, /fp:precise)
+PackedParticle PackedParticle::encode(float x, float y, float z, float vx, float vy, float vz,
+                                      float temperature, float density, uint8_t importance) {
+    PackedParticle packed;
+    packed.position[0] = toHalf(x);
+    packed.position[1] = toHalf(y);
+    packed.position[2] = toHalf(z);
+
+    //Octahedral mapping: project onto |x| + |y| + |z| = 1, then fold the lower half over the upper
+    const float speed = std::sqrt(vx * vx + vy * vy + vz * vz);
+    const float l1 = std::fabs(vx) + std::fabs(vy) + std::fabs(vz);
+    const float inverseL1 = l1 > 0.0f ? 1.0f / l1 : 0.0f;
+    float u = vx * inverseL1;
+    float v = vy * inverseL1;
+    const float foldedU = (1.0f - std::fabs(v)) * signNotZero(u);
+    const float foldedV = (1.0f - std::fabs(u)) * signNotZero(v);
+    u = vz < 0.0f ? foldedU : u;
+    v = vz < 0.0f ? foldedV : v;
+    packed.speed = toHalf(speed);
+    packed.direction[0] = toSnorm16(u);
+    packed.direction[1] = toSnorm16(v);
+
+    packed.temperature = toUnorm8(temperature, TEMPERATURE_RANGE);
+    packed.density = toUnorm8(density, DENSITY_RANGE);
+    packed.importance = importance;
+    packed.padding = 0;
+    return packed;
+}
+
+void PackedParticle::decode(float* out) const {
+    out[0] = fromHalf(position[0]);
+    out[1] = fromHalf(position[1]);
+    out[2] = fromHalf(position[2]);
+
+    //Same steps as octDecode in the vertex shader
+    float dx = fromSnorm16(direction[0]);
+    float dy = fromSnorm16(direction[1]);
+    const float dz = 1.0f - std::fabs(dx) - std::fabs(dy);
+    const float t = std::max(-dz, 0.0f);
+    dx += dx >= 0.0f ? -t : t;
+    dy += dy >= 0.0f ? -t : t;
+    const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+    const float scale = fromHalf(speed) / length;
+    out[3] = dx * scale;
+    out[4] = dy * scale;
+    out[5] = dz * scale;
+
+    out[6] = temperature / 255.0f * TEMPERATURE_RANGE;
+    out[7] = density / 255.0f * DENSITY_RANGE;
+}
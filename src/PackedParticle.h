@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+//16-byte particle vertex, half the size of DiskGenerator's 8 floats.
+//
+//Positions are stored for unit mass (the vertex shader scales them by blackHoleMass), so
+//half floats keep about three significant digits anywhere in the disk. Velocity is split into
+//a half-float speed and an octahedral unit direction. Temperature and density are unorm8 over
+//fixed ranges that cover every component DiskGenerator produces. Importance is the particle's
+//level-of-detail rank from ParticleChunks, drawn at distance only while below a threshold.
+struct PackedParticle {
+    static constexpr float TEMPERATURE_RANGE = 2.0f;   //Must match shaders/disk.vert
+    static constexpr float DENSITY_RANGE = 2.0f;
+
+    uint16_t position[3];   //Half floats, unit-mass coordinates
+    uint16_t speed;         //Half float, read together with position as one half4 attribute
+    int16_t direction[2];   //Octahedral velocity direction, snorm16
+    uint8_t temperature;    //unorm8 over [0, TEMPERATURE_RANGE]
+    uint8_t density;        //unorm8 over [0, DENSITY_RANGE]
+    uint8_t importance;     //0 is always drawn
+    uint8_t padding;
+
+    static PackedParticle encode(float x, float y, float z, float vx, float vy, float vz,
+                                 float temperature, float density, uint8_t importance = 0);
+    //Inverse of encode, in DiskGenerator's interleaved 8-float layout, as the vertex shader sees it
+    void decode(float* out) const;
+
+    //IEEE 754 binary16 conversion, round to nearest even; out of range values saturate
+    static uint16_t toHalf(float value);
+    static float fromHalf(uint16_t half);
+};
+
+static_assert(sizeof(PackedParticle) == 16, "PackedParticle must stay one 16-byte vertex");
@@ -0,0 +1,287 @@
+#include "ParticleChunks.h"
+#include "Philox.h"
+#include "TaskScheduler.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//Particles per scheduler item
+static constexpr size_t BLOCK_PARTICLES = 65536;
+//Key of the importance hash; any fixed value gives an even subsample
+static constexpr uint32_t IMPORTANCE_SEED = 0x4C4F44u;
+
+//Runs fn(first, last) over [begin, end) in blocks, on the scheduler when there is one
+template <typename Fn>
+static void forEachBlock(size_t begin, size_t end, TaskScheduler* scheduler, const Fn& fn) {
+    const size_t blocks = (end - begin + BLOCK_PARTICLES - 1) / BLOCK_PARTICLES;
+    auto runBlock = [&](size_t block, unsigned) {
+        const size_t first = begin + block * BLOCK_PARTICLES;
+        fn(first, std::min(first + BLOCK_PARTICLES, end));
+    };
+    if (scheduler != nullptr && blocks > 1) {
+        scheduler->parallelFor(blocks, runBlock);
+    } else {
+        for (size_t block = 0; block < blocks; ++block) {
+            runBlock(block, 0);
+        }
+    }
+}
+
+//Sector of the angle about the y axis, [0, sectors). Sectors split the diamond angle, which
+//rises with the true angle without a call to atan2, into equal parts.
+static int sectorOf(float x, float z, int sectors) {
+    const float sum = fabsf(x) + fabsf(z);
+    const float p = sum > 0.0f ? x / sum : 1.0f;
+    const float diamond = z >= 0.0f ? 1.0f - p : 3.0f + p;
+    return std::min((int)(diamond * (0.25f * sectors)), sectors - 1);
+}
+
+//Importance values below this are drawn at the given fraction: the fraction of 256 rounded up
+//to a power of two
+static int lodThreshold(float fraction) {
+    int threshold = 1;
+    while (threshold < 256 && (float)threshold < fraction * 256.0f) {
+        threshold *= 2;
+    }
+    return threshold;
+}
+
+ParticleChunks::ParticleChunks() : builtRadius(0.0), rebuilds(0) {
+}
+
+void ParticleChunks::build(ParticleStore& store, const DiskLayout& layout, TaskScheduler* scheduler) {
+    this->layout = layout;
+    forEachBlock(0, store.size(), scheduler, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            ParticleRandom random(IMPORTANCE_SEED, 0, (uint32_t)i);
+            store.importance[i] = (uint8_t)(random.uniform(0) * 256.0f);
+        }
+    });
+    rebuild(store, scheduler);
+    rebuilds = 0;
+}
+
+void ParticleChunks::rebuild(ParticleStore& store, TaskScheduler* scheduler) {
+    const size_t total = std::min(store.size(), (size_t)layout.totalParticles());
+    const size_t jetBegin = std::min((size_t)layout.jetOffset(), total);
+    const size_t jetEnd = std::min(jetBegin + 2 * (size_t)layout.jetParticles, total);
+    chunks.clear();
+    //Disk and spiral arms: bands evenly spaced in log radius between the innermost and outermost particle
+    float minRadius = std::numeric_limits<float>::max(), maxRadius = 0.0f;
+    for (size_t i = 0; i < jetBegin; ++i) {
+        const float r = sqrtf(store.x[i] * store.x[i] + store.z[i] * store.z[i]);
+        minRadius = std::min(minRadius, r);
+        maxRadius = std::max(maxRadius, r);
+    }
+    minRadius = std::max(minRadius, 1e-3f);
+    float innerEdges[RADIAL_BANDS - 1];   //Squared, so particles need no square root or log
+    for (int band = 1; band < RADIAL_BANDS; ++band) {
+        const float edge = minRadius * powf(std::max(maxRadius, minRadius) / minRadius, (float)band / RADIAL_BANDS);
+        innerEdges[band - 1] = edge * edge;
+    }
+    bins.resize(jetBegin);
+    forEachBlock(0, jetBegin, scheduler, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            const float r2 = store.x[i] * store.x[i] + store.z[i] * store.z[i];
+            const int band = (int)(std::upper_bound(innerEdges, innerEdges + RADIAL_BANDS - 1, r2) - innerEdges);
+            bins[i] = (uint16_t)(band * SECTORS + sectorOf(store.x[i], store.z[i], SECTORS));
+        }
+    });
+    sortRange(store, 0, jetBegin, bins, RADIAL_BANDS * SECTORS);
+
+    //Jets: slices along y across both, the two jets never sharing one
+    float minY = std::numeric_limits<float>::max(), maxY = -std::numeric_limits<float>::max();
+    for (size_t i = jetBegin; i < jetEnd; ++i) {
+        minY = std::min(minY, store.y[i]);
+        maxY = std::max(maxY, store.y[i]);
+    }
+    const float sliceScale = maxY > minY ? 2 * JET_SLICES / (maxY - minY) : 0.0f;
+    bins.resize(jetEnd - jetBegin);
+    forEachBlock(jetBegin, jetEnd, scheduler, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            bins[i - jetBegin] = (uint16_t)std::min((int)((store.y[i] - minY) * sliceScale), 2 * JET_SLICES - 1);
+        }
+    });
+    sortRange(store, jetBegin, jetEnd, bins, 2 * JET_SLICES);
+
+    //Torus: sectors
+    bins.resize(total - jetEnd);
+    forEachBlock(jetEnd, total, scheduler, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            bins[i - jetEnd] = (uint16_t)sectorOf(store.x[i], store.z[i], SECTORS);
+        }
+    });
+    sortRange(store, jetEnd, total, bins, SECTORS);
+
+    updateBounds(store, scheduler);
+    builtRadius = 0.0;
+    for (const ParticleChunk& chunk : chunks) {
+        builtRadius += chunk.radius;
+    }
+    rebuilds++;
+}
+
+void ParticleChunks::sortRange(ParticleStore& store, size_t begin, size_t end, const std::vector<uint16_t>& bins,
+                               int binCount) {
+    if (begin >= end) {
+        return;
+    }
+    //Counting sort on the combined key; stable, so equal keys keep their previous order
+    counts.assign((size_t)binCount * 256 + 1, 0u);
+    for (size_t i = begin; i < end; ++i) {
+        counts[(size_t)bins[i - begin] * 256 + store.importance[i] + 1]++;
+    }
+    for (size_t key = 1; key < counts.size(); ++key) {
+        counts[key] += counts[key - 1];
+    }
+    for (int bin = 0; bin < binCount; ++bin) {
+        const uint32_t first = counts[(size_t)bin * 256], last = counts[(size_t)(bin + 1) * 256];
+        if (last > first) {
+            ParticleChunk chunk;
+            chunk.first = (uint32_t)begin + first;
+            chunk.count = last - first;
+            chunks.push_back(chunk);
+        }
+    }
+    sources.resize(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+        sources[counts[(size_t)bins[i - begin] * 256 + store.importance[i]]++] = (uint32_t)i;
+    }
+    store.reorder(sources.data(), begin, end);
+}
+
+void ParticleChunks::restore(const DiskLayout& layout, const std::vector<ParticleChunk>& saved, double builtRadius) {
+    this->layout = layout;
+    chunks = saved;
+    this->builtRadius = builtRadius;
+    rebuilds = 0;
+    stats = ChunkStats();
+}
+
+void ParticleChunks::clear() {
+    chunks.clear();
+    builtRadius = 0.0;
+    rebuilds = 0;
+    stats = ChunkStats();
+}
+
+bool ParticleChunks::updateBounds(const ParticleStore& store, TaskScheduler* scheduler) {
+    auto fitChunk = [&](size_t index, unsigned) {
+        ParticleChunk& chunk = chunks[index];
+        const size_t last = std::min((size_t)chunk.first + chunk.count, store.size());
+        glm::vec3 low(std::numeric_limits<float>::max()), high(-std::numeric_limits<float>::max());
+        for (size_t i = chunk.first; i < last; ++i) {
+            low.x = std::min(low.x, store.x[i]);
+            low.y = std::min(low.y, store.y[i]);
+            low.z = std::min(low.z, store.z[i]);
+            high.x = std::max(high.x, store.x[i]);
+            high.y = std::max(high.y, store.y[i]);
+            high.z = std::max(high.z, store.z[i]);
+        }
+        chunk.low = low;
+        chunk.high = high;
+        chunk.center = 0.5f * (low + high);
+        chunk.radius = 0.5f * glm::length(high - low);
+    };
+    if (scheduler != nullptr && chunks.size() > 1 && store.size() > BLOCK_PARTICLES) {
+        scheduler->parallelFor(chunks.size(), fitChunk);
+    } else {
+        for (size_t index = 0; index < chunks.size(); ++index) {
+            fitChunk(index, 0);
+        }
+    }
+
+    double radius = 0.0;
+    for (const ParticleChunk& chunk : chunks) {
+        radius += chunk.radius;
+    }
+    return radius > REBUILD_GROWTH * builtRadius;
+}
+
+bool ParticleChunks::behindHorizon(const glm::vec3& eye, const glm::vec3& center, float radius) {
+    //Inside the cone from the eye tangent to the horizon, and no nearer than the black hole's
+    //centre, so every ray to the chunk enters the sphere first
+    const float holeDistance = glm::length(eye);
+    const glm::vec3 toChunk = center - eye;
+    const float chunkDistance = glm::length(toChunk);
+    if (holeDistance <= HORIZON_RADIUS || chunkDistance - radius < holeDistance) {
+        return false;
+    }
+    const float cosAngle = glm::clamp(glm::dot(-eye, toChunk) / (holeDistance * chunkDistance), -1.0f, 1.0f);
+    return acosf(cosAngle) + asinf(radius / chunkDistance) <= asinf(HORIZON_RADIUS / holeDistance);
+}
+
+size_t ParticleChunks::select(const ParticleStore& store, const ChunkCamera& camera,
+                              std::vector<ParticleRange>& ranges) {
+    //Frustum planes of clipFromUnit, inside where dot(plane, (p, 1)) >= 0
+    const glm::mat4& m = camera.clipFromUnit;
+    const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+    const glm::vec4 planes[6] = {row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2};
+    const glm::vec3 lift(0.0f, TURBULENCE / camera.blackHoleMass, 0.0f);
+
+    ranges.clear();
+    stats = ChunkStats();
+    stats.chunks = chunks.size();
+    for (const ParticleChunk& chunk : chunks) {
+        const glm::vec3 low = chunk.low - lift, high = chunk.high + lift;
+        bool inside = true;
+        for (const glm::vec4& plane : planes) {
+            //Corner farthest along the plane normal
+            const glm::vec3 corner(plane.x >= 0.0f ? high.x : low.x, plane.y >= 0.0f ? high.y : low.y,
+                                   plane.z >= 0.0f ? high.z : low.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                inside = false;
+                break;
+            }
+        }
+        if (!inside) {
+            stats.outsideFrustum++;
+            continue;
+        }
+        if (behindHorizon(camera.eye, chunk.center, chunk.radius + lift.y)) {
+            stats.behindHorizon++;
+            continue;
+        }
+
+        uint32_t count = chunk.count;
+        if (camera.lodDistance > 0.0f) {
+            const float nearest = glm::length(glm::clamp(camera.eye, low, high) - camera.eye);
+            const int threshold = lodThreshold(lodFraction(nearest, camera.lodDistance));
+            const uint8_t* begin = store.importance.data() + chunk.first;
+            count = (uint32_t)(std::partition_point(begin, begin + chunk.count, [&](uint8_t importance) {
+                                   return importance < threshold;
+                               }) - begin);
+        }
+        if (count == 0) {
+            continue;
+        }
+        if (!ranges.empty() && ranges.back().first + ranges.back().count == chunk.first) {
+            ranges.back().count += count;
+        } else {
+            ParticleRange range;
+            range.first = chunk.first;
+            range.count = count;
+            ranges.push_back(range);
+        }
+        stats.particles += count;
+    }
+    return stats.particles;
+}
+
+float ParticleChunks::lodFraction(float distance, float lodDistance) {
+    if (lodDistance <= 0.0f || distance <= lodDistance) {
+        return 1.0f;
+    }
+    const float ratio = lodDistance / distance;
+    return std::max(ratio * ratio, MIN_FRACTION);
+}
+
+float ParticleChunks::lodDistanceFor(size_t particles) {
+    //A chunk at distance d draws count * (lodDistance / d)^2, which this keeps independent of count
+    const double defaultParticles = DiskLayout().totalParticles();
+    return LOD_DISTANCE * (float)sqrt(defaultParticles / std::max(particles, (size_t)1));
+}
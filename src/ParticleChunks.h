@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "DiskGenerator.h"
+#include "ParticleStore.h"
+
+class TaskScheduler;
+
+//Contiguous particles of one region, ascending in importance, and their bounds (unit mass)
+struct ParticleChunk {
+    uint32_t first = 0;
+    uint32_t count = 0;
+    glm::vec3 low = glm::vec3(0.0f), high = glm::vec3(0.0f);    //Box around every particle
+    glm::vec3 center = glm::vec3(0.0f);                         //Sphere around the box
+    float radius = 0.0f;
+};
+
+//Camera select() culls for, in the store's unit-mass coordinates
+struct ChunkCamera {
+    glm::mat4 clipFromUnit = glm::mat4(1.0f);   //projection * view * model * scale(blackHoleMass)
+    glm::vec3 eye = glm::vec3(0.0f);
+    float blackHoleMass = 1.0f;
+    float lodDistance = 0.0f;                   //Full density out to here, 0 = every particle
+};
+
+//What the last select() kept
+struct ChunkStats {
+    size_t chunks = 0;
+    size_t outsideFrustum = 0;
+    size_t behindHorizon = 0;
+    size_t particles = 0;       //In the selected ranges
+};
+
+//Spatial partition of the accretion disk particles for culling and distance level of detail.
+//
+//build() sorts each component of a DiskLayout store into chunks in place: the inflowing disk and
+//spiral arms into log-spaced radial bands split into azimuthal sectors, each jet into slices
+//along y and the torus into sectors. Every particle gets an importance byte from a counter-based
+//hash, uniform in [0, 256) and carried with it when the store is reordered, and each chunk holds
+//its particles in ascending importance, so any prefix of a chunk is an even subsample of it.
+//
+//updateBounds() refits every chunk's box to the current positions each frame. Orbits shear the
+//sectors and inflow recycles particles to the outer edge, so the boxes grow; once they are
+//REBUILD_GROWTH times their size at build time, rebuild() sorts the particles into chunks again.
+//
+//select() drops the chunks outside the view frustum and those wholly hidden behind the horizon
+//sphere, and of each remaining chunk keeps only the particles with importance below
+//256 * lodFraction() at its nearest point, rounded up to a power of two so the ranges stay the
+//same from frame to frame. shaders/disk.vert drops the rest by each particle's own distance
+//and enlarges the survivors to cover for them.
+class ParticleChunks {
+public:
+    static constexpr int RADIAL_BANDS = 32;
+    static constexpr int SECTORS = 32;              //Of the disk bands and of the torus
+    static constexpr int JET_SLICES = 16;           //Per jet
+    static constexpr int MAX_CHUNKS = RADIAL_BANDS * SECTORS + 2 * JET_SLICES + SECTORS;
+    static constexpr double REBUILD_GROWTH = 1.5;   //Of the summed chunk radii
+    static constexpr float HORIZON_RADIUS = 0.5f;   //Unit mass, as main draws the black hole
+    static constexpr float TURBULENCE = 0.04f;      //Largest lift disk.vert adds, at unit mass
+    static constexpr float LOD_DISTANCE = 48.0f;    //Full density this far from the default layout
+    static constexpr float MIN_FRACTION = 1.0f / 256.0f;
+
+    ParticleChunks();
+
+    //Assigns every particle its importance and sorts the store into chunks by layout's components
+    void build(ParticleStore& store, const DiskLayout& layout, TaskScheduler* scheduler = nullptr);
+    //Sorts the particles into chunks again for where they are now, keeping their importance
+    void rebuild(ParticleStore& store, TaskScheduler* scheduler = nullptr);
+    //Takes over chunks saved for a store in the same order, e.g. by a ParticleSnapshot, with the
+    //summed radii they had when built
+    void restore(const DiskLayout& layout, const std::vector<ParticleChunk>& saved, double builtRadius);
+    void clear();
+    bool empty() const { return chunks.empty(); }
+
+    //Refits every chunk to the store's positions; returns whether the chunks have grown enough
+    //since the last build that rebuild() is due
+    bool updateBounds(const ParticleStore& store, TaskScheduler* scheduler = nullptr);
+
+    //Appends the visible particles of the store, adjacent chunks merged, to ranges (cleared
+    //first); returns how many there are
+    size_t select(const ParticleStore& store, const ChunkCamera& camera, std::vector<ParticleRange>& ranges);
+
+    //Fraction of the particles drawn at unit-mass distance from the camera, as disk.vert computes it
+    static float lodFraction(float distance, float lodDistance);
+    //Distance out to which a store of this many particles is drawn in full, so far chunks
+    //draw about as many particles as the default layout's whatever the count
+    static float lodDistanceFor(size_t particles);
+
+    const std::vector<ParticleChunk>& getChunks() const { return chunks; }
+    const ChunkStats& getStats() const { return stats; }
+    int getRebuilds() const { return rebuilds; }
+    double getBuiltRadius() const { return builtRadius; }
+
+private:
+    //Sorts particles [begin, end) by bins[i - begin] * 256 + importance and appends a chunk per
+    //non-empty bin
+    void sortRange(ParticleStore& store, size_t begin, size_t end, const std::vector<uint16_t>& bins, int binCount);
+    //Whether the sphere lies wholly behind the horizon sphere, seen from eye
+    static bool behindHorizon(const glm::vec3& eye, const glm::vec3& center, float radius);
+
+    DiskLayout layout;
+    std::vector<ParticleChunk> chunks;
+    double builtRadius;             //Sum of the chunk radii right after the last build
+    int rebuilds;
+    ChunkStats stats;
+
+    std::vector<uint16_t> bins;     //Per particle of the range being sorted
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> sources;
+};
@@ -0,0 +1,311 @@
+#include "ParticleSnapshot.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <cstring>
+
+static const char SNAPSHOT_MAGIC[8] = {'B', 'H', 'S', 'N', 'A', 'P', '\0', '\0'};
+//Bytes per scheduler item when copying a frame out
+static constexpr size_t COPY_BLOCK = 1 << 20;
+
+static size_t roundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+//The format is little-endian and read in place, so a big-endian host cannot use it
+static bool littleEndianHost() {
+    const uint16_t probe = 1;
+    unsigned char first;
+    memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+static size_t strideFor(size_t count) {
+    return roundUp(std::max(count, (size_t)1), ParticleSnapshot::ALIGNMENT / sizeof(float));
+}
+
+//Byte offsets within a frame
+static size_t chunksOffset() {
+    return sizeof(SnapshotFrame);
+}
+
+static size_t arraysOffset(size_t chunkCapacity) {
+    return roundUp(chunksOffset() + chunkCapacity * sizeof(SnapshotChunk), ParticleSnapshot::ALIGNMENT);
+}
+
+size_t ParticleSnapshot::frameBytesFor(size_t count, size_t chunkCapacity) {
+    const size_t stride = strideFor(count);
+    return arraysOffset(chunkCapacity) + ARRAYS * stride * sizeof(float) + roundUp(stride, ALIGNMENT);
+}
+
+bool ParticleSnapshot::open(const std::string& path, std::string& error) {
+    close();
+    if (!littleEndianHost()) {
+        error = "particle snapshots need a little-endian host";
+        return false;
+    }
+    if (!file.open(path, error)) {
+        return false;
+    }
+    if (file.size() < sizeof(header)) {
+        error = path + " is not a particle snapshot";
+        close();
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        error = path + " is not a particle snapshot";
+        close();
+        return false;
+    }
+    if (header.version != VERSION) {
+        error = path + ": unsupported snapshot version " + std::to_string(header.version);
+        close();
+        return false;
+    }
+    const size_t count = (size_t)header.particleCount;
+    if (header.arrayStride != strideFor(count) || header.frameBytes != frameBytesFor(count, header.chunkCapacity)
+        || header.dataOffset % DATA_ALIGNMENT != 0 || header.dataOffset < sizeof(header)
+        || header.dataOffset > file.size()) {
+        error = path + ": inconsistent snapshot header";
+        close();
+        return false;
+    }
+    if ((size_t)getLayout().totalParticles() != count) {
+        error = path + ": particle count does not match its disk layout";
+        close();
+        return false;
+    }
+    frames = (size_t)((file.size() - header.dataOffset) / header.frameBytes);
+    return true;
+}
+
+void ParticleSnapshot::close() {
+    file.close();
+    header = SnapshotHeader();
+    frames = 0;
+}
+
+DiskLayout ParticleSnapshot::getLayout() const {
+    DiskLayout layout;
+    layout.diskParticles = header.diskParticles;
+    layout.spiralArms = header.spiralArms;
+    layout.armParticles = header.armParticles;
+    layout.jetParticles = header.jetParticles;
+    layout.torusParticles = header.torusParticles;
+    return layout;
+}
+
+const unsigned char* ParticleSnapshot::frameData(size_t index) const {
+    return file.data() + header.dataOffset + index * header.frameBytes;
+}
+
+const SnapshotFrame& ParticleSnapshot::frame(size_t index) const {
+    return *reinterpret_cast<const SnapshotFrame*>(frameData(index));
+}
+
+const float* ParticleSnapshot::array(size_t frame, SnapshotArray which) const {
+    const size_t offset = arraysOffset(header.chunkCapacity) + (size_t)which * header.arrayStride * sizeof(float);
+    return reinterpret_cast<const float*>(frameData(frame) + offset);
+}
+
+const uint8_t* ParticleSnapshot::importance(size_t frame) const {
+    const size_t offset = arraysOffset(header.chunkCapacity) + ARRAYS * header.arrayStride * sizeof(float);
+    return frameData(frame) + offset;
+}
+
+std::vector<ParticleChunk> ParticleSnapshot::chunks(size_t frame) const {
+    //A table that does not tile the particles is dropped, and the chunks get rebuilt instead
+    const SnapshotFrame& record = this->frame(frame);
+    std::vector<ParticleChunk> result;
+    if (record.chunkCount > header.chunkCapacity) {
+        return result;
+    }
+    const SnapshotChunk* stored = reinterpret_cast<const SnapshotChunk*>(frameData(frame) + chunksOffset());
+    uint64_t next = 0;
+    for (uint32_t i = 0; i < record.chunkCount; ++i) {
+        if (stored[i].first != next || stored[i].count == 0) {
+            return std::vector<ParticleChunk>();
+        }
+        next += stored[i].count;
+        ParticleChunk chunk;
+        chunk.first = stored[i].first;
+        chunk.count = stored[i].count;
+        chunk.low = glm::vec3(stored[i].low[0], stored[i].low[1], stored[i].low[2]);
+        chunk.high = glm::vec3(stored[i].high[0], stored[i].high[1], stored[i].high[2]);
+        chunk.center = 0.5f * (chunk.low + chunk.high);
+        chunk.radius = 0.5f * glm::length(chunk.high - chunk.low);
+        result.push_back(chunk);
+    }
+    if (next != header.particleCount) {
+        result.clear();
+    }
+    return result;
+}
+
+void ParticleSnapshot::read(size_t frame, ParticleStore& store, TaskScheduler* scheduler) const {
+    const size_t count = getParticleCount();
+    store.resize(count);
+    AlignedFloats* targets[ARRAYS] = {&store.x, &store.y, &store.z, &store.vx, &store.vy, &store.vz,
+                                      &store.temperature, &store.density};
+
+    //Every array in blocks, so the copy spreads over the scheduler
+    const size_t blockParticles = COPY_BLOCK / sizeof(float);
+    const size_t blocksPerArray = (count + blockParticles - 1) / blockParticles;
+    auto copyBlock = [&](size_t item, unsigned) {
+        const size_t which = item / blocksPerArray;
+        const size_t first = (item % blocksPerArray) * blockParticles;
+        const size_t n = std::min(blockParticles, count - first);
+        if (which < (size_t)ARRAYS) {
+            memcpy(targets[which]->data() + first, array(frame, (SnapshotArray)which) + first, n * sizeof(float));
+        } else {
+            memcpy(store.importance.data() + first, importance(frame) + first, n);
+        }
+    };
+    const size_t items = (ARRAYS + 1) * blocksPerArray;
+    if (scheduler != nullptr && items > 1) {
+        scheduler->parallelFor(items, copyBlock);
+    } else {
+        for (size_t item = 0; item < items; ++item) {
+            copyBlock(item, 0);
+        }
+    }
+}
+
+SnapshotWriter::SnapshotWriter() : file(nullptr), header(), frames(0), bytesWritten(0) {
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    std::string error;
+    close(error);
+}
+
+bool SnapshotWriter::write(const void* data, size_t bytes) {
+    if (bytes == 0) {
+        return true;
+    }
+    if (fwrite(data, 1, bytes, file) != bytes) {
+        return false;
+    }
+    bytesWritten += bytes;
+    return true;
+}
+
+bool SnapshotWriter::open(const std::string& path, const DiskLayout& layout, uint32_t seed, float blackHoleMass,
+                          size_t particleCount, std::string& error) {
+    close(error);
+    if (!littleEndianHost()) {
+        error = "particle snapshots need a little-endian host";
+        return false;
+    }
+    if ((size_t)layout.totalParticles() != particleCount) {
+        error = "particle count does not match the disk layout";
+        return false;
+    }
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    this->path = path;
+    frames = 0;
+    bytesWritten = 0;
+
+    header = SnapshotHeader();
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = ParticleSnapshot::VERSION;
+    header.chunkCapacity = ParticleChunks::MAX_CHUNKS;
+    header.particleCount = particleCount;
+    header.arrayStride = strideFor(particleCount);
+    header.frameBytes = ParticleSnapshot::frameBytesFor(particleCount, header.chunkCapacity);
+    header.dataOffset = ParticleSnapshot::DATA_ALIGNMENT;
+    header.diskParticles = layout.diskParticles;
+    header.spiralArms = layout.spiralArms;
+    header.armParticles = layout.armParticles;
+    header.jetParticles = layout.jetParticles;
+    header.torusParticles = layout.torusParticles;
+    header.seed = seed;
+    header.blackHoleMass = blackHoleMass;
+
+    static const unsigned char zeros[ParticleSnapshot::DATA_ALIGNMENT] = {};
+    if (!write(&header, sizeof(header)) || !write(zeros, (size_t)header.dataOffset - sizeof(header))) {
+        error = "error writing " + path;
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool SnapshotWriter::append(const ParticleStore& store, const ParticleChunks& chunks, double time,
+                            float blackHoleMass, std::string& error) {
+    if (!file) {
+        error = "no snapshot is open for writing";
+        return false;
+    }
+    const size_t count = (size_t)header.particleCount;
+    if (store.size() != count) {
+        error = path + ": store has " + std::to_string(store.size()) + " particles, the snapshot " +
+                std::to_string(count);
+        return false;
+    }
+    const std::vector<ParticleChunk>& table = chunks.getChunks();
+    const size_t chunkCount = table.size() <= header.chunkCapacity ? table.size() : 0;
+
+    SnapshotFrame record = SnapshotFrame();
+    record.time = time;
+    record.index = frames;
+    record.builtRadius = chunks.getBuiltRadius();
+    record.blackHoleMass = blackHoleMass;
+    record.chunkCount = (uint32_t)chunkCount;
+
+    //Everything goes out in file order from where it already is; padding comes from a zero block
+    static const unsigned char zeros[ParticleSnapshot::ALIGNMENT] = {};
+    auto pad = [&](size_t bytes) {
+        for (; bytes > 0; bytes -= std::min(bytes, sizeof(zeros))) {
+            if (!write(zeros, std::min(bytes, sizeof(zeros)))) return false;
+        }
+        return true;
+    };
+    bool ok = write(&record, sizeof(record));
+    for (size_t i = 0; ok && i < header.chunkCapacity; ++i) {
+        SnapshotChunk stored = SnapshotChunk();
+        if (i < chunkCount) {
+            stored.first = table[i].first;
+            stored.count = table[i].count;
+            for (int axis = 0; axis < 3; ++axis) {
+                stored.low[axis] = table[i].low[axis];
+                stored.high[axis] = table[i].high[axis];
+            }
+        }
+        ok = write(&stored, sizeof(stored));
+    }
+    ok = ok && pad(arraysOffset(header.chunkCapacity) - chunksOffset() - header.chunkCapacity * sizeof(SnapshotChunk));
+    const AlignedFloats* sources[ParticleSnapshot::ARRAYS] = {&store.x, &store.y, &store.z, &store.vx, &store.vy,
+                                                              &store.vz, &store.temperature, &store.density};
+    const size_t stride = (size_t)header.arrayStride;
+    for (const AlignedFloats* source : sources) {
+        ok = ok && write(source->data(), count * sizeof(float)) && pad((stride - count) * sizeof(float));
+    }
+    ok = ok && write(store.importance.data(), count) && pad(roundUp(stride, ParticleSnapshot::ALIGNMENT) - count);
+    if (!ok) {
+        //Readers ignore the partial frame; appending after it would shift every later one
+        error = "error writing " + path;
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    frames++;
+    return true;
+}
+
+bool SnapshotWriter::close(std::string& error) {
+    if (!file) {
+        return true;
+    }
+    const bool ok = fclose(file) == 0;
+    file = nullptr;
+    if (!ok) {
+        error = "error writing " + path;
+    }
+    return ok;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "DiskGenerator.h"
+#include "MappedFile.h"
+#include "ParticleChunks.h"
+#include "ParticleStore.h"
+
+class TaskScheduler;
+
+//Start of a snapshot file. Little-endian throughout; frames follow at dataOffset, frameBytes
+//apart, as many as fit in the file.
+struct SnapshotHeader {
+    char magic[8];              //"BHSNAP" and two NULs
+    uint32_t version;
+    uint32_t chunkCapacity;     //Chunk records in every frame
+    uint64_t particleCount;
+    uint64_t arrayStride;       //Elements per array, a multiple of 16 so each float array fills whole cache lines
+    uint64_t frameBytes;
+    uint64_t dataOffset;        //Of the first frame, a multiple of DATA_ALIGNMENT
+    //Generation parameters: DiskLayout, DiskGenerator seed and the black hole mass
+    int32_t diskParticles;
+    int32_t spiralArms;
+    int32_t armParticles;
+    int32_t jetParticles;
+    int32_t torusParticles;
+    uint32_t seed;
+    float blackHoleMass;
+    uint32_t reserved[13];
+};
+
+//Start of every frame, followed by chunkCapacity SnapshotChunks, then the arrays of
+//SnapshotArray order each arrayStride long, then importance (arrayStride bytes)
+struct SnapshotFrame {
+    double time;                //Simulation seconds
+    uint64_t index;             //Position in the recording
+    double builtRadius;         //ParticleChunks' summed radii when last built
+    float blackHoleMass;
+    uint32_t chunkCount;        //Records in use, the rest are zero
+    uint32_t reserved[8];
+};
+
+//A ParticleChunk as stored; center and radius follow from the box
+struct SnapshotChunk {
+    uint32_t first;
+    uint32_t count;
+    float low[3];
+    float high[3];
+};
+
+static_assert(sizeof(SnapshotHeader) == 128, "SnapshotHeader is part of the file format");
+static_assert(sizeof(SnapshotFrame) == 64, "SnapshotFrame is part of the file format");
+static_assert(sizeof(SnapshotChunk) == 32, "SnapshotChunk is part of the file format");
+
+//ParticleStore arrays in the order a frame holds them
+enum class SnapshotArray {
+    X, Y, Z, VX, VY, VZ, Temperature, Density
+};
+
+//Disk particles saved to disk: one state, or a recording of many frames.
+//
+//Every array in a frame starts on a 64-byte boundary of the file, so once mapped (pages are
+//4096-byte aligned) the arrays can go straight to SIMD loads, to glBufferSubData or to
+//DiskVolume without being parsed or copied. read() copies a frame into a ParticleStore for the
+//simulation to carry on from, memcpy per array. Each frame also keeps the ParticleChunks table
+//that matches its particle order, so restoring it skips the sort into chunks.
+//
+//Frames are fixed-size and the frame count comes from the file size, so a recording that was cut
+//off mid-frame still opens, without its last partial frame.
+class ParticleSnapshot {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr size_t DATA_ALIGNMENT = 4096;    //Of the first frame, so frames can be mapped by page
+    static constexpr int ARRAYS = 8;
+
+    //Maps the file and checks its header; nothing else is read
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    size_t getParticleCount() const { return (size_t)header.particleCount; }
+    size_t getFrameCount() const { return frames; }
+    DiskLayout getLayout() const;
+    uint32_t getSeed() const { return header.seed; }
+    float getBlackHoleMass() const { return header.blackHoleMass; }
+
+    //Pointers into the mapping, valid until close()
+    const SnapshotFrame& frame(size_t index) const;
+    const float* array(size_t frame, SnapshotArray which) const;
+    const uint8_t* importance(size_t frame) const;
+    std::vector<ParticleChunk> chunks(size_t frame) const;
+
+    //Copies a frame into store, resized to the particle count
+    void read(size_t frame, ParticleStore& store, TaskScheduler* scheduler = nullptr) const;
+
+    //Bytes one frame of count particles takes with room for chunkCapacity chunks
+    static size_t frameBytesFor(size_t count, size_t chunkCapacity);
+
+private:
+    const unsigned char* frameData(size_t index) const;
+
+    MappedFile file;
+    SnapshotHeader header = SnapshotHeader();
+    size_t frames = 0;
+};
+
+//Append-only writer for ParticleSnapshot files. Each append() writes one frame straight from a
+//ParticleStore's arrays, so memory use does not grow with the length of a recording.
+class SnapshotWriter {
+public:
+    SnapshotWriter();
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    //Starts a file for particleCount particles generated with the given parameters; replaces
+    //any file at path
+    bool open(const std::string& path, const DiskLayout& layout, uint32_t seed, float blackHoleMass,
+              size_t particleCount, std::string& error);
+    //Adds a frame: the store's particles and, unless empty, the chunks they are sorted into
+    bool append(const ParticleStore& store, const ParticleChunks& chunks, double time, float blackHoleMass,
+                std::string& error);
+    bool close(std::string& error);
+
+    bool isOpen() const { return file != nullptr; }
+    size_t getFrameCount() const { return frames; }
+    uint64_t getBytesWritten() const { return bytesWritten; }
+
+private:
+    bool write(const void* data, size_t bytes);
+
+    FILE* file;
+    std::string path;
+    SnapshotHeader header;
+    size_t frames;
+    uint64_t bytesWritten;
+};
@@ -0,0 +1,422 @@
+#include "ParticleStore.h"
+#include "DiskGenerator.h"
+#include "PackedParticle.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PARTICLES_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+//MSVC emits any intrinsic without flags; GCC and Clang need the AVX2 kernels marked.
+//The AVX2 level also uses F16C, which every AVX2 CPU has.
+#if defined(PARTICLES_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#else
+#define TARGET_AVX2
+#endif
+
+//The SIMD kernels below match the scalar ones bit for bit only if no compiler fuses a multiply
+//and an add into one FMA. Clang does within an expression unless told here; GCC builds pass
+//-ffp-contract=off, as the pragma is not honoured there
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+
+//Particles per scheduler item
+static constexpr size_t CHUNK_PARTICLES = 16384;
+
+//Runs fn(first, last) over [begin, end) in chunks, on the scheduler when there is one
+template <typename Fn>
+static void forEachChunk(size_t begin, size_t end, TaskScheduler* scheduler, const Fn& fn) {
+    const size_t chunks = (end - begin + CHUNK_PARTICLES - 1) / CHUNK_PARTICLES;
+    auto runChunk = [&](size_t chunk, unsigned) {
+        const size_t first = begin + chunk * CHUNK_PARTICLES;
+        fn(first, std::min(first + CHUNK_PARTICLES, end));
+    };
+    if (scheduler != nullptr && chunks > 1) {
+        scheduler->parallelFor(chunks, runChunk);
+    } else {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            runChunk(chunk, 0);
+        }
+    }
+}
+
+//Taylor coefficients of sin and cos on the quarter angle
+static constexpr float INV_6 = 1.0f / 6.0f, INV_20 = 1.0f / 20.0f, INV_42 = 1.0f / 42.0f;
+static constexpr float INV_2 = 0.5f, INV_12 = 1.0f / 12.0f, INV_30 = 1.0f / 30.0f, INV_56 = 1.0f / 56.0f;
+static constexpr float MIN_RADIUS = 0.1f; //Same clamp as the old vertex shader motion
+
+//Every kernel below performs the same IEEE operations in the same order, unfused, so the SIMD
+//versions match the scalar one bit for bit.
+//
+//sin and cos of the orbital angle use a Taylor series on a quarter of the angle (error
+//below 1e-7 for angles up to pi) followed by two double-angle steps. That needs only
+//multiplies and adds, which vectorise directly.
+static void advectScalar(const AdvectParams& p, float* x, float* z, float* vx, float* vz,
+                         size_t begin, size_t end) {
+    const float respawn = p.outerRadius / p.innerRadius;
+    for (size_t i = begin; i < end; ++i) {
+        const float r = sqrtf(x[i] * x[i] + z[i] * z[i]);
+        const float omega = 1.0f / sqrtf(std::max(r * p.blackHoleMass, MIN_RADIUS));
+        const float theta = omega * p.dt;
+
+        const float a = theta * 0.25f;
+        const float a2 = a * a;
+        float s = a * (1.0f - a2 * INV_6 * (1.0f - a2 * INV_20 * (1.0f - a2 * INV_42)));
+        float c = 1.0f - a2 * INV_2 * (1.0f - a2 * INV_12 * (1.0f - a2 * INV_30 * (1.0f - a2 * INV_56)));
+        for (int k = 0; k < 2; ++k) {
+            const float s2 = 2.0f * s * c;
+            c = c * c - s * s;
+            s = s2;
+        }
+
+        float shrink = 1.0f - p.inflow * theta;
+        if (p.inflow > 0.0f && r * shrink < p.innerRadius) {
+            shrink = shrink * respawn;
+        }
+
+        const float px = x[i], pz = z[i], pvx = vx[i], pvz = vz[i];
+        x[i] = (c * px - s * pz) * shrink;
+        z[i] = (s * px + c * pz) * shrink;
+        vx[i] = c * pvx - s * pvz;
+        vz[i] = s * pvx + c * pvz;
+    }
+}
+
+#ifdef PARTICLES_X86
+//Returns the index of the first particle not processed, the caller finishes the tail
+static size_t advectSSE(const AdvectParams& p, float* x, float* z, float* vx, float* vz,
+                        size_t begin, size_t end) {
+    const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), quarter = _mm_set1_ps(0.25f);
+    const __m128 mass = _mm_set1_ps(p.blackHoleMass), minRadius = _mm_set1_ps(MIN_RADIUS);
+    const __m128 dt = _mm_set1_ps(p.dt), inflow = _mm_set1_ps(p.inflow);
+    const __m128 inner = _mm_set1_ps(p.innerRadius), respawn = _mm_set1_ps(p.outerRadius / p.innerRadius);
+    const __m128 c6 = _mm_set1_ps(INV_6), c20 = _mm_set1_ps(INV_20), c42 = _mm_set1_ps(INV_42);
+    const __m128 c2 = _mm_set1_ps(INV_2), c12 = _mm_set1_ps(INV_12), c30 = _mm_set1_ps(INV_30);
+    const __m128 c56 = _mm_set1_ps(INV_56);
+    const bool hasInflow = p.inflow > 0.0f;
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 px = _mm_loadu_ps(x + i), pz = _mm_loadu_ps(z + i);
+        const __m128 pvx = _mm_loadu_ps(vx + i), pvz = _mm_loadu_ps(vz + i);
+
+        const __m128 r = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(pz, pz)));
+        const __m128 omega = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(r, mass), minRadius)));
+        const __m128 theta = _mm_mul_ps(omega, dt);
+
+        const __m128 a = _mm_mul_ps(theta, quarter);
+        const __m128 a2 = _mm_mul_ps(a, a);
+        __m128 s = _mm_sub_ps(one, _mm_mul_ps(a2, c42));
+        s = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(a2, c20), s));
+        s = _mm_mul_ps(a, _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(a2, c6), s)));
+        __m128 c = _mm_sub_ps(one, _mm_mul_ps(a2, c56));
+        c = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(a2, c30), c));
+        c = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(a2, c12), c));
+        c = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(a2, c2), c));
+        for (int k = 0; k < 2; ++k) {
+            const __m128 s2 = _mm_mul_ps(_mm_mul_ps(two, s), c);
+            c = _mm_sub_ps(_mm_mul_ps(c, c), _mm_mul_ps(s, s));
+            s = s2;
+        }
+
+        __m128 shrink = _mm_sub_ps(one, _mm_mul_ps(inflow, theta));
+        if (hasInflow) {
+            const __m128 inside = _mm_cmplt_ps(_mm_mul_ps(r, shrink), inner);
+            shrink = _mm_or_ps(_mm_and_ps(inside, _mm_mul_ps(shrink, respawn)), _mm_andnot_ps(inside, shrink));
+        }
+
+        _mm_storeu_ps(x + i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(c, px), _mm_mul_ps(s, pz)), shrink));
+        _mm_storeu_ps(z + i, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(s, px), _mm_mul_ps(c, pz)), shrink));
+        _mm_storeu_ps(vx + i, _mm_sub_ps(_mm_mul_ps(c, pvx), _mm_mul_ps(s, pvz)));
+        _mm_storeu_ps(vz + i, _mm_add_ps(_mm_mul_ps(s, pvx), _mm_mul_ps(c, pvz)));
+    }
+    return i;
+}
+
+TARGET_AVX2
+static size_t advectAVX2(const AdvectParams& p, float* x, float* z, float* vx, float* vz,
+                         size_t begin, size_t end) {
+    const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), quarter = _mm256_set1_ps(0.25f);
+    const __m256 mass = _mm256_set1_ps(p.blackHoleMass), minRadius = _mm256_set1_ps(MIN_RADIUS);
+    const __m256 dt = _mm256_set1_ps(p.dt), inflow = _mm256_set1_ps(p.inflow);
+    const __m256 inner = _mm256_set1_ps(p.innerRadius), respawn = _mm256_set1_ps(p.outerRadius / p.innerRadius);
+    const __m256 c6 = _mm256_set1_ps(INV_6), c20 = _mm256_set1_ps(INV_20), c42 = _mm256_set1_ps(INV_42);
+    const __m256 c2 = _mm256_set1_ps(INV_2), c12 = _mm256_set1_ps(INV_12), c30 = _mm256_set1_ps(INV_30);
+    const __m256 c56 = _mm256_set1_ps(INV_56);
+    const bool hasInflow = p.inflow > 0.0f;
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 px = _mm256_loadu_ps(x + i), pz = _mm256_loadu_ps(z + i);
+        const __m256 pvx = _mm256_loadu_ps(vx + i), pvz = _mm256_loadu_ps(vz + i);
+
+        const __m256 r = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(pz, pz)));
+        const __m256 omega = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_max_ps(_mm256_mul_ps(r, mass), minRadius)));
+        const __m256 theta = _mm256_mul_ps(omega, dt);
+
+        const __m256 a = _mm256_mul_ps(theta, quarter);
+        const __m256 a2 = _mm256_mul_ps(a, a);
+        __m256 s = _mm256_sub_ps(one, _mm256_mul_ps(a2, c42));
+        s = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_mul_ps(a2, c20), s));
+        s = _mm256_mul_ps(a, _mm256_sub_ps(one, _mm256_mul_ps(_mm256_mul_ps(a2, c6), s)));
+        __m256 c = _mm256_sub_ps(one, _mm256_mul_ps(a2, c56));
+        c = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_mul_ps(a2, c30), c));
+        c = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_mul_ps(a2, c12), c));
+        c = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_mul_ps(a2, c2), c));
+        for (int k = 0; k < 2; ++k) {
+            const __m256 s2 = _mm256_mul_ps(_mm256_mul_ps(two, s), c);
+            c = _mm256_sub_ps(_mm256_mul_ps(c, c), _mm256_mul_ps(s, s));
+            s = s2;
+        }
+
+        __m256 shrink = _mm256_sub_ps(one, _mm256_mul_ps(inflow, theta));
+        if (hasInflow) {
+            const __m256 inside = _mm256_cmp_ps(_mm256_mul_ps(r, shrink), inner, _CMP_LT_OQ);
+            shrink = _mm256_blendv_ps(shrink, _mm256_mul_ps(shrink, respawn), inside);
+        }
+
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(c, px), _mm256_mul_ps(s, pz)), shrink));
+        _mm256_storeu_ps(z + i, _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(s, px), _mm256_mul_ps(c, pz)), shrink));
+        _mm256_storeu_ps(vx + i, _mm256_sub_ps(_mm256_mul_ps(c, pvx), _mm256_mul_ps(s, pvz)));
+        _mm256_storeu_ps(vz + i, _mm256_add_ps(_mm256_mul_ps(s, pvx), _mm256_mul_ps(c, pvz)));
+    }
+    return i;
+}
+
+//Half floats that saturate like PackedParticle::toHalf instead of overflowing to infinity
+TARGET_AVX2
+static inline __m128i toHalf8(__m256 v) {
+    const __m256 halfMax = _mm256_set1_ps(65504.0f);
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_sub_ps(_mm256_setzero_ps(), halfMax)), halfMax);
+    return _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+}
+
+//Round half away from zero, as toSnorm16 in PackedParticle.cpp does
+TARGET_AVX2
+static inline __m256i roundAway8(__m256 v) {
+    const __m256 nonNegative = _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GE_OQ);
+    return _mm256_cvttps_epi32(_mm256_add_ps(v, _mm256_blendv_ps(_mm256_set1_ps(-0.5f), _mm256_set1_ps(0.5f), nonNegative)));
+}
+
+//PackedParticle::encode for 8 particles at a time: F16C for the half floats, and the same
+//float operations as the scalar encoder for everything else, so the bytes are identical.
+//out points at particle begin.
+TARGET_AVX2
+static size_t packAVX2(const ParticleStore& store, float velocityScale, PackedParticle* out,
+                       size_t begin, size_t end) {
+    const __m256 one = _mm256_set1_ps(1.0f), minusOne = _mm256_set1_ps(-1.0f), zero = _mm256_setzero_ps();
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 scale = _mm256_set1_ps(velocityScale), snormScale = _mm256_set1_ps(32767.0f);
+    const __m256 unormScale = _mm256_set1_ps(255.0f);
+    const __m256 inverseTemperature = _mm256_set1_ps(1.0f / PackedParticle::TEMPERATURE_RANGE);
+    const __m256 inverseDensity = _mm256_set1_ps(1.0f / PackedParticle::DENSITY_RANGE);
+
+    alignas(32) uint16_t hx[8], hy[8], hz[8], hs[8];
+    alignas(32) int32_t du[8], dv[8], qt[8], qd[8];
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 vx = _mm256_mul_ps(_mm256_loadu_ps(&store.vx[i]), scale);
+        const __m256 vy = _mm256_mul_ps(_mm256_loadu_ps(&store.vy[i]), scale);
+        const __m256 vz = _mm256_mul_ps(_mm256_loadu_ps(&store.vz[i]), scale);
+
+        const __m256 speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)),
+                                                          _mm256_mul_ps(vz, vz)));
+        const __m256 l1 = _mm256_add_ps(_mm256_add_ps(_mm256_and_ps(vx, absMask), _mm256_and_ps(vy, absMask)),
+                                        _mm256_and_ps(vz, absMask));
+        const __m256 inverseL1 = _mm256_and_ps(_mm256_div_ps(one, l1), _mm256_cmp_ps(l1, zero, _CMP_GT_OQ));
+        __m256 u = _mm256_mul_ps(vx, inverseL1);
+        __m256 v = _mm256_mul_ps(vy, inverseL1);
+        const __m256 signU = _mm256_blendv_ps(minusOne, one, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+        const __m256 signV = _mm256_blendv_ps(minusOne, one, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+        const __m256 foldedU = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_and_ps(v, absMask)), signU);
+        const __m256 foldedV = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_and_ps(u, absMask)), signV);
+        const __m256 lower = _mm256_cmp_ps(vz, zero, _CMP_LT_OQ);
+        u = _mm256_blendv_ps(u, foldedU, lower);
+        v = _mm256_blendv_ps(v, foldedV, lower);
+
+        _mm_store_si128((__m128i*)hx, toHalf8(_mm256_loadu_ps(&store.x[i])));
+        _mm_store_si128((__m128i*)hy, toHalf8(_mm256_loadu_ps(&store.y[i])));
+        _mm_store_si128((__m128i*)hz, toHalf8(_mm256_loadu_ps(&store.z[i])));
+        _mm_store_si128((__m128i*)hs, toHalf8(speed));
+        _mm256_store_si256((__m256i*)du, roundAway8(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(u, minusOne), one), snormScale)));
+        _mm256_store_si256((__m256i*)dv, roundAway8(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(v, minusOne), one), snormScale)));
+        const __m256 t = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&store.temperature[i]), inverseTemperature), zero), one);
+        const __m256 d = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&store.density[i]), inverseDensity), zero), one);
+        _mm256_store_si256((__m256i*)qt, _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(t, unormScale), half)));
+        _mm256_store_si256((__m256i*)qd, _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(d, unormScale), half)));
+
+        //Two 8-byte stores per vertex, in order, which suits write-combined mapped memory
+        for (int k = 0; k < 8; ++k) {
+            const uint64_t low = (uint64_t)hx[k] | (uint64_t)hy[k] << 16 | (uint64_t)hz[k] << 32 | (uint64_t)hs[k] << 48;
+            const uint64_t high = (uint64_t)(uint16_t)du[k] | (uint64_t)(uint16_t)dv[k] << 16 |
+                                  (uint64_t)qt[k] << 32 | (uint64_t)qd[k] << 40 |
+                                  (uint64_t)store.importance[i + k] << 48;
+            unsigned char* vertex = reinterpret_cast<unsigned char*>(out + (i - begin) + k);
+            std::memcpy(vertex, &low, sizeof(low));
+            std::memcpy(vertex + 8, &high, sizeof(high));
+        }
+    }
+    return i;
+}
+#endif
+
+ParticleStore::ParticleStore() : count(0) {
+}
+
+void ParticleStore::resize(size_t newCount) {
+    count = newCount;
+    const size_t padded = (newCount + LANES - 1) / LANES * LANES;
+    for (AlignedFloats* array : {&x, &y, &z, &vx, &vy, &vz, &temperature, &density}) {
+        array->assign(padded, 0.0f);
+    }
+    importance.assign(padded, 0);
+}
+
+void ParticleStore::loadInterleaved(const std::vector<float>& vertices) {
+    const int stride = DiskGenerator::FLOATS_PER_PARTICLE;
+    resize(vertices.size() / stride);
+    for (size_t i = 0; i < count; ++i) {
+        const float* in = &vertices[i * stride];
+        x[i] = in[0];
+        y[i] = in[1];
+        z[i] = in[2];
+        vx[i] = in[3];
+        vy[i] = in[4];
+        vz[i] = in[5];
+        temperature[i] = in[6];
+        density[i] = in[7];
+    }
+}
+
+void ParticleStore::interleave(float* out, size_t begin, size_t end, float velocityScale) const {
+    for (size_t i = begin; i < end; ++i, out += DiskGenerator::FLOATS_PER_PARTICLE) {
+        out[0] = x[i];
+        out[1] = y[i];
+        out[2] = z[i];
+        out[3] = vx[i] * velocityScale;
+        out[4] = vy[i] * velocityScale;
+        out[5] = vz[i] * velocityScale;
+        out[6] = temperature[i];
+        out[7] = density[i];
+    }
+}
+
+void ParticleStore::pack(PackedParticle* out, size_t begin, size_t end, float velocityScale,
+                         TaskScheduler* scheduler, SimdLevel level) const {
+    end = std::min(end, count);
+    if (begin >= end) {
+        return;
+    }
+    if (!isSupported(level)) {
+        level = SimdLevel::Scalar;
+    }
+
+    forEachChunk(begin, end, scheduler, [&](size_t first, size_t last) {
+        size_t done = first;
+#ifdef PARTICLES_X86
+        //SSE2 has no half-float conversion, that level packs with the scalar encoder
+        if (level == SimdLevel::AVX2) {
+            done = packAVX2(*this, velocityScale, out + (first - begin), first, last);
+        }
+#endif
+        for (size_t i = done; i < last; ++i) {
+            out[i - begin] = PackedParticle::encode(x[i], y[i], z[i], vx[i] * velocityScale, vy[i] * velocityScale,
+                                                    vz[i] * velocityScale, temperature[i], density[i], importance[i]);
+        }
+    });
+}
+
+void ParticleStore::reorder(const uint32_t* source, size_t begin, size_t end) {
+    end = std::min(end, count);
+    if (begin >= end) {
+        return;
+    }
+    AlignedFloats floats(end - begin);
+    for (AlignedFloats* array : {&x, &y, &z, &vx, &vy, &vz, &temperature, &density}) {
+        for (size_t i = begin; i < end; ++i) {
+            floats[i - begin] = (*array)[source[i - begin]];
+        }
+        std::copy(floats.begin(), floats.end(), array->begin() + begin);
+    }
+    AlignedBytes bytes(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+        bytes[i - begin] = importance[source[i - begin]];
+    }
+    std::copy(bytes.begin(), bytes.end(), importance.begin() + begin);
+}
+
+void ParticleStore::advect(const AdvectParams& params, size_t begin, size_t end,
+                           TaskScheduler* scheduler, SimdLevel level) {
+    end = std::min(end, count);
+    if (begin >= end) {
+        return;
+    }
+    if (!isSupported(level)) {
+        level = SimdLevel::Scalar;
+    }
+
+    forEachChunk(begin, end, scheduler, [&](size_t first, size_t last) {
+        size_t done = first;
+#ifdef PARTICLES_X86
+        if (level == SimdLevel::AVX2) {
+            done = advectAVX2(params, x.data(), z.data(), vx.data(), vz.data(), first, last);
+        } else if (level == SimdLevel::SSE) {
+            done = advectSSE(params, x.data(), z.data(), vx.data(), vz.data(), first, last);
+        }
+#endif
+        advectScalar(params, x.data(), z.data(), vx.data(), vz.data(), done, last);
+    });
+}
+
+bool ParticleStore::isSupported(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar:
+        return true;
+#ifdef PARTICLES_X86
+    case SimdLevel::SSE:
+        //SSE2 is part of every x86-64 target
+        return true;
+    case SimdLevel::AVX2: {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        const bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+        const bool hasF16C = (info[2] & (1 << 29)) != 0;
+        __cpuidex(info, 7, 0);
+        return osSavesAvx && hasF16C && (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+#endif
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+SimdLevel ParticleStore::bestSimdLevel() {
+    static const SimdLevel best = isSupported(SimdLevel::AVX2) ? SimdLevel::AVX2
+                                : isSupported(SimdLevel::SSE) ? SimdLevel::SSE
+                                : SimdLevel::Scalar;
+    return best;
+}
+
+const char* ParticleStore::simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::SSE: return "sse";
+    case SimdLevel::AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
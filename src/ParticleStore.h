@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+class TaskScheduler;
+struct PackedParticle;
+
+//Minimal allocator handing out 64-byte aligned storage, so every array starts on a
+//cache line and full-width SIMD loads never straddle one
+template <typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+    static constexpr size_t ALIGNMENT = 64;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(ALIGNMENT));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+typedef std::vector<float, AlignedAllocator<float>> AlignedFloats;
+typedef std::vector<uint8_t, AlignedAllocator<uint8_t>> AlignedBytes;
+
+enum class SimdLevel {
+    Scalar,
+    SSE,    //4 lanes, SSE2
+    AVX2    //8 lanes, with F16C
+};
+
+//Particles [first, first + count) of a store
+struct ParticleRange {
+    uint32_t first = 0;
+    uint32_t count = 0;
+
+    bool operator==(const ParticleRange& other) const { return first == other.first && count == other.count; }
+    bool operator!=(const ParticleRange& other) const { return !(*this == other); }
+};
+
+//Orbital motion applied by ParticleStore::advect
+struct AdvectParams {
+    float dt = 0.0f;            //Seconds
+    float blackHoleMass = 1.0f; //Particles are stored for unit mass, angular speed uses the scaled radius
+    float inflow = 0.0f;        //Fractional radius lost per radian of orbit, 0 = closed orbits
+    float innerRadius = 0.6f;   //With inflow, particles inside this (unit-mass) radius...
+    float outerRadius = 12.0f;  //...are moved back out by outerRadius / innerRadius
+};
+
+//Structure-of-arrays particle state: position, velocity, temperature, density and level-of-detail
+//importance each in their own aligned array, padded to a multiple of 8 so SIMD kernels need no
+//scalar tail.
+class ParticleStore {
+public:
+    static constexpr size_t LANES = 8;
+
+    ParticleStore();
+
+    void resize(size_t count);
+    size_t size() const { return count; }
+
+    //Copy from / to the interleaved 8-float layout of DiskGenerator and the vertex buffer.
+    //interleave writes particles [begin, end) and multiplies their velocities by velocityScale.
+    void loadInterleaved(const std::vector<float>& vertices);
+    void interleave(float* out, size_t begin, size_t end, float velocityScale = 1.0f) const;
+    //Same particles in the 16-byte vertex format the disk is drawn from, out[0] being particle
+    //begin. Every level writes the same bytes.
+    void pack(PackedParticle* out, size_t begin, size_t end, float velocityScale = 1.0f,
+              TaskScheduler* scheduler = nullptr, SimdLevel level = bestSimdLevel()) const;
+
+    //Replace particles [begin, end) by source[0], source[1], ... in that order; source must be a
+    //permutation of [begin, end)
+    void reorder(const uint32_t* source, size_t begin, size_t end);
+
+    //Rotate particles [begin, end) about the y axis by their Keplerian angle for one timestep,
+    //along with their velocities, and apply radial inflow. Runs in chunks on the scheduler if
+    //one is given; every level gives the same result up to float rounding.
+    void advect(const AdvectParams& params, size_t begin, size_t end,
+                TaskScheduler* scheduler = nullptr, SimdLevel level = bestSimdLevel());
+
+    //Widest kernel the compiler and CPU support
+    static SimdLevel bestSimdLevel();
+    static bool isSupported(SimdLevel level);
+    static const char* simdLevelName(SimdLevel level);
+
+    AlignedFloats x, y, z;
+    AlignedFloats vx, vy, vz;
+    AlignedFloats temperature, density;
+    AlignedBytes importance;    //Rank set by ParticleChunks, 0 (always drawn) until then
+
+private:
+    size_t count;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+//Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel Random
+//Numbers: As Easy as 1, 2, 3"). Output is a pure function of (counter, key), so any value
+//can be computed independently of every other: no shared state and no ordering between
+//threads.
+class Philox {
+public:
+    struct Block {
+        uint32_t v[4];
+    };
+
+    static Block generate(Block counter, uint32_t key0, uint32_t key1) {
+        for (int round = 0; round < 10; ++round) {
+            const uint64_t p0 = (uint64_t)M0 * counter.v[0];
+            const uint64_t p1 = (uint64_t)M1 * counter.v[2];
+            counter = Block{{(uint32_t)(p1 >> 32) ^ counter.v[1] ^ key0, (uint32_t)p1,
+                             (uint32_t)(p0 >> 32) ^ counter.v[3] ^ key1, (uint32_t)p0}};
+            key0 += W0;
+            key1 += W1;
+        }
+        return counter;
+    }
+
+    //Top 24 bits as a float in [0, 1)
+    static float toUniform(uint32_t bits) {
+        return (float)(bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    static constexpr uint32_t M0 = 0xD2511F53u;
+    static constexpr uint32_t M1 = 0xCD9E8D57u;
+    static constexpr uint32_t W0 = 0x9E3779B9u;
+    static constexpr uint32_t W1 = 0xBB67AE85u;
+};
+
+//Random attributes of one particle, keyed by (seed, component, particle id, attribute).
+//Attributes come four per Philox block; the last block is cached.
+class ParticleRandom {
+public:
+    ParticleRandom(uint32_t seed, uint32_t component, uint32_t particle)
+        : seed(seed), component(component), particle(particle), cachedBlock(UINT32_MAX) {}
+
+    //Uniform float in [0, 1) for the given attribute index
+    float uniform(uint32_t attribute) {
+        const uint32_t block = attribute / 4;
+        if (block != cachedBlock) {
+            cached = Philox::generate(Philox::Block{{particle, block, 0u, 0u}}, seed, component);
+            cachedBlock = block;
+        }
+        return Philox::toUniform(cached.v[attribute % 4]);
+    }
+
+private:
+    uint32_t seed;
+    uint32_t component;
+    uint32_t particle;
+    uint32_t cachedBlock;
+    Philox::Block cached;
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "Float8.h"
+#include "GeodesicTracer.h"
+
+//The planar kernel, templated on the scalar type its state is integrated in. Everything is in
+//geometric units with rs = 1: u = rs / r runs from 0 at infinity to 1 at the horizon and
+//du/dpsi stays of order 1/b, so no product of radii or angles comes near the range or
+//precision limits of a float. Real is double (the reference), float, or Float8 to trace eight
+//rays at once; Lanes describes each.
+template <typename Real>
+struct Lanes;
+
+template <>
+struct Lanes<double> {
+    typedef double Scalar;
+    typedef bool Mask;
+    static constexpr int WIDTH = 1;
+    static constexpr double MIN_TOLERANCE = 0.0;
+
+    static double load(const double* values) { return values[0]; }
+    static double lane(double x, int) { return x; }
+    static int bits(bool m) { return m ? 1 : 0; }
+    static double select(bool m, double a, double b) { return m ? a : b; }
+    static double pow(double x, double y) { return std::pow(x, y); }
+};
+
+template <>
+struct Lanes<float> {
+    typedef float Scalar;
+    typedef bool Mask;
+    static constexpr int WIDTH = 1;
+    //Tighter relative tolerances only chase rounding noise in single precision
+    static constexpr double MIN_TOLERANCE = 1e-6;
+
+    static float load(const float* values) { return values[0]; }
+    static float lane(float x, int) { return x; }
+    static int bits(bool m) { return m ? 1 : 0; }
+    static float select(bool m, float a, float b) { return m ? a : b; }
+    static float pow(float x, float y) { return std::pow(x, y); }
+};
+
+template <>
+struct Lanes<Float8> {
+    typedef float Scalar;
+    typedef Mask8 Mask;
+    static constexpr int WIDTH = 8;
+    static constexpr double MIN_TOLERANCE = 1e-6;
+
+    static Float8 load(const float* values) { return Float8::load(values); }
+    static float lane(Float8 x, int i) {
+        float values[8];
+        x.store(values);
+        return values[i];
+    }
+    static int bits(Mask8 m) { return laneBits(m); }
+    static Float8 select(Mask8 m, Float8 a, Float8 b) { return ::select(m, a, b); }
+    static Float8 pow(Float8 x, float y) { return fastPow(x, y); }
+};
+
+//One Dormand-Prince 5(4) step of u'' + u = 3/2 u^2 in every lane, the tableau and controller of
+//dormandPrinceStep. Lanes whose error is within tolerance advance; every lane's h becomes its
+//suggested next step. Returns the lanes that advanced.
+template <typename Real>
+typename Lanes<Real>::Mask binetStepLanes(Real& u, Real& du, Real& h, Real relTol, Real absTol) {
+    typedef Lanes<Real> L;
+    typedef typename L::Scalar S;
+    auto rhs = [](Real x) { return S(1.5) * x * x - x; };
+
+    const Real k1u = du, k1d = rhs(u);
+    const Real k2u = du + h * (S(1.0 / 5.0) * k1d);
+    const Real k2d = rhs(u + h * (S(1.0 / 5.0) * k1u));
+    const Real k3u = du + h * (S(3.0 / 40.0) * k1d + S(9.0 / 40.0) * k2d);
+    const Real k3d = rhs(u + h * (S(3.0 / 40.0) * k1u + S(9.0 / 40.0) * k2u));
+    const Real k4u = du + h * (S(44.0 / 45.0) * k1d - S(56.0 / 15.0) * k2d + S(32.0 / 9.0) * k3d);
+    const Real k4d = rhs(u + h * (S(44.0 / 45.0) * k1u - S(56.0 / 15.0) * k2u + S(32.0 / 9.0) * k3u));
+    const Real k5u = du + h * (S(19372.0 / 6561.0) * k1d - S(25360.0 / 2187.0) * k2d
+                             + S(64448.0 / 6561.0) * k3d - S(212.0 / 729.0) * k4d);
+    const Real k5d = rhs(u + h * (S(19372.0 / 6561.0) * k1u - S(25360.0 / 2187.0) * k2u
+                                + S(64448.0 / 6561.0) * k3u - S(212.0 / 729.0) * k4u));
+    const Real k6u = du + h * (S(9017.0 / 3168.0) * k1d - S(355.0 / 33.0) * k2d + S(46732.0 / 5247.0) * k3d
+                             + S(49.0 / 176.0) * k4d - S(5103.0 / 18656.0) * k5d);
+    const Real k6d = rhs(u + h * (S(9017.0 / 3168.0) * k1u - S(355.0 / 33.0) * k2u + S(46732.0 / 5247.0) * k3u
+                                + S(49.0 / 176.0) * k4u - S(5103.0 / 18656.0) * k5u));
+    const Real nextU = u + h * (S(35.0 / 384.0) * k1u + S(500.0 / 1113.0) * k3u + S(125.0 / 192.0) * k4u
+                              - S(2187.0 / 6784.0) * k5u + S(11.0 / 84.0) * k6u);
+    const Real nextD = du + h * (S(35.0 / 384.0) * k1d + S(500.0 / 1113.0) * k3d + S(125.0 / 192.0) * k4d
+                               - S(2187.0 / 6784.0) * k5d + S(11.0 / 84.0) * k6d);
+    const Real k7u = nextD, k7d = rhs(nextU);
+    const Real errU = h * (S(71.0 / 57600.0) * k1u - S(71.0 / 16695.0) * k3u + S(71.0 / 1920.0) * k4u
+                         - S(17253.0 / 339200.0) * k5u + S(22.0 / 525.0) * k6u - S(1.0 / 40.0) * k7u);
+    const Real errD = h * (S(71.0 / 57600.0) * k1d - S(71.0 / 16695.0) * k3d + S(71.0 / 1920.0) * k4d
+                         - S(17253.0 / 339200.0) * k5d + S(22.0 / 525.0) * k6d - S(1.0 / 40.0) * k7d);
+
+    using std::abs;
+    using std::max;
+    using std::min;
+    const Real ratioU = abs(errU) / (absTol + relTol * max(abs(u), abs(nextU)));
+    const Real ratioD = abs(errD) / (absTol + relTol * max(abs(du), abs(nextD)));
+    const Real err = max(ratioU, ratioD);
+
+    //NaN fails every comparison, so it rejects with the smallest factor
+    const typename L::Mask accepted = err <= Real(S(1.0));
+    const typename L::Mask finite = err < Real(S(HUGE_VALF));
+    const Real safeErr = L::select(finite & (err > Real(S(0.0))), err, Real(S(1.0)));
+    const Real shrink = L::select(finite, max(Real(S(0.2)), S(0.9) * L::pow(safeErr, S(-0.25))), Real(S(0.2)));
+    const Real grow = L::select(err > Real(S(0.0)),
+                                min(max(S(0.9) * L::pow(safeErr, S(-0.2)), Real(S(0.2))), Real(S(5.0))),
+                                Real(S(5.0)));
+    u = L::select(accepted, nextU, u);
+    du = L::select(accepted, nextD, du);
+    h = h * L::select(accepted, grow, shrink);
+    return accepted;
+}
+
+//Start of one ray, in rs = 1 units
+struct PlanarStart {
+    bool active;            //False for padding lanes and rays settled before integrating
+    double u, du;           //u = rs / r and du/dpsi at the camera
+    double firstNode;       //psi where the orbit first meets the disk plane, infinity if never
+    double inverseImpact2;  //1/b^2 = u'^2 + u^2 - u^3
+};
+
+//Where and why a ray's integration stopped
+struct PlanarEnd {
+    HitType hit;
+    CullType cull;
+    int steps;              //Attempted steps, including rejected ones
+    double psi, u, du;      //State at the end; for a disk hit, the crossing angle and u there
+};
+
+//Tolerances, limits and scene geometry, all in rs = 1 units
+struct PlanarLimits {
+    int maxSteps;
+    double relTolerance;
+    double absTolerance;
+    double maxStepFraction;
+    double escapeU;                 //Integration stops once u falls to this
+    double diskInnerU, diskOuterU;  //u at the disk's inner and outer edge
+    bool cull;
+    double cullInnerU;      //No disk or object at larger u; infinity when something surrounds the hole
+    double cullOuterU;      //Nor at smaller u
+    double cullOuterBarrier;
+    bool objects;           //Call the object test after every accepted step
+    double volumeOuterU;    //u at the volume's outer radius
+    double volumeSegment;   //Longest chord inside it, zero without a volume
+};
+
+//Integrates Lanes<Real>::WIDTH rays at once, the same way GeodesicTracer's planar kernel does
+//one. Disk crossings come from cubic Hermite interpolation of u at each node angle, culling
+//uses the analytic tests of CullType. With limits.objects set, objectHit(lane, psi, u) is called
+//for every accepted step of every live lane and returns true when that step entered an object
+//(or, for the tracer's volume, made the ray opaque).
+template <typename Real, typename ObjectTest>
+void integratePlanar(const PlanarStart* starts, PlanarEnd* ends, const PlanarLimits& limits, ObjectTest& objectHit) {
+    typedef Lanes<Real> L;
+    typedef typename L::Scalar S;
+    typedef typename L::Mask Mask;
+    const int W = L::WIDTH;
+    const S pi = S(3.14159265358979323846);
+
+    S values[4][W];
+    for (int i = 0; i < W; ++i) {
+        values[0][i] = S(starts[i].u);
+        values[1][i] = S(starts[i].du);
+        values[2][i] = S(starts[i].firstNode);
+        values[3][i] = starts[i].active ? S(0.0) : S(1.0);
+    }
+    Real u = L::load(values[0]);
+    Real du = L::load(values[1]);
+    Real nextNode = L::load(values[2]);
+    Mask done = L::load(values[3]) > Real(S(0.5));
+    for (int i = 0; i < W; ++i) {
+        values[0][i] = S(starts[i].inverseImpact2);
+    }
+    const Real inverseImpact2 = L::load(values[0]);
+
+    Real psi = Real(S(0.0));
+    Real steps = Real(S(0.0));
+    Real h = Real(S(std::min(limits.maxStepFraction, 0.01)));
+    const Real maxStep = Real(S(limits.maxStepFraction));
+    const Real relTol = Real(S(std::max(limits.relTolerance, L::MIN_TOLERANCE)));
+    const Real absTol = Real(S(limits.absTolerance));
+    const Real zero = Real(S(0.0));
+
+    auto retire = [&](Mask lanes, HitType hit, CullType cull, CullType cullAtStart, const Real& endPsi,
+                      const Real& endU) {
+        const int bits = L::bits(lanes) & ~L::bits(done);
+        for (int i = 0; i < W; ++i) {
+            if (!(bits & (1 << i))) continue;
+            PlanarEnd& end = ends[i];
+            end.hit = hit;
+            end.steps = (int)L::lane(steps, i);
+            end.cull = end.steps == 0 ? cullAtStart : cull;
+            end.psi = L::lane(endPsi, i);
+            end.u = L::lane(endU, i);
+            end.du = L::lane(du, i);
+        }
+        done = done | lanes;
+    };
+
+    while (L::bits(done) != (1 << W) - 1) {
+        retire(steps >= Real(S(limits.maxSteps)), HitType::None, CullType::None, CullType::None, psi, u);
+        retire(u >= Real(S(1.0)), HitType::BlackHole, CullType::None, CullType::None, psi, u);
+        //u' < 0 is outbound
+        if (limits.cull) {
+            const Mask inbound = du > zero;
+            const Mask outbound = du <= zero;
+            const Mask outside = (u > zero) & (u < Real(S(limits.cullOuterU)));
+            retire(outside & (outbound | (inverseImpact2 < Real(S(limits.cullOuterBarrier)))),
+                   HitType::None, CullType::Escaped, CullType::EscapedAtStart, psi, u);
+            const Mask inside = inbound & (u > Real(S(limits.cullInnerU)));
+            retire(inside & ((inverseImpact2 > Real(S(4.0 / 27.0))) | (u > Real(S(2.0 / 3.0)))),
+                   HitType::BlackHole, CullType::Captured, CullType::CapturedAtStart, psi, u);
+        }
+        const Mask live = !done;
+        if (L::bits(live) == 0) break;
+
+        using std::min;
+        h = min(h, maxStep);
+        if (limits.volumeSegment > 0.0) {
+            //A step of h is a chord about h / u long
+            h = L::select(u > Real(S(limits.volumeOuterU)), min(h, Real(S(limits.volumeSegment)) * u), h);
+        }
+        steps = L::select(live, steps + S(1.0), steps);
+        const Real prevU = u, prevD = du, hTried = h;
+        const Mask accepted = binetStepLanes(u, du, h, relTol, absTol) & live;
+        if (L::bits(accepted) == 0) continue;
+        const Real psiPrev = psi;
+        psi = L::select(accepted, psi + hTried, psi);
+
+        const Mask crossing = accepted & (nextNode <= psi);
+        if (L::bits(crossing) != 0) {
+            const Real t = (nextNode - psiPrev) / hTried;
+            const Real t2 = t * t, t3 = t2 * t;
+            const Real uNode = (S(2.0) * t3 - S(3.0) * t2 + S(1.0)) * prevU + (t3 - S(2.0) * t2 + t) * hTried * prevD
+                             + (S(-2.0) * t3 + S(3.0) * t2) * u + (t3 - t2) * hTried * du;
+            const Mask onDisk = crossing & (uNode > zero) & (uNode >= Real(S(limits.diskOuterU)))
+                              & (uNode <= Real(S(limits.diskInnerU)));
+            retire(onDisk, HitType::Disk, CullType::None, CullType::None, nextNode, uNode);
+            nextNode = L::select(crossing & !onDisk, nextNode + pi, nextNode);
+        }
+
+        retire(accepted & (u <= Real(S(limits.escapeU))), HitType::None, CullType::None, CullType::None, psi, u);
+
+        if (limits.objects) {
+            const int bits = L::bits(accepted) & ~L::bits(done);
+            int entered = 0;
+            for (int i = 0; i < W; ++i) {
+                if ((bits & (1 << i)) && objectHit(i, (double)L::lane(psi, i), (double)L::lane(u, i))) {
+                    entered |= 1 << i;
+                }
+            }
+            for (int i = 0; i < W; ++i) {
+                values[0][i] = (entered & (1 << i)) ? S(1.0) : S(0.0);
+            }
+            retire(L::load(values[0]) > Real(S(0.5)), HitType::Object, CullType::None, CullType::None, psi, u);
+        }
+    }
+}
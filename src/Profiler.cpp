@@ -0,0 +1,199 @@
+#include "Profiler.h"
+
+#ifdef BLACKHOLE_PROFILE
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+static uint64_t steadyNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Names are written as given; they are literals from our own code, so only quotes need escaping
+static void writeName(std::ostream& out, const char* name) {
+    out << '"';
+    for (const char* c = name; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') out << '\\';
+        out << *c;
+    }
+    out << '"';
+}
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() : slots(new Slot[CAPACITY]), head(0), origin(steadyNs()), summaryCursor(0), summaryTime(0) {
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        slots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t Profiler::now() const {
+    return steadyNs() - origin;
+}
+
+uint32_t Profiler::currentThread() {
+    static std::atomic<uint32_t> nextThread(0);
+    thread_local uint32_t thread = nextThread.fetch_add(1, std::memory_order_relaxed);
+    return thread;
+}
+
+void Profiler::record(const ProfileEvent& event) {
+    const uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots[index & (CAPACITY - 1)];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = event;
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::complete(const char* name, uint64_t startNs, uint64_t durationNs, uint32_t thread) {
+    ProfileEvent event;
+    event.name = name;
+    event.startNs = startNs;
+    event.durationNs = durationNs;
+    event.value = 0.0;
+    event.thread = thread;
+    event.type = ProfileEvent::Complete;
+    record(event);
+}
+
+void Profiler::counter(const char* name, double value) {
+    ProfileEvent event;
+    event.name = name;
+    event.startNs = now();
+    event.durationNs = 0;
+    event.value = value;
+    event.thread = currentThread();
+    event.type = ProfileEvent::Counter;
+    record(event);
+}
+
+Histogram& Profiler::histogram(const char* name) {
+    std::lock_guard<std::mutex> lock(histogramMutex);
+    for (std::unique_ptr<Histogram>& histogram : histograms) {
+        if (std::string(histogram->getName()) == name) {
+            return *histogram;
+        }
+    }
+    histograms.emplace_back(new Histogram(name));
+    return *histograms.back();
+}
+
+uint64_t Profiler::snapshot(std::vector<ProfileEvent>& out, uint64_t cursor) const {
+    const uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+    if (cursor > begin) {
+        begin = cursor;
+    }
+
+    for (uint64_t index = begin; index < end; ++index) {
+        const Slot& slot = slots[index & (CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+            continue;   //Still being written, or already overwritten by a newer event
+        }
+        ProfileEvent event = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == index + 1) {
+            out.push_back(event);
+        }
+    }
+    return end;
+}
+
+std::string Profiler::summary(double intervalSeconds) {
+    const uint64_t time = now();
+    if (time - summaryTime < (uint64_t)(intervalSeconds * 1e9)) {
+        return std::string();
+    }
+    summaryTime = time;
+
+    std::vector<ProfileEvent> events;
+    summaryCursor = snapshot(events, summaryCursor);
+
+    //Keep names in order of first appearance, which follows the frame
+    struct Entry { const char* name; bool gpu; bool counter; uint64_t count; double total; };
+    std::vector<Entry> entries;
+    for (const ProfileEvent& event : events) {
+        const bool gpu = event.thread == GPU_THREAD;
+        const bool counter = event.type == ProfileEvent::Counter;
+        Entry* entry = nullptr;
+        for (Entry& existing : entries) {
+            if (existing.name == event.name && existing.gpu == gpu) {
+                entry = &existing;
+                break;
+            }
+        }
+        if (entry == nullptr) {
+            entries.push_back({event.name, gpu, counter, 0, 0.0});
+            entry = &entries.back();
+        }
+        entry->count++;
+        entry->total = counter ? event.value : entry->total + event.durationNs * 1e-6;
+    }
+
+    std::stringstream out;
+    out << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry& entry = entries[i];
+        out << (i > 0 ? " | " : "") << entry.name << (entry.gpu ? " (GPU) " : " ");
+        if (entry.counter) {
+            out << entry.total;
+        } else {
+            out << entry.total / entry.count << " ms";
+        }
+    }
+    return out.str();
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+
+    std::vector<ProfileEvent> events;
+    snapshot(events);
+
+    //Trace timestamps are microseconds
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+    out << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << GPU_THREAD
+        << ", \"args\": {\"name\": \"GPU\"}}";
+    for (const ProfileEvent& event : events) {
+        out << ",\n  {\"name\": ";
+        writeName(out, event.name);
+        if (event.type == ProfileEvent::Counter) {
+            out << ", \"ph\": \"C\", \"ts\": " << event.startNs * 1e-3 << ", \"pid\": 1, \"tid\": " << event.thread
+                << ", \"args\": {\"value\": " << event.value << "}}";
+        } else {
+            out << ", \"ph\": \"X\", \"ts\": " << event.startNs * 1e-3 << ", \"dur\": " << event.durationNs * 1e-3
+                << ", \"pid\": 1, \"tid\": " << event.thread << "}";
+        }
+    }
+
+    //Histograms as one instant event each, bins keyed by their upper bound
+    const uint64_t end = now();
+    std::lock_guard<std::mutex> lock(histogramMutex);
+    for (const std::unique_ptr<Histogram>& histogram : histograms) {
+        out << ",\n  {\"name\": ";
+        writeName(out, histogram->getName());
+        out << ", \"ph\": \"i\", \"s\": \"g\", \"ts\": " << end * 1e-3 << ", \"pid\": 1, \"tid\": 0, \"args\": {";
+        bool first = true;
+        for (int bin = 0; bin < Histogram::BINS; ++bin) {
+            const uint64_t count = histogram->count(bin);
+            if (count == 0) continue;
+            out << (first ? "" : ", ") << "\"<" << (bin == 0 ? 1ull : 1ull << bin) << "\": " << count;
+            first = false;
+        }
+        out << "}}";
+    }
+    out << "\n]}\n";
+    return (bool)out;
+}
+
+#endif
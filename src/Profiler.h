@@ -0,0 +1,139 @@
+#pragma once
+
+//Built-in instrumentation: scoped CPU timers, counters and histograms, collected in a lock-free
+//ring buffer and exported as Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev).
+//
+//Everything is compiled in only when BLACKHOLE_PROFILE is defined. Otherwise the PROFILE_*
+//macros expand to nothing and this header declares nothing else, so release builds pay nothing.
+//GL timer queries live in GpuProfiler.h on top of this.
+
+#ifdef BLACKHOLE_PROFILE
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProfileEvent {
+    enum Type : uint8_t {
+        Complete,   //A span: startNs and durationNs
+        Counter     //A sampled value at startNs
+    };
+
+    const char* name;       //String literal, stored by pointer
+    uint64_t startNs;       //Since the profiler started
+    uint64_t durationNs;
+    double value;
+    uint32_t thread;        //Profiler::currentThread(), or GPU_THREAD
+    Type type;
+};
+
+//Log2 buckets: bin 0 counts zeros, bin b > 0 counts values in [2^(b-1), 2^b)
+class Histogram {
+public:
+    static constexpr int BINS = 40;
+
+    explicit Histogram(const char* name) : name(name) {
+        for (std::atomic<uint64_t>& bin : bins) {
+            bin.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void add(uint64_t value) {
+        int bin = 0;
+        while (value != 0 && bin < BINS - 1) {
+            value >>= 1;
+            ++bin;
+        }
+        bins[bin].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t count(int bin) const { return bins[bin].load(std::memory_order_relaxed); }
+    const char* getName() const { return name; }
+
+private:
+    const char* name;
+    std::atomic<uint64_t> bins[BINS];
+};
+
+class Profiler {
+public:
+    static constexpr size_t CAPACITY = 1 << 16;     //Events kept; older ones are overwritten
+    static constexpr uint32_t GPU_THREAD = 1000;    //Track id of GPU timer query spans
+
+    static Profiler& instance();
+
+    uint64_t now() const;
+    static uint32_t currentThread();
+
+    //Lock-free for any number of writers: a slot is claimed with one fetch_add and published
+    //with a sequence number, so a reader skips slots that are mid-write or already reused
+    void record(const ProfileEvent& event);
+    void complete(const char* name, uint64_t startNs, uint64_t durationNs, uint32_t thread = currentThread());
+    void counter(const char* name, double value);
+
+    //Returns the histogram with this name, creating it on first use
+    Histogram& histogram(const char* name);
+
+    //Appends events recorded at or after cursor that are still in the ring, oldest first,
+    //and returns the cursor for the next call
+    uint64_t snapshot(std::vector<ProfileEvent>& out, uint64_t cursor = 0) const;
+
+    //Mean span per name (and last counter value) since the previous call, at most every
+    //intervalSeconds; returns an empty string in between
+    std::string summary(double intervalSeconds);
+
+    //Every event still in the ring plus the histograms, as Chrome trace-event JSON
+    bool writeChromeTrace(const std::string& path) const;
+
+private:
+    Profiler();
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;     //Index + 1 once written, 0 while being written
+        ProfileEvent event;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<uint64_t> head;
+    uint64_t origin;                        //steady_clock ns at construction
+
+    mutable std::mutex histogramMutex;
+    std::vector<std::unique_ptr<Histogram>> histograms;
+
+    uint64_t summaryCursor;
+    uint64_t summaryTime;
+};
+
+//Records a Complete event for the enclosing scope
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : name(name), start(Profiler::instance().now()) {}
+    ~ProfileScope() { Profiler& profiler = Profiler::instance(); profiler.complete(name, start, profiler.now() - start); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_JOIN(profileScope, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::instance().counter(name, (double)(value))
+#define PROFILE_HISTOGRAM(name, value) do { \
+        static Histogram& profileHistogram = Profiler::instance().histogram(name); \
+        profileHistogram.add((uint64_t)(value)); \
+    } while (0)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_HISTOGRAM(name, value) ((void)0)
+
+#endif
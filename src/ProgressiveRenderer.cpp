@@ -0,0 +1,211 @@
+#include "ProgressiveRenderer.h"
+#include "DiskVolume.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+static bool sameCamera(const TraceCamera& a, const TraceCamera& b) {
+    return a.position == b.position && a.right == b.right && a.up == b.up && a.forward == b.forward
+        && a.tanHalfFov == b.tanHalfFov && a.aspect == b.aspect;
+}
+
+//Everything but the tile size changes what a pixel traces to
+static bool sameSettings(const TraceSettings& a, const TraceSettings& b) {
+    return a.width == b.width && a.height == b.height && a.maxSteps == b.maxSteps && a.stepSize == b.stepSize
+        && a.kernel == b.kernel && a.integrator == b.integrator && a.relTolerance == b.relTolerance
+        && a.absTolerance == b.absTolerance && a.maxStepFraction == b.maxStepFraction
+        && a.analyticCulling == b.analyticCulling && a.precision == b.precision;
+}
+
+static bool sameScene(const TraceScene& a, const TraceScene& b) {
+    if (a.rs != b.rs || a.diskR1 != b.diskR1 || a.diskR2 != b.diskR2 || a.objects.size() != b.objects.size()
+        || a.stars != b.stars || a.starMagnitude != b.starMagnitude || a.volume != b.volume) {
+        return false;
+    }
+    for (size_t i = 0; i < a.objects.size(); ++i) {
+        const TraceObject& p = a.objects[i];
+        const TraceObject& q = b.objects[i];
+        if (p.center != q.center || p.radius != q.radius || p.color != q.color || p.mass != q.mass) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//A volume rebuilt in place keeps its pointer but not its generation
+static uint64_t volumeGeneration(const TraceScene& scene) {
+    return scene.volume ? scene.volume->getGeneration() : 0;
+}
+
+//Radical inverse of i in the given base
+static double halton(int i, int base) {
+    double result = 0.0;
+    double f = 1.0 / base;
+    for (; i > 0; i /= base, f /= base) {
+        result += f * (i % base);
+    }
+    return result;
+}
+
+static RenderStats collect(const std::vector<WorkerStats>& workerStats, TaskScheduler& scheduler,
+                           std::chrono::steady_clock::time_point start) {
+    RenderStats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.threads = scheduler.threadCount();
+    stats.steals = scheduler.lastStealCount();
+    for (const WorkerStats& worker : workerStats) {
+        stats += worker;
+    }
+    return stats;
+}
+
+ProgressiveRenderer::ProgressiveRenderer(const GeodesicTracer& tracer)
+    : tracer(tracer), previewDivisor(4), sampleCount(0),
+      accumulatedCamera(), accumulatedVolume(0) {}
+
+void ProgressiveRenderer::setPreviewDivisor(int divisor) {
+    previewDivisor = std::max(1, divisor);
+}
+
+void ProgressiveRenderer::reset() {
+    std::fill(accumulation.begin(), accumulation.end(), glm::dvec4(0.0));
+    sampleCount = 0;
+}
+
+glm::dvec2 ProgressiveRenderer::jitter(int sample) {
+    //Halton (2, 3) is stratified for every prefix, so the mean converges evenly over the pixel.
+    //Shifting by half a pixel puts sample 0 at the centre, matching GeodesicTracer::render.
+    return glm::fract(glm::dvec2(halton(sample, 2), halton(sample, 3)) + 0.5);
+}
+
+bool ProgressiveRenderer::accumulationValid(const TraceCamera& camera) const {
+    const TraceSettings& settings = tracer.getSettings();
+    return sampleCount > 0
+        && sameSettings(accumulatedSettings, settings)
+        && sameCamera(accumulatedCamera, camera) && sameScene(accumulatedScene, tracer.getScene())
+        && volumeGeneration(tracer.getScene()) == accumulatedVolume;
+}
+
+RenderStats ProgressiveRenderer::renderPass(const TraceCamera& camera, TaskScheduler& scheduler) {
+    const TraceSettings& settings = tracer.getSettings();
+    if (image.getWidth() != settings.width || image.getHeight() != settings.height) {
+        image.resize(settings.width, settings.height);
+    }
+    accumulation.resize((size_t)settings.width * settings.height);
+    if (settings.kernel == TraceKernel::Lookup) {
+        tracer.getDeflectionTable();
+    }
+
+    if (camera.moving) {
+        reset();
+        return renderPreview(camera, scheduler);
+    }
+    if (!accumulationValid(camera)) {
+        reset();
+    }
+    return renderSample(camera, scheduler);
+}
+
+RenderStats ProgressiveRenderer::renderPreview(const TraceCamera& camera, TaskScheduler& scheduler) {
+    const TraceSettings& settings = tracer.getSettings();
+    const int block = previewDivisor;
+    const int blocksX = (settings.width + block - 1) / block;
+    const int blocksY = (settings.height + block - 1) / block;
+    const double pixelAngle = 2.0 * camera.tanHalfFov / settings.height;
+    std::vector<WorkerStats> workerStats(scheduler.threadCount());
+
+    auto start = std::chrono::steady_clock::now();
+
+    //One ray through the middle of each block, written to the whole block
+    PROFILE_SCOPE("preview pass");
+    scheduler.parallelFor((size_t)blocksY, [&](size_t row, unsigned worker) {
+        PROFILE_SCOPE("preview row");
+        const int y0 = (int)row * block;
+        const int y1 = std::min(y0 + block, settings.height);
+        WorkerStats& stats = workerStats[worker];
+
+        std::vector<glm::dvec2> pixels(blocksX);
+        for (int bx = 0; bx < blocksX; ++bx) {
+            const int x0 = bx * block;
+            const int x1 = std::min(x0 + block, settings.width);
+            pixels[bx] = glm::dvec2(0.5 * (x0 + x1), 0.5 * (y0 + y1));
+        }
+        std::vector<TraceResult> results(blocksX);
+        tracer.tracePixels(camera, pixels.data(), blocksX, results.data());
+        for (const TraceResult& result : results) {
+            PROFILE_HISTOGRAM("ray steps", result.steps);
+            stats.count(result);
+        }
+
+        //Rows trace independently, so sky footprints come from the neighbouring blocks in the row
+        for (int bx = 0; bx < blocksX; ++bx) {
+            glm::vec4 color = results[bx].color;
+            if (results[bx].hit == HitType::None) {
+                const glm::dvec3 neighbour = bx + 1 < blocksX ? results[bx + 1].escape
+                                           : bx > 0 ? results[bx - 1].escape : glm::dvec3(0.0);
+                const double footprint = GeodesicTracer::skyFootprint(results[bx].escape, neighbour,
+                    glm::dvec3(0.0), block * pixelAngle) / block;
+                color += glm::vec4(tracer.skyColor(results[bx].escape, footprint, camera) * (1.0f - color.a), 0.0f);
+            }
+            const int x0 = bx * block;
+            const int x1 = std::min(x0 + block, settings.width);
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    image.at(x, y) = color;
+                }
+            }
+        }
+    });
+
+    return collect(workerStats, scheduler, start);
+}
+
+RenderStats ProgressiveRenderer::renderSample(const TraceCamera& camera, TaskScheduler& scheduler) {
+    const TraceSettings& settings = tracer.getSettings();
+    const glm::dvec2 offset = jitter(sampleCount);
+    const double weight = 1.0 / (sampleCount + 1);
+    const double pixelAngle = 2.0 * camera.tanHalfFov / settings.height;
+    std::vector<WorkerStats> workerStats(scheduler.threadCount());
+
+    auto start = std::chrono::steady_clock::now();
+
+    PROFILE_SCOPE("sample pass");
+    scheduler.parallelFor((size_t)settings.height, [&](size_t row, unsigned worker) {
+        PROFILE_SCOPE("sample row");
+        const int y = (int)row;
+        WorkerStats& stats = workerStats[worker];
+
+        std::vector<glm::dvec2> pixels(settings.width);
+        for (int x = 0; x < settings.width; ++x) {
+            pixels[x] = glm::dvec2(x + offset.x, y + offset.y);
+        }
+        std::vector<TraceResult> results(settings.width);
+        tracer.tracePixels(camera, pixels.data(), settings.width, results.data());
+        for (const TraceResult& result : results) {
+            PROFILE_HISTOGRAM("ray steps", result.steps);
+            stats.count(result);
+        }
+
+        for (int x = 0; x < settings.width; ++x) {
+            glm::vec4 color = results[x].color;
+            if (results[x].hit == HitType::None) {
+                const glm::dvec3 neighbour = x + 1 < settings.width ? results[x + 1].escape
+                                           : x > 0 ? results[x - 1].escape : glm::dvec3(0.0);
+                const double footprint = GeodesicTracer::skyFootprint(results[x].escape, neighbour,
+                    glm::dvec3(0.0), pixelAngle);
+                color += glm::vec4(tracer.skyColor(results[x].escape, footprint, camera) * (1.0f - color.a), 0.0f);
+            }
+            glm::dvec4& sum = accumulation[(size_t)y * settings.width + x];
+            sum += glm::dvec4(color);
+            image.at(x, y) = glm::vec4(sum * weight);
+        }
+    });
+
+    ++sampleCount;
+    accumulatedCamera = camera;
+    accumulatedScene = tracer.getScene();
+    accumulatedVolume = volumeGeneration(accumulatedScene);
+    accumulatedSettings = settings;
+    return collect(workerStats, scheduler, start);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "GeodesicTracer.h"
+#include "Image.h"
+
+class TaskScheduler;
+
+//Progressive refinement on top of GeodesicTracer.
+//While the camera is moving each pass is a cheap preview traced at a fraction of the
+//resolution. Once it stops, every pass adds one jittered subpixel sample per pixel to an
+//accumulation buffer and the image shows the running mean, converging to an anti-aliased
+//frame. Accumulation restarts when the camera moves, the scene (mass, disk, volume) changes,
+//including a DiskVolume rebuilt in place, or any TraceSettings but the tile size changes.
+class ProgressiveRenderer {
+public:
+    explicit ProgressiveRenderer(const GeodesicTracer& tracer);
+
+    //Preview traces one ray per divisor x divisor block of pixels
+    void setPreviewDivisor(int divisor);
+
+    //Drop all accumulated samples
+    void reset();
+
+    //Trace one pass and update the image
+    RenderStats renderPass(const TraceCamera& camera, TaskScheduler& scheduler);
+
+    const Image& getImage() const { return image; }
+    int getSampleCount() const { return sampleCount; }
+
+    //Subpixel offset in [0, 1)^2 of a given sample; sample 0 is the pixel centre
+    static glm::dvec2 jitter(int sample);
+
+private:
+    bool accumulationValid(const TraceCamera& camera) const;
+    RenderStats renderPreview(const TraceCamera& camera, TaskScheduler& scheduler);
+    RenderStats renderSample(const TraceCamera& camera, TaskScheduler& scheduler);
+
+    const GeodesicTracer& tracer;
+    int previewDivisor;
+
+    std::vector<glm::dvec4> accumulation;   //Running sum of samples
+    Image image;
+    int sampleCount;
+
+    //What the accumulated samples were traced with
+    TraceCamera accumulatedCamera;
+    TraceScene accumulatedScene;
+    uint64_t accumulatedVolume;             //DiskVolume generation, 0 without a volume
+    TraceSettings accumulatedSettings;
+};
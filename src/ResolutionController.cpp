@@ -0,0 +1,62 @@
+#include "ResolutionController.h"
+#include <algorithm>
+#include <cmath>
+
+ResolutionController::ResolutionController(double targetSeconds)
+    : targetSeconds(targetSeconds), minScale(0.25), maxScale(1.0), minSteps(2000), maxSteps(60000),
+      scale(1.0), stepBudget(60000), estimate(0.0) {}
+
+void ResolutionController::setTarget(double seconds) {
+    targetSeconds = seconds;
+}
+
+void ResolutionController::setLimits(double newMinScale, double newMaxScale, int newMinSteps, int newMaxSteps) {
+    minScale = std::max(1.0 / SCALE_STEPS, std::min(newMinScale, newMaxScale));
+    maxScale = std::max(minScale, newMaxScale);
+    minSteps = std::max(1, std::min(newMinSteps, newMaxSteps));
+    maxSteps = std::max(minSteps, newMaxSteps);
+    scale = maxScale;
+    stepBudget = maxSteps;
+    estimate = 0.0;
+}
+
+int ResolutionController::traceSize(int outputSize) const {
+    return std::max(1, (int)std::lround(outputSize * scale));
+}
+
+bool ResolutionController::update(double seconds, double measuredScale) {
+    if (seconds <= 0.0 || measuredScale <= 0.0 || targetSeconds <= 0.0) {
+        return false;
+    }
+    //Few rays reach the step budget, so only the pixel count is in the cost model
+    const double ratio = scale / measuredScale;
+    const double predicted = seconds * ratio * ratio;
+    estimate = estimate > 0.0 ? estimate + SMOOTHING * (predicted - estimate) : predicted;
+
+    const double error = targetSeconds / estimate;
+    if (error < DEAD_BAND && error > 1.0 / DEAD_BAND) {
+        return false;
+    }
+
+    //Area factor to apply, limited so one outlier frame cannot swing the settings far
+    const double area = std::min(2.0, std::max(0.5, pow(error, GAIN)));
+    const double oldScale = scale;
+    const int oldSteps = stepBudget;
+    if (error < 1.0) {
+        if (scale > minScale) {
+            scale = std::max(minScale, std::floor(scale * sqrt(area) * SCALE_STEPS) / SCALE_STEPS);
+        } else {
+            stepBudget = std::max(minSteps, (int)(stepBudget * area));
+        }
+    } else {
+        if (stepBudget < maxSteps) {
+            stepBudget = std::min(maxSteps, (int)std::ceil(stepBudget * area));
+        } else {
+            scale = std::min(maxScale, std::ceil(scale * sqrt(area) * SCALE_STEPS) / SCALE_STEPS);
+        }
+    }
+
+    //The estimate follows the new resolution so the next frames are judged against it
+    estimate *= (scale / oldScale) * (scale / oldScale);
+    return scale != oldScale || stepBudget != oldSteps;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+//Holds a frame-time budget by trading trace resolution and step budget.
+//Each measured frame time is first rescaled to what the current settings would cost (time
+//goes with the traced pixel count, so results that arrive a few frames late still steer the
+//right way) and smoothed. Outside a dead band around the target the controller moves a damped
+//fraction of the way towards it: over budget it lowers the resolution, and once that is at its
+//floor it cuts the step budget; under budget it gives steps back first, then resolution. The
+//output is traced at getScale() of its size and upscaled.
+class ResolutionController {
+public:
+    static constexpr double DEAD_BAND = 1.15;   //Predicted time within target x/÷ this holds still
+    static constexpr double GAIN = 0.7;         //Fraction of the log error corrected per update
+    static constexpr double SMOOTHING = 0.5;    //Weight of the newest frame in the running estimate
+    static constexpr int SCALE_STEPS = 64;      //Scale is a multiple of 1 / SCALE_STEPS
+
+    explicit ResolutionController(double targetSeconds);
+
+    void setTarget(double seconds);
+    //Range of the scale per axis and of the step budget; both start at their maximum
+    void setLimits(double minScale, double maxScale, int minSteps, int maxSteps);
+
+    //A frame traced at scale took seconds. Returns true if the settings changed.
+    bool update(double seconds, double scale);
+
+    double getScale() const { return scale; }
+    int getStepBudget() const { return stepBudget; }
+    double getTarget() const { return targetSeconds; }
+    //Smoothed frame time expected at the current settings, zero before the first update
+    double getEstimate() const { return estimate; }
+
+    //Trace size for an output dimension, at least one pixel
+    int traceSize(int outputSize) const;
+
+private:
+    double targetSeconds;
+    double minScale, maxScale;
+    int minSteps, maxSteps;
+
+    double scale;
+    int stepBudget;
+    double estimate;
+};
@@ -0,0 +1,297 @@
+#include "ShaderManager.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+namespace fs = std::filesystem;
+
+static constexpr uint32_t CACHE_MAGIC = 0x43534842; //"BHSC"
+
+static GLenum stageForFile(const std::string& file) {
+    const std::string extension = fs::path(file).extension().string();
+    if (extension == ".vert") return GL_VERTEX_SHADER;
+    if (extension == ".geom") return GL_GEOMETRY_SHADER;
+    if (extension == ".frag") return GL_FRAGMENT_SHADER;
+    if (extension == ".comp") return GL_COMPUTE_SHADER;
+    return 0;
+}
+
+static bool binarySupported() {
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+//FNV-1a, enough to tell sources and drivers apart in a file name
+static void hashBytes(uint64_t& hash, const std::string& bytes) {
+    for (unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    hash ^= 0xff;   //Separator, so ("ab", "c") and ("a", "bc") differ
+    hash *= 1099511628211ull;
+}
+
+static std::string glString(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value != nullptr ? reinterpret_cast<const char*>(value) : "";
+}
+
+static std::string shaderLog(GLuint shader) {
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::string log(length > 0 ? length : 1, '\0');
+    glGetShaderInfoLog(shader, (GLsizei)log.size(), nullptr, &log[0]);
+    return log.c_str();
+}
+
+static std::string programLog(GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    std::string log(length > 0 ? length : 1, '\0');
+    glGetProgramInfoLog(program, (GLsizei)log.size(), nullptr, &log[0]);
+    return log.c_str();
+}
+
+ShaderManager::ShaderManager(const std::string& directory, const std::string& cacheDirectory)
+    : directory(directory), cacheDirectory(cacheDirectory), cacheEnabled(true),
+      lastPoll(std::chrono::steady_clock::now()) {
+}
+
+ShaderManager::~ShaderManager() {
+    cleanup();
+}
+
+void ShaderManager::cleanup() {
+    for (std::unique_ptr<ShaderProgram>& program : programs) {
+        if (program->id != 0) {
+            glDeleteProgram(program->id);
+            program->id = 0;
+        }
+    }
+    programs.clear();
+}
+
+bool ShaderManager::readSources(const ShaderProgram& program, std::vector<std::string>& sources,
+                                std::vector<fs::file_time_type>& timestamps) const {
+    sources.clear();
+    //Every file gets a timestamp, even past one that cannot be read, as reloadChanged() compares
+    //them all; a file that cannot be stat'ed gets file_time_type::min()
+    timestamps.clear();
+    for (const std::string& file : program.files) {
+        std::error_code error;
+        timestamps.push_back(fs::last_write_time(directory / file, error));
+    }
+    for (size_t i = 0; i < program.files.size(); ++i) {
+        const fs::path path = directory / program.files[i];
+        std::ifstream in(path, std::ios::binary);
+        if (timestamps[i] == fs::file_time_type::min() || !in) {
+            std::cerr << "Shader " << program.name << ": cannot read " << path.string() << std::endl;
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        sources.push_back(buffer.str());
+    }
+    return true;
+}
+
+std::string ShaderManager::cachePath(const ShaderProgram& program, const std::vector<std::string>& sources) const {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        hashBytes(hash, program.files[i]);
+        hashBytes(hash, sources[i]);
+    }
+    hashBytes(hash, glString(GL_VENDOR));
+    hashBytes(hash, glString(GL_RENDERER));
+    hashBytes(hash, glString(GL_VERSION));
+
+    std::stringstream name;
+    name << program.name << "-" << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return (cacheDirectory / name.str()).string();
+}
+
+GLuint ShaderManager::loadBinary(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    uint32_t header[2];
+    if (!in || !in.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != CACHE_MAGIC) {
+        return 0;
+    }
+    std::vector<char> binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    GLuint id = glCreateProgram();
+    glProgramBinary(id, (GLenum)header[1], binary.data(), (GLsizei)binary.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(id, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(id);
+        return 0;
+    }
+    return id;
+}
+
+void ShaderManager::saveBinary(GLuint id, const std::string& path) {
+    GLint length = 0;
+    glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(id, length, &length, &format, binary.data());
+
+    std::error_code error;
+    fs::create_directories(cacheDirectory, error);
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        return;     //A read-only tree just means every start compiles
+    }
+    const uint32_t header[2] = {CACHE_MAGIC, (uint32_t)format};
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(binary.data(), length);
+}
+
+GLuint ShaderManager::build(ShaderProgram& program) {
+    std::vector<std::string> sources;
+    std::vector<fs::file_time_type> timestamps;
+    const bool readable = readSources(program, sources, timestamps);
+    //Remember these versions even if they fail, so a broken edit is reported once, not every poll
+    program.timestamps = timestamps;
+    if (!readable) {
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const bool useCache = cacheEnabled && binarySupported();
+    const std::string path = useCache ? cachePath(program, sources) : std::string();
+
+    GLuint id = useCache ? loadBinary(path) : 0;
+    if (id != 0) {
+        stats.loadedFromCache++;
+    } else {
+        std::vector<GLuint> shaders;
+        bool compiled = true;
+        for (size_t i = 0; i < sources.size() && compiled; ++i) {
+            const GLenum stage = stageForFile(program.files[i]);
+            if (stage == 0) {
+                std::cerr << "Shader " << program.name << ": unknown stage for " << program.files[i] << std::endl;
+                compiled = false;
+                break;
+            }
+            GLuint shader = glCreateShader(stage);
+            const char* source = sources[i].c_str();
+            glShaderSource(shader, 1, &source, nullptr);
+            glCompileShader(shader);
+            GLint status = GL_FALSE;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+            if (!status) {
+                std::cerr << "Shader " << program.name << ": " << program.files[i] << " failed to compile\n"
+                          << shaderLog(shader) << std::endl;
+                compiled = false;
+            }
+            shaders.push_back(shader);
+        }
+
+        if (compiled) {
+            id = glCreateProgram();
+            for (GLuint shader : shaders) {
+                glAttachShader(id, shader);
+            }
+            if (useCache) {
+                glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
+            glLinkProgram(id);
+            GLint linked = GL_FALSE;
+            glGetProgramiv(id, GL_LINK_STATUS, &linked);
+            for (GLuint shader : shaders) {
+                glDetachShader(id, shader);
+            }
+            if (!linked) {
+                std::cerr << "Shader " << program.name << ": link failed\n" << programLog(id) << std::endl;
+                glDeleteProgram(id);
+                id = 0;
+            }
+        }
+        for (GLuint shader : shaders) {
+            glDeleteShader(shader);
+        }
+
+        if (id != 0) {
+            stats.compiled++;
+            if (useCache) {
+                saveBinary(id, path);
+            }
+        }
+    }
+
+    stats.buildSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return id;
+}
+
+ShaderProgram* ShaderManager::load(const std::string& name, const std::vector<std::string>& files,
+                                   const std::vector<std::string>& uniformNames) {
+    std::unique_ptr<ShaderProgram> program(new ShaderProgram());
+    program->name = name;
+    program->files = files;
+    program->uniformNames = uniformNames;
+
+    program->id = build(*program);
+    if (program->id == 0) {
+        stats.failed++;
+        return nullptr;
+    }
+
+    //Resolved once here, draws then only index into the table
+    program->uniforms.resize(uniformNames.size());
+    for (size_t i = 0; i < uniformNames.size(); ++i) {
+        program->uniforms[i] = glGetUniformLocation(program->id, uniformNames[i].c_str());
+    }
+
+    programs.push_back(std::move(program));
+    return programs.back().get();
+}
+
+int ShaderManager::reloadChanged() {
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - lastPoll).count() < POLL_SECONDS) {
+        return 0;
+    }
+    lastPoll = now;
+
+    int reloaded = 0;
+    for (std::unique_ptr<ShaderProgram>& program : programs) {
+        bool changed = false;
+        for (size_t i = 0; i < program->files.size(); ++i) {
+            std::error_code error;
+            const fs::file_time_type time = fs::last_write_time(directory / program->files[i], error);
+            if (error) {
+                changed = false;    //Mid-save in some editors, look again next poll
+                break;
+            }
+            changed = changed || time != program->timestamps[i];
+        }
+        if (!changed) {
+            continue;
+        }
+
+        GLuint id = build(*program);
+        if (id == 0) {
+            stats.failed++;
+            std::cerr << "Shader " << program->name << ": keeping the previous version" << std::endl;
+            continue;
+        }
+        glDeleteProgram(program->id);
+        program->id = id;
+        for (size_t i = 0; i < program->uniformNames.size(); ++i) {
+            program->uniforms[i] = glGetUniformLocation(id, program->uniformNames[i].c_str());
+        }
+        stats.reloaded++;
+        reloaded++;
+        std::cout << "Reloaded shader " << program->name << std::endl;
+    }
+    return reloaded;
+}
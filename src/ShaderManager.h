@@ -0,0 +1,90 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+//A linked program owned by ShaderManager. Callers keep the pointer: on hot reload the id and
+//uniform locations are replaced in place.
+class ShaderProgram {
+public:
+    GLuint getId() const { return id; }
+    void use() const { glUseProgram(id); }
+
+    //Location of the slot-th name passed to ShaderManager::load, -1 if the program does not use it
+    GLint uniform(int slot) const { return uniforms[slot]; }
+
+    const std::string& getName() const { return name; }
+
+private:
+    friend class ShaderManager;
+
+    std::string name;
+    std::vector<std::string> files;                             //Relative to the shader directory
+    std::vector<std::string> uniformNames;
+    std::vector<GLint> uniforms;
+    std::vector<std::filesystem::file_time_type> timestamps;   //Of files, when last built
+    GLuint id = 0;
+};
+
+struct ShaderStats {
+    int compiled = 0;           //Programs built from source
+    int loadedFromCache = 0;    //Programs restored with glProgramBinary
+    int reloaded = 0;           //Successful hot reloads
+    int failed = 0;             //Builds that did not compile or link
+    double buildSeconds = 0.0;  //Time spent building or restoring programs
+};
+
+//Loads GLSL programs from files, caches linked binaries on disk and reloads edited files.
+//
+//Binaries are stored through glGetProgramBinary (GL 4.1 or GL_ARB_get_program_binary) in
+//<cache directory>/<program>-<key>.bin, where key hashes the sources together with
+//GL_VENDOR, GL_RENDERER and GL_VERSION, so a driver update or an edit misses the cache.
+//Drivers may still reject a binary they wrote, in which case the program is compiled again.
+class ShaderManager {
+public:
+    static constexpr double POLL_SECONDS = 0.5;
+
+    explicit ShaderManager(const std::string& directory = "shaders", const std::string& cacheDirectory = "shader_cache");
+    ~ShaderManager();
+
+    ShaderManager(const ShaderManager&) = delete;
+    ShaderManager& operator=(const ShaderManager&) = delete;
+
+    //Builds a program from files in the shader directory, the stage taken from each extension
+    //(.vert, .geom, .frag, .comp), and resolves the given uniforms. Returns nullptr and prints
+    //the compiler or linker log if it does not build.
+    ShaderProgram* load(const std::string& name, const std::vector<std::string>& files,
+                        const std::vector<std::string>& uniformNames);
+
+    //Rebuilds programs whose files changed since they were built. A program that no longer
+    //compiles keeps running its previous version. Checks the files at most every POLL_SECONDS;
+    //returns the number of programs reloaded.
+    int reloadChanged();
+
+    void setCacheEnabled(bool enabled) { cacheEnabled = enabled; }
+    const ShaderStats& getStats() const { return stats; }
+
+    //Deletes every program, call while the context is current
+    void cleanup();
+
+private:
+    //Links a new program for the current files and uniforms, 0 on failure
+    GLuint build(ShaderProgram& program);
+    GLuint loadBinary(const std::string& path);
+    void saveBinary(GLuint id, const std::string& path);
+    bool readSources(const ShaderProgram& program, std::vector<std::string>& sources,
+                     std::vector<std::filesystem::file_time_type>& timestamps) const;
+    std::string cachePath(const ShaderProgram& program, const std::vector<std::string>& sources) const;
+
+    std::filesystem::path directory;
+    std::filesystem::path cacheDirectory;
+    bool cacheEnabled;
+    std::vector<std::unique_ptr<ShaderProgram>> programs;
+    std::chrono::steady_clock::time_point lastPoll;
+    ShaderStats stats;
+};
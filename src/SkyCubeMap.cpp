@@ -0,0 +1,143 @@
+#include "SkyCubeMap.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+
+//Face and (s, t) in [0, 1] of a direction, from the major-axis table of the GL specification
+static int faceCoordinates(const glm::dvec3& d, double& s, double& t) {
+    const glm::dvec3 a = glm::abs(d);
+    int face;
+    double sc, tc, ma;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = d.x >= 0.0 ? 0 : 1;
+        sc = d.x >= 0.0 ? -d.z : d.z;
+        tc = -d.y;
+        ma = a.x;
+    } else if (a.y >= a.z) {
+        face = d.y >= 0.0 ? 2 : 3;
+        sc = d.x;
+        tc = d.y >= 0.0 ? d.z : -d.z;
+        ma = a.y;
+    } else {
+        face = d.z >= 0.0 ? 4 : 5;
+        sc = d.z >= 0.0 ? d.x : -d.x;
+        tc = -d.y;
+        ma = a.z;
+    }
+    s = 0.5 * (sc / ma + 1.0);
+    t = 0.5 * (tc / ma + 1.0);
+    return face;
+}
+
+//Solid angle of the face region from (-1, -1) to (x, y), up to a constant
+static double areaElement(double x, double y) {
+    return atan2(x * y, sqrt(x * x + y * y + 1.0));
+}
+
+SkyCubeMap::SkyCubeMap() : faceSize(0), levels(0) {
+}
+
+void SkyCubeMap::resize(int newFaceSize) {
+    faceSize = newFaceSize;
+    levels = 0;
+    for (int size = faceSize; size > 0; size /= 2) {
+        ++levels;
+    }
+    texels.assign(6 * levels, std::vector<glm::vec3>());
+    for (int face = 0; face < 6; ++face) {
+        for (int l = 0; l < levels; ++l) {
+            const int size = faceSize >> l;
+            texels[face * levels + l].assign((size_t)size * size, glm::vec3(0.0f));
+        }
+    }
+}
+
+void SkyCubeMap::addFlux(const glm::dvec3& direction, const glm::vec3& flux) {
+    double s, t;
+    const int face = faceCoordinates(direction, s, t);
+    const int x = std::min((int)(s * faceSize), faceSize - 1);
+    const int y = std::min((int)(t * faceSize), faceSize - 1);
+    texels[face * levels][(size_t)y * faceSize + x] += flux;
+}
+
+double SkyCubeMap::texelAngle(int level) const {
+    return 0.5 * glm::pi<double>() / (faceSize >> level);
+}
+
+double SkyCubeMap::texelSolidAngle(int level, int s, int t) const {
+    const double step = 2.0 / (faceSize >> level);
+    const double x0 = -1.0 + s * step, x1 = x0 + step;
+    const double y0 = -1.0 + t * step, y1 = y0 + step;
+    return areaElement(x1, y1) - areaElement(x0, y1) - areaElement(x1, y0) + areaElement(x0, y0);
+}
+
+void SkyCubeMap::buildMips() {
+    //Solid angles are the same on every face, so compute each level's once
+    std::vector<double> solidAngles((size_t)faceSize * faceSize);
+    for (int t = 0; t < faceSize; ++t) {
+        for (int s = 0; s < faceSize; ++s) {
+            solidAngles[(size_t)t * faceSize + s] = texelSolidAngle(0, s, t);
+        }
+    }
+    for (int face = 0; face < 6; ++face) {
+        std::vector<glm::vec3>& base = texels[face * levels];
+        for (size_t i = 0; i < base.size(); ++i) {
+            base[i] /= (float)solidAngles[i];
+        }
+    }
+
+    for (int l = 1; l < levels; ++l) {
+        const int size = faceSize >> l;
+        const int childSize = size * 2;
+        std::vector<double> parentAngles((size_t)size * size, 0.0);
+        for (int t = 0; t < childSize; ++t) {
+            for (int s = 0; s < childSize; ++s) {
+                parentAngles[(size_t)(t / 2) * size + s / 2] += solidAngles[(size_t)t * childSize + s];
+            }
+        }
+
+        for (int face = 0; face < 6; ++face) {
+            const std::vector<glm::vec3>& child = texels[face * levels + l - 1];
+            std::vector<glm::vec3>& parent = texels[face * levels + l];
+            for (int t = 0; t < childSize; ++t) {
+                for (int s = 0; s < childSize; ++s) {
+                    const size_t i = (size_t)t * childSize + s;
+                    parent[(size_t)(t / 2) * size + s / 2] += child[i] * (float)solidAngles[i];
+                }
+            }
+            for (size_t i = 0; i < parent.size(); ++i) {
+                parent[i] /= (float)parentAngles[i];
+            }
+        }
+        solidAngles.swap(parentAngles);
+    }
+}
+
+glm::vec3 SkyCubeMap::sampleLevel(int face, int level, double s, double t) const {
+    const int size = faceSize >> level;
+    const std::vector<glm::vec3>& data = texels[face * levels + level];
+    const double x = s * size - 0.5, y = t * size - 0.5;
+    const int x0 = (int)floor(x), y0 = (int)floor(y);
+    const float fx = (float)(x - x0), fy = (float)(y - y0);
+    auto at = [&](int tx, int ty) {
+        tx = std::min(std::max(tx, 0), size - 1);
+        ty = std::min(std::max(ty, 0), size - 1);
+        return data[(size_t)ty * size + tx];
+    };
+    return glm::mix(glm::mix(at(x0, y0), at(x0 + 1, y0), fx), glm::mix(at(x0, y0 + 1), at(x0 + 1, y0 + 1), fx), fy);
+}
+
+glm::vec3 SkyCubeMap::sample(const glm::dvec3& direction, double lod) const {
+    if (levels == 0) {
+        return glm::vec3(0.0f);
+    }
+    double s, t;
+    const int face = faceCoordinates(direction, s, t);
+    lod = std::min(std::max(lod, 0.0), (double)(levels - 1));
+    const int level = (int)lod;
+    const glm::vec3 fine = sampleLevel(face, level, s, t);
+    if (level + 1 >= levels) {
+        return fine;
+    }
+    return glm::mix(fine, sampleLevel(face, level + 1, s, t), (float)(lod - level));
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+//Mipmapped RGB float cube map of sky radiance (flux per steradian).
+//Laid out as GL expects: faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order, each level's rows
+//running along t from 0, so level(face, l) uploads with glTexImage2D(..., GL_RGB, GL_FLOAT, ...)
+//unchanged. Directions pick a face and (s, t) by the table in the GL specification.
+//sample() filters as textureLod does on a seamless cube map, except that bilinear lookups
+//clamp at face edges instead of reading across them.
+class SkyCubeMap {
+public:
+    SkyCubeMap();
+
+    //Allocates every level down to 1x1, zeroed; faceSize must be a power of two
+    void resize(int faceSize);
+    //Adds flux (not radiance) to the level 0 texel containing direction
+    void addFlux(const glm::dvec3& direction, const glm::vec3& flux);
+    //Turns level 0 flux into radiance and fills the smaller levels; each texel is the
+    //solid-angle weighted mean of the four below it, so total flux is the same on every level
+    void buildMips();
+
+    glm::vec3 sample(const glm::dvec3& direction, double lod) const;
+
+    bool empty() const { return faceSize == 0; }
+    int getFaceSize() const { return faceSize; }
+    int levelCount() const { return levels; }
+    const std::vector<glm::vec3>& level(int face, int level) const { return texels[face * levels + level]; }
+    //Mean angle across one texel of a level
+    double texelAngle(int level) const;
+    //Solid angle of texel (s, t) of a level, the same on every face
+    double texelSolidAngle(int level, int s, int t) const;
+
+private:
+    glm::vec3 sampleLevel(int face, int level, double s, double t) const;
+
+    int faceSize;
+    int levels;
+    std::vector<std::vector<glm::vec3>> texels;     //Indexed by face * levels + level
+};
@@ -0,0 +1,56 @@
+#include "SpacetimeGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <unordered_map>
+
+SpacetimeGrid::SpacetimeGrid(float innerSpacing, int levels, int subdivisions)
+    : innerSpacing(innerSpacing), levels(std::max(1, levels)), subdivisions(std::max(1, subdivisions)) {
+    //Coordinates are integers in units of the finest segment, so vertices on ring boundaries
+    //are found again exactly by the ring outside
+    const float unit = innerSpacing / this->subdivisions;
+    std::unordered_map<uint64_t, unsigned int> vertexIds;
+    auto vertex = [&](int x, int z) {
+        const uint64_t key = ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+        auto found = vertexIds.find(key);
+        if (found != vertexIds.end()) {
+            return found->second;
+        }
+        const unsigned int id = (unsigned int)positions.size();
+        positions.push_back(glm::vec2(x * unit, z * unit));
+        vertexIds.emplace(key, id);
+        return id;
+    };
+
+    for (int level = 0; level < this->levels; ++level) {
+        const int step = 1 << level;                    //Segment length
+        const int cell = this->subdivisions * step;     //Line spacing
+        const int outer = RING_CELLS * cell;
+        const int inner = level > 0 ? outer / 2 : -1;   //Drawn by the ring inside, boundary included
+
+        for (int line = -RING_CELLS; line <= RING_CELLS; ++line) {
+            const int across = line * cell;
+            for (int along = -outer; along < outer; along += step) {
+                if (std::abs(across) <= inner && std::max(std::abs(along), std::abs(along + step)) <= inner) {
+                    continue;
+                }
+                //Lines along z, then along x
+                indices.push_back(vertex(across, along));
+                indices.push_back(vertex(across, along + step));
+                indices.push_back(vertex(along, across));
+                indices.push_back(vertex(along + step, across));
+            }
+        }
+    }
+}
+
+float SpacetimeGrid::height(float x, float z, float blackHoleMass) {
+    //Stronger and wider with higher mass
+    const float dist2 = x * x + z * z;
+    return -2.0f * blackHoleMass * exp(-0.3f * dist2 / blackHoleMass);
+}
+
+float SpacetimeGrid::getExtent() const {
+    return RING_CELLS * innerSpacing * (float)(1 << (levels - 1));
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+//Line grid in the y = 0 plane, pulled down around the origin to show spacetime curvature.
+//The mesh is flat and built once; grid.vert displaces it by height() from a mass uniform, so
+//changing the mass costs no CPU work or upload. Detail falls off in concentric square rings:
+//ring L covers up to RING_CELLS cells of innerSpacing * 2^L from the centre, outside ring
+//L - 1, and every cell edge is split into `subdivisions` segments so the well stays smooth
+//where it is steepest. Lines of an outer ring are also lines of the rings inside it and end on
+//shared vertices.
+class SpacetimeGrid {
+public:
+    static constexpr int RING_CELLS = 16;   //Cells from the centre to the edge of each ring
+
+    SpacetimeGrid(float innerSpacing = 0.05f, int levels = 4, int subdivisions = 10);
+
+    //Depth of the well at (x, z) for a black hole mass; grid.vert evaluates the same formula
+    static float height(float x, float z, float blackHoleMass);
+
+    const std::vector<glm::vec2>& getPositions() const { return positions; }   //(x, z)
+    const std::vector<unsigned int>& getIndices() const { return indices; }
+    int getLevels() const { return levels; }
+    //Half the side of the outermost ring
+    float getExtent() const;
+
+private:
+    float innerSpacing;
+    int levels;
+    int subdivisions;
+    std::vector<glm::vec2> positions;
+    std::vector<unsigned int> indices;  //GL_LINES pairs
+};
@@ -0,0 +1,227 @@
+#include "SparseRenderer.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static double angleBetween(const glm::dvec3& a, const glm::dvec3& b) {
+    return 2.0 * asin(std::min(0.5 * glm::length(a - b), 1.0));
+}
+
+SparseRenderer::SparseRenderer(const GeodesicTracer& tracer)
+    : tracer(tracer), spacing(4), threshold(0.05f), tracedFraction(0.0), gridWidth(0), gridHeight(0) {}
+
+void SparseRenderer::setSpacing(int newSpacing) {
+    spacing = 1;
+    while (spacing < newSpacing) spacing *= 2;
+}
+
+void SparseRenderer::setThreshold(float newThreshold) {
+    threshold = std::max(0.0f, newThreshold);
+}
+
+bool SparseRenderer::needsSplit(int x0, int y0, int size, double pixelAngle) const {
+    const TraceResult* corners[4] = {&at(x0, y0), &at(x0 + size, y0), &at(x0, y0 + size), &at(x0 + size, y0 + size)};
+    for (int i = 1; i < 4; ++i) {
+        if (corners[i]->hit != corners[0]->hit) {
+            return true;
+        }
+    }
+
+    glm::vec4 lo = corners[0]->color, hi = corners[0]->color;
+    for (int i = 1; i < 4; ++i) {
+        lo = glm::min(lo, corners[i]->color);
+        hi = glm::max(hi, corners[i]->color);
+    }
+    const glm::vec4 range = hi - lo;
+    if (std::max(std::max(range.r, range.g), std::max(range.b, range.a)) > threshold) {
+        return true;
+    }
+
+    //Interpolated escape directions place the stars, so the sky map must be close to linear
+    //over the cell: split where the diagonals land over twice as far apart as without lensing
+    if (corners[0]->hit == HitType::None && tracer.getScene().stars) {
+        const double limit = 2.0 * sqrt(2.0) * size * pixelAngle;
+        if (angleBetween(corners[0]->escape, corners[3]->escape) > limit
+            || angleBetween(corners[1]->escape, corners[2]->escape) > limit) {
+            return true;
+        }
+    }
+    return false;
+}
+
+RenderStats SparseRenderer::render(const TraceCamera& camera, Image& image, TaskScheduler& scheduler) {
+    PROFILE_SCOPE("sparse render");
+    const TraceSettings& settings = tracer.getSettings();
+    const int width = settings.width;
+    const int height = settings.height;
+    if (image.getWidth() != width || image.getHeight() != height) {
+        image.resize(width, height);
+    }
+    if (settings.kernel == TraceKernel::Lookup) {
+        tracer.getDeflectionTable();
+    }
+
+    gridWidth = (width - 1 + spacing - 1) / spacing * spacing + 1;
+    gridHeight = (height - 1 + spacing - 1) / spacing * spacing + 1;
+    results.assign((size_t)gridWidth * gridHeight, TraceResult());
+    traced.assign((size_t)gridWidth * gridHeight, 0);
+    const double pixelAngle = 2.0 * camera.tanHalfFov / height;
+    std::vector<WorkerStats> workerStats(scheduler.threadCount());
+
+    auto start = std::chrono::steady_clock::now();
+
+    //Trace the listed pixels of one lattice row in a single run, so packet kernels stay full
+    auto traceRow = [&](int y, const std::vector<int>& xs, WorkerStats& stats) {
+        if (xs.empty()) return;
+        std::vector<glm::dvec2> pixels(xs.size());
+        std::vector<TraceResult> rowResults(xs.size());
+        for (size_t i = 0; i < xs.size(); ++i) {
+            pixels[i] = glm::dvec2(xs[i] + 0.5, y + 0.5);
+        }
+        tracer.tracePixels(camera, pixels.data(), (int)xs.size(), rowResults.data());
+        for (size_t i = 0; i < xs.size(); ++i) {
+            const size_t index = (size_t)y * gridWidth + xs[i];
+            results[index] = rowResults[i];
+            traced[index] = 1;
+            const TraceResult& result = rowResults[i];
+            PROFILE_HISTOGRAM("ray steps", result.steps);
+            stats.count(result);
+        }
+    };
+
+    //Coarse lattice
+    {
+        PROFILE_SCOPE("sparse lattice");
+        scheduler.parallelFor((size_t)((gridHeight - 1) / spacing + 1), [&](size_t row, unsigned worker) {
+            std::vector<int> xs;
+            for (int x = 0; x < gridWidth; x += spacing) xs.push_back(x);
+            traceRow((int)row * spacing, xs, workerStats[worker]);
+        });
+    }
+
+    //Each level decides which of its cells split before any are traced, so workers only ever
+    //write pixels no other worker reads in the same pass
+    std::vector<uint8_t> candidate((size_t)((gridWidth - 1) / spacing) * ((gridHeight - 1) / spacing), 1);
+    std::vector<uint8_t> split;
+    for (int size = spacing; size > 1; size /= 2) {
+        PROFILE_SCOPE("sparse level");
+        const int cellsX = (gridWidth - 1) / size;
+        const int cellsY = (gridHeight - 1) / size;
+        split.assign((size_t)cellsX * cellsY, 0);
+        scheduler.parallelFor((size_t)cellsY, [&](size_t cy, unsigned) {
+            for (int cx = 0; cx < cellsX; ++cx) {
+                const size_t cell = cy * cellsX + cx;
+                split[cell] = candidate[cell] && needsSplit(cx * size, (int)cy * size, size, pixelAngle);
+            }
+        });
+
+        //New points sit on the half-size lattice; trace those on or inside a split cell
+        const int half = size / 2;
+        auto splitAt = [&](int cx, int cy) {
+            return cx >= 0 && cx < cellsX && cy >= 0 && cy < cellsY && split[(size_t)cy * cellsX + cx];
+        };
+        scheduler.parallelFor((size_t)((gridHeight - 1) / half + 1), [&](size_t row, unsigned worker) {
+            const int y = (int)row * half;
+            const int cy = y / size;
+            const bool yEdge = y % size == 0;
+            std::vector<int> xs;
+            for (int x = 0; x < gridWidth; x += half) {
+                if (isTraced(x, y)) continue;
+                const int cx = x / size;
+                const bool xEdge = x % size == 0;
+                if (splitAt(cx, cy) || (xEdge && splitAt(cx - 1, cy)) || (yEdge && splitAt(cx, cy - 1))
+                    || (xEdge && yEdge && splitAt(cx - 1, cy - 1))) {
+                    xs.push_back(x);
+                }
+            }
+            traceRow(y, xs, workerStats[worker]);
+        });
+
+        candidate.assign((size_t)(cellsX * 2) * (cellsY * 2), 0);
+        for (int cy = 0; cy < cellsY * 2; ++cy) {
+            for (int cx = 0; cx < cellsX * 2; ++cx) {
+                candidate[(size_t)cy * cellsX * 2 + cx] = split[(size_t)(cy / 2) * cellsX + cx / 2];
+            }
+        }
+    }
+
+    //Untraced pixels interpolate between the corners of the smallest aligned cell around them
+    //whose corners are traced. A pixel on a cell edge only needs the two corners on that edge,
+    //which is what lets it use midpoints traced by a finer neighbour.
+    std::vector<glm::dvec3> escapes((size_t)width * height);
+    {
+        PROFILE_SCOPE("sparse fill");
+        scheduler.parallelFor((size_t)height, [&](size_t row, unsigned) {
+            const int y = (int)row;
+            for (int x = 0; x < width; ++x) {
+                if (isTraced(x, y)) {
+                    image.at(x, y) = at(x, y).color;
+                    escapes[(size_t)y * width + x] = at(x, y).escape;
+                    continue;
+                }
+                for (int size = 2; size <= spacing; size *= 2) {
+                    const int x0 = x / size * size, y0 = y / size * size;
+                    const int xs[2] = {x0, x0 + size}, ys[2] = {y0, y0 + size};
+                    const double fx = (double)(x - x0) / size, fy = (double)(y - y0) / size;
+                    const double weights[4] = {(1.0 - fx) * (1.0 - fy), fx * (1.0 - fy), (1.0 - fx) * fy, fx * fy};
+                    bool ready = true;
+                    for (int i = 0; i < 4 && ready; ++i) {
+                        ready = weights[i] == 0.0 || isTraced(xs[i & 1], ys[i >> 1]);
+                    }
+                    if (!ready) continue;
+
+                    glm::dvec4 color(0.0);
+                    glm::dvec3 escape(0.0);
+                    bool escaped = true;
+                    for (int i = 0; i < 4; ++i) {
+                        if (weights[i] == 0.0) continue;
+                        const TraceResult& corner = at(xs[i & 1], ys[i >> 1]);
+                        color += weights[i] * glm::dvec4(corner.color);
+                        escape += weights[i] * corner.escape;
+                        escaped = escaped && corner.hit == HitType::None;
+                    }
+                    image.at(x, y) = glm::vec4(color);
+                    if (escaped && escape != glm::dvec3(0.0)) {
+                        escapes[(size_t)y * width + x] = glm::normalize(escape);
+                    }
+                    break;
+                }
+            }
+        });
+    }
+
+    //Sky last, with footprints from the final escape directions as in GeodesicTracer::render
+    if (tracer.getScene().stars) {
+        PROFILE_SCOPE("sparse sky");
+        auto escapeAt = [&](int x, int y) {
+            if (x < 0 || x >= width || y < 0 || y >= height) return glm::dvec3(0.0);
+            return escapes[(size_t)y * width + x];
+        };
+        scheduler.parallelFor((size_t)height, [&](size_t row, unsigned) {
+            const int y = (int)row;
+            for (int x = 0; x < width; ++x) {
+                const glm::dvec3 escape = escapeAt(x, y);
+                if (escape == glm::dvec3(0.0)) continue;
+                glm::dvec3 xNeighbour = escapeAt(x + 1, y);
+                if (xNeighbour == glm::dvec3(0.0)) xNeighbour = escapeAt(x - 1, y);
+                glm::dvec3 yNeighbour = escapeAt(x, y + 1);
+                if (yNeighbour == glm::dvec3(0.0)) yNeighbour = escapeAt(x, y - 1);
+                const double footprint = GeodesicTracer::skyFootprint(escape, xNeighbour, yNeighbour, pixelAngle);
+                glm::vec4& pixel = image.at(x, y);
+                pixel += glm::vec4(tracer.skyColor(escape, footprint, camera) * (1.0f - pixel.a), 0.0f);
+            }
+        });
+    }
+
+    RenderStats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.threads = scheduler.threadCount();
+    stats.steals = scheduler.lastStealCount();
+    for (const WorkerStats& worker : workerStats) {
+        stats += worker;
+    }
+    tracedFraction = (double)stats.rays / ((size_t)width * height);
+    return stats;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GeodesicTracer.h"
+#include "Image.h"
+
+class TaskScheduler;
+
+//Edge-adaptive sampling on top of GeodesicTracer.
+//Traces a coarse lattice of pixels, then splits every lattice cell whose corners disagree:
+//different hit types, colours further apart than the threshold, or (with a star catalog) escape
+//directions spread much wider than an unlensed cell's. Splitting traces the cell's edge
+//midpoints and centre and repeats on the four quarters down to single pixels. Pixels left
+//untraced are interpolated from the finest traced corners around them, so smooth regions cost a
+//few rays per cell while the shadow's rim, the photon ring and the disk edges are traced
+//pixel by pixel. Features that fit between coarse lattice points can be missed.
+class SparseRenderer {
+public:
+    explicit SparseRenderer(const GeodesicTracer& tracer);
+
+    //Pitch of the coarse lattice in pixels, rounded up to a power of two; 1 traces every pixel
+    void setSpacing(int spacing);
+    //Largest colour channel difference between a cell's corners that is still interpolated
+    void setThreshold(float threshold);
+
+    //Render a full frame at the tracer's settings.width x settings.height. RenderStats::rays
+    //counts the rays actually traced.
+    RenderStats render(const TraceCamera& camera, Image& image, TaskScheduler& scheduler);
+
+    //Rays traced by the last render per image pixel
+    double getTracedFraction() const { return tracedFraction; }
+
+private:
+    bool needsSplit(int x0, int y0, int size, double pixelAngle) const;
+    const TraceResult& at(int x, int y) const { return results[(size_t)y * gridWidth + x]; }
+    bool isTraced(int x, int y) const { return traced[(size_t)y * gridWidth + x] != 0; }
+
+    const GeodesicTracer& tracer;
+    int spacing;
+    float threshold;
+    double tracedFraction;
+
+    //Lattice results, gridWidth x gridHeight: the image padded right and down to a whole
+    //number of coarse cells. Padding pixels are traced like any other.
+    int gridWidth;
+    int gridHeight;
+    std::vector<TraceResult> results;
+    std::vector<uint8_t> traced;
+};
@@ -0,0 +1,249 @@
+#include "StarCatalog.h"
+#include "MappedFile.h"
+#include "Philox.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char STAR_MAGIC[8] = {'B', 'H', 'S', 'T', 'A', 'R', 'S', '\0'};
+static constexpr uint32_t STAR_RANDOM_COMPONENT = 7;
+
+//Planck spectrum sampled at red, green and blue wavelengths, scaled to unit luminance
+static glm::vec3 starColor(double temperature) {
+    const double wavelengths[3] = {610e-9, 550e-9, 465e-9};
+    const double hcOverK = 1.4388e-2;   //Second radiation constant, m K
+    temperature = std::max(temperature, 1000.0);
+    glm::dvec3 rgb;
+    for (int i = 0; i < 3; ++i) {
+        const double l = wavelengths[i];
+        rgb[i] = 1.0 / (l * l * l * l * l * (exp(hcOverK / (l * temperature)) - 1.0));
+    }
+    return glm::vec3(rgb / glm::dot(rgb, glm::dvec3(0.2126, 0.7152, 0.0722)));
+}
+
+CatalogStar StarCatalog::decode(const StarRecord& record) {
+    CatalogStar star;
+    star.direction = glm::normalize(glm::vec3(record.direction[0], record.direction[1], record.direction[2]));
+    star.flux = starColor(record.temperature) * (float)pow(10.0, -0.4e-3 * record.magnitude);
+    return star;
+}
+
+void StarCatalog::buildGrid(int targetCells) {
+    const double pi = glm::pi<double>();
+    const double side = sqrt(4.0 * pi / targetCells);
+    const int bands = std::max(1, (int)lround(pi / side));
+
+    //Cells per band for near-square cells, then band heights so every cell has the same area
+    bandFirstCell.assign(bands + 1, 0);
+    for (int k = 0; k < bands; ++k) {
+        const double theta = (k + 0.5) * pi / bands;
+        bandFirstCell[k + 1] = bandFirstCell[k] + std::max(1, (int)lround(2.0 * pi * sin(theta) / side));
+    }
+    const double cellArea = 4.0 * pi / bandFirstCell[bands];
+    bandTop.assign(bands + 1, 1.0);
+    for (int k = 0; k < bands; ++k) {
+        bandTop[k + 1] = bandTop[k] - (bandFirstCell[k + 1] - bandFirstCell[k]) * cellArea / (2.0 * pi);
+    }
+    bandTop[bands] = -1.0;
+    cellAngle = sqrt(cellArea);
+}
+
+int StarCatalog::bandOf(double z) const {
+    //Band edges stay close to equal steps in theta, so the guess is at most a band or two out
+    const int bands = (int)bandTop.size() - 1;
+    int k = std::min((int)(acos(std::min(std::max(z, -1.0), 1.0)) / glm::pi<double>() * bands), bands - 1);
+    while (k > 0 && z > bandTop[k]) --k;
+    while (k < bands - 1 && z < bandTop[k + 1]) ++k;
+    return k;
+}
+
+int StarCatalog::cellOf(const glm::dvec3& direction) const {
+    const int band = bandOf(direction.z);
+    const int cells = bandFirstCell[band + 1] - bandFirstCell[band];
+    double phi = atan2(direction.y, direction.x);
+    if (phi < 0.0) phi += 2.0 * glm::pi<double>();
+    return bandFirstCell[band] + std::min((int)(phi / (2.0 * glm::pi<double>()) * cells), cells - 1);
+}
+
+bool StarCatalog::load(const std::string& path, std::string& error) {
+    MappedFile file;
+    if (!file.open(path, error)) {
+        return false;
+    }
+    StarFileHeader header;
+    if (file.size() < sizeof(header)) {
+        error = path + " is not a star catalog";
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, STAR_MAGIC, sizeof(STAR_MAGIC)) != 0) {
+        error = path + " is not a star catalog";
+        return false;
+    }
+    if (header.version != VERSION) {
+        error = path + ": unsupported catalog version " + std::to_string(header.version);
+        return false;
+    }
+    if (file.size() != sizeof(header) + (size_t)header.count * sizeof(StarRecord)) {
+        error = path + ": size does not match its star count";
+        return false;
+    }
+
+    //Decode straight from the mapping, then counting-sort into cell order
+    const size_t count = header.count;
+    std::vector<CatalogStar> decoded(count);
+    for (size_t i = 0; i < count; ++i) {
+        StarRecord record;
+        memcpy(&record, file.data() + sizeof(header) + i * sizeof(StarRecord), sizeof(record));
+        const float length2 = record.direction[0] * record.direction[0] + record.direction[1] * record.direction[1]
+                            + record.direction[2] * record.direction[2];
+        if (!(length2 > 0.0f) || !std::isfinite(length2)) {
+            error = path + ": star " + std::to_string(i) + " has no direction";
+            return false;
+        }
+        decoded[i] = decode(record);
+    }
+
+    buildGrid(std::max(1, (int)(count / STARS_PER_CELL)));
+    std::vector<int> cells(count);
+    cellStart.assign(bandFirstCell.back() + 2, 0);
+    for (size_t i = 0; i < count; ++i) {
+        cells[i] = cellOf(glm::dvec3(decoded[i].direction));
+        ++cellStart[cells[i] + 2];
+    }
+    for (size_t c = 2; c < cellStart.size(); ++c) {
+        cellStart[c] += cellStart[c - 1];
+    }
+    stars.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        stars[cellStart[cells[i] + 1]++] = decoded[i];
+    }
+    cellStart.pop_back();
+
+    //Fine enough that the switch from gathering stars lands a little above level 0
+    int faceSize = 1;
+    while (faceSize * cellAngle < 0.5 * glm::pi<double>()) {
+        faceSize *= 2;
+    }
+    bakeCubeMap(wideMap, faceSize);
+    return true;
+}
+
+bool StarCatalog::writeSynthetic(const std::string& path, int count, uint32_t seed, std::string& error) {
+    const double pi = glm::pi<double>();
+    //Galactic band tilted 60 degrees from the disk plane
+    const double tilt = glm::radians(60.0);
+
+    std::vector<StarRecord> records(count);
+    for (int i = 0; i < count; ++i) {
+        ParticleRandom random(seed, STAR_RANDOM_COMPONENT, (uint32_t)i);
+        glm::dvec3 direction;
+        if (random.uniform(0) < 0.6f) {
+            //Laplace-distributed latitude about the band
+            const double longitude = 2.0 * pi * random.uniform(1);
+            double latitude = -0.15 * log(1.0 - random.uniform(2));
+            if (random.uniform(3) < 0.5f) latitude = -latitude;
+            const glm::dvec3 band(cos(latitude) * cos(longitude), sin(latitude), cos(latitude) * sin(longitude));
+            direction = glm::dvec3(band.x, cos(tilt) * band.y - sin(tilt) * band.z,
+                                   sin(tilt) * band.y + cos(tilt) * band.z);
+        } else {
+            const double z = 2.0 * random.uniform(1) - 1.0;
+            const double phi = 2.0 * pi * random.uniform(2);
+            const double rho = sqrt(std::max(1.0 - z * z, 0.0));
+            direction = glm::dvec3(rho * cos(phi), rho * sin(phi), z);
+        }
+        //N(< m) grows as 10^(0.6 m) for stars spread evenly through space
+        const double magnitude = std::max(9.5 + log10(std::max((double)random.uniform(4), 1e-9)) / 0.6, -1.5);
+        const double u = random.uniform(5);
+        const double temperature = 3000.0 * pow(10.0, u * u);
+
+        StarRecord& record = records[i];
+        record.direction[0] = (float)direction.x;
+        record.direction[1] = (float)direction.y;
+        record.direction[2] = (float)direction.z;
+        record.magnitude = (int16_t)lround(magnitude * 1000.0);
+        record.temperature = (uint16_t)lround(temperature);
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    StarFileHeader header;
+    memcpy(header.magic, STAR_MAGIC, sizeof(STAR_MAGIC));
+    header.version = VERSION;
+    header.count = (uint32_t)count;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+           && fwrite(records.data(), sizeof(StarRecord), records.size(), file) == records.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        error = "error writing " + path;
+    }
+    return ok;
+}
+
+glm::vec3 StarCatalog::gatherStars(const glm::dvec3& direction, double reach, double sigma) const {
+    const double pi = glm::pi<double>();
+    const double theta = acos(std::min(std::max(direction.z, -1.0), 1.0));
+    double phi = atan2(direction.y, direction.x);
+    if (phi < 0.0) phi += 2.0 * pi;
+
+    const int firstBand = bandOf(cos(std::max(theta - reach, 0.0)));
+    const int lastBand = bandOf(cos(std::min(theta + reach, pi)));
+    //Widest longitude the cap spans; a cap over a pole spans all of them
+    const bool overPole = theta - reach <= 0.0 || theta + reach >= pi;
+    const double halfWidth = overPole ? pi : asin(std::min(sin(reach) / sin(theta), 1.0));
+
+    //Squared chords stand in for squared angles, which they match to second order
+    const glm::vec3 d(direction);
+    const float limit = (float)(2.0 - 2.0 * cos(reach));
+    const float falloff = (float)(-0.5 / (sigma * sigma));
+    glm::vec3 sum(0.0f);
+    for (int band = firstBand; band <= lastBand; ++band) {
+        const int cells = bandFirstCell[band + 1] - bandFirstCell[band];
+        int first = 0, last = cells - 1;
+        if (!overPole) {
+            first = (int)floor((phi - halfWidth) / (2.0 * pi) * cells);
+            last = (int)floor((phi + halfWidth) / (2.0 * pi) * cells);
+            if (last - first + 1 >= cells) {
+                first = 0;
+                last = cells - 1;
+            }
+        }
+        for (int j = first; j <= last; ++j) {
+            const int cell = bandFirstCell[band] + (j % cells + cells) % cells;
+            for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; ++i) {
+                const glm::vec3 offset = stars[i].direction - d;
+                const float chord2 = glm::dot(offset, offset);
+                if (chord2 < limit) {
+                    sum += stars[i].flux * std::exp(chord2 * falloff);
+                }
+            }
+        }
+    }
+    return sum * (float)(1.0 / (2.0 * pi * sigma * sigma));
+}
+
+glm::vec3 StarCatalog::radiance(const glm::dvec3& direction, double sigma) const {
+    if (stars.empty()) {
+        return glm::vec3(0.0f);
+    }
+    sigma = std::max(sigma, 1e-9);
+    //The Gaussian is cut at 3 sigma, where it has fallen to 1%
+    const double reach = 3.0 * sigma;
+    if (reach > 2.0 * cellAngle) {
+        return wideMap.sample(direction, log2(2.0 * sigma / wideMap.texelAngle(0)));
+    }
+    return gatherStars(direction, reach, sigma);
+}
+
+void StarCatalog::bakeCubeMap(SkyCubeMap& cubeMap, int faceSize) const {
+    cubeMap.resize(faceSize);
+    for (const CatalogStar& star : stars) {
+        cubeMap.addFlux(glm::dvec3(star.direction), star.flux);
+    }
+    cubeMap.buildMips();
+}
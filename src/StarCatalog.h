@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SkyCubeMap.h"
+
+//Start of a catalog file, followed by count StarRecords. Little-endian throughout.
+struct StarFileHeader {
+    char magic[8];          //"BHSTARS" and a NUL
+    uint32_t version;
+    uint32_t count;
+};
+
+//One star as stored in a catalog file
+struct StarRecord {
+    float direction[3];     //Unit vector in scene axes
+    int16_t magnitude;      //Apparent visual magnitude x 1000
+    uint16_t temperature;   //Effective temperature, kelvin
+};
+
+static_assert(sizeof(StarFileHeader) == 16, "StarFileHeader is part of the file format");
+static_assert(sizeof(StarRecord) == 16, "StarRecord is part of the file format");
+
+//A decoded star, as the index keeps it
+struct CatalogStar {
+    glm::vec3 direction;
+    glm::vec3 flux;         //Per channel; a magnitude 0 star has luminance 1
+};
+
+//Star field behind the black hole, for the sky escaped rays see.
+//
+//load() maps a catalog file and buckets the stars into an equal-area grid on the sphere:
+//latitude bands of near-square cells, with band edges placed so that every cell covers the
+//same solid angle and holds about STARS_PER_CELL stars on average. A direction finds its
+//cell in constant time, so gathering the stars near a ray only visits the few cells its
+//filter covers.
+//
+//radiance() smooths the stars with a Gaussian as wide as the ray's footprint. Where the lens
+//squeezes a large patch of sky into one pixel the filter averages many stars instead of
+//aliasing them, and once it spans more than a couple of cells the lookup switches to a
+//mipmapped cube map baked at load, so every query costs about the same.
+class StarCatalog {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr int STARS_PER_CELL = 8;
+
+    bool load(const std::string& path, std::string& error);
+    //Writes a made-up catalog: a galactic band over an isotropic background, magnitudes
+    //following Euclidean number counts down to about 9.5, and a spread of temperatures
+    static bool writeSynthetic(const std::string& path, int count, uint32_t seed, std::string& error);
+
+    //Gaussian-filtered radiance (flux per steradian) around a unit direction. sigma is the
+    //filter's standard deviation in radians.
+    glm::vec3 radiance(const glm::dvec3& direction, double sigma) const;
+
+    //Splats every star into a cube map of the given face size and builds its mip chain
+    void bakeCubeMap(SkyCubeMap& cubeMap, int faceSize) const;
+
+    size_t size() const { return stars.size(); }
+    //Stars in cell order
+    const std::vector<CatalogStar>& getStars() const { return stars; }
+    int cellCount() const { return bandFirstCell.empty() ? 0 : bandFirstCell.back(); }
+    //Side of a cell in radians
+    double getCellAngle() const { return cellAngle; }
+
+    static CatalogStar decode(const StarRecord& record);
+
+private:
+    void buildGrid(int targetCells);
+    int bandOf(double z) const;
+    int cellOf(const glm::dvec3& direction) const;
+    //Star sum over the cells touching a cap of the given angular radius
+    glm::vec3 gatherStars(const glm::dvec3& direction, double reach, double sigma) const;
+
+    double cellAngle = 0.0;
+    std::vector<double> bandTop;        //z of each band's upper edge, then -1
+    std::vector<int> bandFirstCell;     //First cell of each band, then the cell count
+    std::vector<uint32_t> cellStart;    //First star of each cell, then the star count
+    std::vector<CatalogStar> stars;
+    SkyCubeMap wideMap;                 //For filters too wide to gather star by star
+};
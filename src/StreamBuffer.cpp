@@ -0,0 +1,118 @@
+#include "StreamBuffer.h"
+#include "Profiler.h"
+#include <chrono>
+
+//Upper bound on a single glClientWaitSync; longer stalls loop so they still get counted
+static constexpr GLuint64 FENCE_TIMEOUT_NS = 1000000;
+
+StreamBuffer::StreamBuffer()
+    : buffer(0), frameBytes(0), persistent(false), mapped(nullptr), segment(0) {
+    for (int i = 0; i < SEGMENTS; ++i) {
+        fences[i] = 0;
+    }
+}
+
+StreamBuffer::~StreamBuffer() {
+    cleanup();
+}
+
+void StreamBuffer::create(size_t bytes, bool allowPersistent) {
+    cleanup();
+    frameBytes = bytes;
+    persistent = allowPersistent && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+    segment = 0;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (persistent) {
+        //Immutable storage for all segments, mapped once for the buffer's lifetime. Coherent
+        //mapping makes writes visible to the GPU without explicit flushes.
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, SEGMENTS * frameBytes, nullptr, flags);
+        mapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, SEGMENTS * frameBytes, flags));
+        if (mapped == nullptr) {
+            //Driver advertised the extension but refused the mapping, use orphaning instead
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            persistent = false;
+        }
+    }
+    if (!persistent) {
+        glBufferData(GL_ARRAY_BUFFER, frameBytes, nullptr, GL_STREAM_DRAW);
+    }
+}
+
+void StreamBuffer::cleanup() {
+    for (int i = 0; i < SEGMENTS; ++i) {
+        if (fences[i] != 0) {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+    if (buffer != 0) {
+        if (mapped != nullptr) {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+}
+
+void StreamBuffer::waitForSegment(int index) {
+    if (fences[index] == 0) {
+        return;
+    }
+
+    //Poll first: in the steady state the GPU finished this segment two frames ago
+    GLenum status = glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        PROFILE_SCOPE("fence wait");
+        auto start = std::chrono::steady_clock::now();
+        do {
+            status = glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        } while (status == GL_TIMEOUT_EXPIRED);
+        stats.fenceWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.fenceWaits++;
+    }
+
+    glDeleteSync(fences[index]);
+    fences[index] = 0;
+}
+
+void* StreamBuffer::beginWrite() {
+    if (persistent) {
+        segment = (segment + 1) % SEGMENTS;
+        waitForSegment(segment);
+        return mapped + (size_t)segment * frameBytes;
+    }
+
+    //Orphan the old storage so the driver can hand out fresh memory while draws still read the old
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, frameBytes, nullptr, GL_STREAM_DRAW);
+    mapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, frameBytes,
+                                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    return mapped;
+}
+
+void StreamBuffer::endWrite() {
+    if (!persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        mapped = nullptr;
+    }
+    stats.bytesUploaded += frameBytes;
+}
+
+void StreamBuffer::endFrame() {
+    if (persistent) {
+        //A later fence covers every earlier draw, so only the newest one per segment is kept
+        if (fences[segment] != 0) {
+            glDeleteSync(fences[segment]);
+        }
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    stats.frames++;
+}
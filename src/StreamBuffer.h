@@ -0,0 +1,59 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+
+struct StreamStats {
+    uint64_t frames = 0;
+    uint64_t bytesUploaded = 0;
+    uint64_t fenceWaits = 0;        //Frames that found their segment still in use by the GPU
+    double fenceWaitSeconds = 0.0;
+};
+
+//Per-frame vertex data upload without reallocating or stalling on the driver.
+//
+//With GL_ARB_buffer_storage (core in 4.4, exposed by Mesa llvmpipe) the buffer holds
+//SEGMENTS copies of a frame and stays persistently and coherently mapped. Each frame
+//writes the next segment while the GPU may still be drawing the previous ones, and a
+//fence per segment guards against overwriting one the GPU has not finished with. On
+//plain GL 3.3 it falls back to orphaning: glBufferData(NULL) then an invalidating map.
+class StreamBuffer {
+public:
+    static constexpr int SEGMENTS = 3;
+
+    StreamBuffer();
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    //Creates the buffer for frames of frameBytes; allowPersistent = false forces orphaning
+    void create(size_t frameBytes, bool allowPersistent = true);
+    void cleanup();
+
+    //Returns where to write this frame's frameBytes, waiting first if the GPU still reads it
+    void* beginWrite();
+    //Finishes the write started by beginWrite
+    void endWrite();
+    //Call after the draws that read this frame's data have been issued
+    void endFrame();
+
+    GLuint getBuffer() const { return buffer; }
+    bool isPersistent() const { return persistent; }
+    //Byte offset of the segment written last, for the draw's base vertex
+    size_t drawOffset() const { return persistent ? (size_t)segment * frameBytes : 0; }
+
+    const StreamStats& getStats() const { return stats; }
+
+private:
+    void waitForSegment(int index);
+
+    GLuint buffer;
+    size_t frameBytes;
+    bool persistent;
+    unsigned char* mapped;          //Whole persistent mapping, or this frame's orphaned mapping
+    int segment;                    //Segment being written or drawn this frame
+    GLsync fences[SEGMENTS];
+    StreamStats stats;
+};
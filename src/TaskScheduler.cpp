@@ -0,0 +1,126 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+
+TaskScheduler::TaskScheduler(unsigned threadCount)
+    : job(nullptr), generation(0), busyWorkers(0), stopping(false), remaining(0), steals(0) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    //Worker 0 is whichever thread calls parallelFor
+    for (unsigned i = 1; i < threadCount; ++i) {
+        workers.emplace_back(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobStart.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void TaskScheduler::parallelFor(size_t count, const std::function<void(size_t, unsigned)>& fn) {
+    if (count == 0) {
+        return;
+    }
+
+    steals = 0;
+
+    //Deal contiguous blocks so neighbouring tiles start on the same worker
+    const size_t workerCount = queues.size();
+    const size_t blockSize = (count + workerCount - 1) / workerCount;
+    for (size_t w = 0; w < workerCount; ++w) {
+        std::lock_guard<std::mutex> lock(queues[w]->mutex);
+        size_t begin = w * blockSize;
+        size_t end = std::min(count, begin + blockSize);
+        for (size_t i = begin; i < end; ++i) {
+            queues[w]->items.push_back(i);
+        }
+    }
+    remaining = count;
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        job = &fn;
+        busyWorkers = (unsigned)workers.size();
+        ++generation;
+    }
+    jobStart.notify_all();
+
+    drain(0);
+
+    //Wait for helpers to leave the job so fn can go out of scope safely
+    std::unique_lock<std::mutex> lock(jobMutex);
+    jobDone.wait(lock, [this] { return busyWorkers == 0; });
+    job = nullptr;
+}
+
+void TaskScheduler::workerLoop(unsigned worker) {
+    unsigned long long seenGeneration = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobStart.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) {
+                return;
+            }
+            seenGeneration = generation;
+        }
+
+        drain(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            --busyWorkers;
+        }
+        jobDone.notify_all();
+    }
+}
+
+void TaskScheduler::drain(unsigned worker) {
+    size_t item;
+    while (remaining.load() > 0) {
+        if (popLocal(worker, item) || steal(worker, item)) {
+            (*job)(item, worker);
+            --remaining;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool TaskScheduler::popLocal(unsigned worker, size_t& item) {
+    WorkQueue& queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.items.empty()) {
+        return false;
+    }
+    item = queue.items.front();
+    queue.items.pop_front();
+    return true;
+}
+
+bool TaskScheduler::steal(unsigned worker, size_t& item) {
+    //Take from the far end of a victim's block to keep its remaining work contiguous
+    const unsigned workerCount = (unsigned)queues.size();
+    for (unsigned offset = 1; offset < workerCount; ++offset) {
+        WorkQueue& victim = *queues[(worker + offset) % workerCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty()) {
+            item = victim.items.back();
+            victim.items.pop_back();
+            ++steals;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Persistent thread pool with per-worker queues and work stealing.
+//Items are dealt out in contiguous blocks; a worker that drains its own queue
+//steals from the back of the first non-empty queue after its own, in worker order,
+//so a few very expensive items (rays grazing the photon sphere) do not leave the
+//other cores idle.
+class TaskScheduler {
+public:
+    //threadCount == 0 uses every hardware thread
+    explicit TaskScheduler(unsigned threadCount = 0);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    //Runs fn(item, worker) for every item in [0, count) and blocks until all have finished.
+    //The calling thread takes part as worker 0.
+    void parallelFor(size_t count, const std::function<void(size_t, unsigned)>& fn);
+
+    unsigned threadCount() const { return (unsigned)queues.size(); }
+
+    //Number of items taken from another worker's queue during the last parallelFor
+    size_t lastStealCount() const { return steals.load(); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    void workerLoop(unsigned worker);
+    void drain(unsigned worker);
+    bool popLocal(unsigned worker, size_t& item);
+    bool steal(unsigned worker, size_t& item);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    //Job hand-off between parallelFor and the workers
+    std::mutex jobMutex;
+    std::condition_variable jobStart;
+    std::condition_variable jobDone;
+    const std::function<void(size_t, unsigned)>* job;
+    unsigned long long generation;
+    unsigned busyWorkers;
+    bool stopping;
+
+    std::atomic<size_t> remaining;
+    std::atomic<size_t> steals;
+};
@@ -0,0 +1,1765 @@
+//Microbenchmarks for the CPU hot paths: disk generation, grid construction and geodesic stepping.
+//No window and no GL. Results go to stdout as a table, CSV or JSON.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "DepthSorter.h"
+#include "DiskGenerator.h"
+#include "DiskVolume.h"
+#include "GeodesicTracer.h"
+#include "Image.h"
+#include "ObjectBVH.h"
+#include "PackedParticle.h"
+#include "ParticleChunks.h"
+#include "ParticleSnapshot.h"
+#include "ParticleStore.h"
+#include "ProgressiveRenderer.h"
+#include "ResolutionController.h"
+#include "SkyCubeMap.h"
+#include "SpacetimeGrid.h"
+#include "SparseRenderer.h"
+#include "StarCatalog.h"
+#include "TaskScheduler.h"
+
+struct BenchOptions {
+    int warmup = 2;
+    int reps = 10;
+    unsigned threads = 0;
+    bool quick = false;
+    std::string format = "text";
+    std::string output;
+    std::string filter;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string size;           //Problem size label, e.g. particle count or resolution
+    std::string unit;           //What one item is: particle, vertex, step, ray
+    uint64_t items = 0;         //Items processed per repetition
+    uint64_t bytesPerItem = 0;  //Memory footprint of one item where that is what is compared, else 0
+    int reps = 0;
+    double minSeconds = 0.0;
+    double medianSeconds = 0.0;
+    double meanSeconds = 0.0;
+
+    double nsPerItem() const { return items > 0 ? medianSeconds * 1e9 / items : 0.0; }
+    double itemsPerSecond() const { return medianSeconds > 0.0 ? items / medianSeconds : 0.0; }
+};
+
+//Keeps results observable so the optimiser cannot drop the timed work
+static volatile double benchSink = 0.0;
+
+static void printUsage() {
+    std::cout << "Usage: bench [options]\n"
+              << "  --reps N          timed repetitions per benchmark (default 10)\n"
+              << "  --warmup N        untimed repetitions first (default 2)\n"
+              << "  --threads N       render worker threads, 0 = all cores (default 0)\n"
+              << "  --filter TEXT     only run benchmarks whose name contains TEXT\n"
+              << "  --quick           smallest sizes only, for a fast smoke run\n"
+              << "  --format NAME     text, csv or json (default text)\n"
+              << "  --output FILE     write results to FILE instead of stdout\n";
+}
+
+//Runs setup then body warmup + reps times, timing only body
+static BenchResult measure(const BenchOptions& options, const std::string& name, const std::string& size,
+                           const std::string& unit, uint64_t items,
+                           const std::function<void()>& setup, const std::function<void()>& body) {
+    std::vector<double> times;
+    for (int i = 0; i < options.warmup + options.reps; ++i) {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        body();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (i >= options.warmup) {
+            times.push_back(seconds);
+        }
+    }
+    std::sort(times.begin(), times.end());
+
+    BenchResult result;
+    result.name = name;
+    result.size = size;
+    result.unit = unit;
+    result.items = items;
+    result.reps = (int)times.size();
+    result.minSeconds = times.front();
+    result.medianSeconds = times[times.size() / 2];
+    double total = 0.0;
+    for (double t : times) total += t;
+    result.meanSeconds = total / times.size();
+    return result;
+}
+
+static bool selected(const BenchOptions& options, const std::string& name) {
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+static void benchDisk(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                      bool& checksPassed) {
+    std::vector<double> scales = {1.0, 8.0, 64.0};
+    if (options.quick) scales.resize(1);
+
+    typedef void (DiskGenerator::*Phase)(float, TaskScheduler*);
+    struct PhaseInfo { const char* name; Phase phase; };
+    const PhaseInfo phases[] = {
+        {"disk/main", &DiskGenerator::generateMainDisk},
+        {"disk/spiral_arms", &DiskGenerator::generateSpiralArms},
+        {"disk/jets", &DiskGenerator::generateJets},
+        {"disk/torus", &DiskGenerator::generateTorus},
+    };
+
+    for (double scale : scales) {
+        DiskGenerator generator(DiskLayout::scaled(scale));
+        const DiskLayout& layout = generator.getLayout();
+        const std::string size = std::to_string(layout.totalParticles());
+
+        if (selected(options, "disk/initialize")) {
+            results.push_back(measure(options, "disk/initialize", size, "particle", layout.totalParticles(),
+                [] {},
+                [&] { generator.generate(1.0f); benchSink = benchSink + generator.getVertices().back(); }));
+        }
+
+        if (selected(options, "disk/parallel_initialize")) {
+            results.push_back(measure(options, "disk/parallel_initialize", size, "particle", layout.totalParticles(),
+                [] {},
+                [&] { generator.generate(1.0f, &scheduler); benchSink = benchSink + generator.getVertices().back(); }));
+
+            //Counter-based random numbers: the parallel result must match the serial one bit for bit
+            DiskGenerator serial(layout);
+            serial.generate(1.0f);
+            if (serial.getVertices() != generator.getVertices()) {
+                std::cerr << "disk/parallel_initialize: output differs from the serial generator" << std::endl;
+                checksPassed = false;
+            }
+        }
+
+        const uint64_t phaseItems[] = {
+            (uint64_t)layout.diskParticles,
+            (uint64_t)layout.spiralArms * layout.armParticles,
+            2ull * layout.jetParticles,
+            (uint64_t)layout.torusParticles,
+        };
+        for (int p = 0; p < 4; ++p) {
+            if (!selected(options, phases[p].name)) continue;
+            const Phase phase = phases[p].phase;
+            results.push_back(measure(options, phases[p].name, size, "particle", phaseItems[p],
+                [] {},
+                [&] { (generator.*phase)(1.0f, nullptr); benchSink = benchSink + generator.getVertices().back(); }));
+        }
+    }
+}
+
+static void benchAdvect(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                        bool& checksPassed) {
+    std::vector<double> scales = {1.0, 64.0};
+    if (options.quick) scales.resize(1);
+    const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2};
+
+    for (double scale : scales) {
+        DiskGenerator generator(DiskLayout::scaled(scale));
+        generator.generate(1.0f, &scheduler);
+        ParticleStore initial;
+        initial.loadInterleaved(generator.getVertices());
+        const size_t count = initial.size();
+        const std::string size = std::to_string(count);
+
+        AdvectParams params;
+        params.dt = 1.0f / 60.0f;
+        params.inflow = 0.01f;
+
+        //Equivalence: every SIMD level rounds as the scalar kernel does, so it must track it bit for
+        //bit over many frames; any difference would grow through the respawn branch
+        const int checkSteps = 600;
+        ParticleStore reference = initial;
+        for (int step = 0; step < checkSteps; ++step) {
+            reference.advect(params, 0, count, nullptr, SimdLevel::Scalar);
+        }
+
+        for (SimdLevel level : levels) {
+            const std::string name = std::string("advect/") + ParticleStore::simdLevelName(level);
+            if (!selected(options, name)) continue;
+            if (!ParticleStore::isSupported(level)) {
+                std::cerr << name << ": not supported on this CPU, skipped" << std::endl;
+                continue;
+            }
+
+            ParticleStore store = initial;
+            for (int step = 0; step < checkSteps; ++step) {
+                store.advect(params, 0, count, nullptr, level);
+            }
+            float maxError = 0.0f;
+            for (size_t i = 0; i < count; ++i) {
+                const float scaleX = std::max(1.0f, std::fabs(reference.x[i]));
+                const float scaleZ = std::max(1.0f, std::fabs(reference.z[i]));
+                maxError = std::max(maxError, std::fabs(store.x[i] - reference.x[i]) / scaleX);
+                maxError = std::max(maxError, std::fabs(store.z[i] - reference.z[i]) / scaleZ);
+            }
+            if (maxError > 0.0f) {
+                std::cerr << name << ": differs from the scalar kernel by " << maxError
+                          << " after " << checkSteps << " steps" << std::endl;
+                checksPassed = false;
+            }
+
+            results.push_back(measure(options, name, size, "particle", count, [] {},
+                [&] { store.advect(params, 0, count, nullptr, level); benchSink = benchSink + store.x[0]; }));
+        }
+
+        const std::string name = "advect/parallel";
+        if (selected(options, name)) {
+            ParticleStore store = initial;
+            results.push_back(measure(options, name, size, "particle", count, [] {},
+                [&] { store.advect(params, 0, count, &scheduler); benchSink = benchSink + store.x[0]; }));
+        }
+    }
+}
+
+static void benchUpload(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                        bool& checksPassed) {
+    std::vector<double> scales = {1.0, 64.0};
+    if (options.quick) scales.resize(1);
+
+    for (double scale : scales) {
+        DiskGenerator generator(DiskLayout::scaled(scale));
+        generator.generate(1.0f, &scheduler);
+        ParticleStore store;
+        store.loadInterleaved(generator.getVertices());
+        const size_t count = store.size();
+        const std::string size = std::to_string(count);
+        const float velocityScale = 1.7f;
+
+        std::vector<float> interleaved(count * DiskGenerator::FLOATS_PER_PARTICLE);
+        std::vector<PackedParticle> packed(count);
+        store.interleave(interleaved.data(), 0, count, velocityScale);
+        store.pack(packed.data(), 0, count, velocityScale, nullptr, SimdLevel::Scalar);
+
+        //Tolerance: decoded values must be within the rounding of each packed field
+        float worst[4] = {0.0f, 0.0f, 0.0f, 0.0f};     //position, velocity, temperature, density
+        for (size_t i = 0; i < count; ++i) {
+            const float* reference = &interleaved[i * DiskGenerator::FLOATS_PER_PARTICLE];
+            float decoded[DiskGenerator::FLOATS_PER_PARTICLE];
+            packed[i].decode(decoded);
+
+            const float speed = std::sqrt(reference[3] * reference[3] + reference[4] * reference[4] +
+                                          reference[5] * reference[5]);
+            for (int c = 0; c < 3; ++c) {
+                //Half float: relative 2^-11, plus the subnormal spacing near zero
+                const float error = std::fabs(decoded[c] - reference[c]) / (std::fabs(reference[c]) * 4.9e-4f + 6e-8f);
+                worst[0] = std::max(worst[0], error);
+                //Half-float speed plus snorm16 octahedral direction
+                const float velocityError = std::fabs(decoded[3 + c] - reference[3 + c]) / (speed * 1e-3f + 1e-6f);
+                worst[1] = std::max(worst[1], velocityError);
+            }
+            worst[2] = std::max(worst[2], std::fabs(decoded[6] - reference[6]) /
+                                          (PackedParticle::TEMPERATURE_RANGE / 510.0f + 1e-6f));
+            worst[3] = std::max(worst[3], std::fabs(decoded[7] - reference[7]) /
+                                          (PackedParticle::DENSITY_RANGE / 510.0f + 1e-6f));
+        }
+        const char* fields[4] = {"position", "velocity", "temperature", "density"};
+        for (int f = 0; f < 4; ++f) {
+            if (worst[f] > 1.0f) {
+                std::cerr << "upload/packed16: decoded " << fields[f] << " error is " << worst[f]
+                          << "x its tolerance" << std::endl;
+                checksPassed = false;
+            }
+        }
+
+        //What a frame's upload writes: the old layout also drew through a 4-byte index per particle
+        if (selected(options, "upload/float32")) {
+            BenchResult result = measure(options, "upload/float32", size, "particle", count, [] {},
+                [&] { store.interleave(interleaved.data(), 0, count, velocityScale); benchSink = benchSink + interleaved[0]; });
+            result.bytesPerItem = DiskGenerator::FLOATS_PER_PARTICLE * sizeof(float) + sizeof(unsigned int);
+            results.push_back(result);
+        }
+        const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::AVX2};
+        for (SimdLevel level : levels) {
+            const std::string name = std::string("upload/packed16/") + ParticleStore::simdLevelName(level);
+            if (!selected(options, name)) continue;
+            if (!ParticleStore::isSupported(level)) {
+                std::cerr << name << ": not supported on this CPU, skipped" << std::endl;
+                continue;
+            }
+
+            std::vector<PackedParticle> simd(count);
+            store.pack(simd.data(), 0, count, velocityScale, nullptr, level);
+            if (std::memcmp(simd.data(), packed.data(), count * sizeof(PackedParticle)) != 0) {
+                std::cerr << name << ": bytes differ from the scalar encoder" << std::endl;
+                checksPassed = false;
+            }
+
+            BenchResult result = measure(options, name, size, "particle", count, [] {},
+                [&] { store.pack(simd.data(), 0, count, velocityScale, nullptr, level); benchSink = benchSink + simd[0].speed; });
+            result.bytesPerItem = sizeof(PackedParticle);
+            results.push_back(result);
+        }
+        if (selected(options, "upload/packed16/parallel")) {
+            BenchResult result = measure(options, "upload/packed16/parallel", size, "particle", count, [] {},
+                [&] { store.pack(packed.data(), 0, count, velocityScale, &scheduler); benchSink = benchSink + packed[0].speed; });
+            result.bytesPerItem = sizeof(PackedParticle);
+            results.push_back(result);
+        }
+    }
+}
+
+//Camera for the sort benchmarks, orbiting the disk in its unit-mass coordinates
+static void sortCamera(double yawDegrees, glm::vec3& eye, glm::vec3& viewDir, double radius = 20.0) {
+    const double yaw = yawDegrees * 3.14159265358979 / 180.0;
+    const double pitch = 15.0 * 3.14159265358979 / 180.0;
+    eye = glm::vec3(radius * std::cos(pitch) * std::cos(yaw), radius * std::sin(pitch),
+                    radius * std::cos(pitch) * std::sin(yaw));
+    viewDir = -glm::normalize(eye);
+}
+
+//Order must be a permutation of the particles in ranges (all of them without) whose depths fall
+//back to front, within one key step, or within one top-digit bucket when the sort started from
+//the previous order
+static bool sortedBackToFront(const DepthSorter& sorter, const ParticleStore& store, const glm::vec3& eye,
+                              const glm::vec3& viewDir,
+                              const std::vector<ParticleRange>& ranges = std::vector<ParticleRange>()) {
+    const std::vector<uint32_t>& order = sorter.getOrder();
+    const std::vector<uint16_t>& keys = sorter.getKeys();
+    const size_t particles = store.size();
+    std::vector<char> wanted(particles, ranges.empty() ? 1 : 0);
+    size_t count = ranges.empty() ? particles : 0;
+    for (const ParticleRange& range : ranges) {
+        std::fill(wanted.begin() + range.first, wanted.begin() + range.first + range.count, 1);
+        count += range.count;
+    }
+    if (order.size() != count || keys.size() != count) return false;
+
+    std::vector<char> seen(particles, 0);
+    std::vector<float> depths(particles);
+    float nearest = 1e30f, farthest = -1e30f;
+    for (size_t i = 0; i < particles; ++i) {
+        if (!wanted[i]) continue;
+        const glm::vec3 p(store.x[i], store.y[i], store.z[i]);
+        depths[i] = glm::dot(p - eye, viewDir);
+        nearest = std::min(nearest, depths[i]);
+        farthest = std::max(farthest, depths[i]);
+    }
+    const int maxKey = (1 << DepthSorter::KEY_BITS) - 1;
+    const int tolerance = sorter.reusedOrder() ? (1 << (DepthSorter::KEY_BITS - DepthSorter::DIGIT_BITS)) - 1 : 0;
+    const float slack = (farthest - nearest) / maxKey * (tolerance + 1) * 1.01f + 1e-5f;
+    int highestKey = 0;
+    float deepest = 1e30f;
+    for (size_t i = 0; i < count; ++i) {
+        if (order[i] >= particles || !wanted[order[i]] || seen[order[i]]) return false;
+        seen[order[i]] = 1;
+        if (keys[i] < highestKey - tolerance || depths[order[i]] > deepest + slack) return false;
+        highestKey = std::max(highestKey, (int)keys[i]);
+        deepest = std::min(deepest, depths[order[i]]);
+    }
+    return true;
+}
+
+static void benchSort(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                      bool& checksPassed) {
+    std::vector<double> scales = {1.0, 64.0, 640.0};
+    if (options.quick) scales.resize(1);
+    const double yawPerFrame = 0.05;    //3 degrees a second at 60 Hz
+
+    for (double scale : scales) {
+        DiskGenerator generator(DiskLayout::scaled(scale));
+        generator.generate(1.0f, &scheduler);
+        ParticleStore initial;
+        initial.loadInterleaved(generator.getVertices());
+        const size_t count = initial.size();
+        const std::string size = std::to_string(count);
+
+        AdvectParams params;
+        params.dt = 1.0f / 60.0f;
+        params.inflow = 0.01f;
+
+        //Every SIMD level gives the scalar level's order
+        glm::vec3 eye, viewDir;
+        sortCamera(30.0, eye, viewDir);
+        DepthSorter reference;
+        reference.sort(initial, eye, viewDir, nullptr, SimdLevel::Scalar);
+        if (!sortedBackToFront(reference, initial, eye, viewDir)) {
+            std::cerr << "sort: scalar order is not back to front" << std::endl;
+            checksPassed = false;
+        }
+        const SimdLevel levels[] = {SimdLevel::SSE, SimdLevel::AVX2};
+        for (SimdLevel level : levels) {
+            if (!ParticleStore::isSupported(level)) continue;
+            DepthSorter sorter;
+            sorter.sort(initial, eye, viewDir, &scheduler, level);
+            if (sorter.getOrder() != reference.getOrder()) {
+                std::cerr << "sort/" << ParticleStore::simdLevelName(level) << ": order differs from the scalar level"
+                          << std::endl;
+                checksPassed = false;
+            }
+        }
+
+        //One frame later the sort starts from the previous order; a quarter turn later it is a full sort
+        {
+            ParticleStore store = initial;
+            store.advect(params, 0, count, &scheduler);
+            DepthSorter sorter = reference;
+            sortCamera(30.0 + yawPerFrame, eye, viewDir);
+            sorter.sort(store, eye, viewDir, &scheduler);
+            const bool reused = sorter.reusedOrder() && sortedBackToFront(sorter, store, eye, viewDir);
+            sortCamera(120.0, eye, viewDir);
+            sorter.sort(store, eye, viewDir, &scheduler);
+            const bool sorted = !sorter.reusedOrder() && sortedBackToFront(sorter, store, eye, viewDir);
+            if (!reused || !sorted) {
+                std::cerr << "sort/reuse: " << (reused ? "a quarter turn was not sorted from scratch"
+                                                       : "one frame did not start from the previous order")
+                          << std::endl;
+                checksPassed = false;
+            }
+        }
+
+        //Frames of a slowly orbiting camera over a moving disk; the setup advances both untimed
+        for (int reuse = 0; reuse < 2; ++reuse) {
+            const std::string name = reuse ? "sort/reuse" : "sort/radix";
+            if (!selected(options, name)) continue;
+            ParticleStore store = initial;
+            DepthSorter sorter;
+            sorter.setTemporalReuse(reuse != 0);
+            double yaw = 30.0;
+            int reusedFrames = 0, frames = 0;
+            sortCamera(yaw, eye, viewDir);
+            sorter.sort(store, eye, viewDir, &scheduler);
+            results.push_back(measure(options, name, size, "particle", count,
+                [&] {
+                    store.advect(params, 0, count, &scheduler);
+                    yaw += yawPerFrame;
+                    sortCamera(yaw, eye, viewDir);
+                },
+                [&] {
+                    sorter.sort(store, eye, viewDir, &scheduler);
+                    reusedFrames += sorter.reusedOrder() ? 1 : 0;
+                    frames++;
+                    benchSink = benchSink + sorter.getOrder()[0];
+                }));
+            if (reuse) {
+                std::cerr << name << ": " << reusedFrames << " of " << frames << " frames started from the previous order"
+                          << std::endl;
+            }
+        }
+    }
+}
+
+//Chunk camera for a sort camera looking at the black hole, at unit mass
+static ChunkCamera chunkCamera(const glm::vec3& eye, float lodDistance) {
+    ChunkCamera camera;
+    camera.clipFromUnit = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) *
+                          glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    camera.eye = eye;
+    camera.lodDistance = lodDistance;
+    return camera;
+}
+
+//Chunks must tile each component of the layout, hold ascending importances and contain their particles
+static bool chunksCoverLayout(const ParticleChunks& chunks, const ParticleStore& store, const DiskLayout& layout) {
+    const uint32_t jetBegin = (uint32_t)layout.jetOffset();
+    const uint32_t jetEnd = jetBegin + 2 * (uint32_t)layout.jetParticles;
+    uint32_t next = 0;
+    for (const ParticleChunk& chunk : chunks.getChunks()) {
+        const uint32_t last = chunk.first + chunk.count;
+        if (chunk.first != next || chunk.count == 0 || last > store.size()) return false;
+        if ((chunk.first < jetBegin && last > jetBegin) || (chunk.first < jetEnd && last > jetEnd)) return false;
+        for (uint32_t i = chunk.first; i < last; ++i) {
+            if (i > chunk.first && store.importance[i] < store.importance[i - 1]) return false;
+            const glm::vec3 p(store.x[i], store.y[i], store.z[i]);
+            if (glm::any(glm::lessThan(p, chunk.low)) || glm::any(glm::greaterThan(p, chunk.high))) return false;
+        }
+        next = last;
+    }
+    return next == store.size();
+}
+
+//Every particle inside the frustum, not hidden by the horizon and drawn at its distance must be
+//selected; counts those particles into drawn
+static bool selectedEveryVisible(const ParticleStore& store, const ChunkCamera& camera,
+                                 const std::vector<ParticleRange>& ranges, size_t& drawn) {
+    std::vector<char> kept(store.size(), 0);
+    for (const ParticleRange& range : ranges) {
+        std::fill(kept.begin() + range.first, kept.begin() + range.first + range.count, 1);
+    }
+    const float horizon = ParticleChunks::HORIZON_RADIUS;
+    bool everyVisible = true;
+    drawn = 0;
+    for (size_t i = 0; i < store.size(); ++i) {
+        const glm::vec3 p(store.x[i], store.y[i], store.z[i]);
+        const glm::vec4 clip = camera.clipFromUnit * glm::vec4(p, 1.0f);
+        if (std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w || std::fabs(clip.z) > clip.w) continue;
+        const float distance = glm::length(p - camera.eye);
+        if (store.importance[i] >= ParticleChunks::lodFraction(distance, camera.lodDistance) * 256.0f) continue;
+        //Hidden if the segment from the eye enters the horizon sphere before reaching p
+        const glm::vec3 dir = (p - camera.eye) / distance;
+        const float b = glm::dot(camera.eye, dir);
+        const float c = glm::dot(camera.eye, camera.eye) - horizon * horizon;
+        const float enter = -b - std::sqrt(std::max(b * b - c, 0.0f));
+        if (b * b - c > 0.0f && enter > 0.0f && enter < distance) continue;
+        drawn++;
+        everyVisible = everyVisible && kept[i];
+    }
+    return everyVisible;
+}
+
+static void benchChunks(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                        bool& checksPassed) {
+    std::vector<double> scales = {1.0, 64.0, 640.0};
+    if (options.quick) scales.resize(1);
+
+    AdvectParams params;
+    params.dt = 1.0f / 60.0f;
+    params.inflow = 0.01f;
+
+    for (double scale : scales) {
+        const DiskLayout layout = DiskLayout::scaled(scale);
+        DiskGenerator generator(layout);
+        generator.generate(1.0f, &scheduler);
+        ParticleStore initial;
+        initial.loadInterleaved(generator.getVertices());
+        const size_t count = initial.size();
+        const std::string size = std::to_string(count);
+        const float lodDistance = ParticleChunks::lodDistanceFor(count);
+
+        ParticleStore store = initial;
+        ParticleChunks chunks;
+        chunks.build(store, layout, &scheduler);
+        if (!chunksCoverLayout(chunks, store, layout)) {
+            std::cerr << "chunks/build: chunks do not tile the layout" << std::endl;
+            checksPassed = false;
+        }
+
+        //From afar, up close and level with the disk; the sort over the ranges must order exactly them
+        const double cameras[][2] = {{30.0, 20.0}, {200.0, 3.0}};
+        for (const auto& placement : cameras) {
+            glm::vec3 eye, viewDir;
+            sortCamera(placement[0], eye, viewDir, placement[1]);
+            const ChunkCamera camera = chunkCamera(eye, lodDistance);
+            std::vector<ParticleRange> ranges;
+            const size_t visible = chunks.select(store, camera, ranges);
+            const ChunkStats& stats = chunks.getStats();
+            size_t drawn = 0;
+            if (!selectedEveryVisible(store, camera, ranges, drawn)) {
+                std::cerr << "chunks/select: a visible particle was culled" << std::endl;
+                checksPassed = false;
+            }
+            std::cerr << "chunks/select at " << placement[1] << ": " << visible << " of " << count << " particles in "
+                      << ranges.size() << " ranges for " << drawn << " drawn, " << stats.outsideFrustum << " of "
+                      << stats.chunks << " chunks outside the frustum, " << stats.behindHorizon
+                      << " behind the horizon" << std::endl;
+            DepthSorter sorter;
+            sorter.sort(store, ranges, eye, viewDir, &scheduler);
+            if (!sortedBackToFront(sorter, store, eye, viewDir, ranges)) {
+                std::cerr << "chunks/sort: visible particles are not back to front" << std::endl;
+                checksPassed = false;
+            }
+            //Chunks keep at most a few times what the shader draws; from afar that is a small part of a large disk
+            const bool far = placement[1] > 10.0;
+            if (visible > 3 * drawn + ParticleChunks::SECTORS || (far && scale >= 64.0 && visible > count / 4)) {
+                std::cerr << "chunks/select: kept " << visible << " particles for " << drawn << " drawn" << std::endl;
+                checksPassed = false;
+            }
+        }
+
+        //Ten seconds of motion: rebuilds stay occasional and leave the chunks tiling the layout
+        if (scale == 1.0) {
+            const int frames = 600;
+            for (int frame = 0; frame < frames; ++frame) {
+                store.advect(params, 0, layout.jetOffset(), &scheduler);
+                if (chunks.updateBounds(store, &scheduler)) {
+                    chunks.rebuild(store, &scheduler);
+                }
+            }
+            std::cerr << "chunks/bounds: " << chunks.getRebuilds() << " rebuilds in " << frames << " frames" << std::endl;
+            if (chunks.getRebuilds() > frames / 10 || !chunksCoverLayout(chunks, store, layout)) {
+                std::cerr << "chunks/bounds: " << (chunks.getRebuilds() > frames / 10 ? "rebuilt too often"
+                                                                                      : "chunks no longer tile the layout")
+                          << std::endl;
+                checksPassed = false;
+            }
+        }
+
+        if (selected(options, "chunks/build")) {
+            ParticleStore scratch;
+            ParticleChunks built;
+            results.push_back(measure(options, "chunks/build", size, "particle", count,
+                [&] { scratch = initial; },
+                [&] { built.build(scratch, layout, &scheduler); }));
+        }
+        if (selected(options, "chunks/rebuild")) {
+            ParticleStore scratch;
+            ParticleChunks rebuilt = chunks;
+            results.push_back(measure(options, "chunks/rebuild", size, "particle", count,
+                [&] { scratch = store; },
+                [&] { rebuilt.rebuild(scratch, &scheduler); }));
+        }
+        if (selected(options, "chunks/bounds")) {
+            results.push_back(measure(options, "chunks/bounds", size, "particle", count,
+                [&] { store.advect(params, 0, layout.jetOffset(), &scheduler); },
+                [&] { benchSink = benchSink + (chunks.updateBounds(store, &scheduler) ? 1.0 : 0.0); }));
+        }
+
+        //Select and sort the visible particles for an orbiting camera, against sorting all of them
+        glm::vec3 eye, viewDir;
+        double yaw = 30.0;
+        std::vector<ParticleRange> ranges;
+        size_t visible = 0;
+        if (selected(options, "chunks/select")) {
+            results.push_back(measure(options, "chunks/select", size, "chunk", chunks.getChunks().size(),
+                [&] {
+                    yaw += 0.05;
+                    sortCamera(yaw, eye, viewDir);
+                },
+                [&] { visible = chunks.select(store, chunkCamera(eye, lodDistance), ranges); }));
+        }
+        if (selected(options, "chunks/sort")) {
+            DepthSorter sorter;
+            results.push_back(measure(options, "chunks/sort", size, "particle", count,
+                [&] {
+                    yaw += 0.05;
+                    sortCamera(yaw, eye, viewDir);
+                    visible = chunks.select(store, chunkCamera(eye, lodDistance), ranges);
+                },
+                [&] {
+                    sorter.sort(store, ranges, eye, viewDir, &scheduler);
+                    benchSink = benchSink + (double)sorter.getOrder().size();
+                }));
+            std::cerr << "chunks/sort: " << visible << " visible particles sorted per frame" << std::endl;
+        }
+    }
+}
+
+//Arrays, importance and chunk tables of a snapshot frame must match the store and chunks written
+static bool snapshotMatches(const ParticleSnapshot& snapshot, size_t frame, const ParticleStore& store,
+                            const ParticleChunks& chunks) {
+    const AlignedFloats* arrays[ParticleSnapshot::ARRAYS] = {&store.x, &store.y, &store.z, &store.vx, &store.vy,
+                                                             &store.vz, &store.temperature, &store.density};
+    const size_t count = store.size();
+    if (snapshot.getParticleCount() != count) return false;
+    for (int a = 0; a < ParticleSnapshot::ARRAYS; ++a) {
+        if (memcmp(snapshot.array(frame, (SnapshotArray)a), arrays[a]->data(), count * sizeof(float)) != 0) return false;
+    }
+    if (memcmp(snapshot.importance(frame), store.importance.data(), count) != 0) return false;
+    const std::vector<ParticleChunk> saved = snapshot.chunks(frame);
+    const std::vector<ParticleChunk>& live = chunks.getChunks();
+    if (saved.size() != live.size() || snapshot.frame(frame).builtRadius != chunks.getBuiltRadius()) return false;
+    for (size_t i = 0; i < saved.size(); ++i) {
+        if (saved[i].first != live[i].first || saved[i].count != live[i].count || saved[i].low != live[i].low ||
+            saved[i].high != live[i].high) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void benchSnapshot(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                          bool& checksPassed) {
+    std::vector<double> scales = {1.0, 64.0, 640.0};
+    if (options.quick) scales.resize(1);
+    const std::string path = "bench_snapshot.bin";
+
+    AdvectParams params;
+    params.dt = 1.0f / 60.0f;
+    params.inflow = 0.01f;
+
+    for (double scale : scales) {
+        const DiskLayout layout = DiskLayout::scaled(scale);
+        DiskGenerator generator(layout);
+        generator.generate(1.0f, &scheduler);
+        ParticleStore store;
+        store.loadInterleaved(generator.getVertices());
+        ParticleChunks chunks;
+        chunks.build(store, layout, &scheduler);
+        const size_t count = store.size();
+        const std::string size = std::to_string(count);
+        const uint64_t frameBytes = ParticleSnapshot::frameBytesFor(count, ParticleChunks::MAX_CHUNKS);
+
+        //Two frames, the second after some motion; both must come back bit for bit
+        SnapshotWriter writer;
+        ParticleStore first;
+        ParticleChunks firstChunks;
+        std::string error;
+        bool written = writer.open(path, layout, generator.getSeed(), 1.0f, count, error) &&
+                       writer.append(store, chunks, 0.0, 1.0f, error);
+        if (written) {
+            first = store;
+            firstChunks = chunks;
+            for (int frame = 0; frame < 60; ++frame) {
+                store.advect(params, 0, layout.jetOffset(), &scheduler);
+                if (chunks.updateBounds(store, &scheduler)) {
+                    chunks.rebuild(store, &scheduler);
+                }
+            }
+            written = writer.append(store, chunks, 1.0, 1.5f, error) && writer.close(error);
+        }
+        ParticleSnapshot snapshot;
+        if (!written || !snapshot.open(path, error)) {
+            std::cerr << "snapshot " << count << ": " << error << std::endl;
+            checksPassed = false;
+            std::remove(path.c_str());
+            return;
+        }
+        const DiskLayout saved = snapshot.getLayout();
+        if (snapshot.getFrameCount() != 2 || saved.diskParticles != layout.diskParticles ||
+            saved.spiralArms != layout.spiralArms || saved.armParticles != layout.armParticles ||
+            saved.jetParticles != layout.jetParticles || saved.torusParticles != layout.torusParticles ||
+            snapshot.getSeed() != generator.getSeed() || snapshot.frame(1).time != 1.0 ||
+            snapshot.frame(1).blackHoleMass != 1.5f) {
+            std::cerr << "snapshot/open " << count << ": header or frame records differ from what was written"
+                      << std::endl;
+            checksPassed = false;
+        }
+        if (!snapshotMatches(snapshot, 0, first, firstChunks) || !snapshotMatches(snapshot, 1, store, chunks)) {
+            std::cerr << "snapshot/read " << count << ": frames differ from what was written" << std::endl;
+            checksPassed = false;
+        }
+        //Every array starts on a cache line, so the mapped arrays can be handed on as they are
+        for (int a = 0; a < ParticleSnapshot::ARRAYS; ++a) {
+            if ((uintptr_t)snapshot.array(1, (SnapshotArray)a) % ParticleSnapshot::ALIGNMENT != 0) {
+                std::cerr << "snapshot/open " << count << ": array " << a << " is not aligned" << std::endl;
+                checksPassed = false;
+            }
+        }
+
+        //A restored store carries on from where the recording stopped
+        ParticleStore restored;
+        snapshot.read(1, restored, &scheduler);
+        ParticleChunks restoredChunks;
+        restoredChunks.restore(layout, snapshot.chunks(1), snapshot.frame(1).builtRadius);
+        if (!chunksCoverLayout(restoredChunks, restored, layout)) {
+            std::cerr << "snapshot/read " << count << ": restored chunks do not tile the layout" << std::endl;
+            checksPassed = false;
+        }
+
+        //Voxelising the mapped arrays bins the same particles as the generator's vertices
+        if (scale == 1.0) {
+            DiskVolume fromGenerator, fromSnapshot;
+            fromGenerator.build(generator.getVertices());
+            ParticleArrays arrays;
+            arrays.x = snapshot.array(0, SnapshotArray::X);
+            arrays.y = snapshot.array(0, SnapshotArray::Y);
+            arrays.z = snapshot.array(0, SnapshotArray::Z);
+            arrays.temperature = snapshot.array(0, SnapshotArray::Temperature);
+            arrays.density = snapshot.array(0, SnapshotArray::Density);
+            arrays.count = snapshot.getParticleCount();
+            fromSnapshot.build(arrays);
+            if (fromSnapshot.getStoredBricks() != fromGenerator.getStoredBricks() ||
+                fromSnapshot.getOuterRadius() != fromGenerator.getOuterRadius()) {
+                std::cerr << "snapshot/volume: mapped arrays voxelise differently" << std::endl;
+                checksPassed = false;
+            }
+        }
+
+        snapshot.close();
+
+        //A recording cut off mid-frame opens without the partial frame
+        if (scale == 1.0) {
+            std::filesystem::resize_file(path, std::filesystem::file_size(path) - frameBytes / 2);
+            if (!snapshot.open(path, error) || snapshot.getFrameCount() != 1 ||
+                !snapshotMatches(snapshot, 0, first, firstChunks)) {
+                std::cerr << "snapshot/open: a truncated recording should keep its first frame" << std::endl;
+                checksPassed = false;
+            }
+            snapshot.close();
+
+            //Anything but a snapshot is refused, as is a store that does not match the layout
+            FILE* file = fopen(path.c_str(), "r+b");
+            if (file) {
+                fputs("NOTASNAP", file);
+                fclose(file);
+            }
+            SnapshotWriter mismatched;
+            const bool refused = !snapshot.open(path, error) &&
+                                 !mismatched.open(path, layout, generator.getSeed(), 1.0f, count + 1, error);
+            if (!refused || (mismatched.open(path, DiskLayout::scaled(2.0), 0, 1.0f,
+                                             (size_t)DiskLayout::scaled(2.0).totalParticles(), error) &&
+                             mismatched.append(store, chunks, 0.0, 1.0f, error))) {
+                std::cerr << "snapshot/open: a bad magic or a mismatched layout was accepted" << std::endl;
+                checksPassed = false;
+            }
+            mismatched.close(error);
+        }
+
+        //The checks above spoil the file; the timed loads read one frame of the moved particles
+        if (!writer.open(path, layout, generator.getSeed(), 1.0f, count, error) ||
+            !writer.append(store, chunks, 1.0, 1.0f, error) || !writer.close(error)) {
+            std::cerr << "snapshot " << count << ": " << error << std::endl;
+            checksPassed = false;
+            std::remove(path.c_str());
+            return;
+        }
+
+        if (selected(options, "snapshot/write")) {
+            results.push_back(measure(options, "snapshot/write", size, "particle", count, [] {},
+                [&] {
+                    SnapshotWriter timed;
+                    std::string timedError;
+                    if (!timed.open(path, layout, generator.getSeed(), 1.0f, count, timedError) ||
+                        !timed.append(store, chunks, 0.0, 1.0f, timedError) || !timed.close(timedError)) {
+                        benchSink = benchSink + 1.0;
+                    }
+                }));
+        }
+        if (selected(options, "snapshot/open")) {
+            results.push_back(measure(options, "snapshot/open", size, "particle", count, [] {},
+                [&] {
+                    ParticleSnapshot timed;
+                    std::string timedError;
+                    timed.open(path, timedError);
+                    benchSink = benchSink + (double)timed.getFrameCount();
+                }));
+        }
+        //Startup from a file against generating the disk and sorting it into chunks
+        if (selected(options, "snapshot/load")) {
+            ParticleStore loaded;
+            ParticleChunks loadedChunks;
+            results.push_back(measure(options, "snapshot/load", size, "particle", count,
+                [&] { loaded = ParticleStore(); },
+                [&] {
+                    ParticleSnapshot timed;
+                    std::string timedError;
+                    if (timed.open(path, timedError) && timed.getFrameCount() > 0) {
+                        const size_t last = timed.getFrameCount() - 1;
+                        timed.read(last, loaded, &scheduler);
+                        loadedChunks.restore(timed.getLayout(), timed.chunks(last), timed.frame(last).builtRadius);
+                    }
+                    benchSink = benchSink + loaded.x[0];
+                }));
+        }
+        if (selected(options, "snapshot/generate")) {
+            ParticleStore generated;
+            ParticleChunks generatedChunks;
+            results.push_back(measure(options, "snapshot/generate", size, "particle", count,
+                [&] { generated = ParticleStore(); },
+                [&] {
+                    DiskGenerator timed(layout);
+                    timed.generate(1.0f, &scheduler);
+                    generated.loadInterleaved(timed.getVertices());
+                    generatedChunks.build(generated, layout, &scheduler);
+                    benchSink = benchSink + generated.x[0];
+                }));
+        }
+
+        std::remove(path.c_str());
+    }
+}
+
+static void benchGrid(const BenchOptions& options, std::vector<BenchResult>& results, bool& checksPassed) {
+    if (!selected(options, "grid/build")) return;
+    //Segments per cell edge; the mesh is built once at startup and displaced on the GPU
+    std::vector<int> subdivisions = {1, 4, 10};
+    if (options.quick) subdivisions.resize(1);
+
+    for (int n : subdivisions) {
+        SpacetimeGrid grid(0.05f, 4, n);
+        const size_t vertices = grid.getPositions().size();
+        results.push_back(measure(options, "grid/build", std::to_string(n) + " per edge", "vertex", vertices, [] {},
+            [&] { SpacetimeGrid rebuilt(0.05f, 4, n); benchSink = benchSink + rebuilt.getPositions().back().x; }));
+
+        //Rings must meet on shared vertices, so no segment may be emitted twice
+        const std::vector<unsigned int>& indices = grid.getIndices();
+        std::vector<uint64_t> segments;
+        for (size_t i = 0; i + 1 < indices.size(); i += 2) {
+            const uint64_t a = std::min(indices[i], indices[i + 1]), b = std::max(indices[i], indices[i + 1]);
+            segments.push_back(a << 32 | b);
+        }
+        std::sort(segments.begin(), segments.end());
+        const bool duplicated = std::adjacent_find(segments.begin(), segments.end()) != segments.end();
+        if (duplicated) {
+            std::cerr << "grid/build " << n << ": a segment is emitted twice" << std::endl;
+            checksPassed = false;
+        }
+    }
+}
+
+static void benchSteps(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const int steps = options.quick ? 20000 : 200000;
+    const int restartEvery = 1000;   //Start over before the ray wanders far from the hole
+    const double rs = SAGA_RS;
+    const glm::dvec3 pos(0.0, 0.0, -10.0 * rs);
+    const glm::dvec3 dir = glm::normalize(glm::dvec3(0.3, 0.05, 1.0));
+    const TraceSettings defaults;
+    const std::string size = std::to_string(steps);
+
+    if (selected(options, "step/euler")) {
+        results.push_back(measure(options, "step/euler", size, "step", steps, [] {}, [&] {
+            Ray ray = initRay(pos, dir, rs);
+            for (int i = 0; i < steps; ++i) {
+                if (i % restartEvery == 0) ray = initRay(pos, dir, rs);
+                eulerStep(ray, D_LAMBDA, rs);
+            }
+            benchSink = benchSink + ray.r;
+        }));
+    }
+
+    if (selected(options, "step/dormand_prince")) {
+        results.push_back(measure(options, "step/dormand_prince", size, "step", steps, [] {}, [&] {
+            Ray ray = initRay(pos, dir, rs);
+            double h = D_LAMBDA;
+            for (int i = 0; i < steps; ++i) {
+                if (i % restartEvery == 0) { ray = initRay(pos, dir, rs); h = D_LAMBDA; }
+                h = std::min(h, defaults.maxStepFraction * ray.r);
+                dormandPrinceStep(ray, h, rs, defaults.relTolerance, defaults.absTolerance);
+            }
+            benchSink = benchSink + ray.r;
+        }));
+    }
+
+    if (selected(options, "step/binet")) {
+        results.push_back(measure(options, "step/binet", size, "step", steps, [] {}, [&] {
+            const glm::dvec2 start(0.1, 0.2);
+            glm::dvec2 state = start;
+            double h = 0.01;
+            for (int i = 0; i < steps; ++i) {
+                if (i % restartEvery == 0) { state = start; h = 0.01; }
+                h = std::min(h, defaults.maxStepFraction);
+                binetStep(state, h, defaults.relTolerance, defaults.absTolerance);
+            }
+            benchSink = benchSink + state.x;
+        }));
+    }
+}
+
+struct KernelInfo {
+    const char* name;
+    TraceKernel kernel;
+    Integrator integrator;
+};
+
+static const KernelInfo KERNELS[] = {
+    {"fixed", TraceKernel::Spherical, Integrator::FixedEuler},
+    {"adaptive", TraceKernel::Spherical, Integrator::DormandPrince},
+    {"planar", TraceKernel::Planar, Integrator::DormandPrince},
+    {"lookup", TraceKernel::Lookup, Integrator::DormandPrince},
+};
+
+static TraceCamera benchCamera(int width, int height) {
+    return TraceCamera::orbit(6.34194e10, -90.0, 5.0, 60.0, (double)width / height);
+}
+
+static void benchRays(const BenchOptions& options, std::vector<BenchResult>& results) {
+    //A fixed set of camera rays across the frame, traced one after another
+    const int gridSide = options.quick ? 8 : 16;
+    const int rays = gridSide * gridSide;
+
+    for (const KernelInfo& info : KERNELS) {
+        const std::string name = std::string("ray/") + info.name;
+        if (!selected(options, name)) continue;
+
+        TraceSettings settings;
+        settings.kernel = info.kernel;
+        settings.integrator = info.integrator;
+        GeodesicTracer tracer;
+        tracer.setSettings(settings);
+        if (info.kernel == TraceKernel::Lookup) tracer.getDeflectionTable();
+        const TraceCamera camera = benchCamera(settings.width, settings.height);
+
+        //Count steps once so the result can be reported per step as well as per ray
+        uint64_t steps = 0;
+        for (int i = 0; i < rays; ++i) {
+            steps += tracer.tracePixel(camera, (i % gridSide + 0.5) * settings.width / gridSide,
+                                       (i / gridSide + 0.5) * settings.height / gridSide).steps;
+        }
+
+        auto traceAll = [&] {
+            double sum = 0.0;
+            for (int i = 0; i < rays; ++i) {
+                sum += tracer.tracePixel(camera, (i % gridSide + 0.5) * settings.width / gridSide,
+                                         (i / gridSide + 0.5) * settings.height / gridSide).color.g;
+            }
+            benchSink = benchSink + sum;
+        };
+        BenchResult perRay = measure(options, name, std::to_string(rays), "ray", rays, [] {}, traceAll);
+        results.push_back(perRay);
+
+        //Same timings, reported against the number of integration steps
+        BenchResult perStep = perRay;
+        perStep.name = name + "/per_step";
+        perStep.size = std::to_string(steps);
+        perStep.unit = "step";
+        perStep.items = steps;
+        results.push_back(perStep);
+    }
+}
+
+static void benchRender(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results) {
+    struct Resolution { int width, height; };
+    std::vector<Resolution> resolutions = {{160, 120}, {320, 240}, {640, 480}};
+    if (options.quick) resolutions.resize(1);
+
+    for (const KernelInfo& info : KERNELS) {
+        const std::string name = std::string("render/") + info.name;
+        if (!selected(options, name)) continue;
+
+        //The fixed-step loop is thousands of steps per ray; one small frame is enough to track it
+        std::vector<Resolution> sizes = resolutions;
+        BenchOptions frameOptions = options;
+        if (info.integrator == Integrator::FixedEuler) {
+            sizes = {{80, 60}};
+            frameOptions.warmup = 0;
+            frameOptions.reps = std::min(options.reps, 2);
+        }
+
+        for (const Resolution& resolution : sizes) {
+            TraceSettings settings;
+            settings.width = resolution.width;
+            settings.height = resolution.height;
+            settings.kernel = info.kernel;
+            settings.integrator = info.integrator;
+            GeodesicTracer tracer;
+            tracer.setSettings(settings);
+            const TraceCamera camera = benchCamera(settings.width, settings.height);
+            Image image;
+
+            results.push_back(measure(frameOptions, name,
+                std::to_string(resolution.width) + "x" + std::to_string(resolution.height), "ray",
+                (uint64_t)resolution.width * resolution.height,
+                [] {},
+                [&] { tracer.render(camera, image, scheduler); benchSink = benchSink + image.at(0, 0).r; }));
+        }
+    }
+}
+
+static void benchCulling(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                         bool& checksPassed) {
+    //The fixed-step loop is left out: unculled, its background rays run all 60000 steps
+    struct View { const char* name; double radius; double fov; };
+    const View views[] = {{"near", 6.34194e10, 60.0}, {"far", 3e11, 90.0}};
+    const int width = options.quick ? 80 : 160;
+    const int height = options.quick ? 60 : 120;
+
+    for (const KernelInfo& info : KERNELS) {
+        if (info.integrator == Integrator::FixedEuler || info.kernel == TraceKernel::Lookup) continue;
+        for (const View& view : views) {
+            const std::string name = std::string("cull/") + info.name + "/" + view.name;
+            if (!selected(options, name)) continue;
+
+            const TraceCamera camera = TraceCamera::orbit(view.radius, -90.0, 5.0, view.fov, (double)width / height);
+            RenderStats stats[2];
+            for (int culling = 0; culling < 2; ++culling) {
+                TraceSettings settings;
+                settings.width = width;
+                settings.height = height;
+                settings.kernel = info.kernel;
+                settings.integrator = info.integrator;
+                settings.analyticCulling = culling == 1;
+                GeodesicTracer tracer;
+                tracer.setSettings(settings);
+                Image image;
+                stats[culling] = tracer.render(camera, image, scheduler);
+
+                results.push_back(measure(options, name + (culling ? "/on" : "/off"),
+                    std::to_string(width) + "x" + std::to_string(height), "ray", (uint64_t)width * height,
+                    [] {},
+                    [&] { tracer.render(camera, image, scheduler); benchSink = benchSink + image.at(0, 0).r; }));
+            }
+
+            //Culling only retires rays whose outcome is already decided, so every ray must end the same way
+            for (int i = 0; i < 4; ++i) {
+                if (stats[0].hits[i] != stats[1].hits[i]) {
+                    std::cerr << name << ": culling changed the hit counts" << std::endl;
+                    checksPassed = false;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+//Random spheres in a thick shell around the hole, where bodies in the scene usually sit
+static std::vector<BoundingSphere> benchSpheres(int count, std::mt19937& rng) {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<BoundingSphere> spheres(count);
+    for (BoundingSphere& sphere : spheres) {
+        const double angle = unit(rng) * 6.283185307179586;
+        const double radius = 1.2e11 + unit(rng) * 1e11;
+        sphere.center = glm::dvec3(radius * cos(angle), (unit(rng) - 0.5) * 4e10, radius * sin(angle));
+        sphere.radius = 1e9 + unit(rng) * 2e9;
+    }
+    return spheres;
+}
+
+static void benchObjects(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                         bool& checksPassed) {
+    std::vector<int> counts = {16, 256, 4096, 16384};
+    if (options.quick) counts.resize(2);
+    const int segments = 1024;
+    const int width = options.quick ? 80 : 160;
+    const int height = options.quick ? 60 : 120;
+
+    for (int count : counts) {
+        std::mt19937 rng(42);
+        const std::vector<BoundingSphere> spheres = benchSpheres(count, rng);
+        ObjectBVH bvh;
+        bvh.build(spheres);
+
+        //Segments about one integration step long, scattered through the shell
+        std::uniform_real_distribution<double> unit(-1.0, 1.0);
+        std::vector<glm::dvec3> starts(segments), ends(segments);
+        for (int i = 0; i < segments; ++i) {
+            starts[i] = glm::dvec3(unit(rng) * 2.2e11, unit(rng) * 2e10, unit(rng) * 2.2e11);
+            ends[i] = starts[i] + glm::normalize(glm::dvec3(unit(rng), unit(rng), unit(rng))) * 2e10;
+        }
+
+        auto linear = [&](int i, double& t) {
+            int index = -1;
+            t = 1.0;
+            for (int j = 0; j < count; ++j) {
+                double tSphere;
+                if (ObjectBVH::segmentSphere(starts[i], ends[i] - starts[i], spheres[j].center, spheres[j].radius,
+                                             tSphere) && tSphere <= t) {
+                    t = tSphere;
+                    index = j;
+                }
+            }
+            return index;
+        };
+
+        //The tree must find the same first hit as testing every sphere
+        for (int i = 0; i < segments; ++i) {
+            double tLinear, tTree = 1.0;
+            int treeIndex = -1;
+            const int linearIndex = linear(i, tLinear);
+            bvh.intersectSegment(starts[i], ends[i], tTree, treeIndex);
+            if (treeIndex != linearIndex && (treeIndex < 0 || linearIndex < 0 || tTree != tLinear)) {
+                std::cerr << "objects/bvh " << count << ": segment " << i << " hit " << treeIndex
+                          << ", every sphere gives " << linearIndex << std::endl;
+                checksPassed = false;
+                break;
+            }
+        }
+
+        const std::string size = std::to_string(count);
+        if (selected(options, "objects/build")) {
+            results.push_back(measure(options, "objects/build", size, "object", (uint64_t)count, [] {},
+                [&] { bvh.build(spheres); benchSink = benchSink + (double)bvh.nodeCount(); }));
+        }
+        if (selected(options, "objects/bvh")) {
+            results.push_back(measure(options, "objects/bvh", size, "segment", segments, [] {}, [&] {
+                int hits = 0;
+                for (int i = 0; i < segments; ++i) {
+                    double t;
+                    int index;
+                    hits += bvh.intersectSegment(starts[i], ends[i], t, index) ? 1 : 0;
+                }
+                benchSink = benchSink + hits;
+            }));
+        }
+        if (selected(options, "objects/linear")) {
+            results.push_back(measure(options, "objects/linear", size, "segment", segments, [] {}, [&] {
+                int hits = 0;
+                for (int i = 0; i < segments; ++i) {
+                    double t;
+                    hits += linear(i, t) >= 0 ? 1 : 0;
+                }
+                benchSink = benchSink + hits;
+            }));
+        }
+
+        //Whole frames, so the per-ray cost as the scene grows includes everything else a ray does
+        if (selected(options, "objects/render")) {
+            TraceScene scene;
+            for (const BoundingSphere& sphere : spheres) {
+                scene.objects.push_back({sphere.center, sphere.radius, glm::vec4(1.0f, 1.0f, 0.0f, 1.0f), 0.0});
+            }
+            TraceSettings settings;
+            settings.width = width;
+            settings.height = height;
+            settings.kernel = TraceKernel::Planar;
+            GeodesicTracer tracer;
+            tracer.setScene(scene);
+            tracer.setSettings(settings);
+            const TraceCamera camera = benchCamera(width, height);
+            Image image;
+            results.push_back(measure(options, "objects/render", size, "ray", (uint64_t)width * height, [] {},
+                [&] { tracer.render(camera, image, scheduler); benchSink = benchSink + image.at(0, 0).r; }));
+        }
+    }
+}
+
+static void benchStars(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                       bool& checksPassed) {
+    std::vector<int> counts = {10000, 100000, 1000000};
+    if (options.quick) counts.resize(1);
+    const int lookups = 4096;
+    const int width = options.quick ? 80 : 160;
+    const int height = options.quick ? 60 : 120;
+    const std::string path = "bench_stars.bin";
+
+    for (int count : counts) {
+        std::string error;
+        StarCatalog catalog;
+        if (!StarCatalog::writeSynthetic(path, count, 1, error) || !catalog.load(path, error)) {
+            std::cerr << "stars " << count << ": " << error << std::endl;
+            checksPassed = false;
+            std::remove(path.c_str());
+            return;
+        }
+
+        std::mt19937 rng(42);
+        std::normal_distribution<double> normal;
+        std::vector<glm::dvec3> directions(lookups);
+        for (glm::dvec3& direction : directions) {
+            direction = glm::normalize(glm::dvec3(normal(rng), normal(rng), normal(rng)));
+        }
+        //Narrow filters gather from the grid, wide ones read the cube map
+        const double narrow = 0.5 * catalog.getCellAngle();
+        const double wide = 4.0 * catalog.getCellAngle();
+
+        //The grid must find every star a scan of the whole catalog finds
+        const std::vector<CatalogStar>& stars = catalog.getStars();
+        for (int i = 0; i < 64; ++i) {
+            const glm::vec3 d(directions[i]);
+            const float limit = (float)(2.0 - 2.0 * cos(3.0 * narrow));
+            glm::dvec3 expected(0.0);
+            for (const CatalogStar& star : stars) {
+                const glm::vec3 offset = star.direction - d;
+                const float chord2 = glm::dot(offset, offset);
+                if (chord2 < limit) {
+                    expected += glm::dvec3(star.flux) * exp(-0.5 * chord2 / (narrow * narrow));
+                }
+            }
+            expected /= 2.0 * 3.141592653589793 * narrow * narrow;
+            const glm::dvec3 found(catalog.radiance(directions[i], narrow));
+            if (glm::length(found - expected) > 1e-4 * glm::length(expected) + 1e-6) {
+                std::cerr << "stars/lookup " << count << ": direction " << i << " gathers " << found.g
+                          << ", every star gives " << expected.g << std::endl;
+                checksPassed = false;
+                break;
+            }
+        }
+
+        //Mip levels average radiance by solid angle, so every level carries the catalog's flux
+        SkyCubeMap cubeMap;
+        const int faceSize = options.quick ? 128 : 512;
+        catalog.bakeCubeMap(cubeMap, faceSize);
+        glm::dvec3 catalogFlux(0.0);
+        for (const CatalogStar& star : stars) {
+            catalogFlux += glm::dvec3(star.flux);
+        }
+        for (int l = 0; l < cubeMap.levelCount(); l += cubeMap.levelCount() - 1) {
+            const int size = faceSize >> l;
+            glm::dvec3 flux(0.0);
+            for (int face = 0; face < 6; ++face) {
+                const std::vector<glm::vec3>& texels = cubeMap.level(face, l);
+                for (int t = 0; t < size; ++t) {
+                    for (int s = 0; s < size; ++s) {
+                        flux += glm::dvec3(texels[(size_t)t * size + s]) * cubeMap.texelSolidAngle(l, s, t);
+                    }
+                }
+            }
+            if (glm::length(flux - catalogFlux) > 1e-4 * glm::length(catalogFlux)) {
+                std::cerr << "stars/bake " << count << ": level " << l << " holds flux " << flux.g
+                          << " of " << catalogFlux.g << std::endl;
+                checksPassed = false;
+            }
+        }
+
+        const std::string size = std::to_string(count);
+        if (selected(options, "stars/load")) {
+            results.push_back(measure(options, "stars/load", size, "star", (uint64_t)count, [] {}, [&] {
+                StarCatalog loaded;
+                loaded.load(path, error);
+                benchSink = benchSink + (double)loaded.size();
+            }));
+        }
+        if (selected(options, "stars/bake")) {
+            results.push_back(measure(options, "stars/bake", size, "star", (uint64_t)count, [] {},
+                [&] { catalog.bakeCubeMap(cubeMap, faceSize); benchSink = benchSink + cubeMap.level(0, 0)[0].g; }));
+        }
+        const struct { const char* name; double sigma; } filters[] = {{"stars/narrow", narrow}, {"stars/wide", wide}};
+        for (const auto& filter : filters) {
+            if (!selected(options, filter.name)) continue;
+            results.push_back(measure(options, filter.name, size, "lookup", lookups, [] {}, [&] {
+                float sum = 0.0f;
+                for (const glm::dvec3& direction : directions) {
+                    sum += catalog.radiance(direction, filter.sigma).g;
+                }
+                benchSink = benchSink + sum;
+            }));
+        }
+
+        //Whole frames against the same view with a black sky
+        if (selected(options, "stars/render")) {
+            const TraceCamera camera = TraceCamera::orbit(3e11, -90.0, 80.0, 60.0, (double)width / height);
+            TraceSettings settings;
+            settings.width = width;
+            settings.height = height;
+            settings.kernel = TraceKernel::Planar;
+            for (int withStars = 0; withStars < 2; ++withStars) {
+                TraceScene scene;
+                scene.stars = withStars ? &catalog : nullptr;
+                GeodesicTracer tracer;
+                tracer.setScene(scene);
+                tracer.setSettings(settings);
+                Image image;
+                results.push_back(measure(options, withStars ? "stars/render/on" : "stars/render/off", size, "ray",
+                    (uint64_t)width * height, [] {},
+                    [&] { tracer.render(camera, image, scheduler); benchSink = benchSink + image.at(0, 0).r; }));
+            }
+        }
+    }
+    std::remove(path.c_str());
+
+    //A culled ray's direction at infinity comes from the analytic deflection integral, an
+    //unculled one from integrating out to ESCAPE_R; both must point at the same stars
+    if (selected(options, "stars/render")) {
+        const TraceCamera camera = TraceCamera::orbit(3e11, -90.0, 80.0, 60.0, (double)width / height);
+        GeodesicTracer tracers[2];
+        for (int culling = 0; culling < 2; ++culling) {
+            TraceSettings settings;
+            settings.width = width;
+            settings.height = height;
+            settings.kernel = TraceKernel::Planar;
+            settings.analyticCulling = culling == 1;
+            tracers[culling].setSettings(settings);
+        }
+        double worst = 0.0;
+        for (int y = 0; y < height; y += 4) {
+            for (int x = 0; x < width; x += 4) {
+                const TraceResult off = tracers[0].tracePixel(camera, x + 0.5, y + 0.5);
+                const TraceResult on = tracers[1].tracePixel(camera, x + 0.5, y + 0.5);
+                if (off.hit != HitType::None || on.hit != HitType::None) continue;
+                worst = std::max(worst, glm::length(on.escape - off.escape));
+            }
+        }
+        if (worst > 1e-5) {
+            std::cerr << "stars/render: culled escape directions are up to " << worst << " rad out" << std::endl;
+            checksPassed = false;
+        }
+    }
+}
+
+static void benchPrecision(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                           bool& checksPassed) {
+    struct PrecisionInfo { const char* name; Precision precision; };
+    const PrecisionInfo precisions[] = {
+        {"double", Precision::Double}, {"float", Precision::Float}, {"simd8", Precision::Simd8}};
+    struct Resolution { int width, height; };
+    std::vector<Resolution> resolutions = {{160, 120}, {320, 240}, {640, 480}};
+    if (options.quick) resolutions.resize(1);
+
+    for (const Resolution& resolution : resolutions) {
+        const TraceCamera camera = benchCamera(resolution.width, resolution.height);
+        const double pixelAngle = 2.0 * camera.tanHalfFov / resolution.height;
+        std::vector<TraceResult> reference;
+        for (const PrecisionInfo& info : precisions) {
+            const std::string name = std::string("precision/planar/") + info.name;
+            if (!selected(options, name)) continue;
+
+            TraceSettings settings;
+            settings.width = resolution.width;
+            settings.height = resolution.height;
+            settings.kernel = TraceKernel::Planar;
+            settings.precision = info.precision;
+            GeodesicTracer tracer;
+            tracer.setSettings(settings);
+            Image image;
+            results.push_back(measure(options, name,
+                std::to_string(resolution.width) + "x" + std::to_string(resolution.height), "ray",
+                (uint64_t)resolution.width * resolution.height,
+                [] {},
+                [&] { tracer.render(camera, image, scheduler); benchSink = benchSink + image.at(0, 0).r; }));
+
+            //Every pixel once more for the error report, in the packets render uses
+            std::vector<TraceResult> frame((size_t)resolution.width * resolution.height);
+            std::vector<glm::dvec2> pixels(resolution.width);
+            for (int y = 0; y < resolution.height; ++y) {
+                for (int x = 0; x < resolution.width; ++x) {
+                    pixels[x] = glm::dvec2(x + 0.5, y + 0.5);
+                }
+                tracer.tracePixels(camera, pixels.data(), resolution.width, &frame[(size_t)y * resolution.width]);
+            }
+            if (info.precision == Precision::Double) {
+                reference = frame;
+                continue;
+            }
+            if (reference.empty()) continue;
+
+            //Single precision may move a ray across a disk edge or the shadow's rim, and rays winding
+            //close to the photon sphere amplify any rounding, but only a handful may change: every other
+            //escaped ray must land well within its pixel's sky footprint of the double result
+            size_t changed = 0, escaped = 0, displaced = 0;
+            double maxError = 0.0;
+            auto escapeAt = [&](int x, int y) {
+                if (x < 0 || x >= resolution.width || y < 0 || y >= resolution.height) return glm::dvec3(0.0);
+                return reference[(size_t)y * resolution.width + x].escape;
+            };
+            for (size_t i = 0; i < frame.size(); ++i) {
+                if (frame[i].hit != reference[i].hit) {
+                    ++changed;
+                } else if (frame[i].hit == HitType::None) {
+                    //Neighbours chosen as render chooses them
+                    const int x = (int)(i % resolution.width), y = (int)(i / resolution.width);
+                    glm::dvec3 xNeighbour = escapeAt(x + 1, y);
+                    if (xNeighbour == glm::dvec3(0.0)) xNeighbour = escapeAt(x - 1, y);
+                    glm::dvec3 yNeighbour = escapeAt(x, y + 1);
+                    if (yNeighbour == glm::dvec3(0.0)) yNeighbour = escapeAt(x, y - 1);
+                    const glm::dvec3& a = frame[i].escape;
+                    const glm::dvec3& b = reference[i].escape;
+                    const double footprint = GeodesicTracer::skyFootprint(b, xNeighbour, yNeighbour, pixelAngle);
+                    const double error = atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)) / footprint;
+                    maxError = std::max(maxError, error);
+                    ++escaped;
+                    if (error > 0.5) ++displaced;
+                }
+            }
+            if (changed * 1000 > frame.size() || displaced * 1000 > escaped) {
+                std::cerr << name << " " << resolution.width << "x" << resolution.height << ": " << changed
+                          << " pixels changed hit type, " << displaced << " of " << escaped
+                          << " escaped rays off by over half a footprint (up to " << maxError << ")" << std::endl;
+                checksPassed = false;
+            }
+        }
+    }
+}
+
+static void benchSparse(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                        bool& checksPassed) {
+    struct Resolution { int width, height; };
+    std::vector<Resolution> resolutions = {{320, 240}, {640, 480}, {1280, 960}};
+    if (options.quick) resolutions = {{160, 120}};
+    const int spacings[] = {1, 4, 8};
+
+    for (const Resolution& resolution : resolutions) {
+        TraceSettings settings;
+        settings.width = resolution.width;
+        settings.height = resolution.height;
+        settings.kernel = TraceKernel::Planar;
+        GeodesicTracer tracer;
+        tracer.setSettings(settings);
+        const TraceCamera camera = benchCamera(resolution.width, resolution.height);
+        const std::string size = std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+        const uint64_t pixels = (uint64_t)resolution.width * resolution.height;
+
+        Image full;
+        tracer.render(camera, full, scheduler);
+        for (int spacing : spacings) {
+            const std::string name = "sparse/" + std::to_string(spacing);
+            if (!selected(options, name)) continue;
+
+            SparseRenderer sparse(tracer);
+            sparse.setSpacing(spacing);
+            Image image;
+            BenchResult perPixel = measure(options, name, size, "pixel", pixels, [] {},
+                [&] { sparse.render(camera, image, scheduler); benchSink = benchSink + image.at(0, 0).r; });
+            results.push_back(perPixel);
+
+            //Same timings against the rays actually traced
+            BenchResult perRay = perPixel;
+            perRay.name = name + "/traced";
+            perRay.unit = "ray";
+            perRay.items = (uint64_t)(sparse.getTracedFraction() * pixels + 0.5);
+            results.push_back(perRay);
+
+            //Interpolated pixels must look like traced ones: hardly any may differ visibly
+            size_t differing = 0;
+            for (int y = 0; y < resolution.height; ++y) {
+                for (int x = 0; x < resolution.width; ++x) {
+                    const glm::vec4 d = glm::abs(image.at(x, y) - full.at(x, y));
+                    if (std::max(std::max(d.r, d.g), std::max(d.b, d.a)) > 0.05f) ++differing;
+                }
+            }
+            if (differing * 200 > pixels || (spacing > 1 && sparse.getTracedFraction() > 0.5)) {
+                std::cerr << name << " " << size << ": traced " << 100.0 * sparse.getTracedFraction() << "% of pixels, "
+                          << differing << " differ from a full render by > 0.05" << std::endl;
+                checksPassed = false;
+            }
+        }
+    }
+}
+
+static void benchDynamicResolution(const BenchOptions& options, TaskScheduler& scheduler,
+                                   std::vector<BenchResult>& results, bool& checksPassed) {
+    const std::string name = "dynres/dive";
+    if (!selected(options, name)) return;
+    const int width = options.quick ? 160 : 320;
+    const int height = options.quick ? 120 : 240;
+    const int frames = options.quick ? 24 : 60;
+    const std::string size = std::to_string(width) + "x" + std::to_string(height);
+
+    TraceSettings settings;
+    settings.width = width;
+    settings.height = height;
+    settings.kernel = TraceKernel::Planar;
+    GeodesicTracer tracer;
+    tracer.setSettings(settings);
+
+    //Camera falling from far outside the disk to just above the photon sphere
+    auto cameraAt = [&](int frame) {
+        const double t = (double)frame / (frames - 1);
+        return TraceCamera::orbit(3e11 * pow(2.5e10 / 3e11, t), -90.0, 5.0, 60.0, (double)width / height);
+    };
+
+    //Budget: half of what the dive costs on average at full resolution
+    Image image, scaled;
+    double fullSeconds = 0.0;
+    for (int frame = 0; frame < frames; ++frame) {
+        fullSeconds += tracer.render(cameraAt(frame), image, scheduler).seconds;
+    }
+    const double budget = 0.5 * fullSeconds / frames;
+
+    std::vector<double> frameSeconds, frameScales;
+    auto dive = [&] {
+        ResolutionController resolution(budget);
+        frameSeconds.clear();
+        frameScales.clear();
+        for (int frame = 0; frame < frames; ++frame) {
+            TraceSettings frameSettings = settings;
+            frameSettings.width = resolution.traceSize(width);
+            frameSettings.height = resolution.traceSize(height);
+            tracer.setSettings(frameSettings);
+            const double seconds = tracer.render(cameraAt(frame), scaled, scheduler).seconds;
+            image.resampleFrom(scaled);
+            frameSeconds.push_back(seconds);
+            frameScales.push_back(resolution.getScale());
+            resolution.update(seconds, resolution.getScale());
+        }
+        benchSink = benchSink + image.at(0, 0).r;
+    };
+    results.push_back(measure(options, name, size, "frame", frames, [] {}, dive));
+    tracer.setSettings(settings);
+
+    //Once settled (after the first quarter of the dive) frames must sit near the budget while the
+    //scene's cost changes under them, and none may run far over it
+    std::vector<double> settled(frameSeconds.begin() + frames / 4, frameSeconds.end());
+    std::sort(settled.begin(), settled.end());
+    const double median = settled[settled.size() / 2];
+    double meanScale = 0.0;
+    for (double scale : frameScales) meanScale += scale / frames;
+    if (median > 1.5 * budget || median < budget / 1.5 || settled.back() > 2.0 * budget || meanScale >= 1.0) {
+        std::cerr << name << " " << size << ": median settled frame " << median * 1000.0 << " ms, slowest "
+                  << settled.back() * 1000.0 << " ms for a " << budget * 1000.0 << " ms budget, mean scale "
+                  << meanScale << std::endl;
+        checksPassed = false;
+    }
+}
+
+static void benchVolume(const BenchOptions& options, TaskScheduler& scheduler, std::vector<BenchResult>& results,
+                        bool& checksPassed) {
+    std::vector<double> scales = {1.0, 8.0};
+    if (options.quick) scales.resize(1);
+
+    for (double scale : scales) {
+        if (!selected(options, "volume/build")) break;
+        DiskGenerator generator(DiskLayout::scaled(scale));
+        generator.generate(1.0f, &scheduler);
+        const int particles = generator.getParticleCount();
+        DiskVolume volume;
+        results.push_back(measure(options, "volume/build", std::to_string(particles), "particle",
+                                  (uint64_t)particles, [] {}, [&] {
+            volume.build(generator.getVertices());
+            benchSink = benchSink + volume.getStoredBricks();
+        }));
+    }
+
+    const int width = options.quick ? 160 : 320;
+    const int height = options.quick ? 120 : 240;
+    const std::string size = std::to_string(width) + "x" + std::to_string(height);
+    if (!selected(options, "volume/render")) return;
+
+    DiskGenerator generator(DiskLayout::scaled(8.0));
+    generator.generate(1.0f, &scheduler);
+    DiskVolume volume;
+    volume.build(generator.getVertices());
+    TraceScene scene;
+    scene.volume = &volume;
+    TraceSettings settings;
+    settings.width = width;
+    settings.height = height;
+    settings.kernel = TraceKernel::Planar;
+    settings.precision = Precision::Simd8;
+    GeodesicTracer tracer;
+    tracer.setScene(scene);
+    tracer.setSettings(settings);
+    //From above the disk's rim, so rays cross the flow, the jets and the empty bricks between
+    const TraceCamera camera = TraceCamera::orbit(4.5e11, -90.0, 12.0, 60.0, (double)width / height);
+
+    Image skipped, plain;
+    RenderStats stats;
+    results.push_back(measure(options, "volume/render", size, "ray", (uint64_t)width * height, [] {},
+                              [&] { stats = tracer.render(camera, skipped, scheduler); }));
+    volume.setEmptySkipping(false);
+    results.push_back(measure(options, "volume/render/no-skip", size, "ray", (uint64_t)width * height, [] {},
+                              [&] { tracer.render(camera, plain, scheduler); }));
+
+    //Skipping lands on the samples a plain march takes, so the images match; and the flow must
+    //show, with some rays stopped in it
+    float maxDiff = 0.0f, brightest = 0.0f;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const glm::vec4 d = glm::abs(skipped.at(x, y) - plain.at(x, y));
+            maxDiff = std::max(maxDiff, std::max(std::max(d.r, d.g), std::max(d.b, d.a)));
+            brightest = std::max(brightest, skipped.at(x, y).r);
+        }
+    }
+    if (maxDiff > 1e-5f || brightest < 0.5f || stats.hits[(int)HitType::Disk] == 0) {
+        std::cerr << "volume/render " << size << ": skipped and plain marches differ by " << maxDiff
+                  << ", brightest red " << brightest << ", " << stats.hits[(int)HitType::Disk]
+                  << " rays stopped in the volume" << std::endl;
+        checksPassed = false;
+    }
+
+    //Progressive accumulation restarts when the volume is swapped, dropped or rebuilt in place, and
+    //when the settings change
+    TraceSettings small = settings;
+    small.width = 32;
+    small.height = 24;
+    GeodesicTracer smallTracer;
+    smallTracer.setScene(scene);
+    smallTracer.setSettings(small);
+    ProgressiveRenderer progressive(smallTracer);
+    const TraceCamera still = TraceCamera::orbit(4.5e11, -90.0, 12.0, 60.0, (double)small.width / small.height);
+    progressive.renderPass(still, scheduler);
+    progressive.renderPass(still, scheduler);
+    const int accumulated = progressive.getSampleCount();
+    volume.build(generator.getVertices());
+    progressive.renderPass(still, scheduler);
+    const int afterRebuild = progressive.getSampleCount();
+    scene.volume = nullptr;
+    smallTracer.setScene(scene);
+    progressive.renderPass(still, scheduler);
+    const int afterRemoval = progressive.getSampleCount();
+    //As it does when the step budget a ResolutionController sets is cut
+    small.maxSteps /= 2;
+    smallTracer.setSettings(small);
+    progressive.renderPass(still, scheduler);
+    const int afterSettings = progressive.getSampleCount();
+    if (accumulated != 2 || afterRebuild != 1 || afterRemoval != 1 || afterSettings != 1) {
+        std::cerr << "volume/progressive: " << accumulated << " samples, then " << afterRebuild
+                  << " after a rebuild, " << afterRemoval << " without the volume and " << afterSettings
+                  << " with fewer steps" << std::endl;
+        checksPassed = false;
+    }
+}
+
+static void writeText(std::ostream& out, const std::vector<BenchResult>& results, unsigned threads) {
+    out << "threads: " << threads << "\n"
+        << std::left << std::setw(26) << "benchmark" << std::setw(12) << "size" << std::right
+        << std::setw(12) << "median ms" << std::setw(12) << "min ms"
+        << std::setw(14) << "ns/item" << std::setw(16) << "items/s" << std::setw(8) << "B/item" << "  unit\n";
+    for (const BenchResult& r : results) {
+        out << std::left << std::setw(26) << r.name << std::setw(12) << r.size << std::right
+            << std::fixed << std::setprecision(3)
+            << std::setw(12) << r.medianSeconds * 1e3 << std::setw(12) << r.minSeconds * 1e3
+            << std::setprecision(2) << std::setw(14) << r.nsPerItem()
+            << std::setprecision(0) << std::setw(16) << r.itemsPerSecond()
+            << std::setw(8) << (r.bytesPerItem > 0 ? std::to_string(r.bytesPerItem) : "-")
+            << "  " << r.unit << "\n";
+    }
+}
+
+static void writeCsv(std::ostream& out, const std::vector<BenchResult>& results, unsigned threads) {
+    out << "name,size,unit,items,reps,threads,min_s,median_s,mean_s,ns_per_item,items_per_s,bytes_per_item\n";
+    out << std::setprecision(9);
+    for (const BenchResult& r : results) {
+        out << r.name << "," << r.size << "," << r.unit << "," << r.items << "," << r.reps << ","
+            << threads << "," << r.minSeconds << "," << r.medianSeconds << "," << r.meanSeconds << ","
+            << r.nsPerItem() << "," << r.itemsPerSecond() << "," << r.bytesPerItem << "\n";
+    }
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results, unsigned threads) {
+    out << std::setprecision(9) << "{\n  \"threads\": " << threads << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"size\": \"" << r.size << "\", \"unit\": \"" << r.unit
+            << "\", \"items\": " << r.items << ", \"reps\": " << r.reps
+            << ", \"min_s\": " << r.minSeconds << ", \"median_s\": " << r.medianSeconds
+            << ", \"mean_s\": " << r.meanSeconds << ", \"ns_per_item\": " << r.nsPerItem()
+            << ", \"items_per_s\": " << r.itemsPerSecond() << ", \"bytes_per_item\": " << r.bytesPerItem << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return 0;
+        } else if (arg == "--reps" && hasValue) {
+            options.reps = atoi(argv[++i]);
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmup = atoi(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--format" && hasValue) {
+            options.format = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            options.output = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (options.reps <= 0 || options.warmup < 0) {
+        std::cerr << "Repetitions must be positive" << std::endl;
+        return 1;
+    }
+    if (options.format != "text" && options.format != "csv" && options.format != "json") {
+        std::cerr << "Unknown format: " << options.format << std::endl;
+        return 1;
+    }
+
+    TaskScheduler scheduler(options.threads);
+    std::vector<BenchResult> results;
+    bool checksPassed = true;
+    benchDisk(options, scheduler, results, checksPassed);
+    benchAdvect(options, scheduler, results, checksPassed);
+    benchUpload(options, scheduler, results, checksPassed);
+    benchSort(options, scheduler, results, checksPassed);
+    benchChunks(options, scheduler, results, checksPassed);
+    benchSnapshot(options, scheduler, results, checksPassed);
+    benchGrid(options, results, checksPassed);
+    benchSteps(options, results);
+    benchRays(options, results);
+    benchRender(options, scheduler, results);
+    benchCulling(options, scheduler, results, checksPassed);
+    benchObjects(options, scheduler, results, checksPassed);
+    benchStars(options, scheduler, results, checksPassed);
+    benchPrecision(options, scheduler, results, checksPassed);
+    benchSparse(options, scheduler, results, checksPassed);
+    benchDynamicResolution(options, scheduler, results, checksPassed);
+    benchVolume(options, scheduler, results, checksPassed);
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            std::cerr << "Failed to open " << options.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.output.empty() ? std::cout : file;
+
+    if (options.format == "csv") {
+        writeCsv(out, results, scheduler.threadCount());
+    } else if (options.format == "json") {
+        writeJson(out, results, scheduler.threadCount());
+    } else {
+        writeText(out, results, scheduler.threadCount());
+    }
+    return checksPassed ? 0 : 1;
+}
@@ -5,6 +5,7 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <vector>
+#include <string>
 #include <sstream>
 #include <iomanip>
 #include <cmath>
@@ -12,6 +13,11 @@
 #include <algorithm>
 
 #include "AccretionDisk.h"
+#include "GpuProfiler.h"
+#include "ResolutionController.h"
+#include "ShaderManager.h"
+#include "SpacetimeGrid.h"
+#include "TaskScheduler.h"
 
 struct Camera {
     float radius;
@@ -31,7 +37,16 @@ bool isDragging = false;
 
 //Black hole parameters
 float blackHoleMass = 1.0f; //Relative mass (1.0 = default)
-bool needsGridUpdate = true;
+bool massChanged = true;
+
+//Window framebuffer, and the size the scene is rendered at before upscaling to it
+int framebufferWidth = 800, framebufferHeight = 600;
+int renderWidth = 800, renderHeight = 600;
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+    framebufferWidth = width;
+    framebufferHeight = height;
+}
 
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
@@ -78,16 +93,16 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         if (key == GLFW_KEY_UP || key == GLFW_KEY_EQUAL) {
             blackHoleMass += 0.1f;
             if (blackHoleMass > 5.0f) blackHoleMass = 5.0f;
-            needsGridUpdate = true;
+            massChanged = true;
         }
         else if (key == GLFW_KEY_DOWN || key == GLFW_KEY_MINUS) {
             blackHoleMass -= 0.1f;
             if (blackHoleMass < 0.1f) blackHoleMass = 0.1f;
-            needsGridUpdate = true;
+            massChanged = true;
         }
         else if (key == GLFW_KEY_R) {
             blackHoleMass = 1.0f;
-            needsGridUpdate = true;
+            massChanged = true;
         }
     }
 }
@@ -101,111 +116,80 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
         camera.radius = 45.0f;
 }
 
-void updateGrid(std::vector<glm::vec3>& gridPositions) {
-    const int gridWidth = 25;
-    const int gridHeight = 25;
-    
-    gridPositions.clear();
-    
-    //Generate grid vertices with mass-dependent curvature
-    for (int j = 0; j <= gridHeight; ++j) {
-        for (int i = 0; i <= gridWidth; ++i) {
-            float x = (float)(i - gridWidth/2) * 0.4f;
-            float z = (float)(j - gridHeight/2) * 0.4f;
-            
-            //Create spacetime curvature effect (stronger with higher mass)
-            float dist = sqrt(x * x + z * z);
-            float y = -2.0f * blackHoleMass * exp(-0.3f * dist * dist / blackHoleMass);
-            
-            gridPositions.push_back(glm::vec3(x, y, z));
-        }
-    }
-}
-
 void updateWindowTitle(GLFWwindow* window) {
     std::stringstream ss;
     ss << "Black Hole Simulator - Mass: " << std::fixed << std::setprecision(1) << blackHoleMass 
-       << "x (Use +/- or Up/Down to adjust, R to reset)";
+       << "x (Use +/- or Up/Down to adjust, R to reset) - Rendering " << renderWidth << "x" << renderHeight;
     glfwSetWindowTitle(window, ss.str().c_str());
 }
-const char* gridVertexShaderSource = R"(
-    #version 330 core
-    layout (location = 0) in vec3 aPos;
-
-    uniform mat4 viewProj;
-
-    void main() {
-        gl_Position = viewProj * vec4(aPos, 1.0);
-    }
-)";
-
-const char* gridFragmentShaderSource = R"(
-    #version 330 core
-    out vec4 FragColor;
-
-    void main() {
-        FragColor = vec4(0.3, 0.7, 1.0, 0.8); //Blue grid lines
-    } 
-)";
-
-const char* vertexShaderSource = R"(
-    #version 330 core
-    layout (location = 0) in vec3 aPos;
-    layout (location = 1) in vec3 aNormal;
-
-    out vec3 FragPos;
-    out vec3 Normal;
 
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+//(Re)allocates the offscreen scene target; storage is only replaced when the size changes
+void resizeRenderTarget(GLuint colorBuffer, GLuint depthBuffer, int width, int height) {
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+}
 
-    void main() {
-        FragPos = vec3(model * vec4(aPos, 1.0));
-        Normal = mat3(transpose(inverse(model))) * aNormal;  
-        gl_Position = projection * view * vec4(FragPos, 1.0);
+//Uniform slots, in the order each program is loaded with
+enum GridUniform { GRID_VIEW_PROJ, GRID_MASS };
+enum SurfaceUniform { SURFACE_MODEL, SURFACE_VIEW, SURFACE_PROJECTION, SURFACE_LIGHT_POS, SURFACE_LIGHT_COLOR,
+                      SURFACE_OBJECT_COLOR };
+
+int main(int argc, char** argv) {
+    //--disk-scale F multiplies every disk component's particle count,
+    //--orphan-upload streams the disk through glBufferData orphaning even where persistent mapping exists,
+    //--no-shader-cache always compiles shaders from source,
+    //--trace FILE writes a Chrome trace on exit (builds with BLACKHOLE_PROFILE),
+    //--frame-budget MS sets the GPU time per frame the render resolution adapts to (default 16.7),
+    //--native-resolution always renders at the framebuffer size,
+    //--no-depth-sort draws the disk particles in generation order instead of back to front,
+    //--no-chunking draws every disk particle, with no culling or distance level of detail,
+    //--load-disk FILE starts from the last frame of a particle snapshot instead of generating the disk,
+    //--save-disk FILE writes the disk as it is on exit, --record FILE appends every frame to a snapshot
+    DiskLayout diskLayout;
+    bool persistentMapping = true;
+    bool shaderCache = true;
+    std::string tracePath;
+    double frameBudgetMs = 16.7;
+    bool dynamicResolution = true;
+    bool depthSort = true;
+    bool chunking = true;
+    std::string loadPath, savePath, recordPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--disk-scale" && i + 1 < argc) {
+            diskLayout = DiskLayout::scaled(atof(argv[++i]));
+        } else if (arg == "--orphan-upload") {
+            persistentMapping = false;
+        } else if (arg == "--no-shader-cache") {
+            shaderCache = false;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+#ifndef BLACKHOLE_PROFILE
+            std::cerr << "--trace needs a build with BLACKHOLE_PROFILE defined, ignoring it" << std::endl;
+#endif
+        } else if (arg == "--frame-budget" && i + 1 < argc) {
+            frameBudgetMs = atof(argv[++i]);
+        } else if (arg == "--native-resolution") {
+            dynamicResolution = false;
+        } else if (arg == "--no-depth-sort") {
+            depthSort = false;
+        } else if (arg == "--no-chunking") {
+            chunking = false;
+        } else if (arg == "--load-disk" && i + 1 < argc) {
+            loadPath = argv[++i];
+        } else if (arg == "--save-disk" && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << " (usage: main [--disk-scale F] [--orphan-upload] [--no-shader-cache] [--trace FILE] [--frame-budget MS] [--native-resolution] [--no-depth-sort] [--no-chunking] [--load-disk FILE] [--save-disk FILE] [--record FILE])" << std::endl;
+            return -1;
+        }
     }
-)";
-
-const char* fragmentShaderSource = R"(
-    #version 330 core
-    out vec4 FragColor;
-
-    in vec3 FragPos;
-    in vec3 Normal;  
-
-    uniform vec3 lightPos; 
-    uniform vec3 lightColor;
-    uniform vec3 objectColor;
-
-    void main() {
-        //ambient
-        float ambientStrength = 0.1;
-        vec3 ambient = ambientStrength * lightColor;
-  	
-        //diffuse 
-        vec3 norm = normalize(Normal);
-        vec3 lightDir = normalize(lightPos - FragPos);
-        float diff = max(dot(norm, lightDir), 0.0);
-        vec3 diffuse = diff * lightColor;
-            
-        vec3 result = (ambient + diffuse) * objectColor;
-        FragColor = vec4(result, 1.0);
-    } 
-)";
-
-
-const char* blackHoleFragmentShaderSource = R"(
-    #version 330 core
-    out vec4 FragColor;
 
-    void main() {
-        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
-    } 
-)";
-
-
-int main() {
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
         return -1;
@@ -228,6 +212,8 @@ int main() {
     glfwSetCursorPosCallback(window, cursor_position_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
 
     //Set initial window title
     updateWindowTitle(window);
@@ -240,92 +226,27 @@ int main() {
 
     glEnable(GL_DEPTH_TEST);
 
-    //Compile and link shaders
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    GLuint blackHoleShaderProgram = glCreateProgram();
-    glAttachShader(blackHoleShaderProgram, vertexShader);
-    GLuint blackHoleFragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(blackHoleFragmentShader, 1, &blackHoleFragmentShaderSource, NULL);
-    glCompileShader(blackHoleFragmentShader);
-    glAttachShader(blackHoleShaderProgram, blackHoleFragmentShader);
-    glLinkProgram(blackHoleShaderProgram);
-
-    glDeleteShader(blackHoleFragmentShader);
-
-    //Create grid shader program
-    GLuint gridVertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(gridVertexShader, 1, &gridVertexShaderSource, NULL);
-    glCompileShader(gridVertexShader);
-
-    GLuint gridFragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(gridFragmentShader, 1, &gridFragmentShaderSource, NULL);
-    glCompileShader(gridFragmentShader);
-
-    GLuint gridShaderProgram = glCreateProgram();
-    glAttachShader(gridShaderProgram, gridVertexShader);
-    glAttachShader(gridShaderProgram, gridFragmentShader);
-    glLinkProgram(gridShaderProgram);
-
-    //Create disk shader program using AccretionDisk class
-    const char* diskVertexShaderSource = AccretionDisk::getVertexShaderSource();
-    const char* diskFragmentShaderSource = AccretionDisk::getFragmentShaderSource();
-    
-    GLuint diskVertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(diskVertexShader, 1, &diskVertexShaderSource, NULL);
-    glCompileShader(diskVertexShader);
-
-    GLuint diskFragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(diskFragmentShader, 1, &diskFragmentShaderSource, NULL);
-    glCompileShader(diskFragmentShader);
-
-    GLuint diskShaderProgram = glCreateProgram();
-    glAttachShader(diskShaderProgram, diskVertexShader);
-    glAttachShader(diskShaderProgram, diskFragmentShader);
-    glLinkProgram(diskShaderProgram);
-
-    glDeleteShader(gridVertexShader);
-    glDeleteShader(gridFragmentShader);
-    glDeleteShader(diskVertexShader);
-    glDeleteShader(diskFragmentShader);
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    //Grid generation (spacetime visualization)
-    const int gridWidth = 25;
-    const int gridHeight = 25;
-    std::vector<glm::vec3> gridPositions;
-    std::vector<unsigned int> gridIndices;
-
-    //Initial grid generation
-    updateGrid(gridPositions);
-
-    //Generate grid line indices
-    for (int j = 0; j < gridHeight; ++j) {
-        for (int i = 0; i < gridWidth; ++i) {
-            int current = j * (gridWidth + 1) + i;
-            
-            //Horizontal lines
-            gridIndices.push_back(current);
-            gridIndices.push_back(current + 1);
-            
-            //Vertical lines
-            gridIndices.push_back(current);
-            gridIndices.push_back(current + gridWidth + 1);
-        }
+    //Load shader programs from shaders/, or from the binary cache when nothing changed
+    ShaderManager shaders;
+    shaders.setCacheEnabled(shaderCache);
+    const std::vector<std::string> surfaceUniforms = {"model", "view", "projection", "lightPos", "lightColor", "objectColor"};
+    ShaderProgram* surfaceProgram = shaders.load("surface", {"surface.vert", "surface.frag"}, surfaceUniforms);
+    ShaderProgram* blackHoleProgram = shaders.load("blackhole", {"surface.vert", "blackhole.frag"}, surfaceUniforms);
+    ShaderProgram* gridProgram = shaders.load("grid", {"grid.vert", "grid.frag"}, {"viewProj", "mass"});
+    ShaderProgram* diskProgram = shaders.load("disk", {"disk.vert", "disk.frag"}, AccretionDisk::getUniformNames());
+    if (!surfaceProgram || !blackHoleProgram || !gridProgram || !diskProgram) {
+        std::cerr << "Failed to build shaders (run from the directory containing shaders/)" << std::endl;
+        glfwTerminate();
+        return -1;
     }
+    const ShaderStats& shaderStats = shaders.getStats();
+    std::cout << "Shaders: " << shaderStats.compiled << " compiled, " << shaderStats.loadedFromCache
+              << " from cache in " << shaderStats.buildSeconds * 1000.0 << " ms" << std::endl;
+
+    //Grid generation (spacetime visualization); built once, grid.vert applies the mass
+    SpacetimeGrid grid;
+    const std::vector<glm::vec2>& gridPositions = grid.getPositions();
+    const std::vector<unsigned int>& gridIndices = grid.getIndices();
 
     GLuint gridVBO, gridVAO, gridEBO;
     glGenVertexArrays(1, &gridVAO);
@@ -334,15 +255,46 @@ int main() {
 
     glBindVertexArray(gridVAO);
     glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
-    glBufferData(GL_ARRAY_BUFFER, gridPositions.size() * sizeof(glm::vec3), &gridPositions[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, gridPositions.size() * sizeof(glm::vec2), &gridPositions[0], GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridEBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, gridIndices.size() * sizeof(unsigned int), &gridIndices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
     glEnableVertexAttribArray(0);
 
-    //Create and initialize the accretion disk
-    AccretionDisk accretionDisk;
-    accretionDisk.initialize(blackHoleMass);
+    //Create and initialize the accretion disk, generating particles on every core
+    TaskScheduler scheduler;
+    AccretionDisk accretionDisk(diskLayout, persistentMapping);
+    accretionDisk.setDepthSorting(depthSort);
+    accretionDisk.setChunking(chunking);
+    if (loadPath.empty()) {
+        accretionDisk.initialize(blackHoleMass, &scheduler);
+    } else {
+        //The mapping is only needed until the particles are copied out
+        const double loadStart = glfwGetTime();
+        ParticleSnapshot snapshot;
+        std::string error;
+        if (!snapshot.open(loadPath, error) || snapshot.getFrameCount() == 0) {
+            std::cerr << (error.empty() ? loadPath + " holds no frames" : error) << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        const size_t frame = snapshot.getFrameCount() - 1;
+        blackHoleMass = snapshot.frame(frame).blackHoleMass;
+        accretionDisk.initialize(snapshot, frame, &scheduler);
+        std::cout << "Loaded " << snapshot.getParticleCount() << " particles from frame " << frame << " of " << loadPath
+                  << " in " << (glfwGetTime() - loadStart) * 1000.0 << " ms" << std::endl;
+    }
+    
+    //Recording writes each frame as it is simulated, so memory stays flat however long it runs
+    SnapshotWriter recorder;
+    if (!recordPath.empty()) {
+        const DiskGenerator& generator = accretionDisk.getGenerator();
+        std::string error;
+        if (!recorder.open(recordPath, generator.getLayout(), generator.getSeed(), blackHoleMass,
+                           accretionDisk.getParticles().size(), error)) {
+            std::cerr << error << std::endl;
+        }
+    }
 
     //Original surface mesh (now simplified)
     std::vector<float> vertices;
@@ -430,14 +382,6 @@ int main() {
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
-    //Get uniform locations
-    GLuint modelLoc = glGetUniformLocation(shaderProgram, "model");
-    GLuint viewLoc = glGetUniformLocation(shaderProgram, "view");
-    GLuint projLoc = glGetUniformLocation(shaderProgram, "projection");
-    GLuint lightPosLoc = glGetUniformLocation(shaderProgram, "lightPos");
-    GLuint lightColorLoc = glGetUniformLocation(shaderProgram, "lightColor");
-    GLuint objectColorLoc = glGetUniformLocation(shaderProgram, "objectColor");
-
     //Black hole sphere generation
     const int sphereSegments = 50;
     std::vector<float> sphereVertices;
@@ -482,24 +426,80 @@ int main() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    //The scene renders into an offscreen target at the controller's scale of the framebuffer and
+    //is upscaled when blitted to the window. Its GPU time comes from a ring of timer queries
+    //read a few frames late, each remembering the scale it measured.
+    ResolutionController resolution(frameBudgetMs / 1000.0);
+    resolution.setLimits(dynamicResolution ? 0.25 : 1.0, 1.0, 60000, 60000);
+    GLuint sceneFBO, sceneColor, sceneDepth;
+    glGenFramebuffers(1, &sceneFBO);
+    glGenRenderbuffers(1, &sceneColor);
+    glGenRenderbuffers(1, &sceneDepth);
+    int targetWidth = 0, targetHeight = 0;
+
+    const int TIMER_QUERIES = 4;
+    GLuint timerQueries[TIMER_QUERIES];
+    double timerScales[TIMER_QUERIES];
+    glGenQueries(TIMER_QUERIES, timerQueries);
+    int timerNext = 0, timerPending = 0;
+
+    float lastTime = glfwGetTime();
     while (!glfwWindowShouldClose(window)) {
+        PROFILE_SCOPE("frame");
         float currentTime = glfwGetTime();
+        float deltaTime = currentTime - lastTime;
+        lastTime = currentTime;
+        
+        //Pick up edited shader files
+        shaders.reloadChanged();
         
-        //Update grid if mass changed
-        if (needsGridUpdate) {
-            updateGrid(gridPositions);
+        //The grid and disk shaders take the mass as a uniform; only the jet velocities change
+        if (massChanged) {
+            PROFILE_SCOPE("mass change");
             updateWindowTitle(window);
-            
-            //Update GPU buffer
-            glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
-            glBufferData(GL_ARRAY_BUFFER, gridPositions.size() * sizeof(glm::vec3), &gridPositions[0], GL_STATIC_DRAW);
-            
-            //Update accretion disk for new mass
             accretionDisk.update(blackHoleMass);
             
-            needsGridUpdate = false;
+            massChanged = false;
         }
         
+        //Oldest timer results first, without waiting on any that are not ready
+        while (timerPending > 0) {
+            const int oldest = (timerNext - timerPending + TIMER_QUERIES) % TIMER_QUERIES;
+            GLint available = 0;
+            glGetQueryObjectiv(timerQueries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) break;
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(timerQueries[oldest], GL_QUERY_RESULT, &elapsedNs);
+            resolution.update(elapsedNs * 1e-9, timerScales[oldest]);
+            --timerPending;
+        }
+        PROFILE_COUNTER("render scale", resolution.getScale());
+
+        //A minimised window has a zero-sized framebuffer; nothing to draw
+        if (framebufferWidth <= 0 || framebufferHeight <= 0) {
+            glfwWaitEvents();
+            continue;
+        }
+        renderWidth = resolution.traceSize(framebufferWidth);
+        renderHeight = resolution.traceSize(framebufferHeight);
+        if (renderWidth != targetWidth || renderHeight != targetHeight) {
+            resizeRenderTarget(sceneColor, sceneDepth, renderWidth, renderHeight);
+            glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sceneColor);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sceneDepth);
+            targetWidth = renderWidth;
+            targetHeight = renderHeight;
+            updateWindowTitle(window);
+        }
+
+        //With every query still in flight this frame goes unmeasured rather than stalling
+        const bool timed = timerPending < TIMER_QUERIES;
+        if (timed) {
+            timerScales[timerNext] = resolution.getScale();
+            glBeginQuery(GL_TIME_ELAPSED, timerQueries[timerNext]);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glViewport(0, 0, renderWidth, renderHeight);
         glClearColor(0.0f, 0.0f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -512,51 +512,150 @@ int main() {
         //Create transformations
         glm::mat4 model = glm::mat4(1.0f);
         glm::mat4 view = glm::lookAt(cameraPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+            (float)framebufferWidth / (float)framebufferHeight, 0.1f, 100.0f);
         glm::mat4 viewProj = projection * view;
 
         //Draw spacetime grid
-        glUseProgram(gridShaderProgram);
-        glUniformMatrix4fv(glGetUniformLocation(gridShaderProgram, "viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
-        
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glBindVertexArray(gridVAO);
-        glDrawElements(GL_LINES, gridIndices.size(), GL_UNSIGNED_INT, 0);
-        glDisable(GL_BLEND);
+        {
+            PROFILE_SCOPE("grid draw");
+            PROFILE_GPU_SCOPE("grid draw");
+            gridProgram->use();
+            glUniformMatrix4fv(gridProgram->uniform(GRID_VIEW_PROJ), 1, GL_FALSE, glm::value_ptr(viewProj));
+            glUniform1f(gridProgram->uniform(GRID_MASS), blackHoleMass);
+            
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glBindVertexArray(gridVAO);
+            glDrawElements(GL_LINES, gridIndices.size(), GL_UNSIGNED_INT, 0);
+            glDisable(GL_BLEND);
+        }
 
         //Draw realistic 3D accretion disk using AccretionDisk class
-        accretionDisk.render(diskShaderProgram, model, view, projection, currentTime, blackHoleMass);
+        {
+            PROFILE_SCOPE("disk advance");
+            accretionDisk.advance(deltaTime, blackHoleMass, &scheduler);
+        }
+        if (recorder.isOpen()) {
+            PROFILE_SCOPE("disk record");
+            std::string error;
+            if (!recorder.append(accretionDisk.getParticles(), accretionDisk.getChunks(), currentTime, blackHoleMass,
+                                 error)) {
+                std::cerr << error << ", recording stopped" << std::endl;
+            }
+        }
+        {
+            PROFILE_SCOPE("disk draw");
+            PROFILE_GPU_SCOPE("disk draw");
+            accretionDisk.render(*diskProgram, model, view, projection, currentTime, blackHoleMass, &scheduler);
+        }
+        PROFILE_COUNTER("fence wait ms", accretionDisk.getStreamStats().fenceWaitSeconds * 1000.0);
 
         //Draw black hole sphere (scaled by mass)
-        glUseProgram(blackHoleShaderProgram);
-        glm::mat4 blackHoleModel = glm::scale(glm::mat4(1.0f), glm::vec3(blackHoleMass * 0.5f));
-        glUniformMatrix4fv(glGetUniformLocation(blackHoleShaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(blackHoleModel));
-        glUniformMatrix4fv(glGetUniformLocation(blackHoleShaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(blackHoleShaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-        glBindVertexArray(sphereVAO);
-        glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
-
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("sphere draw");
+            PROFILE_GPU_SCOPE("sphere draw");
+            blackHoleProgram->use();
+            glm::mat4 blackHoleModel = glm::scale(glm::mat4(1.0f), glm::vec3(blackHoleMass * 0.5f));
+            glUniformMatrix4fv(blackHoleProgram->uniform(SURFACE_MODEL), 1, GL_FALSE, glm::value_ptr(blackHoleModel));
+            glUniformMatrix4fv(blackHoleProgram->uniform(SURFACE_VIEW), 1, GL_FALSE, glm::value_ptr(view));
+            glUniformMatrix4fv(blackHoleProgram->uniform(SURFACE_PROJECTION), 1, GL_FALSE, glm::value_ptr(projection));
+            glBindVertexArray(sphereVAO);
+            glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
+        }
+
+        if (timed) {
+            glEndQuery(GL_TIME_ELAPSED);
+            timerNext = (timerNext + 1) % TIMER_QUERIES;
+            ++timerPending;
+        }
+
+        //Upscale to the window
+        {
+            PROFILE_SCOPE("upscale");
+            PROFILE_GPU_SCOPE("upscale");
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            glViewport(0, 0, framebufferWidth, framebufferHeight);
+            glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, framebufferWidth, framebufferHeight,
+                              GL_COLOR_BUFFER_BIT, renderWidth == framebufferWidth ? GL_NEAREST : GL_LINEAR);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+
+        {
+            PROFILE_SCOPE("swap");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+
+        PROFILE_GPU_COLLECT();
+#ifdef BLACKHOLE_PROFILE
+        const std::string profileSummary = Profiler::instance().summary(1.0);
+        if (!profileSummary.empty()) {
+            std::cout << profileSummary << std::endl;
+        }
+#endif
+    }
+
+    const StreamStats& streamStats = accretionDisk.getStreamStats();
+    std::cout << "Disk upload (" << (accretionDisk.isPersistentMapped() ? "persistent mapped" : "orphaning") << "): "
+              << streamStats.bytesUploaded / (1024.0 * 1024.0) << " MiB over " << streamStats.frames << " frames, "
+              << streamStats.fenceWaitSeconds * 1000.0 << " ms waiting on fences in "
+              << streamStats.fenceWaits << " frames" << std::endl;
+    
+    if (recorder.isOpen()) {
+        std::string error;
+        const bool closed = recorder.close(error);
+        std::cout << "Recorded " << recorder.getFrameCount() << " frames (" << recorder.getBytesWritten() / (1024.0 * 1024.0)
+                  << " MiB) to " << recordPath << std::endl;
+        if (!closed) {
+            std::cerr << error << std::endl;
+        }
+    }
+    if (!savePath.empty()) {
+        SnapshotWriter writer;
+        const DiskGenerator& generator = accretionDisk.getGenerator();
+        std::string error;
+        if (!writer.open(savePath, generator.getLayout(), generator.getSeed(), blackHoleMass,
+                         accretionDisk.getParticles().size(), error) ||
+            !writer.append(accretionDisk.getParticles(), accretionDisk.getChunks(), glfwGetTime(), blackHoleMass, error) ||
+            !writer.close(error)) {
+            std::cerr << error << std::endl;
+        } else {
+            std::cout << "Saved the disk to " << savePath << std::endl;
+        }
     }
 
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
-    glDeleteProgram(shaderProgram);
 
     glDeleteVertexArrays(1, &gridVAO);
     glDeleteBuffers(1, &gridVBO);
     glDeleteBuffers(1, &gridEBO);
-    glDeleteProgram(gridShaderProgram);
 
-    glDeleteProgram(diskShaderProgram);
+    accretionDisk.cleanup(); //Unmaps and deletes the stream while the context still exists
+
+    glDeleteQueries(TIMER_QUERIES, timerQueries);
+    glDeleteFramebuffers(1, &sceneFBO);
+    glDeleteRenderbuffers(1, &sceneColor);
+    glDeleteRenderbuffers(1, &sceneDepth);
 
     glDeleteVertexArrays(1, &sphereVAO);
     glDeleteBuffers(1, &sphereVBO);
     glDeleteBuffers(1, &sphereEBO);
-    glDeleteProgram(blackHoleShaderProgram);
+    shaders.cleanup();
+    PROFILE_GPU_CLEANUP();
+
+#ifdef BLACKHOLE_PROFILE
+    if (!tracePath.empty()) {
+        if (Profiler::instance().writeChromeTrace(tracePath)) {
+            std::cout << "Wrote profile trace to " << tracePath << std::endl;
+        } else {
+            std::cerr << "Failed to write " << tracePath << std::endl;
+        }
+    }
+#endif
 
     glfwTerminate();
     return 0;
@@ -0,0 +1,754 @@
+//Headless geodesic tracer: renders one lensed frame on the CPU and writes it to disk
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/constants.hpp>
+
+#include "CameraPath.h"
+#include "DiskGenerator.h"
+#include "DiskVolume.h"
+#include "FrameWriter.h"
+#include "GeodesicTracer.h"
+#include "Image.h"
+#include "ParticleSnapshot.h"
+#include "Profiler.h"
+#include "ProgressiveRenderer.h"
+#include "ResolutionController.h"
+#include "SparseRenderer.h"
+#include "StarCatalog.h"
+#include "TaskScheduler.h"
+
+static void printUsage() {
+    std::cout << "Usage: tracer [options]\n"
+              << "  --width N          image width (default 800)\n"
+              << "  --height N         image height (default 600)\n"
+              << "  --threads N        worker threads, 0 = all cores (default 0)\n"
+              << "  --tile N           tile edge in pixels (default 16)\n"
+              << "  --steps N          maximum integration steps per ray (default 60000)\n"
+              << "  --radius M         camera distance in metres (default 6.34194e10)\n"
+              << "  --yaw DEG          camera yaw (default -90)\n"
+              << "  --pitch DEG        camera pitch (default 5)\n"
+              << "  --fov DEG          vertical field of view (default 60)\n"
+              << "  --object X,Y,Z,R   add a sphere (metres), may be repeated\n"
+              << "  --volume           replace the thin disk with the accretion disk particles, voxelised\n"
+              << "  --disk-scale F     particle count multiplier for --volume (default 8)\n"
+              << "  --disk-snapshot FILE  voxelise the last frame of a particle snapshot instead for --volume\n"
+              << "  --volume-opacity X absorption per rs at unit particle density (default 0.5)\n"
+              << "  --kernel NAME      spherical (shader's 6-component state), planar (Binet equation)\n"
+              << "                     or lookup (precomputed deflection table)\n"
+              << "  --integrator NAME  fixed (shader's D_LAMBDA loop) or adaptive (Dormand-Prince 5(4))\n"
+              << "  --precision NAME   planar kernel arithmetic: double (default), float, or simd8 (eight rays at once)\n"
+              << "  --rtol X           adaptive relative tolerance (default 1e-7)\n"
+              << "  --atol X           adaptive absolute tolerance, rs = 1 units (default 1e-10)\n"
+              << "  --samples N        jittered samples per pixel, accumulated progressively (default 1)\n"
+              << "  --sparse N         trace every Nth pixel, then only cells with edges in them (power of two)\n"
+              << "  --sparse-threshold X  colour difference that splits a sparse cell (default 0.05)\n"
+              << "  --no-cull          integrate every ray to the end instead of retiring it once its fate is known\n"
+              << "  --compare          render with each integrator, kernel and precision and report steps, time and accuracy\n"
+              << "  --output FILE      output image, binary PPM (default trace.ppm)\n"
+              << "  --path FILE        render a keyframed camera path (\"time radius yaw pitch mass\" per line);\n"
+              << "                     --output NAME.y4m writes a Y4M stream, anything else a numbered PPM\n"
+              << "                     sequence (a printf pattern such as frames/%05d.ppm, or trace00000.ppm...)\n"
+              << "  --fps N            frames per second of path time (default 30)\n"
+              << "  --frame-budget MS  trace path frames at the resolution and step budget that hold this time\n"
+              << "                     per frame, upscaled to --width x --height (default off)\n"
+              << "  --stars FILE       star catalog for the sky behind escaped rays (default black)\n"
+              << "  --star-magnitude M magnitude that peaks at full brightness in an unlensed pixel (default 6)\n"
+              << "  --make-stars FILE  write a synthetic star catalog and exit\n"
+              << "  --star-count N     stars in a synthetic catalog (default 100000)\n"
+              << "  --trace FILE       write a Chrome trace of the render (builds with BLACKHOLE_PROFILE)\n";
+}
+
+//Binet-equation counterpart of measureDeflection: same starting point and direction, stop
+//when u falls back to rs / rOut and compare the swept angle with a straight line
+static double measurePlanarDeflection(const TraceSettings& settings, double rs, double b, double rOut, int& steps) {
+    const double u0 = rs / rOut;
+    const double alpha = asin(b / rOut);
+    glm::dvec2 state(u0, u0 / tan(alpha));
+    glm::dvec2 prev = state;
+    double psi = 0.0, psiPrev = 0.0, hTaken = 0.0;
+    double h = 0.01;
+    steps = 0;
+
+    while (steps < 10000000) {
+        if (state.x >= 1.0) return -1.0;
+        if (state.x < u0 && state.y < 0.0) break;
+        ++steps;
+        double hTried = std::min(h, settings.maxStepFraction);
+        h = hTried;
+        glm::dvec2 before = state;
+        if (binetStep(state, h, settings.relTolerance, settings.absTolerance)) {
+            prev = before;
+            psiPrev = psi;
+            hTaken = hTried;
+            psi += hTried;
+        }
+    }
+
+    //Bisect the cubic Hermite interpolant of the last step for u = u0
+    double lo = 0.0, hi = 1.0;
+    for (int i = 0; i < 50; ++i) {
+        double t = 0.5 * (lo + hi), t2 = t * t, t3 = t2 * t;
+        double u = (2.0 * t3 - 3.0 * t2 + 1.0) * prev.x + (t3 - 2.0 * t2 + t) * hTaken * prev.y
+                 + (-2.0 * t3 + 3.0 * t2) * state.x + (t3 - t2) * hTaken * state.y;
+        (u > u0 ? lo : hi) = t;
+    }
+    double sweep = psiPrev + 0.5 * (lo + hi) * hTaken;
+    return sweep - (glm::pi<double>() - 2.0 * alpha);
+}
+
+//Integrate a ray in the theta = pi/2 plane with impact parameter b until it is
+//outbound past radius rOut, returning its deflection in radians (negative if captured)
+static double measureDeflection(const TraceSettings& settings, double rs, double b, double rOut, int& steps) {
+    if (settings.kernel == TraceKernel::Planar) {
+        return measurePlanarDeflection(settings, rs, b, rOut, steps);
+    }
+
+    const double r0 = rOut;
+    glm::dvec3 pos(-sqrt(r0 * r0 - b * b), b, 0.0);
+    Ray ray = initRay(pos, glm::dvec3(1.0, 0.0, 0.0), rs);
+    double h = settings.stepSize;
+    steps = 0;
+
+    Ray prev = ray;
+    while (steps < 10000000) {
+        if (ray.r <= rs * 1.001) return -1.0;
+        if (ray.r > rOut && ray.dr > 0.0) break;
+        prev = ray;
+        ++steps;
+        if (settings.integrator == Integrator::DormandPrince) {
+            h = std::min(h, settings.maxStepFraction * ray.r);
+            dormandPrinceStep(ray, h, rs, settings.relTolerance, settings.absTolerance);
+        } else {
+            eulerStep(ray, settings.stepSize, rs);
+        }
+    }
+
+    //Interpolate the direction to exactly rOut so step length does not bias the result
+    double t = (rOut - prev.r) / (ray.r - prev.r);
+    glm::dvec3 dir = glm::normalize(glm::mix(glm::normalize(rayDirection(prev)),
+                                             glm::normalize(rayDirection(ray)), t));
+    return atan2(dir.y, dir.x) < 0.0 ? acos(dir.x) : -acos(dir.x);
+}
+
+static RenderStats renderTimed(GeodesicTracer& tracer, const TraceCamera& camera, Image& image,
+                               TaskScheduler& scheduler, const char* label) {
+    RenderStats stats = tracer.render(camera, image, scheduler);
+    std::cout << std::fixed << std::setprecision(3)
+              << "  " << std::left << std::setw(10) << label << std::right
+              << "time " << std::setw(9) << stats.seconds << " s   steps/ray "
+              << std::setprecision(1) << std::setw(9) << (double)stats.steps / stats.rays
+              << "   rays/s/core " << std::setw(10) << stats.raysPerSecondPerCore() << "\n";
+    return stats;
+}
+
+static double differingFraction(const Image& a, const Image& b) {
+    size_t differing = 0;
+    for (int y = 0; y < a.getHeight(); ++y) {
+        for (int x = 0; x < a.getWidth(); ++x) {
+            glm::vec4 d = glm::abs(a.at(x, y) - b.at(x, y));
+            if (std::max(std::max(d.r, d.g), std::max(d.b, d.a)) > 0.05f) ++differing;
+        }
+    }
+    return (double)differing / ((size_t)a.getWidth() * a.getHeight());
+}
+
+//Every pixel's result, traced a row at a time as render does
+static std::vector<TraceResult> traceFrame(const GeodesicTracer& tracer, const TraceCamera& camera) {
+    const TraceSettings& settings = tracer.getSettings();
+    std::vector<TraceResult> results((size_t)settings.width * settings.height);
+    std::vector<glm::dvec2> pixels(settings.width);
+    for (int y = 0; y < settings.height; ++y) {
+        for (int x = 0; x < settings.width; ++x) {
+            pixels[x] = glm::dvec2(x + 0.5, y + 0.5);
+        }
+        tracer.tracePixels(camera, pixels.data(), settings.width, &results[(size_t)y * settings.width]);
+    }
+    return results;
+}
+
+//Single-precision planar kernels against the double one: hit types that change, and how far
+//apart escaped rays land on the sky relative to the angle their pixel spans there
+static void comparePrecisions(const TraceScene& scene, TraceSettings settings, const TraceCamera& camera,
+                              TaskScheduler& scheduler) {
+    settings.kernel = TraceKernel::Planar;
+    const Precision precisions[] = {Precision::Double, Precision::Float, Precision::Simd8};
+    const char* labels[] = {"double", "float", "simd8"};
+    const double pixelAngle = 2.0 * camera.tanHalfFov / settings.height;
+
+    GeodesicTracer tracer;
+    tracer.setScene(scene);
+    std::cout << "Planar kernel precision:\n";
+    std::vector<TraceResult> reference;
+    double referenceSeconds = 0.0;
+    for (int p = 0; p < 3; ++p) {
+        settings.precision = precisions[p];
+        tracer.setSettings(settings);
+        Image image;
+        RenderStats stats = renderTimed(tracer, camera, image, scheduler, labels[p]);
+        std::vector<TraceResult> results = traceFrame(tracer, camera);
+        if (p == 0) {
+            reference = results;
+            referenceSeconds = stats.seconds;
+            continue;
+        }
+
+        auto escapeAt = [&](int x, int y) {
+            if (x < 0 || x >= settings.width || y < 0 || y >= settings.height) return glm::dvec3(0.0);
+            return reference[(size_t)y * settings.width + x].escape;
+        };
+        size_t hitChanged = 0, escaped = 0;
+        double maxError = 0.0, sumError = 0.0;
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (results[i].hit != reference[i].hit) {
+                ++hitChanged;
+            } else if (results[i].hit == HitType::None) {
+                const int x = (int)(i % settings.width), y = (int)(i / settings.width);
+                glm::dvec3 xNeighbour = escapeAt(x + 1, y);
+                if (xNeighbour == glm::dvec3(0.0)) xNeighbour = escapeAt(x - 1, y);
+                glm::dvec3 yNeighbour = escapeAt(x, y + 1);
+                if (yNeighbour == glm::dvec3(0.0)) yNeighbour = escapeAt(x, y - 1);
+                const glm::dvec3& a = results[i].escape;
+                const glm::dvec3& b = reference[i].escape;
+                const double footprint = GeodesicTracer::skyFootprint(b, xNeighbour, yNeighbour, pixelAngle);
+                const double error = atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)) / footprint;
+                maxError = std::max(maxError, error);
+                sumError += error;
+                ++escaped;
+            }
+        }
+        std::cout << std::setprecision(2) << "  " << labels[p] << ": speedup " << referenceSeconds / stats.seconds
+                  << "x over double, " << 100.0 * hitChanged / results.size() << "% of pixels change hit, "
+                  << std::scientific << "escape error max " << maxError << ", mean "
+                  << (escaped > 0 ? sumError / escaped : 0.0) << " pixel footprints" << std::fixed << "\n";
+    }
+}
+
+static void compareIntegrators(const TraceScene& scene, TraceSettings settings, const TraceCamera& camera,
+                               TaskScheduler& scheduler) {
+    TraceSettings fixed = settings;
+    fixed.kernel = TraceKernel::Spherical;
+    fixed.integrator = Integrator::FixedEuler;
+    TraceSettings adaptive = fixed;
+    adaptive.integrator = Integrator::DormandPrince;
+    TraceSettings planar = adaptive;
+    planar.kernel = TraceKernel::Planar;
+    TraceSettings lookup = adaptive;
+    lookup.kernel = TraceKernel::Lookup;
+    TraceSettings unculled = fixed;
+    unculled.analyticCulling = false;
+
+    GeodesicTracer tracer;
+    tracer.setScene(scene);
+
+    std::cout << "Frame " << settings.width << "x" << settings.height << ":\n";
+    Image unculledImage, fixedImage, adaptiveImage, planarImage;
+    tracer.setSettings(unculled);
+    RenderStats unculledStats = renderTimed(tracer, camera, unculledImage, scheduler, "unculled");
+    tracer.setSettings(fixed);
+    RenderStats fixedStats = renderTimed(tracer, camera, fixedImage, scheduler, "fixed");
+    tracer.setSettings(adaptive);
+    RenderStats adaptiveStats = renderTimed(tracer, camera, adaptiveImage, scheduler, "adaptive");
+    tracer.setSettings(planar);
+    RenderStats planarStats = renderTimed(tracer, camera, planarImage, scheduler, "planar");
+
+    //First lookup render includes building the table; the second shows a camera move
+    Image lookupImage;
+    tracer.setSettings(lookup);
+    renderTimed(tracer, camera, lookupImage, scheduler, "lookup+");
+    RenderStats lookupStats = renderTimed(tracer, camera, lookupImage, scheduler, "lookup");
+
+    std::cout << std::setprecision(2)
+              << "  culling:  speedup " << unculledStats.seconds / fixedStats.seconds << "x, step ratio "
+              << (double)unculledStats.steps / fixedStats.steps << "x, "
+              << 100.0 * differingFraction(unculledImage, fixedImage) << "% of pixels differ from unculled by > 0.05\n"
+              << "  adaptive: speedup " << fixedStats.seconds / adaptiveStats.seconds << "x, step ratio "
+              << (double)fixedStats.steps / adaptiveStats.steps << "x, "
+              << 100.0 * differingFraction(fixedImage, adaptiveImage) << "% of pixels differ from fixed by > 0.05\n"
+              << "  planar:   speedup " << fixedStats.seconds / planarStats.seconds << "x, "
+              << adaptiveStats.seconds / planarStats.seconds << "x over adaptive, "
+              << 100.0 * differingFraction(adaptiveImage, planarImage) << "% of pixels differ from adaptive by > 0.05\n"
+              << "  lookup:   speedup " << planarStats.seconds / lookupStats.seconds << "x over planar, "
+              << 100.0 * differingFraction(planarImage, lookupImage) << "% of pixels differ from planar by > 0.05, "
+              << tracer.getDeflectionTable().memoryBytes() / (1024.0 * 1024.0) << " MB table\n";
+
+    //Deflection against a tight-tolerance reference, measured at a radius the fixed loop can reach
+    TraceSettings reference = adaptive;
+    reference.relTolerance = 1e-12;
+    reference.absTolerance = 1e-14;
+    const double rOut = 40.0 * scene.rs;
+
+    std::cout << "Deflection at r = 40 rs (radians):\n"
+              << "      b/rs     reference   fixed error  steps   adaptive error  steps   planar error  steps\n";
+    const double impacts[] = {2.7, 3.0, 4.0, 6.0, 10.0, 20.0};
+    for (double b : impacts) {
+        int refSteps, fixedSteps, adaptiveSteps, planarSteps;
+        double expected = measureDeflection(reference, scene.rs, b * scene.rs, rOut, refSteps);
+        double fixedAngle = measureDeflection(fixed, scene.rs, b * scene.rs, rOut, fixedSteps);
+        double adaptiveAngle = measureDeflection(adaptive, scene.rs, b * scene.rs, rOut, adaptiveSteps);
+        double planarAngle = measureDeflection(planar, scene.rs, b * scene.rs, rOut, planarSteps);
+        std::cout << std::setprecision(2) << std::setw(10) << b
+                  << std::scientific << std::setprecision(4)
+                  << std::setw(14) << expected
+                  << std::setw(14) << fabs(fixedAngle - expected) << std::setw(7) << fixedSteps
+                  << std::setw(17) << fabs(adaptiveAngle - expected) << std::setw(7) << adaptiveSteps
+                  << std::setw(15) << fabs(planarAngle - expected) << std::setw(7) << planarSteps
+                  << std::fixed << "\n";
+    }
+}
+
+static bool writeProfileTrace(const std::string& path) {
+#ifdef BLACKHOLE_PROFILE
+    if (!path.empty()) {
+        if (!Profiler::instance().writeChromeTrace(path)) {
+            std::cerr << "Failed to write " << path << std::endl;
+            return false;
+        }
+        std::cout << "Wrote profile trace to " << path << std::endl;
+    }
+#else
+    (void)path;
+#endif
+    return true;
+}
+
+//Batch mode: one frame per 1/fps seconds of the path. Frame N + 1 is traced while the
+//FrameWriter thread encodes and writes frame N. With a frame budget each frame is traced at the
+//controller's resolution and step budget, judged on the frames before it, and upscaled.
+static int renderPath(const CameraPath& path, int fps, const TraceScene& baseScene, const TraceSettings& settings,
+                      int samples, int sparse, float sparseThreshold, double frameBudget, double fov,
+                      const std::string& output, TaskScheduler& scheduler) {
+    FrameWriter writer;
+    std::string error;
+    if (!writer.open(output, settings.width, settings.height, fps, error)) {
+        std::cerr << "Failed to open output: " << error << std::endl;
+        return 1;
+    }
+
+    const int frameCount = (int)floor(path.duration() * fps + 1e-9) + 1;
+    const double startTime = path.getKeyframes().front().time;
+    const double aspect = (double)settings.width / settings.height;
+
+    GeodesicTracer tracer;
+    tracer.setSettings(settings);
+    std::unique_ptr<ProgressiveRenderer> progressive;
+    std::unique_ptr<SparseRenderer> sparseRenderer;
+    if (samples > 1) {
+        progressive.reset(new ProgressiveRenderer(tracer));
+    } else if (sparse > 0) {
+        sparseRenderer.reset(new SparseRenderer(tracer));
+        sparseRenderer->setSpacing(sparse);
+        sparseRenderer->setThreshold(sparseThreshold);
+    }
+    ResolutionController resolution(frameBudget);
+    resolution.setLimits(0.25, 1.0, std::min(2000, settings.maxSteps), settings.maxSteps);
+    Image scaled;
+    double scaleSum = 0.0;
+    double slowestFrame = 0.0;
+
+    std::cout << "Rendering " << frameCount << " frames at " << settings.width << "x" << settings.height
+              << " to " << (writer.isStream() ? output : writer.framePath(0) + "...") << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    RenderStats total;
+    int written = 0;
+    for (int frame = 0; frame < frameCount; ++frame) {
+        //Mass scales the horizon and the disk together, as in the interactive view
+        CameraKeyframe key = path.sample(startTime + (double)frame / fps);
+        TraceScene scene = baseScene;
+        scene.rs = baseScene.rs * key.mass;
+        scene.diskR1 = baseScene.diskR1 * key.mass;
+        scene.diskR2 = baseScene.diskR2 * key.mass;
+        tracer.setScene(scene);
+        TraceCamera camera = TraceCamera::orbit(key.radius * baseScene.rs, key.yaw, key.pitch, fov, aspect);
+
+        Image* image = writer.acquire();
+        if (frameBudget > 0.0) {
+            TraceSettings frameSettings = settings;
+            frameSettings.width = resolution.traceSize(settings.width);
+            frameSettings.height = resolution.traceSize(settings.height);
+            frameSettings.maxSteps = resolution.getStepBudget();
+            tracer.setSettings(frameSettings);
+            const bool native = frameSettings.width == settings.width && frameSettings.height == settings.height;
+            RenderStats frameStats = sparseRenderer ? sparseRenderer->render(camera, native ? *image : scaled, scheduler)
+                                                    : tracer.render(camera, native ? *image : scaled, scheduler);
+            if (!native) {
+                //Pool frames start empty and only tracing into one sizes it
+                if (image->getWidth() != settings.width || image->getHeight() != settings.height) {
+                    image->resize(settings.width, settings.height);
+                }
+                image->resampleFrom(scaled);
+            }
+            total += frameStats;
+            scaleSum += resolution.getScale();
+            slowestFrame = std::max(slowestFrame, frameStats.seconds);
+            resolution.update(frameStats.seconds, resolution.getScale());
+        } else if (progressive) {
+            progressive->reset();
+            for (int pass = 0; pass < samples; ++pass) {
+                total += progressive->renderPass(camera, scheduler);
+            }
+            *image = progressive->getImage();
+        } else if (sparseRenderer) {
+            total += sparseRenderer->render(camera, *image, scheduler);
+        } else {
+            total += tracer.render(camera, *image, scheduler);
+        }
+        if (!writer.submit(image)) {
+            break;
+        }
+        ++written;
+        std::cout << "\r  frame " << written << "/" << frameCount << std::flush;
+    }
+    std::cout << std::endl;
+
+    const bool ok = writer.finish(error);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok) {
+        std::cerr << "Failed to write frames: " << error << std::endl;
+        return 1;
+    }
+
+    //Pipeline memory is the writer's frame pool and encode buffer plus the accumulation buffer
+    const FrameWriterStats& stats = writer.getStats();
+    const size_t accumulationBytes = progressive ? (size_t)settings.width * settings.height * sizeof(glm::dvec4) : 0;
+    std::cout << std::fixed << std::setprecision(2)
+              << "  frames:        " << stats.frames << " in " << seconds << " s, "
+              << stats.frames * 60.0 / seconds << " frames/min\n"
+              << "  tracing:       " << total.seconds << " s, " << std::setprecision(1)
+              << (double)total.steps / total.rays << " steps/ray\n" << std::setprecision(2);
+    if (sparseRenderer) {
+        std::cout << "  traced:        " << 100.0 * total.rays / ((double)written * settings.width * settings.height)
+                  << "% of pixels\n";
+    }
+    if (frameBudget > 0.0) {
+        std::cout << "  resolution:    " << 100.0 * scaleSum / std::max(written, 1) << "% mean scale, "
+                  << total.seconds * 1000.0 / std::max(written, 1) << " ms mean and " << slowestFrame * 1000.0
+                  << " ms slowest frame for a " << frameBudget * 1000.0 << " ms budget\n";
+    }
+    std::cout << "  writer:        " << stats.encodeSeconds << " s encode, " << stats.writeSeconds << " s write, "
+              << stats.bytesWritten / (1024.0 * 1024.0) << " MB\n"
+              << "  stalled:       " << stats.stallSeconds << " s waiting for the writer\n"
+              << "  peak memory:   " << (stats.peakBytes + accumulationBytes) / (1024.0 * 1024.0) << " MB ("
+              << FrameWriter::POOL_SIZE << " pooled frames";
+    if (accumulationBytes > 0) {
+        std::cout << ", " << accumulationBytes / (1024.0 * 1024.0) << " MB accumulation";
+    }
+    std::cout << ")" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    TraceSettings settings;
+    settings.width = 800;
+    settings.height = 600;
+    TraceScene scene;
+
+    unsigned threads = 0;
+    double radius = 6.34194e10;
+    double yaw = -90.0;
+    double pitch = 5.0;
+    double fov = 60.0;
+    std::string output = "trace.ppm";
+    int samples = 1;
+    int sparse = 0;
+    float sparseThreshold = 0.05f;
+    bool compare = false;
+    std::string tracePath;
+    std::string pathFile;
+    int fps = 30;
+    double frameBudgetMs = 0.0;
+    std::string starsFile;
+    std::string makeStarsFile;
+    int starCount = 100000;
+    bool useVolume = false;
+    double diskScale = 8.0;
+    std::string diskSnapshot;
+    double volumeOpacity = 0.5;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return 0;
+        } else if (arg == "--width" && hasValue) {
+            settings.width = atoi(argv[++i]);
+        } else if (arg == "--height" && hasValue) {
+            settings.height = atoi(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            threads = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--tile" && hasValue) {
+            settings.tileSize = atoi(argv[++i]);
+        } else if (arg == "--steps" && hasValue) {
+            settings.maxSteps = atoi(argv[++i]);
+        } else if (arg == "--radius" && hasValue) {
+            radius = atof(argv[++i]);
+        } else if (arg == "--yaw" && hasValue) {
+            yaw = atof(argv[++i]);
+        } else if (arg == "--pitch" && hasValue) {
+            pitch = atof(argv[++i]);
+        } else if (arg == "--fov" && hasValue) {
+            fov = atof(argv[++i]);
+        } else if (arg == "--object" && hasValue) {
+            TraceObject object;
+            if (sscanf(argv[++i], "%lf,%lf,%lf,%lf", &object.center.x, &object.center.y,
+                       &object.center.z, &object.radius) != 4) {
+                std::cerr << "Bad --object value, expected X,Y,Z,R" << std::endl;
+                return 1;
+            }
+            object.color = glm::vec4(1.0f, 1.0f, 0.0f, 1.0f);
+            object.mass = 0.0;
+            scene.objects.push_back(object);
+        } else if (arg == "--volume") {
+            useVolume = true;
+        } else if (arg == "--disk-scale" && hasValue) {
+            diskScale = atof(argv[++i]);
+        } else if (arg == "--disk-snapshot" && hasValue) {
+            diskSnapshot = argv[++i];
+        } else if (arg == "--volume-opacity" && hasValue) {
+            volumeOpacity = atof(argv[++i]);
+        } else if (arg == "--kernel" && hasValue) {
+            std::string name = argv[++i];
+            if (name == "spherical") {
+                settings.kernel = TraceKernel::Spherical;
+            } else if (name == "planar") {
+                settings.kernel = TraceKernel::Planar;
+            } else if (name == "lookup") {
+                settings.kernel = TraceKernel::Lookup;
+            } else {
+                std::cerr << "Unknown kernel: " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--integrator" && hasValue) {
+            std::string name = argv[++i];
+            if (name == "fixed") {
+                settings.integrator = Integrator::FixedEuler;
+            } else if (name == "adaptive") {
+                settings.integrator = Integrator::DormandPrince;
+            } else {
+                std::cerr << "Unknown integrator: " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--precision" && hasValue) {
+            std::string name = argv[++i];
+            if (name == "double") {
+                settings.precision = Precision::Double;
+            } else if (name == "float") {
+                settings.precision = Precision::Float;
+            } else if (name == "simd8") {
+                settings.precision = Precision::Simd8;
+            } else {
+                std::cerr << "Unknown precision: " << name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--rtol" && hasValue) {
+            settings.relTolerance = atof(argv[++i]);
+        } else if (arg == "--atol" && hasValue) {
+            settings.absTolerance = atof(argv[++i]);
+        } else if (arg == "--samples" && hasValue) {
+            samples = atoi(argv[++i]);
+        } else if (arg == "--sparse" && hasValue) {
+            sparse = atoi(argv[++i]);
+        } else if (arg == "--sparse-threshold" && hasValue) {
+            sparseThreshold = (float)atof(argv[++i]);
+        } else if (arg == "--no-cull") {
+            settings.analyticCulling = false;
+        } else if (arg == "--compare") {
+            compare = true;
+        } else if (arg == "--output" && hasValue) {
+            output = argv[++i];
+        } else if (arg == "--path" && hasValue) {
+            pathFile = argv[++i];
+        } else if (arg == "--fps" && hasValue) {
+            fps = atoi(argv[++i]);
+        } else if (arg == "--frame-budget" && hasValue) {
+            frameBudgetMs = atof(argv[++i]);
+        } else if (arg == "--stars" && hasValue) {
+            starsFile = argv[++i];
+        } else if (arg == "--star-magnitude" && hasValue) {
+            scene.starMagnitude = atof(argv[++i]);
+        } else if (arg == "--make-stars" && hasValue) {
+            makeStarsFile = argv[++i];
+        } else if (arg == "--star-count" && hasValue) {
+            starCount = atoi(argv[++i]);
+        } else if (arg == "--trace" && hasValue) {
+            tracePath = argv[++i];
+#ifndef BLACKHOLE_PROFILE
+            std::cerr << "--trace needs a build with BLACKHOLE_PROFILE defined, ignoring it" << std::endl;
+#endif
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (settings.width <= 0 || settings.height <= 0) {
+        std::cerr << "Image size must be positive" << std::endl;
+        return 1;
+    }
+    if (samples <= 0) {
+        std::cerr << "Sample count must be positive" << std::endl;
+        return 1;
+    }
+    if (fps <= 0) {
+        std::cerr << "Frame rate must be positive" << std::endl;
+        return 1;
+    }
+    if (sparse < 0 || (sparse > 0 && samples > 1)) {
+        std::cerr << "--sparse takes a positive spacing and one sample per pixel" << std::endl;
+        return 1;
+    }
+    if (frameBudgetMs < 0.0 || (frameBudgetMs > 0.0 && (samples > 1 || pathFile.empty()))) {
+        std::cerr << "--frame-budget takes a positive time and applies to --path renders with one sample per pixel"
+                  << std::endl;
+        return 1;
+    }
+
+    if (!makeStarsFile.empty()) {
+        std::string error;
+        if (starCount <= 0 || !StarCatalog::writeSynthetic(makeStarsFile, starCount, 1, error)) {
+            std::cerr << "Failed to write star catalog: " << (starCount <= 0 ? "star count must be positive" : error)
+                      << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << starCount << " stars to " << makeStarsFile << std::endl;
+        return 0;
+    }
+
+    StarCatalog stars;
+    if (!starsFile.empty()) {
+        std::string error;
+        auto loadStart = std::chrono::steady_clock::now();
+        if (!stars.load(starsFile, error)) {
+            std::cerr << "Failed to load star catalog: " << error << std::endl;
+            return 1;
+        }
+        double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+        std::cout << "Loaded " << stars.size() << " stars into " << stars.cellCount() << " sky cells in "
+                  << std::fixed << std::setprecision(3) << loadSeconds << " s" << std::endl;
+        scene.stars = &stars;
+    }
+
+    TaskScheduler scheduler(threads);
+
+    //Particles come out per unit mass, and the volume is kept in rs units, so it follows any mass
+    DiskVolume volume;
+    if (useVolume) {
+        if (diskScale <= 0.0 || volumeOpacity < 0.0) {
+            std::cerr << "--disk-scale must be positive and --volume-opacity not negative" << std::endl;
+            return 1;
+        }
+        auto buildStart = std::chrono::steady_clock::now();
+        volume.setOpacity(volumeOpacity);
+        size_t particles = 0;
+        if (diskSnapshot.empty()) {
+            DiskGenerator generator(DiskLayout::scaled(diskScale));
+            generator.generate(1.0f, &scheduler);
+            volume.build(generator.getVertices());
+            particles = (size_t)generator.getParticleCount();
+        } else {
+            //Binned straight from the mapped arrays, nothing copied
+            ParticleSnapshot snapshot;
+            std::string error;
+            if (!snapshot.open(diskSnapshot, error) || snapshot.getFrameCount() == 0) {
+                std::cerr << (error.empty() ? diskSnapshot + " holds no frames" : error) << std::endl;
+                return 1;
+            }
+            const size_t frame = snapshot.getFrameCount() - 1;
+            ParticleArrays arrays;
+            arrays.x = snapshot.array(frame, SnapshotArray::X);
+            arrays.y = snapshot.array(frame, SnapshotArray::Y);
+            arrays.z = snapshot.array(frame, SnapshotArray::Z);
+            arrays.temperature = snapshot.array(frame, SnapshotArray::Temperature);
+            arrays.density = snapshot.array(frame, SnapshotArray::Density);
+            arrays.count = snapshot.getParticleCount();
+            volume.build(arrays);
+            particles = arrays.count;
+        }
+        double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+        std::cout << "Voxelised " << particles << " particles into " << volume.getStoredBricks()
+                  << " of " << volume.getBrickCount() << " bricks (" << std::fixed << std::setprecision(1)
+                  << volume.getBytes() / (1024.0 * 1024.0) << " MB) in " << std::setprecision(3) << buildSeconds
+                  << " s" << std::endl;
+        scene.volume = &volume;
+    }
+
+    TraceCamera camera = TraceCamera::orbit(radius, yaw, pitch, fov, (double)settings.width / settings.height);
+
+    if (compare) {
+        compareIntegrators(scene, settings, camera, scheduler);
+        comparePrecisions(scene, settings, camera, scheduler);
+        return 0;
+    }
+
+    if (!pathFile.empty()) {
+        CameraPath path;
+        std::string error;
+        if (!path.load(pathFile, error)) {
+            std::cerr << "Bad camera path: " << error << std::endl;
+            return 1;
+        }
+        int result = renderPath(path, fps, scene, settings, samples, sparse, sparseThreshold, frameBudgetMs / 1000.0,
+                                fov, output, scheduler);
+        return writeProfileTrace(tracePath) && result == 0 ? 0 : 1;
+    }
+
+    GeodesicTracer tracer;
+    tracer.setScene(scene);
+    tracer.setSettings(settings);
+
+    Image image;
+    RenderStats stats;
+    double tracedFraction = 1.0;
+    if (sparse > 0) {
+        SparseRenderer sparseRenderer(tracer);
+        sparseRenderer.setSpacing(sparse);
+        sparseRenderer.setThreshold(sparseThreshold);
+        stats = sparseRenderer.render(camera, image, scheduler);
+        tracedFraction = sparseRenderer.getTracedFraction();
+    } else if (samples == 1) {
+        stats = tracer.render(camera, image, scheduler);
+    } else {
+        //Camera is still, so every pass adds one more jittered sample per pixel
+        ProgressiveRenderer progressive(tracer);
+        for (int pass = 0; pass < samples; ++pass) {
+            stats += progressive.renderPass(camera, scheduler);
+        }
+        image = progressive.getImage();
+    }
+
+    if (!image.writePPM(output)) {
+        std::cerr << "Failed to write " << output << std::endl;
+        return 1;
+    }
+
+    std::cout << "Rendered " << settings.width << "x" << settings.height << " to " << output
+              << " (" << samples << (samples == 1 ? " sample" : " samples") << " per pixel)\n"
+              << std::fixed << std::setprecision(3)
+              << "  time:          " << stats.seconds << " s\n"
+              << "  threads:       " << stats.threads << " (" << stats.steals << " tiles stolen)\n"
+              << "  steps/ray:     " << std::setprecision(1) << (double)stats.steps / stats.rays << "\n"
+              << "  traced:        " << 100.0 * tracedFraction << "% of pixels\n"
+              << "  rays/s:        " << stats.raysPerSecond() << "\n"
+              << "  rays/s/core:   " << stats.raysPerSecondPerCore() << "\n"
+              << "  hits:          horizon " << stats.hits[(int)HitType::BlackHole]
+              << ", disk " << stats.hits[(int)HitType::Disk]
+              << ", object " << stats.hits[(int)HitType::Object]
+              << ", none " << stats.hits[(int)HitType::None] << "\n"
+              << "  culled:        captured " << stats.culled[(int)CullType::CapturedAtStart] << " at start + "
+              << stats.culled[(int)CullType::Captured] << " in flight, escaped "
+              << stats.culled[(int)CullType::EscapedAtStart] << " at start + "
+              << stats.culled[(int)CullType::Escaped] << " in flight, "
+              << stats.culled[(int)CullType::None] << " integrated to the end" << std::endl;
+
+    return writeProfileTrace(tracePath) ? 0 : 1;
+}